@@ -0,0 +1,91 @@
+// Precision-mode benchmark: the headline cases (10000!, 1000 digits of π)
+// end to end through the expression VM, plus the multiplication
+// algorithms at the sizes where each one takes over. Results are checked
+// against known values and by multiplying back.
+#include "../calc_bignum.h"
+#include "../calc_expr.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Evaluate text at `digits` significant digits, reporting time and result
+static bool evaluate(const char *text, size_t digits, std::string &result, double *seconds) {
+    ExprCompiler compiler;
+    Program program;
+    if (!compiler.compile(text, strlen(text), program)) return false;
+    BigFloat value;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EvalResult status = program.run_precise(text, digits, &value);
+    *seconds = seconds_since(start);
+    if (status.status != EVAL_OK) return false;
+    format_number(value, digits, result);
+    return true;
+}
+
+// (10^n - 1)², computed with whichever algorithm n selects
+static void time_square(size_t digits, int *failures) {
+    std::string nines(digits, '9');
+    BigInt a;
+    a.parse(nines.data(), nines.size());
+    int repeats = digits < 10000 ? 200 : 10;
+
+    BigInt square;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) square = a * a;
+    double seconds = seconds_since(start) / repeats;
+
+    BigInt root = BigInt::isqrt(square);
+    bool ok = BigInt::compare_magnitude(root, a) == 0;
+    printf("%8zu digits squared: %10.3f us  %s\n", digits, seconds * 1e6, ok ? "" : "WRONG");
+    if (!ok) (*failures)++;
+}
+
+int main() {
+    int failures = 0;
+    std::string result;
+    double seconds;
+
+    printf("End to end (compile + run_precise + format):\n");
+    if (evaluate("10000!", 50, result, &seconds)) {
+        printf("  10000!            %8.2f ms  %s\n", seconds * 1e3, result.c_str());
+        failures += check("10000! leading digits", result.compare(0, 12, "2.8462596809") == 0);
+        failures += check("10000! has 35660 digits", result.find("e+35659") != std::string::npos);
+    } else {
+        failures += check("10000!", false);
+    }
+
+    if (evaluate("π", 1000, result, &seconds)) {
+        printf("  π to 1000 digits  %8.2f ms  ...%s\n", seconds * 1e3, result.c_str() + result.size() - 20);
+        failures += check("π digit 1000", result.size() == 1001 && result.compare(result.size() - 10, 10, "9216420199") == 0);
+    } else {
+        failures += check("π", false);
+    }
+
+    const char *cases[][3] = {
+        {"√2", "50", "1.4142135623730950488016887242096980785696718753769"},
+        {"e", "50", "2.7182818284590452353602874713526624977572470937"},
+        {"ln(10)", "40", "2.302585092994045684017991454684364207601"},
+        {"sin(1)", "30", "0.0174524064372835128194189785163"},
+        {"sin(30)", "30", "0.5"},
+        {"2^0.5", "30", "1.41421356237309504880168872421"},
+        {"0.1+0.2", "30", "0.3"},
+        {"2^100", "40", "1267650600228229401496703205376"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bool ok = evaluate(cases[i][0], strtoul(cases[i][1], NULL, 10), result, &seconds) &&
+                  result == cases[i][2];
+        if (!ok) printf("  %s = %s\n", cases[i][0], result.c_str());
+        failures += check(cases[i][0], ok);
+    }
+
+    printf("\nMultiplication by size (schoolbook, Karatsuba, NTT):\n");
+    const size_t sizes[] = {90, 360, 1800, 9000, 36000, 180000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        time_square(sizes[i], &failures);
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
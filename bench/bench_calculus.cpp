@@ -0,0 +1,226 @@
+// Calculus benchmark: evaluations per second of f(x) parsed afresh at
+// every point, compiled once and run point by point, and run a batch at a
+// time; then root scans and integrals on one thread against every core.
+// Checks integrals with closed forms (including an endpoint singularity),
+// that non-finite integrands fail, roots including a touching one and
+// poles that are not roots, derivatives, that results do not depend on
+// the thread count, and the history-line cost text.
+//
+//   bench/bench_calculus [--threads N]
+#include "../calc_calculus.h"
+#include "../calc_vecmath.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const double PI = 3.14159265358979323846;
+static const char *BENCH_EXPRESSION = "sin(x)*e^(-x/400)+x^2/7-3";
+
+static Program compile(const char *text, AngleUnit unit = ANGLE_DEGREES) {
+    ExprCompiler compiler;
+    compiler.set_angle_unit(unit);
+    Program program;
+    if (!compiler.compile(text, strlen(text), program)) fprintf(stderr, "%s: %s\n", text, compiler.error());
+    return program;
+}
+
+static bool close_to(double value, double expected, double relative) {
+    return fabs(value - expected) <= relative * fabs(expected);
+}
+
+static double integral(const char *text, double a, double b, AngleUnit unit = ANGLE_DEGREES, size_t threads = 0,
+                       bool *ok = NULL, CalculusStats *stats = NULL) {
+    CalculusOptions options = {threads, 0};
+    CalculusStats unused;
+    std::string error;
+    double value = 0, estimate = 0;
+    bool done = integrate(compile(text, unit), a, b, options, &value, &estimate, stats ? stats : &unused, &error);
+    if (ok) *ok = done;
+    return value;
+}
+
+static std::vector<double> roots(const char *text, double a, double b, size_t threads = 0,
+                                 CalculusStats *stats = NULL) {
+    CalculusOptions options = {threads, 0};
+    CalculusStats unused;
+    std::string error;
+    std::vector<double> found;
+    find_roots(compile(text), a, b, options, &found, stats ? stats : &unused, &error);
+    return found;
+}
+
+static double derivative(const char *text, double x, AngleUnit unit = ANGLE_DEGREES) {
+    CalculusStats stats;
+    std::string error;
+    double value = 0, estimate = 0;
+    differentiate(compile(text, unit), x, &value, &estimate, &stats, &error);
+    return value;
+}
+
+// Evaluations per second of the three ways to sample f over [0, 1000]
+static int evaluation_rates() {
+    const size_t points = 200000;
+    std::vector<double> xs(points), ys(points);
+    for (size_t i = 0; i < points; i++) xs[i] = i * (1000.0 / points);
+    size_t length = strlen(BENCH_EXPRESSION);
+    printf("Evaluating %s\n", BENCH_EXPRESSION);
+
+    size_t reparsed = points / 20;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reparsed; i++) {
+        ExprCompiler compiler;
+        Program program;
+        compiler.compile(BENCH_EXPRESSION, length, program);
+        ys[i] = program.run(xs[i]).value;
+    }
+    double parse_rate = reparsed / seconds_since(start);
+
+    Program program = compile(BENCH_EXPRESSION);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < points; i++) ys[i] = program.run(xs[i]).value;
+    double run_rate = points / seconds_since(start);
+
+    const VecMath &math = vecmath_best();
+    std::vector<double> stack;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < points; i += VECTOR_BATCH) {
+        size_t n = points - i < VECTOR_BATCH ? points - i : VECTOR_BATCH;
+        program.run_vector(&xs[i], &ys[i], n, math, stack);
+    }
+    double vector_rate = points / seconds_since(start);
+
+    printf("  %-24s %10.2f M/s\n", "parse every point", parse_rate / 1e6);
+    printf("  %-24s %10.2f M/s  %6.1fx\n", "compiled, run()", run_rate / 1e6, run_rate / parse_rate);
+    printf("  %-24s %10.2f M/s  %6.1fx\n", "compiled, run_vector()", vector_rate / 1e6, vector_rate / parse_rate);
+    int failures = check("compiling once is 5× parsing every point", run_rate > 5 * parse_rate);
+    return failures + check("batches beat one point at a time", vector_rate > run_rate);
+}
+
+static void report(const char *what, size_t threads, const CalculusStats &stats) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s, %zu thread%s", what, threads, threads == 1 ? "" : "s");
+    printf("  %-32s %8.2f ms  %s\n", name, stats.seconds * 1000, calculus_cost(stats).c_str());
+}
+
+// Wall time of a scan with many roots and of a hard integral
+static void scaling(size_t threads) {
+    printf("\nThreads\n");
+    size_t counts[2] = {1, threads};
+    for (int t = 0; t < (threads > 1 ? 2 : 1); t++) {
+        CalculusStats stats;
+        roots("sin(x^2/360)", -3000, 3000, counts[t], &stats);
+        report("roots of sin(x²/360)", counts[t], stats);
+    }
+    for (int t = 0; t < (threads > 1 ? 2 : 1); t++) {
+        CalculusStats stats;
+        integral("sin(x)^2/sqrt(sqrt((x-0.5)^2))", 0, 20, ANGLE_RADIANS, counts[t], NULL, &stats);
+        report("∫ sin²/√|x−½|, 0…20", counts[t], stats);
+    }
+}
+
+static int integrals() {
+    int failures = 0;
+    printf("\nIntegrals\n");
+    bool powers = true;
+    const char *monomials[] = {"1", "x", "x^2", "x^3", "x^7"};
+    for (int k = 0; k < 5; k++) {
+        int power = k == 4 ? 7 : k;
+        double expected = (pow(3.0, power + 1) - pow(-1.0, power + 1)) / (power + 1);
+        powers = powers && close_to(integral(monomials[k], -1, 3), expected, 1e-13);
+    }
+    failures += check("∫ xᵏ from -1 to 3 is exact", powers);
+    failures += check("∫ sin(x), 0…180 is 360/π in degrees", close_to(integral("sin(x)", 0, 180), 360 / PI, 1e-12));
+    failures += check("∫ sin(x), 0…π is 2 in radians",
+                      close_to(integral("sin(x)", 0, PI, ANGLE_RADIANS), 2, 1e-12));
+    failures += check("∫ e^-x², -10…10 is √π",
+                      close_to(integral("e^(-x^2)", -10, 10, ANGLE_RADIANS), sqrt(PI), 1e-12));
+    failures += check("∫ 1/√x, 0…1 is 2", close_to(integral("1/sqrt(x)", 0, 1), 2, 1e-9));
+    failures += check("reversed bounds negate", integral("x^2", 3, 0) == -integral("x^2", 0, 3));
+    bool ok = true;
+    integral("1/x", -1, 1, ANGLE_DEGREES, 0, &ok);
+    failures += check("∫ 1/x across 0 fails", !ok);
+    return failures;
+}
+
+static int root_finding() {
+    int failures = 0;
+    printf("\nRoots\n");
+    std::vector<double> found = roots("x^2-2", 0, 5);
+    failures += check("x² − 2 has the root √2", found.size() == 1 && fabs(found[0] - sqrt(2.0)) < 1e-15);
+    found = roots("sin(x)", -720, 720);
+    bool multiples = found.size() == 9;
+    for (size_t i = 0; multiples && i < found.size(); i++) multiples = fabs(found[i] - (-720.0 + 180 * i)) < 1e-9;
+    failures += check("sin(x) on -720…720 has 9 roots at multiples of 180", multiples);
+    found = roots("(x-1)^2", -3, 4.3);
+    failures += check("(x − 1)² touches 0 at 1", found.size() == 1 && fabs(found[0] - 1) < 1e-7);
+    found = roots("tan(x)-1", 0, 89);
+    failures += check("tan(x) = 1 at 45", found.size() == 1 && fabs(found[0] - 45) < 1e-12);
+    failures += check("tan(x) has no root between its poles' signs", roots("tan(x)", 1, 179).empty());
+    failures += check("1/x is a pole, not a root", roots("1/x", -1, 1).empty());
+    failures += check("x² + 1 has none", roots("x^2+1", -10, 10).empty());
+    return failures;
+}
+
+static int derivatives() {
+    int failures = 0;
+    printf("\nDerivatives\n");
+    failures += check("d/dx x³ at 2 is 12", close_to(derivative("x^3", 2), 12, 1e-12));
+    failures += check("d/dx sin(x) at 0 is π/180 in degrees", close_to(derivative("sin(x)", 0), PI / 180, 1e-12));
+    failures += check("d/dx eˣ at 1 is e", close_to(derivative("e^x", 1, ANGLE_RADIANS), exp(1.0), 1e-12));
+    failures += check("d/dx ln(x) at 0.001 is 1000", close_to(derivative("ln(x)", 0.001), 1000, 1e-9));
+    CalculusStats stats;
+    std::string error;
+    double value = 0, estimate = 0;
+    failures += check("d/dx √x at -1 fails",
+                      !differentiate(compile("sqrt(x)"), -1, &value, &estimate, &stats, &error) && !error.empty());
+    return failures;
+}
+
+static int determinism(size_t threads) {
+    int failures = 0;
+    printf("\nThread counts\n");
+    bool same = true;
+    size_t counts[] = {1, 2, 3, threads > 3 ? threads : 8};
+    double first = integral("sin(x)^2/sqrt(sqrt((x-0.5)^2))", 0, 20, ANGLE_RADIANS, 1);
+    std::vector<double> scan = roots("sin(x^2/360)", -600, 600, 1);
+    for (size_t t = 1; t < sizeof(counts) / sizeof(counts[0]); t++) {
+        double value = integral("sin(x)^2/sqrt(sqrt((x-0.5)^2))", 0, 20, ANGLE_RADIANS, counts[t]);
+        same = same && memcmp(&value, &first, sizeof(value)) == 0 && roots("sin(x^2/360)", -600, 600, counts[t]) == scan;
+    }
+    failures += check("same bits on 1, 2, 3 and many threads", same);
+
+    CalculusStats stats;
+    stats.evaluations = 1234567;
+    stats.seconds = 0.5;
+    std::string cost = calculus_cost(stats);
+    failures += check("cost reads \"1,234,567 evaluations in 500.0 ms, 2.5M/s\"",
+                      cost == "1,234,567 evaluations in 500.0 ms, 2.5M/s");
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    int failures = evaluation_rates();
+    scaling(threads);
+    failures += integrals() + root_finding() + derivatives() + determinism(threads);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+// Keypad dispatch benchmark: cost per event of turning a button press into
+// a handler call. Compares the old label path (copy the label into a
+// std::string, walk an == chain) with the command table (index by the ID
+// the button carries, switch on its kind). Handlers are replaced by
+// counters so only the dispatch itself is timed.
+#include "../calc_commands.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static unsigned long handled[CMD_COUNT];
+
+// The chain press() used before commands existed, minus the handlers
+static void dispatch_label(const char *label) {
+    std::string btn = label;
+
+    if (btn.size() == 1 && btn[0] >= '0' && btn[0] <= '9') {
+        handled[CMD_DIGIT_0 + (btn[0] - '0')]++;
+    } else if (btn == "00") {
+        handled[CMD_DOUBLE_ZERO]++;
+    } else if (btn == ".") {
+        handled[CMD_DECIMAL]++;
+    } else if (btn == "AC") {
+        handled[CMD_ALL_CLEAR]++;
+    } else if (btn == "CE") {
+        handled[CMD_CLEAR_ENTRY]++;
+    } else if (btn == "±") {
+        handled[CMD_SIGN]++;
+    } else if (btn == "%") {
+        handled[CMD_PERCENT]++;
+    } else if (btn == "⌫") {
+        handled[CMD_BACKSPACE]++;
+    } else if (btn == "+") {
+        handled[CMD_ADD]++;
+    } else if (btn == "-") {
+        handled[CMD_SUBTRACT]++;
+    } else if (btn == "×") {
+        handled[CMD_MULTIPLY]++;
+    } else if (btn == "÷") {
+        handled[CMD_DIVIDE]++;
+    } else if (btn == "^") {
+        handled[CMD_POWER]++;
+    } else if (btn == "=") {
+        handled[CMD_EQUALS]++;
+    } else if (btn == "M+") {
+        handled[CMD_MEMORY_ADD]++;
+    } else if (btn == "M-") {
+        handled[CMD_MEMORY_SUBTRACT]++;
+    } else if (btn == "MR") {
+        handled[CMD_MEMORY_RECALL]++;
+    } else if (btn == "MC") {
+        handled[CMD_MEMORY_CLEAR]++;
+    } else if (btn == "sin") {
+        handled[CMD_SIN]++;
+    } else if (btn == "cos") {
+        handled[CMD_COS]++;
+    } else if (btn == "tan") {
+        handled[CMD_TAN]++;
+    } else if (btn == "log") {
+        handled[CMD_LOG]++;
+    } else if (btn == "ln") {
+        handled[CMD_LN]++;
+    } else if (btn == "√") {
+        handled[CMD_SQRT]++;
+    } else if (btn == "x²") {
+        handled[CMD_SQUARE]++;
+    } else if (btn == "xʸ") {
+        handled[CMD_POWER]++;
+    } else if (btn == "π") {
+        handled[CMD_PI]++;
+    } else if (btn == "e") {
+        handled[CMD_E]++;
+    } else if (btn == "!") {
+        handled[CMD_FACTORIAL]++;
+    } else if (btn == "(") {
+        handled[CMD_LPAREN]++;
+    } else if (btn == ")") {
+        handled[CMD_RPAREN]++;
+    }
+}
+
+// Same shape as CalcEngine::press()
+static void dispatch_command(Command command) {
+    const CommandInfo &info = command_info(command);
+    switch (info.kind) {
+    case KIND_NONE:
+        return;
+    case KIND_DIGIT:
+    case KIND_DOUBLE_ZERO:
+    case KIND_DECIMAL:
+        handled[command]++;
+        break;
+    case KIND_OPERATOR:
+    case KIND_FUNCTION:
+    case KIND_CONSTANT:
+    case KIND_PAREN:
+        handled[command] += info.arg + 1;
+        break;
+    default:
+        handled[command]++;
+        break;
+    }
+}
+
+int main() {
+    // Every keypad button, in layout order
+    Command commands[KEYPAD_ROWS * KEYPAD_COLUMNS];
+    const char *labels[KEYPAD_ROWS * KEYPAD_COLUMNS];
+    size_t count = 0;
+    for (int row = 0; row < KEYPAD_ROWS; row++) {
+        for (int col = 0; col < KEYPAD_COLUMNS; col++) {
+            if (KEYPAD_LAYOUT[row][col] == CMD_NONE) continue;
+            commands[count] = KEYPAD_LAYOUT[row][col];
+            labels[count] = command_info(commands[count]).label;
+            count++;
+        }
+    }
+
+    const int rounds = 2000000;
+    double events = (double)rounds * count;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            dispatch_label(labels[i]);
+        }
+    }
+    double label_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            dispatch_command(commands[i]);
+        }
+    }
+    double command_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned long total = 0;
+    for (int i = 0; i < CMD_COUNT; i++) total += handled[i];
+
+    // Check that both paths reach every button
+    size_t unresolved = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (command_for_label(labels[i]) != commands[i]) unresolved++;
+    }
+
+    printf("buttons:               %zu\n", count);
+    printf("events per path:       %.0f\n", events);
+    printf("label chain ns/event:  %.2f\n", label_seconds * 1e9 / events);
+    printf("command table ns/event:%.2f\n", command_seconds * 1e9 / events);
+    printf("speedup:               %.1fx\n", label_seconds / command_seconds);
+    printf("checksum:              %lu\n", total);
+    printf("label mismatches:      %zu\n", unresolved);
+    return unresolved == 0 ? 0 : 1;
+}
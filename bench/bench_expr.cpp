@@ -0,0 +1,79 @@
+// Microbenchmark for the expression compiler and VM: reports compile and
+// evaluation cost per token for expressions of increasing length.
+#include "../calc_expr.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Random mix of numbers, operators, brackets and functions
+static std::string make_expression(int operands, unsigned seed) {
+    static const char *ops[] = {"+", "-", "×", "÷", "^"};
+    static const char *funcs[] = {"sin(", "cos(", "tan("}; // Total, so eval never stops early
+    srand(seed);
+    std::string text;
+    int open = 0;
+    for (int i = 0; i < operands; i++) {
+        if (rand() % 6 == 0) {
+            text += funcs[rand() % 3];
+            open++;
+        } else if (rand() % 8 == 0) {
+            text += "(";
+            open++;
+        }
+        char number[32];
+        snprintf(number, sizeof(number), "%d.%d", rand() % 1000 + 1, rand() % 100);
+        text += number;
+        while (open > 0 && rand() % 3 == 0) {
+            text += ")";
+            open--;
+        }
+        if (i + 1 < operands) text += ops[rand() % 4]; // Keep ^ out of long chains
+    }
+    text.append(open, ')');
+    return text;
+}
+
+int main() {
+    const int sizes[] = {4, 16, 64, 256, 1024};
+    ExprCompiler compiler;
+    Program program;
+    volatile double sink = 0;
+
+    printf("%10s %10s %14s %14s %14s\n", "operands", "tokens", "compile ns/tok", "eval ns/tok", "eval ns/expr");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        std::string text = make_expression(sizes[s], 42 + s);
+        if (!compiler.compile(text.data(), text.size(), program)) {
+            fprintf(stderr, "compile failed: %s\n", compiler.error());
+            return 1;
+        }
+        size_t tokens = compiler.token_count();
+        if (program.run().status != EVAL_OK) {
+            fprintf(stderr, "evaluation failed for %d operands\n", sizes[s]);
+            return 1;
+        }
+        int iterations = 2000000 / sizes[s];
+
+        double start = now_ns();
+        for (int i = 0; i < iterations; i++) {
+            compiler.compile(text.data(), text.size(), program);
+        }
+        double compile_ns = (now_ns() - start) / iterations;
+
+        start = now_ns();
+        for (int i = 0; i < iterations; i++) {
+            sink = sink + program.run().value;
+        }
+        double eval_ns = (now_ns() - start) / iterations;
+
+        printf("%10d %10zu %14.2f %14.2f %14.1f\n", sizes[s], tokens, compile_ns / tokens,
+               eval_ns / tokens, eval_ns);
+    }
+    return 0;
+}
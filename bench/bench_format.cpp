@@ -0,0 +1,83 @@
+// Formatter benchmark: the shortest round-trip format_number against the
+// previous ostringstream implementation over a few million random doubles.
+// Also verifies that every output parses back to the same value.
+#include "../calc_format.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The format_number this replaced, kept for comparison
+static std::string legacy_format_number(double num) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(10) << num;
+    std::string result = oss.str();
+    result.erase(result.find_last_not_of('0') + 1, std::string::npos);
+    if (result.back() == '.') {
+        result.pop_back();
+    }
+    return result;
+}
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned long long next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void run(const char *name, const std::vector<double> &values) {
+    volatile size_t sink = 0;
+    char buf[FORMAT_BUFFER_SIZE];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < values.size(); i++) {
+        sink = sink + format_number(values[i], buf);
+    }
+    double fast = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < values.size(); i++) {
+        sink = sink + legacy_format_number(values[i]).size();
+    }
+    double legacy = seconds_since(start);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        format_number(values[i], buf, FORMAT_BUFFER_SIZE - 1);
+        if (strtod(buf, NULL) != values[i]) mismatches++;
+    }
+
+    double n = (double)values.size();
+    printf("%-12s %10.0f %12.1f %12.1f %9.1fx %12zu\n", name, n, fast * 1e9 / n, legacy * 1e9 / n,
+           legacy / fast, mismatches);
+}
+
+int main() {
+    const size_t count = 2000000;
+    std::vector<double> bits(count), ratios(count), integers(count);
+    for (size_t i = 0; i < count; i++) {
+        double d;
+        do {
+            unsigned long long r = next_random();
+            memcpy(&d, &r, sizeof(d));
+        } while (d != d || d - d != 0); // Finite values only
+        bits[i] = d;
+        ratios[i] = (double)(next_random() % 1000000) / (double)(next_random() % 999 + 1);
+        integers[i] = (double)(next_random() % 100000000);
+    }
+
+    printf("%-12s %10s %12s %12s %10s %12s\n", "values", "count", "new ns/call", "old ns/call", "speedup",
+           "round-trip!");
+    run("random bits", bits);
+    run("ratios", ratios);
+    run("integers", integers);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Factorial, Gamma and nCr/nPr benchmark: cost per call across input
+// sizes for the double kernels and the exact/precision kernels, plus
+// spot checks against known values.
+#include "../calc_bignum.h"
+#include "../calc_expr.h"
+#include "../calc_special.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Keeps results live so the loops are not optimised away
+static volatile double sink;
+
+typedef EvalStatus (*BinaryKernel)(double, double, double *);
+
+static void time_double(const char *name, double x, double y, BinaryKernel binary) {
+    const int repeats = 1000000;
+    double r = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        if (binary) {
+            binary(x, y, &r);
+        } else {
+            factorial(x, &r);
+        }
+        sink = r;
+    }
+    printf("  %-16s %10.1f ns  %.15g\n", name, seconds_since(start) / repeats * 1e9, r);
+}
+
+// Evaluate text at `digits` significant digits through the VM
+static bool evaluate(const char *text, size_t digits, std::string &result, double *seconds) {
+    ExprCompiler compiler;
+    Program program;
+    if (!compiler.compile(text, strlen(text), program)) return false;
+    BigFloat value;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EvalResult status = program.run_precise(text, digits, &value);
+    *seconds = seconds_since(start);
+    if (status.status != EVAL_OK) return false;
+    format_number(value, digits, result);
+    return true;
+}
+
+static double evaluate_double(const char *text) {
+    ExprCompiler compiler;
+    Program program;
+    if (!compiler.compile(text, strlen(text), program)) return NAN;
+    EvalResult result = program.run();
+    return result.status == EVAL_OK ? result.value : NAN;
+}
+
+int main() {
+    int failures = 0;
+
+    printf("Double kernels (per call):\n");
+    time_double("20!", 20, 0, NULL);
+    time_double("170!", 170, 0, NULL);
+    time_double("0.5!", 0.5, 0, NULL);
+    time_double("100.5!", 100.5, 0, NULL);
+    time_double("52 nCr 5", 52, 5, combinations);
+    time_double("1000 nCr 500", 1000, 500, combinations);
+    time_double("1e6 nCr 5e5", 1e6, 5e5, combinations);
+    time_double("20 nPr 10", 20, 10, permutations);
+    time_double("1000 nPr 100", 1000, 100, permutations);
+
+    failures += check("170! = 7.257415615307999e306", evaluate_double("170!") == 7.257415615307999e306);
+    failures += check("171! overflows to Infinity", evaluate_double("171!") == HUGE_VAL);
+    failures += check("0.5! = √π/2", fabs(evaluate_double("0.5!") - sqrt(M_PI) / 2) < 1e-15);
+    failures += check("52nCr5 = 2598960", evaluate_double("52nCr5") == 2598960);
+    failures += check("10nPr3 = 720", evaluate_double("10nPr3") == 720);
+    failures += check("-10nCr3 = -120", evaluate_double("-10nCr3") == -120);
+    failures += check("2^3nCr2 = 28", evaluate_double("2^3nCr2") == 28);
+    failures += check("3nCr5 is invalid", evaluate_double("3nCr5") != evaluate_double("3nCr5"));
+    failures += check("(-1)! is invalid", evaluate_double("(-1)!") != evaluate_double("(-1)!"));
+
+    // Past the double range, from log-Gamma
+    double mantissa = 0;
+    long long exponent = 0;
+    int digits = 0;
+    bool ok = large_factorial(171, &mantissa, &exponent, &digits);
+    failures += check("171! ≈ 1.24101807021767e+309",
+                      ok && exponent == 309 && fabs(mantissa - 1.2410180702176678) < 1e-14 && digits == 15);
+    ok = large_factorial(1000, &mantissa, &exponent, &digits);
+    failures += check("1000! ≈ 4.02387260077094e+2567",
+                      ok && exponent == 2567 && fabs(mantissa - 4.0238726007709377) < 1e-13);
+    ok = large_factorial(1e6, &mantissa, &exponent, &digits);
+    failures += check("1e6! ≈ 8.26393168833e+5565708 to its digits",
+                      ok && exponent == 5565708 && digits >= 10 &&
+                      fabs(mantissa - 8.2639316883312400) < 5 * pow(10.0, -digits));
+    failures += check("170! and 0.5! are not large", !large_factorial(170, &mantissa, &exponent, &digits) &&
+                                                      !large_factorial(0.5, &mantissa, &exponent, &digits));
+    failures += check("171.5! is large, 1e300! is past writing",
+                      large_factorial(171.5, &mantissa, &exponent, &digits) && exponent == 310 &&
+                      !large_factorial(1e300, &mantissa, &exponent, &digits));
+
+    printf("\nExact n! (range product vs prime swing):\n");
+    const uint32_t sizes[] = {1000, 3000, 10000, 40000, 100000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t n = sizes[i];
+        int repeats = n <= 10000 ? 20 : 2;
+        BigInt plain, swing;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int j = 0; j < repeats; j++) plain = BigInt::range_product(2, n);
+        double plain_seconds = seconds_since(start) / repeats;
+        start = std::chrono::steady_clock::now();
+        for (int j = 0; j < repeats; j++) swing = BigInt::factorial(n);
+        double swing_seconds = seconds_since(start) / repeats;
+        bool ok = BigInt::compare_magnitude(plain, swing) == 0;
+        printf("  %6u!  product %9.3f ms  swing %9.3f ms  %s\n", n, plain_seconds * 1e3,
+               swing_seconds * 1e3, ok ? "" : "WRONG");
+        if (!ok) failures++;
+    }
+
+    printf("\nPrecision mode (compile + run_precise + format):\n");
+    const char *cases[][3] = {
+        {"0.5!", "50", "0.88622692545275801364908374167057259139877472806119"},
+        {"(-0.5)!", "40", "1.772453850905516027298167483341145182798"},
+        {"52nCr5", "30", "2598960"},
+        {"1000nCr500", "20", "2.7028824094543656952e+299"},
+        {"100nPr50", "20", "3.0685187562549660372e+93"},
+        {"10000!", "20", "2.8462596809170545189e+35659"},
+        {"1000000!", "20", "8.2639316883312400624e+5565708"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        std::string result;
+        double seconds = 0;
+        bool ok = evaluate(cases[i][0], strtoul(cases[i][1], NULL, 10), result, &seconds) &&
+                  result == cases[i][2];
+        printf("  %-12s %4s digits %9.3f ms  %s\n", cases[i][0], cases[i][1], seconds * 1e3,
+               result.c_str());
+        failures += check(cases[i][0], ok);
+    }
+
+    printf("\nΓ at non-integers by precision:\n");
+    const size_t precisions[] = {20, 50, 100, 300};
+    for (size_t i = 0; i < sizeof(precisions) / sizeof(precisions[0]); i++) {
+        std::string result;
+        double seconds = 0;
+        if (!evaluate("7.3!", precisions[i], result, &seconds)) {
+            failures += check("7.3!", false);
+            continue;
+        }
+        printf("  7.3!  %4zu digits %9.3f ms  %.24s...\n", precisions[i], seconds * 1e3, result.c_str());
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+// History log benchmark: appending a million calculations, reopening the
+// log (which must not read it), the first search that maps it, indexing
+// it in steps, and then searches of every kind, each against a 10 ms
+// budget and checked against a plain scan. Also checks that a record torn by a crash
+// is cut off and that later appends are found.
+#include "../calc_history.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const size_t ENTRIES = 1000000;
+static const size_t LIMIT = 200;
+static const double BUDGET_MS = 10;
+
+static unsigned long long lcg_state = 12345;
+static unsigned next_random(unsigned n) {
+    lcg_state = lcg_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(lcg_state >> 33) % n;
+}
+
+// History lines shaped like the keypad's: numbers, operators, functions
+static std::string make_line(size_t *split) {
+    static const char *ops[] = {"+", "−", "×", "÷", "^"};
+    static const char *functions[] = {"sin", "cos", "tan", "ln", "log", "√"};
+    char buf[128];
+    int a = next_random(1000), b = next_random(100);
+    double value;
+    switch (next_random(3)) {
+    case 0:
+        snprintf(buf, sizeof(buf), "%d%s%d", a, ops[next_random(5)], b);
+        value = a + b;
+        break;
+    case 1:
+        snprintf(buf, sizeof(buf), "%s(%d)", functions[next_random(6)], a);
+        value = a * 0.5;
+        break;
+    default:
+        snprintf(buf, sizeof(buf), "(%d.%d%s%d)×%d", a, b, ops[next_random(5)], b, next_random(10));
+        value = a * 1.5;
+        break;
+    }
+    std::string line = buf;
+    *split = line.size();
+    snprintf(buf, sizeof(buf), " = %.15g", value);
+    return line + buf;
+}
+
+// What search() should return, found the slow way
+static void brute_search(HistoryLog &log, const char *query, bool prefix, std::vector<size_t> &out) {
+    out.clear();
+    for (size_t r = log.count(); r > 0 && out.size() < LIMIT; r--) {
+        HistoryEntry e = log.entry(r - 1);
+        std::string line(e.line, e.length);
+        size_t at = line.find(query);
+        if (prefix ? at == 0 : at != std::string::npos) out.push_back(r - 1);
+    }
+}
+
+static off_t file_size(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    off_t size = ftello(f);
+    fclose(f);
+    return size;
+}
+
+int main() {
+    int failures = 0;
+    char path[] = "/tmp/bench_history_XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    ::close(tmp);
+    unlink(path); // open() creates it
+
+    printf("Log of %zu calculations\n", ENTRIES);
+    HistoryLog log;
+    if (!log.open(path)) {
+        fprintf(stderr, "%s\n", log.error());
+        return 1;
+    }
+    std::vector<std::string> lines(ENTRIES);
+    std::vector<size_t> splits(ENTRIES);
+    for (size_t i = 0; i < ENTRIES; i++) lines[i] = make_line(&splits[i]);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool appended = true;
+    for (size_t i = 0; i < ENTRIES; i++) {
+        appended = log.append(lines[i].c_str(), splits[i], (double)i, (uint32_t)(1700000000 + i)) && appended;
+    }
+    double append_time = seconds_since(start);
+    log.close();
+    off_t size = file_size(path);
+    printf("  append      %8.3f s  %6.2f us each, %.1f bytes a record\n", append_time,
+           append_time * 1e6 / ENTRIES, (double)(size - 8) / ENTRIES);
+    failures += check("every append succeeded", appended);
+
+    start = std::chrono::steady_clock::now();
+    bool opened = log.open(path);
+    double open_time = seconds_since(start);
+    printf("  open        %8.3f ms  (%zu records read)\n", open_time * 1e3, log.count());
+    failures += check("reopening reads nothing but the last record", opened && log.count() == 0 && open_time < 0.005);
+
+    std::vector<size_t> results, expected;
+    start = std::chrono::steady_clock::now();
+    log.search("sin(", false, LIMIT, results);
+    double first_time = seconds_since(start);
+    printf("  first search %7.3f ms  (maps and walks %zu records)\n", first_time * 1e3, log.count());
+    failures += check("every record found", log.count() == ENTRIES);
+
+    // The panel indexes a segment per idle callback
+    double slowest_step = 0;
+    int steps = 0;
+    start = std::chrono::steady_clock::now();
+    for (bool more = true; more; steps++) {
+        std::chrono::steady_clock::time_point step_start = std::chrono::steady_clock::now();
+        more = log.index_more();
+        double t = seconds_since(step_start);
+        if (t > slowest_step) slowest_step = t;
+    }
+    double index_time = seconds_since(start);
+    size_t indexed = log.indexed();
+    printf("  index       %8.3f ms  in %d steps, slowest %.3f ms, %zu records left to scan\n", index_time * 1e3,
+           steps, slowest_step * 1e3, ENTRIES - indexed);
+    failures += check("each indexing step fits in 10 ms", slowest_step * 1e3 < BUDGET_MS);
+
+    HistoryEntry e = log.entry(ENTRIES / 2);
+    failures += check("records read back as written",
+                      std::string(e.line, e.length) == lines[ENTRIES / 2] && e.split == splits[ENTRIES / 2] &&
+                      e.value == (double)(ENTRIES / 2) && e.time == 1700000000 + ENTRIES / 2);
+
+    printf("\nSearches, newest %zu matches\n", LIMIT);
+    struct {
+        const char *query;
+        bool prefix;
+    } queries[] = {
+        {"7", false},          {"×", false},          {"sin(", false},      {"(12.3", true},
+        {"= 1.5", false},      {"987−5", false},      {"log(999)", false},  {"tan(42) = 21", false},
+        {"123.45+45)×3", false}, {"√(1)", true},      {"no such thing", false}, {"q!", false}, {"9)", false}, {"", false},
+    };
+    double slowest = 0;
+    bool all_match = true;
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        // Best of a few, as the panel reruns a search on every keystroke
+        double best = 1e9;
+        for (int rep = 0; rep < 3; rep++) {
+            start = std::chrono::steady_clock::now();
+            log.search(queries[q].query, queries[q].prefix, LIMIT, results);
+            double t = seconds_since(start);
+            if (t < best) best = t;
+            if (rep == 0 && t > slowest) slowest = t;
+        }
+        brute_search(log, queries[q].query, queries[q].prefix, expected);
+        bool same = results == expected;
+        all_match = all_match && same;
+        printf("  %-8s %-16s %8.3f ms  %3zu found%s\n", queries[q].prefix ? "prefix" : "contains",
+               queries[q].query, best * 1e3, results.size(), same ? "" : "  MISMATCH");
+    }
+    failures += check("results match a plain scan", all_match);
+    failures += check("every search within 10 ms", slowest * 1e3 < BUDGET_MS);
+
+    // New records are searched before they are indexed
+    log.append("31337×2 = 62674", 7, 62674, 0);
+    log.search("31337", false, LIMIT, results);
+    failures += check("a record appended after indexing is found",
+                      results.size() == 1 && results[0] == ENTRIES && log.indexed() == indexed);
+    log.close();
+
+    // A crash part way through a write leaves a partial record at the end
+    size = file_size(path);
+    FILE *f = fopen(path, "ab");
+    const unsigned char torn[] = {0x12, 0x34, 0x56, 0x78, 40, 0, 10, 0, 1, 2, 3};
+    fwrite(torn, 1, sizeof(torn), f);
+    fclose(f);
+    bool reopened = log.open(path);
+    failures += check("a torn last record is cut off on open", reopened && file_size(path) == size);
+    log.append("2+2 = 4", 3, 4, 0);
+    log.search("2+2 = 4", true, LIMIT, results);
+    failures += check("appends after the cut are found",
+                      log.count() == ENTRIES + 2 && !results.empty() && results[0] == ENTRIES + 1);
+    log.close();
+
+    // The panel searches with an empty entry until something is typed, so
+    // it must list indexed records too, not just the unindexed tail
+    unlink(path);
+    log.open(path);
+    const size_t segment = 1 << 15;
+    for (size_t i = 0; i < segment + 5; i++) log.append(lines[i].c_str(), splits[i], (double)i, 0);
+    log.search("", false, LIMIT, expected); // Maps the records for indexing
+    while (log.index_more()) {
+    }
+    log.search("", false, LIMIT, results);
+    failures += check("an empty search lists indexed records",
+                      log.indexed() == segment && expected.size() == LIMIT && results == expected);
+    log.close();
+
+    f = fopen(path, "wb");
+    fputs("not a log", f);
+    fclose(f);
+    failures += check("other files are refused", !log.open(path));
+    unlink(path);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+// Keypad state machine benchmark: drives CalcEngine with typical key
+// sequences, renders the display after every key like the window does, and
+// counts heap allocations. Exits non-zero if steady-state keypresses
+// allocate or a keystroke check fails.
+#include "../calc_engine.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+static unsigned long allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    free(p);
+}
+
+static const Command SESSION[] = {
+    CMD_DIGIT_1, CMD_DIGIT_2, CMD_DIGIT_3, CMD_DECIMAL, CMD_DIGIT_4, CMD_DIGIT_5, CMD_ADD,
+    CMD_DIGIT_6, CMD_DIGIT_7, CMD_MULTIPLY, CMD_LPAREN, CMD_DIGIT_8, CMD_SUBTRACT, CMD_DIGIT_9,
+    CMD_RPAREN, CMD_EQUALS, CMD_DIVIDE, CMD_DIGIT_3, CMD_EQUALS, CMD_SIN, CMD_ADD, CMD_PI,
+    CMD_SQUARE, CMD_EQUALS, CMD_MEMORY_ADD, CMD_ALL_CLEAR,
+    CMD_DIGIT_2, CMD_POWER, CMD_DIGIT_1, CMD_DIGIT_0, CMD_SUBTRACT, CMD_DIGIT_5, CMD_DIGIT_0,
+    CMD_DIGIT_0, CMD_PERCENT, CMD_EQUALS, CMD_SIGN, CMD_SQRT, CMD_BACKSPACE, CMD_CLEAR_ENTRY,
+    CMD_DIGIT_4, CMD_FACTORIAL, CMD_ADD, CMD_MEMORY_RECALL, CMD_EQUALS, CMD_LN, CMD_LOG,
+    CMD_DIGIT_1, CMD_DIVIDE, CMD_DIGIT_0, CMD_EQUALS, CMD_ALL_CLEAR, CMD_MEMORY_CLEAR
+};
+static const size_t SESSION_KEYS = sizeof(SESSION) / sizeof(SESSION[0]);
+
+static size_t run_session(CalcEngine &engine) {
+    size_t rendered = 0;
+    for (size_t i = 0; i < SESSION_KEYS; i++) {
+        engine.press(SESSION[i]);
+        rendered += strlen(engine.display_text()) + strlen(engine.history_text());
+    }
+    return rendered;
+}
+
+// Presses `count` copies of a key; true if none was refused
+static bool press_times(CalcEngine &engine, Command command, size_t count) {
+    bool taken = true;
+    for (size_t i = 0; i < count; i++) {
+        engine.press(command);
+        taken = taken && !engine.refused();
+    }
+    return taken;
+}
+
+// Presses keys in order; true if display and history then read as given
+static bool shows(const Command *keys, size_t count, const char *display, const char *history) {
+    CalcEngine engine;
+    for (size_t i = 0; i < count; i++) engine.press(keys[i]);
+    return strcmp(engine.display_text(), display) == 0 && strcmp(engine.history_text(), history) == 0;
+}
+
+static int keystroke_checks() {
+    printf("\nChecks\n");
+    CalcEngine engine;
+    bool taken = press_times(engine, CMD_DIGIT_7, 35);
+    int failures = check("35 typed digits all show", taken && std::string(engine.display_text()) == std::string(35, '7'));
+
+    engine.press(CMD_ALL_CLEAR);
+    engine.set_precision(1000);
+    taken = press_times(engine, CMD_DIGIT_3, CalcEngine::MAX_ENTRY_DIGITS);
+    engine.press(CMD_DECIMAL);
+    engine.press(CMD_DIGIT_3);
+    bool refused = engine.refused();
+    failures += check("a 1000-digit operand is typed in full",
+                      taken && strlen(engine.display_text()) == CalcEngine::MAX_ENTRY_DIGITS + 1);
+    failures += check("a digit past that is refused, not dropped", refused);
+    engine.press(CMD_BACKSPACE); // The point
+    engine.press(CMD_BACKSPACE);
+    engine.press(CMD_DIGIT_3);
+    failures += check("a digit fits again after a backspace", !engine.refused());
+
+    // Backspace keeps the display in step with the expression left
+    const Command operator_deleted[] = {CMD_DIGIT_2, CMD_ADD, CMD_DIGIT_3, CMD_BACKSPACE};
+    failures += check("2+3⌫ shows 2 over 2+", shows(operator_deleted, 4, "2", "2+"));
+    const Command retyped[] = {CMD_DIGIT_2, CMD_ADD, CMD_DIGIT_3, CMD_BACKSPACE, CMD_BACKSPACE, CMD_DIGIT_4, CMD_EQUALS};
+    failures += check("2+3⌫⌫4= types on to 24", shows(retyped, 7, "24", "24 = 24"));
+    const Command factorial_deleted[] = {CMD_DIGIT_5, CMD_FACTORIAL, CMD_BACKSPACE};
+    failures += check("5!⌫ shows 5 over 5", shows(factorial_deleted, 3, "5", "5"));
+    const Command all_deleted[] = {CMD_DIGIT_5, CMD_FACTORIAL, CMD_BACKSPACE, CMD_BACKSPACE};
+    failures += check("5!⌫⌫ shows 0 over nothing", shows(all_deleted, 4, "0", ""));
+    const Command bracket_deleted[] = {CMD_LPAREN, CMD_DIGIT_2, CMD_ADD, CMD_DIGIT_3, CMD_RPAREN,
+                                       CMD_FACTORIAL, CMD_BACKSPACE, CMD_MULTIPLY, CMD_DIGIT_2, CMD_EQUALS};
+    failures += check("(2+3)!⌫×2= is 10", shows(bracket_deleted, 10, "10", "(2+3)×2 = 10"));
+    return failures;
+}
+
+int main() {
+    CalcEngine engine;
+    volatile size_t sink = 0;
+
+    // Warm up so the compiler's token and code buffers reach full size
+    for (int i = 0; i < 100; i++) {
+        sink = sink + run_session(engine);
+    }
+
+    const int sessions = 200000;
+    allocations = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++) {
+        sink = sink + run_session(engine);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double keys = (double)sessions * SESSION_KEYS;
+    printf("keypresses:            %.0f\n", keys);
+    printf("keypresses/sec:        %.0f\n", keys / seconds);
+    printf("ns/keypress:           %.1f\n", seconds * 1e9 / keys);
+    printf("allocations:           %lu\n", allocations);
+    printf("allocations/keypress:  %.4f\n", allocations / keys);
+    unsigned long steady_allocations = allocations;
+
+    int failures = keystroke_checks(); // These may allocate
+    return steady_allocations == 0 && failures == 0 ? 0 : 1;
+}
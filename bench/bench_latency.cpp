@@ -0,0 +1,117 @@
+// Latency instrumentation benchmark: what the tracker costs per keypress
+// disabled and enabled, and how close the histogram's percentiles are to
+// the exact ones of the same values. Also follows inputs through commit,
+// paint and presentation the way the frame clock drives them.
+#include "../calc_latency.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const int KEYS = 10000000;
+static const size_t VALUES = 1000000;
+
+// ns per keypress for input, commit, paint and presentation of one frame
+static double time_keypresses(LatencyTracker &tracker) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < KEYS; i++) {
+        tracker.input(i);
+        tracker.committed(i + 100, i);
+        tracker.painted(i + 900, i);
+        tracker.presented(i, i + 5000);
+    }
+    return seconds_since(start) * 1e9 / KEYS;
+}
+
+static double exact_percentile(const std::vector<uint64_t> &sorted, double p) {
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return (double)sorted[rank ? rank - 1 : 0];
+}
+
+int main() {
+    int failures = 0;
+
+    printf("Tracker cost, %d keypresses\n", KEYS);
+    LatencyTracker off;
+    double off_ns = time_keypresses(off);
+    LatencyTracker on;
+    on.enable();
+    double on_ns = time_keypresses(on);
+    printf("  disabled    %8.2f ns per keypress\n", off_ns);
+    printf("  enabled     %8.2f ns per keypress\n", on_ns);
+    failures += check("disabled tracking records nothing", off.stage(LatencyTracker::TO_COMMIT).count() == 0);
+    failures += check("disabled tracking costs under 5 ns a keypress", off_ns < 5);
+    failures += check("enabled tracking costs under 200 ns a keypress", on_ns < 200);
+    failures += check("every keypress reaches every stage",
+                      on.stage(LatencyTracker::TO_PRESENT).count() == (uint64_t)KEYS &&
+                      on.stage(LatencyTracker::TO_PAINT).percentile(0.5) == 900);
+
+    printf("\nPercentiles of %zu log-normal values\n", VALUES);
+    srand(7);
+    LatencyHistogram histogram;
+    std::vector<uint64_t> values(VALUES);
+    for (size_t i = 0; i < VALUES; i++) {
+        double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+        double normal = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+        values[i] = (uint64_t)exp(8 + 1.5 * normal); // Median about 3 ms, long tail
+        histogram.record((int64_t)values[i]);
+    }
+    std::sort(values.begin(), values.end());
+    const double ps[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+    double worst = 0;
+    for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+        double exact = exact_percentile(values, ps[i]);
+        double approx = (double)histogram.percentile(ps[i]);
+        double error = fabs(approx - exact) / exact;
+        worst = std::max(worst, error);
+        printf("  p%-6g %12.0f us, histogram %12.0f us, %5.2f%% off\n", ps[i] * 100, exact, approx, error * 100);
+    }
+    failures += check("percentiles are within 3.2% of exact", worst < 0.032);
+    failures += check("min, max and count are exact",
+                      histogram.min() == values.front() && histogram.max() == values.back() &&
+                      histogram.count() == VALUES);
+
+    LatencyHistogram small;
+    for (int v = 0; v < 64; v++) small.record(v);
+    failures += check("values below 64 us are exact", small.percentile(0.5) == 31 && small.percentile(1) == 63);
+    small.record(-5);
+    failures += check("negative intervals count as 0", small.min() == 0);
+
+    printf("\nFrames\n");
+    LatencyTracker frames;
+    frames.enable();
+    frames.input(1000);
+    frames.input(1200);
+    frames.committed(1500, 7);
+    frames.input(1600); // Arrives after frame 7's commit, shown in frame 8
+    frames.painted(2000, 7);
+    failures += check("keys between frames share a commit",
+                      frames.stage(LatencyTracker::TO_COMMIT).count() == 2 &&
+                      frames.stage(LatencyTracker::TO_PAINT).count() == 2);
+    failures += check("the oldest painted frame awaits presentation", frames.awaiting_presentation() == 7);
+    frames.committed(2100, 8);
+    frames.painted(2400, 8);
+    frames.presented(7, 0);
+    failures += check("an unknown presentation time is not recorded",
+                      frames.stage(LatencyTracker::TO_PRESENT).count() == 0 && frames.awaiting_presentation() == 8);
+    frames.presented(8, 3600);
+    failures += check("a presented frame records each of its keys",
+                      frames.stage(LatencyTracker::TO_PRESENT).max() == 2000 && frames.awaiting_presentation() == -1);
+
+    LatencyTracker flood;
+    flood.enable();
+    for (size_t i = 0; i < LatencyTracker::MAX_PENDING + 10; i++) flood.input((int64_t)i);
+    flood.committed(1000, 1);
+    failures += check("inputs beyond the limit drop the oldest",
+                      flood.stage(LatencyTracker::TO_COMMIT).count() == LatencyTracker::MAX_PENDING &&
+                      flood.stage(LatencyTracker::TO_COMMIT).max() == 1000 - 10);
+    char summary[128];
+    on.summary(summary, sizeof(summary));
+    printf("  overlay: %s\n", summary);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
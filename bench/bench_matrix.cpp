@@ -0,0 +1,284 @@
+// Matrix benchmark: GFLOP/s of the naive triple loop against the blocked
+// multiply with each kernel set and on every core, and of LU, at sizes up
+// to --size. Checks products against the naive loop (including ragged
+// sizes), residuals of solve, inverse and least squares, determinants,
+// eigenvalues with known answers, and parsing.
+//
+//   bench/bench_matrix [--size N] [--threads N]
+#include "../calc_matrix.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static unsigned long long lcg_state = 12345;
+static double next_uniform() {
+    lcg_state = lcg_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((lcg_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static Matrix random_matrix(size_t rows, size_t cols) {
+    Matrix m(rows, cols);
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) m(r, c) = 2 * next_uniform() - 1;
+    }
+    return m;
+}
+
+// What a caller would write without calc_matrix
+static Matrix naive_multiply(const Matrix &a, const Matrix &b) {
+    Matrix c(a.rows(), b.cols());
+    for (size_t i = 0; i < a.rows(); i++) {
+        for (size_t j = 0; j < b.cols(); j++) {
+            double sum = 0;
+            for (size_t k = 0; k < a.cols(); k++) sum += a(i, k) * b(k, j);
+            c(i, j) = sum;
+        }
+    }
+    return c;
+}
+
+static double max_difference(const Matrix &a, const Matrix &b) {
+    double worst = 0;
+    for (size_t r = 0; r < a.rows(); r++) {
+        for (size_t c = 0; c < a.cols(); c++) worst = std::max(worst, fabs(a(r, c) - b(r, c)));
+    }
+    return worst;
+}
+
+static bool same(const Matrix &a, const Matrix &b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return false;
+    for (size_t r = 0; r < a.rows(); r++) {
+        if (memcmp(a.row(r), b.row(r), a.cols() * sizeof(double)) != 0) return false;
+    }
+    return true;
+}
+
+static Matrix parse(const char *text) {
+    Matrix m;
+    std::string error;
+    matrix_parse(text, strlen(text), &m, &error);
+    return m;
+}
+
+// Best of a few runs, each at least 0.1 s of repeats
+template <typename F> static double best_seconds(F run) {
+    double best = 1e9;
+    for (int rep = 0; rep < 3; rep++) {
+        int count = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed;
+        do {
+            run();
+            count++;
+            elapsed = seconds_since(start);
+        } while (elapsed < 0.1);
+        best = std::min(best, elapsed / count);
+    }
+    return best;
+}
+
+static int products(const char *kernels) {
+    int failures = 0;
+    const size_t shapes[][3] = {{1, 1, 1}, {37, 53, 29}, {130, 7, 257}, {5, 300, 3}, {97, 260, 2100}};
+    double worst = 0;
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        Matrix a = random_matrix(shapes[s][0], shapes[s][1]), b = random_matrix(shapes[s][1], shapes[s][2]), c;
+        matrix_multiply(a, b, &c, 1);
+        worst = std::max(worst, max_difference(c, naive_multiply(a, b)) / shapes[s][1]);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s: ragged products match the naive loop", kernels);
+    failures += check(name, worst < 4 * DBL_EPSILON);
+    return failures;
+}
+
+static int solvers(size_t n) {
+    int failures = 0;
+    printf("\nSolvers\n");
+
+    // Residual of LU solve, relative to what rounding allows
+    Matrix a = random_matrix(n, n), b = random_matrix(n, 3), x, ax;
+    matrix_solve(a, b, &x);
+    matrix_multiply(a, x, &ax);
+    double norm_a = 0, norm_x = 0;
+    for (size_t r = 0; r < n; r++) {
+        double row = 0;
+        for (size_t c = 0; c < n; c++) row += fabs(a(r, c));
+        norm_a = std::max(norm_a, row);
+        for (size_t c = 0; c < 3; c++) norm_x = std::max(norm_x, fabs(x(r, c)));
+    }
+    double residual = max_difference(ax, b) / (norm_a * norm_x * n * DBL_EPSILON);
+    printf("  scaled LU residual %.3f\n", residual);
+    failures += check("LU solve residual within rounding", residual < 1);
+
+    Matrix inverse, product;
+    matrix_inverse(a, &inverse);
+    matrix_multiply(a, inverse, &product);
+    failures += check("A·A⁻¹ is the identity", max_difference(product, Matrix::identity(n)) < 1e-9);
+
+    double det = 0;
+    matrix_determinant(parse("1 2; 3 4"), &det);
+    failures += check("det [1 2; 3 4] = -2", det == -2);
+    matrix_determinant(parse("0 1 0; 0 0 1; 1 0 0"), &det);
+    bool cyclic = det == 1;
+    matrix_determinant(parse("0 1 0; 1 0 0; 0 0 1"), &det);
+    failures += check("permutations have determinant ±1", cyclic && det == -1);
+    matrix_determinant(parse("1 2; 3 6"), &det);
+    MatrixStatus status = matrix_inverse(parse("1 2; 3 6"), &inverse);
+    failures += check("[1 2; 3 6] is singular: det 0, no inverse", det == 0 && status == MATRIX_SINGULAR);
+    status = matrix_inverse(parse("1 0; 0 1e-20"), &inverse);
+    failures += check("diag(1, 1e-20) is not", status == MATRIX_OK && inverse(1, 1) == 1e20);
+    failures += check("solve refuses mismatched sizes",
+                      matrix_solve(parse("1 2; 3 4"), parse("1; 2; 3"), &x) == MATRIX_SHAPE);
+
+    // y = 1 + 2t through exact points, then a noisy fit against the
+    // normal equations
+    matrix_least_squares(parse("1 0; 1 1; 1 2; 1 3"), parse("1; 3; 5; 7"), &x);
+    failures += check("least squares through exact points", fabs(x(0, 0) - 1) < 1e-14 && fabs(x(1, 0) - 2) < 1e-14);
+    Matrix design(200, 3), observed(200, 1);
+    for (size_t i = 0; i < 200; i++) {
+        double t = i / 20.0;
+        design(i, 0) = 1;
+        design(i, 1) = t;
+        design(i, 2) = t * t;
+        observed(i, 0) = 3 - t + 0.5 * t * t + 0.1 * (next_uniform() - 0.5);
+    }
+    Matrix transposed = matrix_transpose(design), gram, moment, normal;
+    matrix_multiply(transposed, design, &gram);
+    matrix_multiply(transposed, observed, &moment);
+    matrix_solve(gram, moment, &normal);
+    matrix_least_squares(design, observed, &x);
+    failures += check("least squares agrees with the normal equations", max_difference(x, normal) < 1e-10);
+    failures += check("rank-deficient least squares is refused",
+                      matrix_least_squares(parse("1 2; 2 4; 3 6"), parse("1; 2; 3"), &x) == MATRIX_SINGULAR);
+
+    // The (2, -1) tridiagonal matrix has eigenvalues 2 - 2cos(kπ/(n+1))
+    size_t m = 100;
+    Matrix laplacian(m, m);
+    for (size_t i = 0; i < m; i++) {
+        laplacian(i, i) = 2;
+        if (i + 1 < m) laplacian(i, i + 1) = laplacian(i + 1, i) = -1;
+    }
+    std::vector<double> values;
+    status = matrix_symmetric_eigenvalues(laplacian, &values);
+    double worst = 0;
+    for (size_t k = 1; k <= m && status == MATRIX_OK; k++) {
+        worst = std::max(worst, fabs(values[k - 1] - (2 - 2 * cos(k * M_PI / (m + 1)))));
+    }
+    failures += check("eigenvalues of the (2, -1) matrix", status == MATRIX_OK && worst < 1e-13);
+
+    // A random symmetric matrix: the eigenvalues sum to the trace and
+    // their squares to the squared Frobenius norm
+    Matrix s = random_matrix(150, 150);
+    for (size_t i = 0; i < 150; i++) {
+        for (size_t j = 0; j < i; j++) s(i, j) = s(j, i);
+    }
+    matrix_symmetric_eigenvalues(s, &values);
+    double trace = 0, frobenius = 0, sum = 0, squares = 0;
+    for (size_t i = 0; i < 150; i++) {
+        trace += s(i, i);
+        for (size_t j = 0; j < 150; j++) frobenius += s(i, j) * s(i, j);
+        sum += values[i];
+        squares += values[i] * values[i];
+    }
+    failures += check("eigenvalues keep the trace and Frobenius norm",
+                      fabs(sum - trace) < 1e-11 && fabs(squares - frobenius) < 1e-9 * frobenius &&
+                          std::is_sorted(values.begin(), values.end()));
+    failures += check("a non-symmetric matrix is refused",
+                      matrix_symmetric_eigenvalues(parse("1 2; 3 4"), &values) == MATRIX_NOT_SYMMETRIC);
+    return failures;
+}
+
+static int parsing() {
+    int failures = 0;
+    printf("\nParsing\n");
+    Matrix m;
+    std::string error;
+    bool ok = matrix_parse("1 2; 3 4", 8, &m, &error);
+    failures += check("\"1 2; 3 4\" is 2×2", ok && m.rows() == 2 && m.cols() == 2 && m(1, 0) == 3);
+    const char *text = "\n 1.5, -2e3\t+4\r\n\n-0.25 0 7\n";
+    ok = matrix_parse(text, strlen(text), &m, &error);
+    failures += check("commas, tabs, CRLF and blank lines", ok && m.rows() == 2 && m.cols() == 3 && m(0, 1) == -2000);
+    failures += check("format reads back the same", ok && same(parse(matrix_format(m).c_str()), m));
+    failures += check("ragged rows are refused", !matrix_parse("1 2\n3", 5, &m, &error) && !error.empty());
+    failures += check("words are refused", !matrix_parse("1 2x", 4, &m, &error) && error == "Not a number: 2x");
+    failures += check("empty text is refused", !matrix_parse(" \n ", 3, &m, &error));
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    size_t largest = 512;
+    size_t threads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--size") == 0) {
+            largest = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (largest < 64) largest = 64;
+
+    const char *best = matrix_kernels();
+    const char *sets[2] = {"sse2", "avx2"};
+    int failures = 0, mismatches = 0;
+    double naive_rate = 0, blocked_rate = 0;
+
+    printf("GFLOP/s     naive    sse2    avx2   threads      LU\n");
+    for (size_t n = 64; n <= largest; n *= 2) {
+        Matrix a = random_matrix(n, n), b = random_matrix(n, n), c;
+        double flops = 2.0 * n * n * n;
+        double naive = best_seconds([&]() { c = naive_multiply(a, b); });
+        Matrix reference = c;
+        printf("  %4zu  %8.2f", n, flops / naive / 1e9);
+        naive_rate = flops / naive;
+        for (int s = 0; s < 2; s++) {
+            if (!matrix_use_kernels(sets[s])) {
+                printf("       -");
+                continue;
+            }
+            double t = best_seconds([&]() { matrix_multiply(a, b, &c, 1); });
+            printf("  %6.2f", flops / t / 1e9);
+            mismatches += max_difference(c, reference) > 4 * n * DBL_EPSILON;
+            if (strcmp(sets[s], best) == 0) blocked_rate = flops / t;
+        }
+        matrix_use_kernels(best);
+        double t = best_seconds([&]() { matrix_multiply(a, b, &c, threads); });
+        printf("  %8.2f", flops / t / 1e9);
+        LuDecomposition lu;
+        double lu_time = best_seconds([&]() { lu.factor(a, threads); });
+        printf("  %6.2f\n", 2.0 / 3 * n * n * n / lu_time / 1e9);
+    }
+
+    printf("\nProducts\n");
+    failures += check("every size matches the naive loop", mismatches == 0);
+    for (int s = 0; s < 2; s++) {
+        if (matrix_use_kernels(sets[s])) failures += products(sets[s]);
+    }
+    matrix_use_kernels(best);
+    Matrix a = random_matrix(300, 200), b = random_matrix(200, 250), one, three;
+    matrix_multiply(a, b, &one, 1);
+    matrix_multiply(a, b, &three, 3);
+    failures += check("three threads give the same bits as one", same(one, three));
+    Matrix t = matrix_transpose(a);
+    failures += check("transpose", t.rows() == 200 && t.cols() == 300 && t(17, 255) == a(255, 17) &&
+                                       same(matrix_transpose(t), a));
+    char label[64];
+    snprintf(label, sizeof(label), "%s is 4× the naive loop at %zu", best, largest);
+    failures += check(label, blocked_rate > 4 * naive_rate);
+
+    failures += solvers(largest);
+    failures += parsing();
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+// Plot sampling benchmark: samples per tile column, the cost of filling a
+// window from nothing, and how much a pan or zoom gets from the cache.
+// Checks that straight lines between samples stay within a pixel of the
+// curve and that poles and failing stretches are broken, not joined.
+#include "../calc_plot.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const int VIEW_WIDTH = 450;
+static const int VIEW_HEIGHT = 300;
+static const double PI = 3.14159265358979323846;
+
+// The plot panel's starting view: x from -10 to 10, square pixels
+static PlotViewport default_viewport() {
+    PlotViewport view = {0, 0, 20.0 / VIEW_WIDTH, 20.0 / VIEW_WIDTH, VIEW_WIDTH, VIEW_HEIGHT};
+    return view;
+}
+
+static long long column_of(double x, int level) {
+    return (long long)floor(x / (PLOT_TILE_SIZE * plot_level_units(level)));
+}
+
+// Samples every visible tile column, as the panel does for one frame
+static void draw_frame(PlotCurve *curves, size_t count, const PlotViewport &view) {
+    int lx = plot_level(view.units_x), ly = plot_level(view.units_y);
+    long long first = column_of(view.plot_x(0), lx), last = column_of(view.plot_x(view.width), lx);
+    for (size_t c = 0; c < count; c++) {
+        for (long long column = first; column <= last; column++) curves[c].tile_samples(lx, ly, column);
+    }
+}
+
+// Largest distance in tile pixels between the curve and the straight
+// lines joining its samples, probed at points between them
+static double worst_chord_error(const std::vector<PlotPoint> &points, double (*f)(double), int ly) {
+    double worst = 0;
+    for (size_t i = 0; i + 1 < points.size(); i++) {
+        const PlotPoint &a = points[i], &b = points[i + 1];
+        if (a.y != a.y || b.y != b.y) continue;
+        for (int k = 1; k < 8; k++) {
+            double t = k / 8.0, x = a.x + t * (b.x - a.x);
+            double line = a.y + t * (b.y - a.y);
+            worst = fmax(worst, fabs(f(x) - line) / plot_level_units(ly));
+        }
+    }
+    return worst;
+}
+
+static double sin_degrees(double x) { return sin(x * PI / 180); }
+static double cubic(double x) { return x * x * x - 2 * x; }
+
+int main() {
+    int failures = 0;
+
+    printf("Samples per %d-pixel tile column at the starting view\n", PLOT_TILE_SIZE);
+    const char *expressions[] = {"x", "x^3-2x", "sin(x×36)", "tan(x×18)", "√x", "1÷x"};
+    const size_t count = sizeof(expressions) / sizeof(expressions[0]);
+    PlotCurve curves[count];
+    PlotViewport view = default_viewport();
+    int lx = plot_level(view.units_x), ly = plot_level(view.units_y);
+    for (size_t c = 0; c < count; c++) {
+        curves[c].set_expression(expressions[c]);
+        size_t points = 0, breaks = 0;
+        for (long long column = -1; column <= 0; column++) {
+            const std::vector<PlotPoint> &samples = curves[c].tile_samples(lx, ly, column);
+            points += samples.size();
+            for (size_t i = 0; i < samples.size(); i++) breaks += samples[i].y != samples[i].y;
+        }
+        printf("  %-12s %6zu points %4zu breaks\n", expressions[c], points / 2, breaks);
+    }
+
+    // Straight segments stay within the tolerance of smooth curves
+    PlotCurve sine, poly;
+    sine.set_expression("sin(x)");
+    poly.set_expression("x^3-2x");
+    double sine_error = 0, poly_error = 0;
+    PlotViewport wide = {0, 0, 720.0 / VIEW_WIDTH, 2.0 / VIEW_HEIGHT, VIEW_WIDTH, VIEW_HEIGHT};
+    int wx = plot_level(wide.units_x), wy = plot_level(wide.units_y);
+    for (long long column = column_of(-360, wx); column <= column_of(360, wx); column++) {
+        sine_error = fmax(sine_error, worst_chord_error(sine.tile_samples(wx, wy, column), sin_degrees, wy));
+    }
+    for (long long column = -1; column <= 0; column++) {
+        poly_error = fmax(poly_error, worst_chord_error(poly.tile_samples(lx, ly, column), cubic, ly));
+    }
+    printf("  worst chord error: sin %.3f px, cubic %.3f px\n", sine_error, poly_error);
+    failures += check("segments within half a pixel of sin(x) and x^3-2x", sine_error < 0.5 && poly_error < 0.5);
+
+    // tan(x) near 90: a break between the last point below and the first above
+    PlotCurve tangent;
+    tangent.set_expression("tan(x)");
+    const std::vector<PlotPoint> &t = tangent.tile_samples(wx, wy, column_of(90, wx));
+    bool joined = false, broken = false;
+    for (size_t i = 0; i + 1 < t.size(); i++) {
+        if (t[i].x < 90 && t[i + 1].x > 90) {
+            joined = joined || (t[i].y == t[i].y && t[i + 1].y == t[i + 1].y);
+        }
+        if (t[i].y != t[i].y && fabs(t[i].x - 90) < wide.units_x) broken = true;
+    }
+    failures += check("tan(x) is broken at its pole, not joined across", broken && !joined);
+
+    // √x fails left of 0: one break there, samples reaching right up to 0
+    PlotCurve root;
+    root.set_expression("√x");
+    const std::vector<PlotPoint> &r = root.tile_samples(lx, ly, -1);
+    size_t failed = 0;
+    for (size_t i = 0; i < r.size(); i++) failed += r[i].y != r[i].y;
+    const std::vector<PlotPoint> &r0 = root.tile_samples(lx, ly, 0);
+    failures += check("√x left of 0 collapses to one gap", failed == 1 && r0.front().x == 0 && r0.front().y == 0);
+
+    // Columns at the same level are identical whichever frame asks first
+    PlotCurve again;
+    again.set_expression("sin(x×36)");
+    const std::vector<PlotPoint> &a = again.tile_samples(lx, ly, 0);
+    const std::vector<PlotPoint> &b = curves[2].tile_samples(lx, ly, 0);
+    failures += check("a column samples the same however it is reached",
+                      a.size() == b.size() && memcmp(&a[0], &b[0], a.size() * sizeof(PlotPoint)) == 0);
+
+    printf("\nFrames with %zu curves (%dx%d view)\n", count, VIEW_WIDTH, VIEW_HEIGHT);
+    for (size_t c = 0; c < count; c++) curves[c].set_expression(expressions[c]);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    draw_frame(curves, count, view);
+    double cold = seconds_since(start);
+    printf("  first frame, nothing cached  %8.3f ms\n", cold * 1e3);
+
+    // Pan two pixels a frame for ten seconds at 60 fps
+    const int PAN_FRAMES = 600;
+    unsigned long misses_before = 0, evaluations_before = 0;
+    for (size_t c = 0; c < count; c++) {
+        misses_before += curves[c].stats().misses;
+        evaluations_before += curves[c].stats().evaluations;
+    }
+    double slowest = 0;
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < PAN_FRAMES; frame++) {
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        view.center_x += 2 * view.units_x;
+        draw_frame(curves, count, view);
+        slowest = fmax(slowest, seconds_since(frame_start));
+    }
+    double pan = seconds_since(start);
+    unsigned long misses = 0, evaluations = 0;
+    for (size_t c = 0; c < count; c++) {
+        misses += curves[c].stats().misses;
+        evaluations += curves[c].stats().evaluations;
+    }
+    printf("  pan %d frames                %8.3f ms/frame, slowest %.3f ms, %lu columns sampled, %.1f points/frame\n",
+           PAN_FRAMES, pan * 1e3 / PAN_FRAMES, slowest * 1e3, misses - misses_before,
+           (double)(evaluations - evaluations_before) / PAN_FRAMES);
+    failures += check("panning samples only newly uncovered columns",
+                      misses - misses_before <= count * ((2 * PAN_FRAMES + PLOT_TILE_SIZE - 1) / PLOT_TILE_SIZE + 1));
+
+    // Zoom in 1% a frame: the level changes every 70 frames, and each time
+    // the screen spans at most twice its width in tile pixels
+    const int ZOOM_FRAMES = 140;
+    misses_before = misses;
+    slowest = 0;
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < ZOOM_FRAMES; frame++) {
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        view.zoom(0.99, VIEW_WIDTH * 0.5, VIEW_HEIGHT * 0.5);
+        draw_frame(curves, count, view);
+        slowest = fmax(slowest, seconds_since(frame_start));
+    }
+    double zoom = seconds_since(start);
+    misses = 0;
+    for (size_t c = 0; c < count; c++) misses += curves[c].stats().misses;
+    printf("  zoom %d frames               %8.3f ms/frame, slowest %.3f ms, %lu columns sampled\n", ZOOM_FRAMES,
+           zoom * 1e3 / ZOOM_FRAMES, slowest * 1e3, misses - misses_before);
+    failures += check("zooming samples again only when the level changes", misses - misses_before <= count * 2 * (2 * VIEW_WIDTH / PLOT_TILE_SIZE + 2));
+    failures += check("slowest frame fits in a 60 fps frame", slowest < 1.0 / 60);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
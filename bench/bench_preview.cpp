@@ -0,0 +1,301 @@
+// Live preview benchmark: the cost per keystroke of keeping the value of
+// a growing expression up to date, incrementally and by compiling and
+// running the whole expression again, at lengths up to --tokens. Checks
+// that the incremental cost does not grow with the length, and that the
+// preview is the value "=" gives, to the bit, over random token
+// sequences with edits in the middle and over random keypad sessions.
+//
+//   bench/bench_preview [--tokens N] [--seed N]
+#include "../calc_engine.h"
+#include "../calc_preview.h"
+#include "../calc_registers.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const double NO_BUDGET = 1e9;
+
+static unsigned long long lcg_state = 12345;
+static unsigned next_random(unsigned n) {
+    lcg_state = lcg_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)((lcg_state >> 33) % n);
+}
+
+static Token make_token(TokenType type, unsigned char op = 0, double value = 0) {
+    Token tok = {type, op, 0, value, 0, 0};
+    return tok;
+}
+
+static bool same_bits(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+// "1+2×(3−4÷5)^2…" a token at a time, brackets kept shallow
+static std::vector<Token> long_expression(size_t count) {
+    static const TokenType OPERATORS[] = {TOK_PLUS, TOK_MULTIPLY, TOK_MINUS, TOK_DIVIDE, TOK_PLUS, TOK_POWER};
+    std::vector<Token> tokens;
+    int open = 0;
+    for (size_t i = 0; tokens.size() < count; i++) {
+        if (i % 7 == 3 && open < 2) {
+            tokens.push_back(make_token(TOK_LPAREN));
+            open++;
+        }
+        tokens.push_back(make_token(TOK_NUMBER, 0, 1 + i % 9));
+        if (i % 7 == 5 && open > 0) {
+            tokens.push_back(make_token(TOK_RPAREN));
+            open--;
+        }
+        TokenType op = OPERATORS[i % 6];
+        if (op == TOK_POWER) tokens.push_back(make_token(TOK_NUMBER, 0, 0.5)); // Implied ×, then ^
+        tokens.push_back(make_token(op));
+    }
+    tokens.resize(count);
+    return tokens;
+}
+
+// Nanoseconds per token appended, with the value read after each
+static double incremental_ns(const std::vector<Token> &tokens, size_t from, size_t to) {
+    double best = 1e9;
+    volatile double sink = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        ExprPreview preview;
+        preview.update(&tokens[0], from, NO_BUDGET);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t n = from + 1; n <= to; n++) {
+            preview.update(&tokens[0], n, NO_BUDGET);
+            double value = 0;
+            if (preview.value(&value)) sink = sink + value;
+        }
+        best = std::min(best, seconds_since(start) * 1e9 / (to - from));
+    }
+    return best;
+}
+
+// The same with every keystroke compiled and run from scratch
+static double recompile_ns(const std::vector<Token> &tokens, size_t from, size_t to) {
+    double best = 1e9;
+    volatile double sink = 0;
+    ExprCompiler compiler;
+    Program program;
+    for (int rep = 0; rep < 3; rep++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t n = from + 1; n <= to; n++) {
+            if (compiler.compile_tokens(&tokens[0], n, program)) sink = sink + program.run().value;
+        }
+        best = std::min(best, seconds_since(start) * 1e9 / (to - from));
+    }
+    return best;
+}
+
+static int scaling(size_t largest) {
+    int failures = 0;
+    printf("Per keystroke, appending to an expression of N tokens\n");
+    printf("  %8s %14s %14s %9s\n", "N", "incremental", "recompile", "speedup");
+    std::vector<Token> tokens = long_expression(largest + 64);
+    double first = 0, last = 0, last_recompile = 0;
+    for (size_t n = 16; n <= largest; n *= 4) {
+        double fast = incremental_ns(tokens, n, n + 64);
+        double slow = recompile_ns(tokens, n, n + 64);
+        printf("  %8zu %11.1f ns %11.1f ns %8.1fx\n", n, fast, slow, slow / fast);
+        if (!first) first = fast;
+        last = fast;
+        last_recompile = slow;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "cost at %zu tokens within 3× of at 16", largest);
+    failures += check(name, last < 3 * first);
+    failures += check("faster than recompiling at the longest", last * 4 < last_recompile);
+
+    // The budget: a long expression read from scratch stops early when
+    // given no time, and finishes over later calls
+    ExprPreview preview;
+    int calls = 1;
+    bool done = preview.update(&tokens[0], largest, 0);
+    for (; !done && calls < 100000; calls++) done = preview.update(&tokens[0], largest, 0);
+    double value = 0, expected = 0;
+    ExprCompiler compiler;
+    Program program;
+    // The preview leaves out a trailing operator or bracket, which would
+    // not compile
+    size_t operands = largest;
+    while (operands > 1 && !compiler.compile_tokens(&tokens[0], operands, program)) operands--;
+    bool compiled = compiler.compile_tokens(&tokens[0], operands, program);
+    expected = program.run().value;
+    failures += check("no time budget: done over several calls, same value",
+                      done && calls > 1 && compiled && preview.value(&value) && same_bits(value, expected));
+    return failures;
+}
+
+// Random token sequences, grammatical or not. Wherever a prefix compiles
+// and runs, the preview of it must be the same value; where it does not,
+// the preview must not pretend it does unless the prefix ends without an
+// operand.
+static int random_sequences(const Registers &registers, SymbolId name) {
+    static const TokenType TYPES[] = {TOK_NUMBER, TOK_NUMBER, TOK_NUMBER, TOK_CONSTANT, TOK_FUNCTION, TOK_PLUS,
+                                      TOK_MINUS, TOK_MINUS, TOK_MULTIPLY, TOK_DIVIDE, TOK_POWER, TOK_PERCENT,
+                                      TOK_FACTORIAL, TOK_SQUARE, TOK_LPAREN, TOK_LPAREN, TOK_RPAREN,
+                                      TOK_RPAREN, TOK_COMBINATION, TOK_PERMUTATION, TOK_NAME};
+    static const unsigned char FUNCTIONS[] = {OP_SIN, OP_COS, OP_TAN, OP_LOG, OP_LN, OP_SQRT};
+    static const double NUMBERS[] = {0, 1, 2, 3, 0.5, 7, 10, 30, 90, 170};
+    const size_t types = sizeof(TYPES) / sizeof(TYPES[0]);
+    printf("\nRandom token sequences\n");
+
+    ExprCompiler compiler;
+    compiler.set_registers(&registers);
+    Program program;
+    ExprPreview preview;
+    preview.set_registers(&registers);
+    unsigned long compared = 0, mismatches = 0, false_values = 0, edits = 0;
+    for (int sequence = 0; sequence < 20000; sequence++) {
+        std::vector<Token> tokens;
+        size_t length = 1 + next_random(24);
+        preview.changed(0);
+        for (size_t i = 0; i < length; i++) {
+            TokenType type = TYPES[next_random(types)];
+            Token tok = make_token(type);
+            if (type == TOK_NUMBER) tok.value = NUMBERS[next_random(10)];
+            if (type == TOK_CONSTANT) {
+                tok.op = next_random(2) ? CONST_PI : CONST_E;
+                tok.value = tok.op == CONST_PI ? M_PI : M_E;
+            }
+            if (type == TOK_FUNCTION) tok.op = FUNCTIONS[next_random(6)];
+            if (type == TOK_NAME) tok.symbol = name;
+            // Now and then edit an earlier token instead of appending
+            if (tokens.size() > 2 && next_random(5) == 0) {
+                size_t at = next_random(tokens.size());
+                tokens[at] = tok;
+                preview.changed(at);
+                edits++;
+            } else {
+                tokens.push_back(tok);
+            }
+
+            preview.update(&tokens[0], tokens.size(), NO_BUDGET);
+            double value = 0;
+            bool has_value = preview.value(&value);
+            TokenType last = tokens.back().type;
+            bool ends_in_operand = last == TOK_NUMBER || last == TOK_CONSTANT || last == TOK_NAME ||
+                                   last == TOK_RPAREN || last == TOK_PERCENT || last == TOK_FACTORIAL ||
+                                   last == TOK_SQUARE;
+            if (compiler.compile_tokens(&tokens[0], tokens.size(), program)) {
+                EvalResult expected = program.run();
+                if (expected.status == EVAL_OK) {
+                    compared++;
+                    if (!has_value || !same_bits(value, expected.value)) mismatches++;
+                } else if (has_value) {
+                    false_values++;
+                }
+            } else if (has_value && ends_in_operand) {
+                false_values++;
+            }
+        }
+    }
+    printf("  %lu prefixes compared, %lu earlier tokens edited\n", compared, edits);
+    int failures = check("every value that runs is previewed, same bits", compared > 10000 && mismatches == 0);
+    failures += check("no value where \"=\" would fail", false_values == 0);
+    return failures;
+}
+
+// Whether the expression ends in an operand after command: "=" would
+// otherwise fill in the displayed value ("2+=" is 2+2) where the preview
+// leaves the operator out. ± keeps what was there; ")" and M+ are skipped.
+static bool leaves_operand(Command command, bool before) {
+    switch (command_info(command).kind) {
+        case KIND_DIGIT:
+        case KIND_DOUBLE_ZERO:
+        case KIND_DECIMAL:
+        case KIND_PERCENT:
+        case KIND_FUNCTION:
+        case KIND_CONSTANT:
+        case KIND_MEMORY_RECALL:
+            return true;
+        case KIND_SIGN:
+            return before;
+        default:
+            return false;
+    }
+}
+
+// Random keypad sessions: after each key that leaves an operand at the
+// end, the preview must be what pressing "=" then would show
+static int keypad_sessions() {
+    static const Command KEYS[] = {
+        CMD_DIGIT_1, CMD_DIGIT_2, CMD_DIGIT_3, CMD_DIGIT_5, CMD_DIGIT_9, CMD_DIGIT_0, CMD_DECIMAL, CMD_ADD,
+        CMD_SUBTRACT, CMD_MULTIPLY, CMD_DIVIDE, CMD_POWER, CMD_SIGN, CMD_PERCENT, CMD_BACKSPACE,
+        CMD_CLEAR_ENTRY, CMD_SIN, CMD_COS, CMD_SQRT, CMD_SQUARE, CMD_FACTORIAL, CMD_LN, CMD_PI, CMD_E,
+        CMD_LPAREN, CMD_LPAREN, CMD_RPAREN, CMD_RPAREN, CMD_COMBINATIONS, CMD_MEMORY_ADD, CMD_MEMORY_RECALL,
+        CMD_EQUALS};
+    const size_t key_count = sizeof(KEYS) / sizeof(KEYS[0]);
+    printf("\nKeypad sessions\n");
+
+    CalcEngine engine;
+    unsigned long compared = 0, mismatches = 0;
+    bool operand = false;
+    for (int key = 0; key < 200000; key++) {
+        Command command = KEYS[next_random(key_count)];
+        if (key % 40 == 0) command = CMD_ALL_CLEAR;
+        engine.press(command);
+        double value = 0;
+        PreviewStatus status = engine.preview(NO_BUDGET, &value);
+        operand = leaves_operand(command, operand);
+        if (!operand || status == PREVIEW_PENDING) continue;
+        CalcEngine after = engine;
+        unsigned long results = after.calculation_count();
+        after.press(CMD_EQUALS);
+        if (after.calculation_count() == results) continue; // Nothing to evaluate, or an error showing
+        compared++;
+        if (status != PREVIEW_READY || !same_bits(value, after.value())) mismatches++;
+    }
+    printf("  %lu keys compared with \"=\"\n", compared);
+    int failures = check("preview matches \"=\" after every operand key", compared > 10000 && mismatches == 0);
+
+    // A few by hand: a trailing operator is left out, brackets are closed
+    static const Command TYPED[] = {CMD_DIGIT_2, CMD_ADD, CMD_DIGIT_3, CMD_MULTIPLY, CMD_LPAREN, CMD_DIGIT_4,
+                                    CMD_SUBTRACT, CMD_DIGIT_1};
+    static const double SHOWN[] = {2, 2, 5, 5, 5, 14, 14, 11};
+    engine.press(CMD_ALL_CLEAR);
+    bool shown = true;
+    for (size_t i = 0; i < sizeof(TYPED) / sizeof(TYPED[0]); i++) {
+        engine.press(TYPED[i]);
+        double value = 0;
+        shown = shown && engine.preview(NO_BUDGET, &value) == PREVIEW_READY && value == SHOWN[i];
+    }
+    failures += check("2 + 3 × (4 − 1 previews 2, 5, 14, 11", shown);
+    engine.press(CMD_EQUALS);
+    double value = 0;
+    failures += check("nothing to preview after \"=\"", engine.preview(NO_BUDGET, &value) == PREVIEW_NONE);
+    engine.press(CMD_DIVIDE);
+    engine.press(CMD_DIGIT_0);
+    failures += check("nothing to preview for 11 ÷ 0", engine.preview(NO_BUDGET, &value) == PREVIEW_NONE);
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    size_t largest = 4096;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--tokens") == 0) {
+            largest = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0) {
+            lcg_state = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (largest < 64) largest = 64;
+
+    Registers registers;
+    SymbolId rate = registers.intern("rate", 4);
+    registers.set(rate, 0.25);
+
+    int failures = scaling(largest);
+    failures += random_sequences(registers, rate);
+    failures += keypad_sessions();
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+// Register benchmark: interning and looking up names, evaluating programs
+// that read registers against the same program with constants, and
+// saving and loading a snapshot. Also checks how names tokenize ("x2"
+// stays x×2 until x2 is defined), batch assignments, memory slots and
+// that damaged snapshots are refused.
+#include "../calc_batch.h"
+#include "../calc_engine.h"
+#include "../calc_registers.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const size_t NAMES = 100000;
+static const int RUNS = 5000000;
+
+// Best of a few timings of RUNS evaluations, in ns each
+static double time_program(const Program &program, double *value) {
+    double best = 1e9;
+    for (int rep = 0; rep < 3; rep++) {
+        volatile double sink = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RUNS; i++) sink = sink + program.run().value;
+        double t = seconds_since(start) * 1e9 / RUNS;
+        if (t < best) best = t;
+    }
+    *value = program.run().value;
+    return best;
+}
+
+static std::string run_lines(const char *input, size_t digits = 0) {
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    fputs(input, in);
+    rewind(in);
+    run_batch(in, out, digits);
+    rewind(out);
+    std::string text;
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), out)) > 0) text.append(buf, n);
+    fclose(in);
+    fclose(out);
+    return text;
+}
+
+int main() {
+    int failures = 0;
+
+    printf("Interning %zu names\n", NAMES);
+    std::vector<std::string> names(NAMES);
+    char buf[64];
+    for (size_t i = 0; i < NAMES; i++) {
+        snprintf(buf, sizeof(buf), "v%zu_%zx", i, i * 2654435761u);
+        names[i] = buf;
+    }
+    Registers registers;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < NAMES; i++) registers.intern(names[i].data(), names[i].size());
+    double intern_time = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    bool all_found = true;
+    for (size_t i = 0; i < NAMES; i++) {
+        all_found = all_found && registers.find(names[i].data(), names[i].size()) == i;
+    }
+    double find_time = seconds_since(start);
+    printf("  intern      %8.1f ns each\n", intern_time * 1e9 / NAMES);
+    printf("  find        %8.1f ns each\n", find_time * 1e9 / NAMES);
+    failures += check("every name finds its id", all_found && registers.size() == NAMES);
+    failures += check("interning again returns the same id",
+                      registers.intern(names[7].data(), names[7].size()) == 7 && registers.size() == NAMES);
+    failures += check("unknown names are not added", registers.find("nope", 4) == NO_SYMBOL && registers.size() == NAMES);
+
+    printf("\nEvaluation, %d runs each\n", RUNS);
+    SymbolId rate = registers.intern("rate", 4);
+    SymbolId fee = registers.intern("fee", 3);
+    registers.set(rate, 0.05);
+    registers.set(fee, 3);
+    ExprCompiler compiler;
+    compiler.set_registers(&registers);
+    Program named, constant;
+    const char *named_text = "1000×(1+rate)^12+fee×(2+rate)";
+    const char *constant_text = "1000×(1+0.05)^12+3×(2+0.05)";
+    bool compiled = compiler.compile(named_text, strlen(named_text), named);
+    compiled = compiler.compile(constant_text, strlen(constant_text), constant) && compiled;
+    failures += check("both programs compile", compiled);
+    double named_value, constant_value;
+    double named_ns = time_program(named, &named_value);
+    double constant_ns = time_program(constant, &constant_value);
+    printf("  registers   %8.1f ns each\n", named_ns);
+    printf("  constants   %8.1f ns each\n", constant_ns);
+    failures += check("registers give the constants' result", named_value == constant_value);
+    failures += check("reading registers costs no more than 1.5x constants", named_ns < constant_ns * 1.5);
+    registers.set(rate, 0);
+    failures += check("a new value is used without recompiling", named.run().value == 1000 + 3 * 2);
+    registers.remove(fee);
+    EvalResult removed = named.run();
+    failures += check("a removed register fails", removed.status == EVAL_INVALID_INPUT && removed.failed_op == OP_LOAD);
+
+    printf("\nNames in expressions\n");
+    Program p;
+    failures += check("x2 is x×2 while x2 is undefined",
+                      compiler.compile("x2", 2, p) && p.uses_variable() && p.run(3).value == 6);
+    registers.set(registers.intern("x2", 2), 10);
+    failures += check("x2 is the register once defined",
+                      compiler.compile("x2", 2, p) && !p.uses_variable() && p.run(3).value == 10);
+    failures += check("rate2 is rate×2", compiler.compile("rate2", 5, p) && p.run().value == 0);
+    registers.set(rate, 4);
+    failures += check("2rate and rate(3) multiply", compiler.compile("2rate+rate(3)", 13, p) && p.run().value == 20);
+    failures += check("undefined names are unknown",
+                      !compiler.compile("fee+1", 5, p) && strcmp(compiler.error(), "Unknown name") == 0);
+    failures += check("built-in names cannot be registers",
+                      !Registers::valid_name("sin", 3) && !Registers::valid_name("e", 1) &&
+                      !Registers::valid_name("2a", 2) && Registers::valid_name("a_2", 3));
+
+    printf("\nSnapshot of %zu registers\n", NAMES);
+    for (size_t i = 0; i < NAMES; i++) registers.set((SymbolId)i, i * 0.5, i % 10 == 0 ? "12345678901234567890.5" : NULL);
+    char path[] = "/tmp/bench_registers_XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    ::close(tmp);
+    start = std::chrono::steady_clock::now();
+    bool saved = registers.save(path);
+    double save_time = seconds_since(start);
+    Registers loaded;
+    start = std::chrono::steady_clock::now();
+    bool read = loaded.load(path);
+    double load_time = seconds_since(start);
+    printf("  save        %8.3f ms\n", save_time * 1e3);
+    printf("  load        %8.3f ms\n", load_time * 1e3);
+    bool same = saved && read;
+    for (size_t i = 0; same && i < registers.size(); i++) {
+        SymbolId id = loaded.find(registers.name((SymbolId)i), strlen(registers.name((SymbolId)i)));
+        if (!registers.is_defined((SymbolId)i)) {
+            same = id == NO_SYMBOL || !loaded.is_defined(id);
+            continue;
+        }
+        same = id != NO_SYMBOL && loaded.value(id) == registers.value((SymbolId)i) &&
+               loaded.exact_text(id) == registers.exact_text((SymbolId)i);
+    }
+    failures += check("snapshot reads back as written", same);
+
+    Registers small;
+    small.set(small.intern("kept", 4), 42);
+    FILE *f = fopen(path, "r+b");
+    fseek(f, 100, SEEK_SET);
+    fputc('!', f);
+    fclose(f);
+    SymbolId kept = small.find("kept", 4);
+    failures += check("a damaged snapshot is refused",
+                      !small.load(path) && small.is_defined(kept) && small.value(kept) == 42);
+    unlink(path);
+    failures += check("a missing snapshot is refused", !small.load(path));
+
+    printf("\nBatch and keypad\n");
+    failures += check("batch assignments and ans",
+                      run_lines("a = 3\nb = a^2\nans+1\nsin = 2\nc=b+a\n") == "3\n9\n10\nError\n12\n");
+    failures += check("precision batch keeps registers exact",
+                      run_lines("third = 1/3\nthird×3\n", 30) ==
+                          "0.333333333333333333333333333333\n0.999999999999999999999999999999\n");
+
+    CalcEngine engine;
+    engine.press(CMD_DIGIT_7);
+    engine.press(CMD_MEMORY_ADD);
+    engine.select_memory_slot(1);
+    engine.press(CMD_DIGIT_5);
+    engine.press(CMD_MEMORY_ADD);
+    engine.press(CMD_MEMORY_ADD);
+    engine.select_memory_slot(0);
+    engine.press(CMD_ALL_CLEAR);
+    engine.press(CMD_MEMORY_RECALL);
+    const Registers &slots = engine.variables();
+    failures += check("memory slots are separate",
+                      engine.value() == 7 && slots.value(engine.memory_symbol(1)) == 10);
+    engine.press(CMD_DIGIT_2);
+    failures += check("store_variable refuses bad names", !engine.store_variable("pi", 2));
+    engine.store_variable("two", 3);
+    engine.press(CMD_ALL_CLEAR);
+    engine.press(CMD_DIGIT_3);
+    engine.press(CMD_MULTIPLY);
+    engine.insert_variable(slots.find("two", 3));
+    engine.press(CMD_EQUALS);
+    failures += check("an inserted name shows and evaluates",
+                      engine.value() == 6 && strcmp(engine.history_text(), "3×two = 6") == 0);
+    failures += check("= sets ans", slots.value(slots.find("ans", 3)) == 6);
+
+    engine.set_precision(50);
+    engine.press(CMD_MEMORY_CLEAR);
+    engine.press(CMD_DIGIT_1);
+    engine.press(CMD_DIVIDE);
+    engine.press(CMD_DIGIT_3);
+    engine.press(CMD_EQUALS);
+    engine.press(CMD_MEMORY_ADD);
+    engine.press(CMD_ALL_CLEAR);
+    engine.press(CMD_MEMORY_RECALL);
+    failures += check("precision memory keeps its digits",
+                      engine.display_text() == "0." + std::string(50, '3') &&
+                      slots.value(engine.memory_symbol(0)) == 1.0 / 3);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
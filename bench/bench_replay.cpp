@@ -0,0 +1,123 @@
+// Session replay benchmark. With session files as arguments, replays each
+// against a fresh engine and fails on any mismatch (make replay runs the
+// recorded sessions in bench/sessions this way). Without arguments,
+// records a long random session, replays it with and without checking
+// the output, and checks that drift and damaged files are caught.
+#include "../calc_session.h"
+#include "bench_util.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+static const unsigned long KEYS = 200000;
+
+// Mostly digits and operators, with every other input now and then
+static void record_random_session(const char *path, unsigned long keys) {
+    static const Command common[] = {
+        CMD_DIGIT_1, CMD_DIGIT_2, CMD_DIGIT_3, CMD_DIGIT_4, CMD_DIGIT_5, CMD_DIGIT_6, CMD_DIGIT_7,
+        CMD_DIGIT_8, CMD_DIGIT_9, CMD_DIGIT_0, CMD_DECIMAL, CMD_ADD, CMD_SUBTRACT, CMD_MULTIPLY,
+        CMD_DIVIDE, CMD_EQUALS, CMD_EQUALS, CMD_LPAREN, CMD_RPAREN, CMD_BACKSPACE};
+    CalcEngine engine;
+    SessionRecorder recorder;
+    recorder.open(path, engine);
+    srand(12345);
+    for (unsigned long i = 0; i < keys; i++) {
+        int roll = rand() % 100;
+        if (roll < 90) {
+            Command command = common[rand() % (sizeof(common) / sizeof(common[0]))];
+            engine.press(command);
+            recorder.press(command, engine);
+        } else if (roll < 98) {
+            Command command = (Command)(1 + rand() % (CMD_COUNT - 1));
+            engine.press(command);
+            recorder.press(command, engine);
+        } else if (roll == 98) {
+            size_t slot = rand() % MEMORY_SLOTS;
+            engine.select_memory_slot(slot);
+            recorder.select_memory_slot(slot, engine);
+        } else if (rand() % 2) {
+            if (engine.store_variable("r", 1)) recorder.store_variable("r", 1, engine);
+        } else {
+            SymbolId id = engine.variables().find("r", 1);
+            engine.insert_variable(id);
+            recorder.insert_variable(id, engine);
+        }
+    }
+    recorder.close(engine);
+}
+
+static int replay_files(int argc, char *argv[]) {
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (replay_session(argv[i], 1, true, stdout) != 0) status = 1;
+    }
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) return replay_files(argc, argv);
+    int failures = 0;
+
+    char path[] = "/tmp/bench_replay_XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    ::close(tmp);
+    record_random_session(path, KEYS);
+
+    Session session;
+    bool loaded = session.load(path);
+    printf("Random session, %lu events\n", session.events());
+    failures += check("the recording loads", loaded && session.keystrokes() > KEYS * 9 / 10);
+
+    ReplayReport verified, unverified;
+    bool first_ok = true, same = true;
+    for (int rep = 0; rep < 3; rep++) {
+        CalcEngine engine;
+        ReplayReport r;
+        first_ok = session.replay(engine, true, &r) && first_ok;
+        if (rep == 0 || r.seconds < verified.seconds) verified = r;
+        CalcEngine fast;
+        session.replay(fast, false, &r);
+        if (rep == 0 || r.seconds < unverified.seconds) unverified = r;
+        same = same && strcmp(fast.display_text(), engine.display_text()) == 0;
+    }
+    printf("  verified    %12.0f keystrokes/s\n", verified.keystrokes / verified.seconds);
+    printf("  unverified  %12.0f keystrokes/s\n", unverified.keystrokes / unverified.seconds);
+    failures += check("every check matches on replay", first_ok && verified.checks > 1000);
+    failures += check("replays end in the same state", same);
+
+    std::string data;
+    FILE *f = fopen(path, "rb");
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    fclose(f);
+
+    // The final check ends with the history text; flip its last byte
+    data[data.size() - 1] ^= 0x01;
+    f = fopen(path, "wb");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    Session changed;
+    ReplayReport drift;
+    CalcEngine engine;
+    failures += check("a changed result is reported",
+                      changed.load(path) && !changed.replay(engine, true, &drift) && drift.mismatches == 1 &&
+                      drift.mismatch_event == session.events());
+
+    f = fopen(path, "wb");
+    fwrite(data.data(), 1, data.size() - 3, f);
+    fclose(f);
+    failures += check("a truncated session is refused",
+                      !changed.load(path) && strcmp(changed.error(), "damaged session file") == 0);
+    unlink(path);
+    failures += check("a missing session is refused", !changed.load(path));
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+// Load test for calculator --serve. Opens several connections, keeps a
+// number of pipelined requests in flight on each, and reports requests
+// and expressions per second and the latency distribution of replies.
+// Every reply is compared with what --batch gives for the same lines.
+//
+//   bench/bench_server [--socket PATH] [--connections N] [--depth N]
+//                      [--batch N] [--seconds S] [--threads N]
+//
+// Without --socket it starts a server in this process on a temporary
+// socket and also checks pipelining, split frames and bad frames.
+#include "../calc_batch.h"
+#include "../calc_latency.h"
+#include "../calc_server.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const char *const EXPRESSIONS[] = {
+    "12+3*4", "sin(30)+cos(60)", "2^0.5", "10!", "(1+2)*(3+4)/5", "r = 7", "r^2+ans", "52nCr5",
+    "1/0", "sqrt(2)", "log(1000)-ln(e)", "1.5*(2+r)"};
+static const size_t EXPRESSION_COUNT = sizeof(EXPRESSIONS) / sizeof(EXPRESSIONS[0]);
+
+struct Options {
+    const char *socket;
+    int connections;
+    size_t depth;
+    size_t batch;
+    double seconds;
+    size_t threads;
+};
+
+// Request text and expected reply for a batch starting at each expression
+struct Workload {
+    std::vector<std::string> requests;
+    std::vector<std::string> replies;
+
+    explicit Workload(size_t batch) {
+        BatchEvaluator evaluator;
+        for (size_t start = 0; start < EXPRESSION_COUNT; start++) {
+            std::string text, reply;
+            evaluator.reset();
+            for (size_t i = 0; i < batch; i++) {
+                const char *line = EXPRESSIONS[(start + i) % EXPRESSION_COUNT];
+                text += line;
+                text += '\n';
+                evaluator.evaluate(line, strlen(line), 0, reply);
+            }
+            requests.push_back(text);
+            replies.push_back(reply);
+        }
+    }
+};
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void put_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out += (char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const char *p) {
+    const unsigned char *b = (const unsigned char *)p;
+    return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static std::string request_frame(uint32_t id, uint32_t digits, const std::string &text) {
+    std::string frame;
+    put_u32(frame, (uint32_t)(8 + text.size()));
+    put_u32(frame, id);
+    put_u32(frame, digits);
+    return frame + text;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n <= 0) return false;
+        got += (size_t)n;
+    }
+    return true;
+}
+
+// One reply: its id and text; false when the server closed the connection
+static bool read_reply(int fd, uint32_t *id, std::string &text) {
+    char header[8];
+    if (!recv_all(fd, header, 4)) return false;
+    uint32_t len = get_u32(header);
+    if (len < 4 || !recv_all(fd, header + 4, 4)) return false;
+    *id = get_u32(header + 4);
+    text.resize(len - 4);
+    return len == 4 || recv_all(fd, &text[0], len - 4);
+}
+
+struct ClientResult {
+    LatencyHistogram latency;
+    unsigned long requests;
+    unsigned long wrong;
+    bool failed;
+};
+
+// Keeps `depth` requests in flight until time is up, then drains. The id
+// of a request is its slot in the window.
+static void run_client(const Options &options, const Workload &workload, ClientResult *result) {
+    result->requests = 0;
+    result->wrong = 0;
+    result->failed = true;
+    int fd = connect_to(options.socket);
+    if (fd < 0) return;
+    std::vector<int64_t> sent(options.depth);
+    std::vector<size_t> start(options.depth);
+    std::string batch;
+    size_t next = 0;
+    for (size_t slot = 0; slot < options.depth; slot++) {
+        start[slot] = next++ % EXPRESSION_COUNT;
+        sent[slot] = now_us();
+        batch += request_frame((uint32_t)slot, 0, workload.requests[start[slot]]);
+    }
+    if (!send_all(fd, batch)) {
+        close(fd);
+        return;
+    }
+    int64_t deadline = now_us() + (int64_t)(options.seconds * 1e6);
+    size_t outstanding = options.depth;
+    std::string reply;
+    while (outstanding > 0) {
+        uint32_t id;
+        if (!read_reply(fd, &id, reply) || id >= options.depth) break;
+        int64_t now = now_us();
+        result->latency.record(now - sent[id]);
+        result->requests++;
+        if (reply != workload.replies[start[id]]) result->wrong++;
+        if (now >= deadline) {
+            outstanding--;
+            continue;
+        }
+        start[id] = next++ % EXPRESSION_COUNT;
+        sent[id] = now;
+        if (!send_all(fd, request_frame(id, 0, workload.requests[start[id]]))) break;
+    }
+    result->failed = outstanding > 0;
+    close(fd);
+}
+
+static bool load_test(const Options &options, unsigned long *requests) {
+    Workload workload(options.batch);
+    std::vector<ClientResult> results(options.connections);
+    std::vector<std::thread> clients;
+    int64_t started = now_us();
+    for (int i = 0; i < options.connections; i++) {
+        clients.push_back(std::thread(run_client, std::cref(options), std::cref(workload), &results[i]));
+    }
+    for (size_t i = 0; i < clients.size(); i++) clients[i].join();
+    double elapsed = (now_us() - started) / 1e6;
+
+    LatencyHistogram latency;
+    unsigned long wrong = 0;
+    bool failed = false;
+    *requests = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        latency.merge(results[i].latency);
+        *requests += results[i].requests;
+        wrong += results[i].wrong;
+        failed = failed || results[i].failed;
+    }
+    printf("%d connections, %zu requests in flight each, %zu expressions per request, %.1f s\n",
+           options.connections, options.depth, options.batch, elapsed);
+    printf("  requests    %10lu  %12.0f/s\n", *requests, *requests / elapsed);
+    printf("  expressions %10lu  %12.0f/s\n", *requests * options.batch, *requests * options.batch / elapsed);
+    printf("  latency     p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+           (unsigned long long)latency.percentile(0.5), (unsigned long long)latency.percentile(0.9),
+           (unsigned long long)latency.percentile(0.99), (unsigned long long)latency.percentile(0.999),
+           (unsigned long long)latency.max());
+    if (failed) printf("  a connection failed before its last reply\n");
+    if (wrong) printf("  %lu replies differ from --batch\n", wrong);
+    return !failed && wrong == 0;
+}
+
+// Protocol details the load test does not exercise
+static int protocol_checks(const char *path) {
+    int failures = 0;
+    printf("\nProtocol\n");
+
+    int fd = connect_to(path);
+    std::string frames = request_frame(1, 0, "1+1\n") + request_frame(2, 30, "1/3") + request_frame(3, 0, "");
+    bool ok = fd >= 0;
+    // One byte at a time: frames split anywhere are reassembled
+    for (size_t i = 0; ok && i < frames.size(); i++) ok = send_all(fd, frames.substr(i, 1));
+    std::string replies[4];
+    for (int i = 0; ok && i < 3; i++) {
+        uint32_t id;
+        std::string text;
+        ok = read_reply(fd, &id, text) && id >= 1 && id <= 3;
+        if (ok) replies[id] = text;
+    }
+    failures += check("split and pipelined requests are answered", ok);
+    failures += check("double and precision replies",
+                      replies[1] == "2\n" && replies[2] == "0.333333333333333333333333333333\n");
+    failures += check("an empty request gets an empty reply", ok && replies[3].empty());
+
+    int bad = connect_to(path);
+    std::string garbage("\x03\x00\x00\x00xyz", 7); // Shorter than a request header
+    send_all(bad, garbage);
+    uint32_t id;
+    std::string text;
+    failures += check("a malformed frame closes its connection", !read_reply(bad, &id, text));
+    close(bad);
+    ok = send_all(fd, request_frame(9, 0, "r = 2\nr^10\nans+r")) && read_reply(fd, &id, text);
+    failures += check("other connections carry on", ok && id == 9 && text == "2\n1024\n1026\n");
+    ok = send_all(fd, request_frame(10, 0, "r")) && read_reply(fd, &id, text);
+    failures += check("requests share no registers", ok && text == "Error\n");
+    close(fd);
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    Options options = {NULL, 4, 32, 8, 2.0, 0};
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (has_value && strcmp(argv[i], "--socket") == 0) {
+            options.socket = argv[++i];
+        } else if (has_value && strcmp(argv[i], "--connections") == 0) {
+            options.connections = atoi(argv[++i]);
+        } else if (has_value && strcmp(argv[i], "--depth") == 0) {
+            options.depth = strtoul(argv[++i], NULL, 10);
+        } else if (has_value && strcmp(argv[i], "--batch") == 0) {
+            options.batch = strtoul(argv[++i], NULL, 10);
+        } else if (has_value && strcmp(argv[i], "--seconds") == 0) {
+            options.seconds = atof(argv[++i]);
+        } else if (has_value && strcmp(argv[i], "--threads") == 0) {
+            options.threads = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.connections < 1 || options.depth < 1 || options.batch < 1) {
+        fprintf(stderr, "--connections, --depth and --batch must be at least 1\n");
+        return 1;
+    }
+    unsigned long requests;
+    if (options.socket) return load_test(options, &requests) ? 0 : 1;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_server_%d.sock", (int)getpid());
+    options.socket = path;
+    EvalServer server;
+    if (!server.start(path, options.threads)) return 1;
+    printf("In-process server, %zu evaluator threads\n", server.thread_count());
+    int failures = 0;
+    failures += check("every reply matches --batch", load_test(options, &requests));
+    failures += check("the server counted every request", server.requests() == requests);
+    failures += protocol_checks(path);
+    server.stop();
+    failures += check("stopping removes the socket", access(path, F_OK) != 0);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+// Statistics ingestion benchmark: writes a file of numbers, one per line,
+// and times reading it raw, summarising it through the memory map on one
+// thread and on every core, and the fgets/strtod loop it replaces, in MB/s.
+// Checks the summary against a two-pass long double reference and the
+// quantiles against the sorted values, and the corner cases: cancellation,
+// CSV fields, stdin and split points.
+//
+//   bench/bench_stats [--megabytes N] [--threads N]
+#include "../calc_stats.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static bool close_to(double a, double b, double tolerance) {
+    return fabs(a - b) <= tolerance * fabs(b);
+}
+
+static unsigned long long lcg_state = 12345;
+static double next_uniform() {
+    lcg_state = lcg_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((lcg_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Normally distributed around 1000, printed to 6 decimals; values holds
+// them as read back
+static bool write_numbers(const char *path, size_t megabytes, std::vector<double> &values) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    size_t written = 0;
+    char line[64];
+    while (written < megabytes << 20) {
+        double u = next_uniform(), v = next_uniform();
+        double x = 1000 + 50 * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+        int n = snprintf(line, sizeof(line), "%.6f\n", x);
+        fwrite(line, 1, n, f);
+        values.push_back(strtod(line, NULL));
+        written += n;
+    }
+    return fclose(f) == 0;
+}
+
+static double read_raw(const char *path) {
+    FILE *f = fopen(path, "rb");
+    static char block[1 << 20];
+    size_t n, checksum = 0;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0) checksum += (unsigned char)block[n - 1];
+    fclose(f);
+    return (double)checksum;
+}
+
+// What a caller would write without calc_stats: a line at a time
+static double naive_mean(const char *path) {
+    FILE *f = fopen(path, "rb");
+    char line[256];
+    double sum = 0;
+    size_t n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        sum += strtod(line, NULL);
+        n++;
+    }
+    fclose(f);
+    return sum / n;
+}
+
+static ColumnStats summarize(const char *text, size_t field) {
+    StatsOptions options = {field, 1};
+    ColumnStats stats;
+    summarize_text(text, strlen(text), options, &stats);
+    return stats;
+}
+
+static int corner_cases() {
+    int failures = 0;
+    printf("\nCorner cases\n");
+
+    ColumnStats s = summarize("1000000004\n1000000007\n1000000013\n1000000016\n", 0);
+    failures += check("Welford: 1e9 + 4, 7, 13, 16 has variance 30", s.variance() == 30 && s.mean() == 1000000010);
+    s = summarize("1e16 1 -1e16 1e-3 1e16 -1e16", 0);
+    failures += check("compensated sum of 1e16, 1, -1e16, ... is 1.001", s.total() == 1.001);
+    s = summarize("1 2, 3;4\n-5 +6 abc 1e3 \"7\" 2x\n", 0);
+    failures += check("every number: 8 values, 2 skipped", s.count() == 8 && s.skipped_count() == 2 && s.total() == 1018);
+    s = summarize("name,value\r\na, 1.5\r\nb,\"-2\"\r\n\r\nc,\nd,x\ne\n", 2);
+    failures += check("CSV field 2: 2 values, header and 3 bad skipped",
+                      s.count() == 2 && s.total() == -0.5 && s.skipped_count() == 4);
+    s = summarize("5", 1);
+    failures += check("one value: variance 0, every quantile is it",
+                      s.variance() == 0 && s.quantile(0.5) == 5 && s.quantile(0.99) == 5);
+    s = summarize("", 0);
+    failures += check("no values: count 0, mean NaN", s.count() == 0 && std::isnan(s.mean()));
+    s = summarize("-3 -1 0 0 2 4 1e300 -1e-300 5e-324", 0);
+    failures += check("signs, zeros, extremes: quantiles in order",
+                      s.quantile(0.1) == -3 && s.quantile(0.2) < -0.99 && s.quantile(0.2) > -1.01 &&
+                      s.quantile(0.5) == 0 && s.quantile(1) == 1e300 &&
+                          fabs(s.quantile(0.95) / 1e300 - 1) <= QuantileSketch::RELATIVE_ERROR);
+    s = summarize("1e999 -1e999 2", 0);
+    failures += check("infinities are skipped", s.count() == 1 && s.skipped_count() == 2);
+
+    // The same text read whole, split for four threads and streamed agree
+    std::string text;
+    for (int i = 0; i < 4500000; i++) text += std::to_string(i % 977) + (i % 3 ? " " : "\n");
+    StatsOptions four = {0, 4};
+    ColumnStats one = summarize(text.c_str(), 0), split;
+    summarize_text(text.data(), text.size(), four, &split);
+    char path[] = "/tmp/bench_stats_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text.data(), text.size()) != (ssize_t)text.size()) return failures + 1;
+    close(fd);
+    FILE *f = fopen(path, "rb");
+    ColumnStats streamed;
+    summarize_stream(f, four, &streamed);
+    fclose(f);
+    unlink(path);
+    bool same = one.count() == 4500000 && split.count() == one.count() && streamed.count() == one.count() &&
+                split.total() == one.total() && streamed.total() == one.total();
+    for (int i = 1; i < 100; i++) {
+        same = same && split.quantile(i / 100.0) == one.quantile(i / 100.0) &&
+               streamed.quantile(i / 100.0) == one.quantile(i / 100.0);
+    }
+    failures += check("whole, split and streamed summaries agree", same);
+
+    std::string error;
+    failures += check("a missing file is refused", !summarize_file(path, four, &streamed, &error) && !error.empty());
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = 32;
+    size_t threads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--megabytes") == 0) {
+            megabytes = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (megabytes == 0) megabytes = 1;
+
+    char path[] = "/tmp/bench_stats_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    std::vector<double> values;
+    if (!write_numbers(path, megabytes, values)) {
+        perror(path);
+        unlink(path);
+        return 1;
+    }
+    double mb = (double)(megabytes << 20) / 1e6;
+    printf("%zu MB, %zu values\n", megabytes, values.size());
+
+    // Warm the page cache, then take the best of three for each reader
+    read_raw(path);
+    double raw = 1e9, naive = 1e9, single = 1e9, parallel = 1e9;
+    ColumnStats one, all;
+    StatsOptions single_options = {0, 1}, parallel_options = {0, threads};
+    std::string error;
+    for (int rep = 0; rep < 3; rep++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        read_raw(path);
+        raw = std::min(raw, seconds_since(start));
+        start = std::chrono::steady_clock::now();
+        naive_mean(path);
+        naive = std::min(naive, seconds_since(start));
+        one.clear();
+        start = std::chrono::steady_clock::now();
+        summarize_file(path, single_options, &one, &error);
+        single = std::min(single, seconds_since(start));
+        all.clear();
+        start = std::chrono::steady_clock::now();
+        summarize_file(path, parallel_options, &all, &error);
+        parallel = std::min(parallel, seconds_since(start));
+    }
+    unlink(path);
+    printf("  raw read          %8.0f MB/s\n", mb / raw);
+    printf("  fgets + strtod    %8.0f MB/s\n", mb / naive);
+    printf("  summary, 1 thread %8.0f MB/s\n", mb / single);
+    char label[32];
+    snprintf(label, sizeof(label), "summary, %zu threads", threads ? threads : (size_t)sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  %-18s%8.0f MB/s\n", label, mb / parallel);
+    printf("  sketch memory     %8zu bytes\n", all.quantiles().memory());
+
+    // Two-pass reference in long double
+    long double sum = 0, squares = 0;
+    for (size_t i = 0; i < values.size(); i++) sum += values[i];
+    long double mean = sum / values.size();
+    for (size_t i = 0; i < values.size(); i++) squares += (values[i] - mean) * (values[i] - mean);
+    double variance = (double)(squares / (values.size() - 1));
+    std::vector<double> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    double worst = 0;
+    for (int i = 1; i < 1000; i++) {
+        double p = i / 1000.0;
+        size_t rank = (size_t)ceil(p * sorted.size());
+        double exact = sorted[rank - 1];
+        worst = std::max(worst, fabs(all.quantile(p) - exact) / fabs(exact));
+    }
+    printf("  worst quantile error %.5f%%\n", worst * 100);
+
+    printf("\n");
+    int failures = 0;
+    failures += check("every value is counted", one.count() == values.size() && all.count() == values.size() &&
+                                                    all.skipped_count() == 0);
+    failures += check("sum and mean match the reference", close_to(all.total(), (double)sum, 1e-15) &&
+                                                             close_to(all.mean(), (double)mean, 1e-15));
+    failures += check("variance matches the two-pass reference", close_to(all.variance(), variance, 1e-12) &&
+                                                                    close_to(one.variance(), variance, 1e-12));
+    failures += check("min and max are exact", all.min() == sorted.front() && all.max() == sorted.back());
+    failures += check("quantiles within the sketch's relative error", worst <= QuantileSketch::RELATIVE_ERROR);
+    failures += check("sketch stays under 64 KB", all.quantiles().memory() < 65536);
+    failures += check("one thread beats fgets + strtod", single < naive);
+    failures += corner_cases();
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
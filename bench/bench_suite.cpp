@@ -0,0 +1,334 @@
+// Benchmark suite behind `make bench`: number formatting, the arithmetic
+// behind "=", every keypad function, keypad dispatch and the display text
+// the window reads after each key, all through the headless engine.
+//
+// Each case is warmed up, then timed as a number of samples, each a batch
+// of iterations sized to take about SAMPLE_TARGET; the median, 99th
+// percentile and fastest sample are reported per operation. Results go
+// to stdout as a table and, with --json, to a file with one case per
+// line in a fixed order, so two builds' files diff line by line.
+// --compare reads such a file and exits non-zero if any median got more
+// than --threshold percent slower.
+//
+//   bench_suite [--json FILE] [--compare FILE] [--threshold PCT]
+//               [--samples N] [--filter TEXT]
+#include "../calc_engine.h"
+#include "../calc_format.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const double WARMUP_SECONDS = 0.02;
+static const double SAMPLE_TARGET = 0.0002; // Seconds per sample
+static const size_t DEFAULT_SAMPLES = 101;
+
+struct Result {
+    std::string name;
+    double median; // ns per operation
+    double p99;
+    double min;
+    size_t samples;
+    size_t batch; // Iterations per sample
+};
+
+class Suite {
+private:
+    size_t sample_count;
+    const char *filter;
+    std::vector<Result> results;
+
+public:
+    Suite(size_t samples, const char *only) : sample_count(samples), filter(only) {}
+
+    // Times body(), which performs ops operations per call
+    template <class Body>
+    void run(const std::string &name, size_t ops, Body body) {
+        if (filter && name.find(filter) == std::string::npos) return;
+
+        // Warm caches and branch predictors, and size the batch from it
+        size_t calls = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed;
+        do {
+            body();
+            calls++;
+        } while ((elapsed = seconds_since(start)) < WARMUP_SECONDS);
+        size_t batch = (size_t)(SAMPLE_TARGET / (elapsed / calls));
+        if (batch == 0) batch = 1;
+
+        std::vector<double> times(sample_count);
+        for (size_t s = 0; s < sample_count; s++) {
+            start = Clock::now();
+            for (size_t i = 0; i < batch; i++) body();
+            times[s] = seconds_since(start) * 1e9 / ((double)batch * ops);
+        }
+        std::sort(times.begin(), times.end());
+
+        Result r;
+        r.name = name;
+        r.median = times[sample_count / 2];
+        r.p99 = times[std::min(sample_count - 1, (sample_count * 99 + 99) / 100 - 1)]; // Nearest rank
+        r.min = times[0];
+        r.samples = sample_count;
+        r.batch = batch;
+        results.push_back(r);
+        printf("  %-28s %10.1f %10.1f %10.1f\n", name.c_str(), r.median, r.p99, r.min);
+        fflush(stdout);
+    }
+
+    const std::vector<Result> &all() const { return results; }
+};
+
+static volatile size_t sink;
+
+// Each engine case types keys from a fresh AC
+static void press_all(CalcEngine &engine, const std::vector<Command> &keys) {
+    for (size_t i = 0; i < keys.size(); i++) engine.press(keys[i]);
+    sink = sink + (size_t)engine.value();
+}
+
+static void add_number(std::vector<Command> &keys, const char *digits) {
+    for (const char *c = digits; *c; c++) {
+        keys.push_back(*c == '.' ? CMD_DECIMAL : static_cast<Command>(CMD_DIGIT_0 + (*c - '0')));
+    }
+}
+
+static void format_cases(Suite &suite) {
+    static const struct {
+        const char *name;
+        double values[4];
+    } kinds[] = {
+        {"format/integer", {7, 42, 123456, 9876543210.0}},
+        {"format/decimal", {0.5, 12.75, 0.1 + 0.2, 1234.5678}},
+        {"format/irrational", {3.141592653589793, 2.718281828459045, 1.4142135623730951, 0.5773502691896257}},
+        {"format/exponent", {6.02214076e23, 1.602176634e-19, 1e300, 2.5e-308}},
+    };
+    char buf[FORMAT_BUFFER_SIZE];
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        const double *values = kinds[k].values;
+        // Shortest round trip, as --batch prints
+        suite.run(kinds[k].name, 4, [&]() {
+            for (int i = 0; i < 4; i++) sink = sink + format_number(values[i], buf, FORMAT_BUFFER_SIZE - 1);
+        });
+        // Rounded to the display's 15 digits, as the window shows
+        suite.run(std::string(kinds[k].name) + "/display", 4, [&]() {
+            for (int i = 0; i < 4; i++) sink = sink + format_number(values[i], buf, DISPLAY_WIDTH, DISPLAY_DIGITS);
+        });
+    }
+}
+
+static void equals_cases(Suite &suite, CalcEngine &engine) {
+    static const struct {
+        const char *name;
+        const char *left;
+        Command op;
+        const char *right;
+    } ops[] = {
+        {"add", "123.45", CMD_ADD, "6.7"},
+        {"subtract", "123.45", CMD_SUBTRACT, "6.7"},
+        {"multiply", "123.45", CMD_MULTIPLY, "6.7"},
+        {"divide", "123.45", CMD_DIVIDE, "6.7"},
+        {"power", "1.5", CMD_POWER, "12"},
+        {"combinations", "52", CMD_COMBINATIONS, "5"},
+        {"permutations", "10", CMD_PERMUTATIONS, "3"},
+    };
+    // Typing without "=" first, so the cost of "=" is the difference
+    std::vector<Command> keys;
+    keys.push_back(CMD_ALL_CLEAR);
+    add_number(keys, "123.45");
+    keys.push_back(CMD_ADD);
+    add_number(keys, "6.7");
+    suite.run("equals/typing-only", 1, [&]() { press_all(engine, keys); });
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        keys.clear();
+        keys.push_back(CMD_ALL_CLEAR);
+        add_number(keys, ops[i].left);
+        keys.push_back(ops[i].op);
+        add_number(keys, ops[i].right);
+        keys.push_back(CMD_EQUALS);
+        suite.run(std::string("equals/") + ops[i].name, 1, [&]() { press_all(engine, keys); });
+    }
+
+    // A longer expression, compiled and run as one program
+    keys.clear();
+    keys.push_back(CMD_ALL_CLEAR);
+    add_number(keys, "2");
+    keys.push_back(CMD_ADD);
+    keys.push_back(CMD_LPAREN);
+    add_number(keys, "3.5");
+    keys.push_back(CMD_MULTIPLY);
+    add_number(keys, "4");
+    keys.push_back(CMD_SUBTRACT);
+    add_number(keys, "1");
+    keys.push_back(CMD_RPAREN);
+    keys.push_back(CMD_POWER);
+    add_number(keys, "2");
+    keys.push_back(CMD_DIVIDE);
+    keys.push_back(CMD_PI);
+    keys.push_back(CMD_EQUALS);
+    suite.run("equals/expression", 1, [&]() { press_all(engine, keys); });
+}
+
+// ASCII case names, so results files stay plain
+static const char *function_name(unsigned char op) {
+    switch (op) {
+        case OP_SQRT: return "sqrt";
+        case OP_SQUARE: return "square";
+        default: return opcode_name(op);
+    }
+}
+
+// Every keypad function, applied to a freshly typed 30
+static void function_cases(Suite &suite, CalcEngine &engine) {
+    std::vector<Command> keys;
+    keys.push_back(CMD_ALL_CLEAR);
+    add_number(keys, "30");
+    suite.run("function/typing-only", 1, [&]() { press_all(engine, keys); });
+
+    for (int c = 0; c < CMD_COUNT; c++) {
+        const CommandInfo &info = command_info(static_cast<Command>(c));
+        if (info.kind != KIND_FUNCTION) continue;
+        keys.resize(3);
+        keys.push_back(info.command);
+        suite.run(std::string("function/") + function_name(info.arg), 1, [&]() { press_all(engine, keys); });
+    }
+}
+
+// A mixed session of every kind of key
+static const Command SESSION[] = {
+    CMD_DIGIT_1, CMD_DIGIT_2, CMD_DIGIT_3, CMD_DECIMAL, CMD_DIGIT_4, CMD_DIGIT_5, CMD_ADD,
+    CMD_DIGIT_6, CMD_DIGIT_7, CMD_MULTIPLY, CMD_LPAREN, CMD_DIGIT_8, CMD_SUBTRACT, CMD_DIGIT_9,
+    CMD_RPAREN, CMD_EQUALS, CMD_DIVIDE, CMD_DIGIT_3, CMD_EQUALS, CMD_SIN, CMD_ADD, CMD_PI,
+    CMD_SQUARE, CMD_EQUALS, CMD_MEMORY_ADD, CMD_ALL_CLEAR,
+    CMD_DIGIT_2, CMD_POWER, CMD_DIGIT_1, CMD_DIGIT_0, CMD_SUBTRACT, CMD_DIGIT_5, CMD_DIGIT_0,
+    CMD_DIGIT_0, CMD_PERCENT, CMD_EQUALS, CMD_SIGN, CMD_SQRT, CMD_BACKSPACE, CMD_CLEAR_ENTRY,
+    CMD_DIGIT_4, CMD_FACTORIAL, CMD_ADD, CMD_MEMORY_RECALL, CMD_EQUALS, CMD_LN, CMD_LOG,
+    CMD_DIGIT_1, CMD_DIVIDE, CMD_DIGIT_0, CMD_EQUALS, CMD_ALL_CLEAR, CMD_MEMORY_CLEAR
+};
+static const size_t SESSION_KEYS = sizeof(SESSION) / sizeof(SESSION[0]);
+
+static void session_cases(Suite &suite, CalcEngine &engine) {
+    // Dispatch and engine work alone
+    suite.run("dispatch/session", SESSION_KEYS, [&]() {
+        for (size_t i = 0; i < SESSION_KEYS; i++) engine.press(SESSION[i]);
+        sink = sink + (size_t)engine.value();
+    });
+    // Plus the display and history text the window commits each frame
+    suite.run("display/session", SESSION_KEYS, [&]() {
+        for (size_t i = 0; i < SESSION_KEYS; i++) {
+            engine.press(SESSION[i]);
+            sink = sink + strlen(engine.display_text()) + strlen(engine.history_text());
+        }
+    });
+    // Digit entry only, the commonest case
+    suite.run("display/typing", 10, [&]() {
+        engine.press(CMD_ALL_CLEAR);
+        for (int d = 1; d <= 9; d++) {
+            engine.press(static_cast<Command>(CMD_DIGIT_0 + d));
+            sink = sink + strlen(engine.display_text()) + strlen(engine.history_text());
+        }
+    });
+}
+
+static bool write_json(const char *path, const std::vector<Result> &results) {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "{\n  \"suite\": \"calculator\",\n  \"unit\": \"ns/op\",\n  \"compiler\": \"%s\",\n  \"results\": [\n",
+            __VERSION__);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"median\": %.2f, \"p99\": %.2f, \"min\": %.2f, \"samples\": %zu, \"batch\": %zu}%s\n",
+                r.name.c_str(), r.median, r.p99, r.min, r.samples, r.batch, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Reads back the name and median of each line write_json() wrote
+static bool read_medians(const char *path, std::vector<std::pair<std::string, double> > &out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *median = strstr(line, "\"median\": ");
+        if (!name || !median) continue;
+        name += strlen("\"name\": \"");
+        const char *end = strchr(name, '"');
+        if (!end) continue;
+        out.push_back(std::make_pair(std::string(name, end - name), atof(median + strlen("\"median\": "))));
+    }
+    fclose(f);
+    return true;
+}
+
+static int compare(const char *path, const std::vector<Result> &results, double threshold) {
+    std::vector<std::pair<std::string, double> > old;
+    if (!read_medians(path, old)) {
+        perror(path);
+        return 1;
+    }
+    printf("\nAgainst %s (regression past %.0f%%)\n", path, threshold);
+    int regressions = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        for (size_t j = 0; j < old.size(); j++) {
+            if (old[j].first != results[i].name || old[j].second <= 0) continue;
+            double change = (results[i].median / old[j].second - 1) * 100;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            printf("  %-28s %10.1f %10.1f %+8.1f%%%s\n", results[i].name.c_str(), old[j].second,
+                   results[i].median, change, regressed ? "  REGRESSED" : "");
+        }
+    }
+    printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json = NULL;
+    const char *baseline = NULL;
+    const char *filter = NULL;
+    double threshold = 10;
+    size_t samples = DEFAULT_SAMPLES;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (has_value && strcmp(argv[i], "--json") == 0) {
+            json = argv[++i];
+        } else if (has_value && strcmp(argv[i], "--compare") == 0) {
+            baseline = argv[++i];
+        } else if (has_value && strcmp(argv[i], "--threshold") == 0) {
+            threshold = atof(argv[++i]);
+        } else if (has_value && strcmp(argv[i], "--samples") == 0) {
+            samples = strtoul(argv[++i], NULL, 10);
+            if (samples == 0) samples = 1;
+        } else if (has_value && strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--json FILE] [--compare FILE] [--threshold PCT] [--samples N] [--filter TEXT]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    printf("  %-28s %10s %10s %10s   (ns/op)\n", "case", "median", "p99", "min");
+    Suite suite(samples, filter);
+    CalcEngine engine;
+    format_cases(suite);
+    equals_cases(suite, engine);
+    function_cases(suite, engine);
+    session_cases(suite, engine);
+
+    if (json && !write_json(json, suite.all())) {
+        perror(json);
+        return 1;
+    }
+    return baseline ? compare(baseline, suite.all(), threshold) : 0;
+}
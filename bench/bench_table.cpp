@@ -0,0 +1,241 @@
+// Table mode benchmark: points per second for each math kernel in every
+// kernel set this CPU has (scalar libm, SSE2, AVX2), whole expressions
+// through Program::run_vector against one Program::run per point, and
+// run_table end to end. Accuracy is checked against long double libm.
+#include "../calc_batch.h"
+#include "../calc_expr.h"
+#include "../calc_vecmath.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const size_t POINTS = 4096;
+static const size_t TOTAL_POINTS = 20000000;
+static const long double PI_L = 3.141592653589793238462643383279502884L;
+
+// Distance from the long double reference in units of the double's ulp
+static double ulp_error(double got, long double want) {
+    double w = (double)want;
+    if (std::isnan(got) || std::isnan(w)) return std::isnan(got) == std::isnan(w) ? 0 : 1e9;
+    if (std::isinf(w)) return got == w ? 0 : 1e9;
+    double ulp = nextafter(fabs(w), INFINITY) - fabs(w);
+    return (double)(fabsl((long double)got - want) / ulp);
+}
+
+// Trig reference with the same exact degree reduction as the kernels
+static long double trig_reference(double x, int which) {
+    long double d = remainderl(x, 90.0L);
+    long long q = ((long long)fmodl((x - d) / 90.0L, 4.0L) + 4) % 4;
+    long double s = sinl(d * PI_L / 180), c = cosl(d * PI_L / 180);
+    long double sines[4] = {s, c, -s, -c};
+    long double cosines[4] = {c, -s, -c, s};
+    if (which == 0) return sines[q];
+    if (which == 1) return cosines[q];
+    return sines[q] / cosines[q];
+}
+
+struct KernelCase {
+    const char *name;
+    double lo, hi;     // Input range (exponent of 10 for ln/log)
+    bool log_scale;
+    double max_ulps;   // Accuracy bound for the SIMD sets
+};
+
+static const KernelCase KERNEL_CASES[] = {
+    {"sin", -1e4, 1e4, false, 1},
+    {"cos", -1e4, 1e4, false, 1},
+    {"tan", -1e4, 1e4, false, 3},
+    {"log", -300, 300, true, 1.5},
+    {"ln", -300, 300, true, 1},
+    {"exp", -700, 700, false, 1},
+    {"sqrt", 0, 1e6, false, 0.5},
+    {"pow", -15, 15, true, 2},
+};
+
+static long double reference(size_t kernel, double x, double y) {
+    switch (kernel) {
+        case 0: return trig_reference(x, 0);
+        case 1: return trig_reference(x, 1);
+        case 2: return trig_reference(x, 2);
+        case 3: return log10l(x);
+        case 4: return logl(x);
+        case 5: return expl(x);
+        case 6: return sqrtl(x);
+        default: return powl(x, y);
+    }
+}
+
+static void run_kernel(const VecMath &math, size_t kernel, const double *x, const double *y, double *out) {
+    switch (kernel) {
+        case 0: math.sin_degrees(x, out, POINTS); break;
+        case 1: math.cos_degrees(x, out, POINTS); break;
+        case 2: math.tan_degrees(x, out, POINTS); break;
+        case 3: math.log10(x, out, POINTS); break;
+        case 4: math.ln(x, out, POINTS); break;
+        case 5: math.exp(x, out, POINTS); break;
+        case 6: math.sqrt(x, out, POINTS); break;
+        default: math.pow(x, y, out, POINTS); break;
+    }
+}
+
+// Points per second for one kernel over TOTAL_POINTS
+static double kernel_rate(const VecMath &math, size_t kernel, const double *x, const double *y, double *out) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < TOTAL_POINTS; done += POINTS) run_kernel(math, kernel, x, y, out);
+    return TOTAL_POINTS / seconds_since(start);
+}
+
+// Points per second evaluating text at every x, one run() per point or
+// run_vector a batch at a time
+static double expression_rate(const Program &program, const VecMath *math, const std::vector<double> &x,
+                              std::vector<double> &y) {
+    std::vector<double> stack;
+    size_t repeats = TOTAL_POINTS / 4 / x.size();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        if (!math) {
+            for (size_t i = 0; i < x.size(); i++) {
+                EvalResult result = program.run(x[i]);
+                y[i] = result.status == EVAL_OK ? result.value : NAN;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < x.size(); i += VECTOR_BATCH) {
+            size_t n = x.size() - i < VECTOR_BATCH ? x.size() - i : VECTOR_BATCH;
+            program.run_vector(&x[i], &y[i], n, *math, stack);
+        }
+    }
+    return repeats * x.size() / seconds_since(start);
+}
+
+int main() {
+    int failures = 0;
+    std::mt19937_64 random(42);
+    std::vector<double> x(POINTS), y(POINTS), out(POINTS);
+
+    std::vector<const VecMath *> sets;
+    const char *names[] = {"scalar", "sse2", "vec128", "avx2"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (const VecMath *math = vecmath_find(names[i])) sets.push_back(math);
+    }
+    printf("Kernels (million points/s; worst error in ulps), best set: %s\n", vecmath_best().name);
+    printf("  %-6s", "");
+    for (size_t s = 0; s < sets.size(); s++) printf(" %16s", sets[s]->name);
+    printf("  speedup\n");
+
+    for (size_t k = 0; k < sizeof(KERNEL_CASES) / sizeof(KERNEL_CASES[0]); k++) {
+        const KernelCase &c = KERNEL_CASES[k];
+        std::uniform_real_distribution<double> dist(c.lo, c.hi);
+        std::uniform_real_distribution<double> exponents(-20, 20);
+        for (size_t i = 0; i < POINTS; i++) {
+            double v = dist(random);
+            x[i] = c.log_scale ? pow(10.0, v) : v;
+            y[i] = exponents(random);
+        }
+
+        printf("  %-6s", c.name);
+        double scalar_rate = 0, best_rate = 0;
+        double worst_simd = 0;
+        for (size_t s = 0; s < sets.size(); s++) {
+            double rate = kernel_rate(*sets[s], k, &x[0], &y[0], &out[0]);
+            double worst = 0;
+            for (size_t i = 0; i < POINTS; i++) {
+                long double want = reference(k, x[i], y[i]);
+                if (fabsl(want) > 1e-300L && fabsl(want) < 1e300L) worst = fmax(worst, ulp_error(out[i], want));
+            }
+            printf(" %8.1f (%5.2f)", rate / 1e6, worst);
+            if (s == 0) {
+                scalar_rate = rate;
+                continue;
+            }
+            worst_simd = fmax(worst_simd, worst);
+            best_rate = fmax(best_rate, rate);
+        }
+        printf("  %5.1fx\n", best_rate / scalar_rate);
+        if (worst_simd > c.max_ulps) {
+            printf("    %s: %.2f ulps (bound %.1f)\n", c.name, worst_simd, c.max_ulps);
+            failures++;
+        }
+    }
+
+    printf("\nExpressions (million points/s)\n");
+    printf("  %-24s %10s %10s %10s\n", "", "run()", "scalar", vecmath_best().name);
+    const char *expressions[] = {"sin(x)^2+cos(x)^2", "x^3-2x+1", "ln(x)×√x", "tan(x)", "10^(x/100)"};
+    std::vector<double> points(100000), results(points.size()), expected(points.size());
+    std::uniform_real_distribution<double> dist(-500, 500);
+    for (size_t i = 0; i < points.size(); i++) points[i] = dist(random);
+    for (size_t e = 0; e < sizeof(expressions) / sizeof(expressions[0]); e++) {
+        const char *text = expressions[e];
+        ExprCompiler compiler;
+        Program program;
+        if (!compiler.compile(text, strlen(text), program)) {
+            failures += check(text, false);
+            continue;
+        }
+        double per_point = expression_rate(program, NULL, points, expected);
+        double scalar = expression_rate(program, &vecmath_scalar(), points, results);
+        double simd = expression_rate(program, &vecmath_best(), points, results);
+        printf("  %-24s %10.1f %10.1f %10.1f\n", text, per_point / 1e6, scalar / 1e6, simd / 1e6);
+
+        // Same answers as the keypad path, allowing for its inexact π/180
+        bool agree = true;
+        for (size_t i = 0; i < points.size(); i++) {
+            double a = expected[i], b = results[i];
+            if (std::isnan(a) != std::isnan(b)) agree = std::isinf(a) && std::isnan(b); // tan poles
+            else if (!std::isnan(a) && fabs(a - b) > 1e-9 * fmax(1.0, fabs(a))) agree = false;
+            if (!agree) {
+                printf("    %s at x=%.17g: run() %.17g, run_vector %.17g\n", text, points[i], a, b);
+                break;
+            }
+        }
+        if (!agree) failures++;
+    }
+
+    printf("\nrun_table end to end\n");
+    const size_t table_points[] = {10000000, 1000000};
+    for (int binary = 1; binary >= 0; binary--) {
+        size_t n = table_points[binary ? 0 : 1];
+        TableOptions options = {"sin(x)×e^(-x/1000)", 0.0, (double)(n - 1), 1.0, NULL, binary == 1};
+        FILE *sink = tmpfile();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int status = run_table(options, sink);
+        double seconds = seconds_since(start);
+        long bytes = ftell(sink);
+        fclose(sink);
+        printf("  %-8s %9zu points %8.1f M points/s  %6.1f MB\n", binary ? "binary" : "CSV", n, n / seconds / 1e6,
+               bytes / 1e6);
+        failures += check(binary ? "binary output size" : "CSV status",
+                          status == 0 && (!binary || bytes == (long)(2 * n * sizeof(double))));
+    }
+
+    // 0 to 1 in steps of 0.1 includes both ends despite 0.1 being inexact
+    TableOptions tenths = {"x", 0.0, 1.0, 0.1, NULL, false};
+    FILE *sink = tmpfile();
+    run_table(tenths, sink);
+    rewind(sink);
+    char text[256] = {0};
+    size_t len = fread(text, 1, sizeof(text) - 1, sink);
+    fclose(sink);
+    int lines = 0;
+    for (size_t i = 0; i < len; i++) lines += text[i] == '\n';
+    failures += check("0..1 step 0.1 gives 11 points ending at 1", lines == 11 && strstr(text, "\n1,1\n") != NULL);
+
+    // A long range just short of a whole number of steps gains no point past --to
+    TableOptions long_range = {"x", 0.0, 999999.9995, 1.0, NULL, true};
+    sink = tmpfile();
+    int status = run_table(long_range, sink);
+    long bytes = ftell(sink);
+    double last[2] = {0, 0};
+    fseek(sink, -(long)sizeof(last), SEEK_END);
+    bool read = fread(last, sizeof(last), 1, sink) == 1;
+    fclose(sink);
+    failures += check("0..999999.9995 step 1 stops at 999999",
+                      status == 0 && read && bytes == (long)(2 * 1000000 * sizeof(double)) && last[0] == 999999);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+// Scalar trigonometry benchmark: sin, cos and tan in each angle unit
+// against the libm path the keypad used before (sin(x·π/180)), as
+// throughput over a spread of angles and as worst error in ulps against
+// long double, plus the values that must come out exact.
+#include "../calc_expr.h"
+#include "../calc_trig.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static volatile double sink;
+
+static const char *const UNIT_NAMES[] = {"degrees", "radians", "gradians"};
+
+static double libm_sin(double x) { return sin(x * M_PI / 180.0); }
+static double libm_cos(double x) { return cos(x * M_PI / 180.0); }
+static double libm_tan(double x) { return tan(x * M_PI / 180.0); }
+
+// Best of three passes over xs, in ns per call
+template <typename F>
+static double time_calls(const std::vector<double> &xs, F f) {
+    double best = 1e9;
+    for (int rep = 0; rep < 3; rep++) {
+        double sum = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < xs.size(); i++) sum += f(xs[i]);
+        double t = seconds_since(start) * 1e9 / xs.size();
+        sink = sum;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+struct SinAngle {
+    AngleUnit unit;
+    double operator()(double x) const { return sin_angle(x, unit); }
+};
+struct CosAngle {
+    AngleUnit unit;
+    double operator()(double x) const { return cos_angle(x, unit); }
+};
+struct TanAngle {
+    AngleUnit unit;
+    double operator()(double x) const {
+        double r = 0;
+        tan_angle(x, unit, &r);
+        return r;
+    }
+};
+
+// sin, cos and tan of x in long double, reduced exactly in degrees and
+// gradians so the reference is good near the zeros too
+static void reference(double x, AngleUnit unit, long double out[3]) {
+    const long double PI_L = 3.141592653589793238462643383279502884L;
+    if (unit == ANGLE_RADIANS) {
+        out[0] = sinl(x);
+        out[1] = cosl(x);
+        out[2] = tanl(x);
+        return;
+    }
+    long double quarter = unit == ANGLE_DEGREES ? 90 : 100;
+    long double r = fmodl((long double)x, 4 * quarter);
+    long double q = roundl(r / quarter);
+    long double a = (r - q * quarter) * PI_L / (2 * quarter);
+    long double s = sinl(a), c = cosl(a);
+    switch ((int)q & 3) {
+        case 0: out[0] = s; out[1] = c; break;
+        case 1: out[0] = c; out[1] = -s; break;
+        case 2: out[0] = -s; out[1] = -c; break;
+        default: out[0] = -c; out[1] = s; break;
+    }
+    out[2] = out[0] / out[1];
+}
+
+static double ulps(double got, long double want) {
+    if (want == 0) return got == 0 ? 0 : 1e9;
+    double w = fabs((double)want);
+    return (double)fabsl((long double)got - want) / (nextafter(w, INFINITY) - w);
+}
+
+int main() {
+    int failures = 0;
+    const size_t N = 1000000;
+    srand(2024);
+    std::vector<double> degrees(N), radians(N);
+    for (size_t i = 0; i < N; i++) {
+        double u = (double)rand() / RAND_MAX * 2 - 1;
+        degrees[i] = u * 720;
+        radians[i] = u * 12.5;
+    }
+
+    printf("ns per call, angles within two turns\n");
+    printf("  %-10s %10s %10s %10s\n", "", "sin", "cos", "tan");
+    double old_sin = time_calls(degrees, libm_sin);
+    double old_cos = time_calls(degrees, libm_cos);
+    double old_tan = time_calls(degrees, libm_tan);
+    printf("  %-10s %10.2f %10.2f %10.2f\n", "libm °", old_sin, old_cos, old_tan);
+    double unit_sin[3], unit_cos[3], unit_tan[3];
+    for (int u = 0; u < 3; u++) {
+        AngleUnit unit = (AngleUnit)u;
+        const std::vector<double> &xs = unit == ANGLE_RADIANS ? radians : degrees;
+        SinAngle s = {unit};
+        CosAngle c = {unit};
+        TanAngle t = {unit};
+        unit_sin[u] = time_calls(xs, s);
+        unit_cos[u] = time_calls(xs, c);
+        unit_tan[u] = time_calls(xs, t);
+        printf("  %-10s %10.2f %10.2f %10.2f\n", UNIT_NAMES[u], unit_sin[u], unit_cos[u], unit_tan[u]);
+    }
+    failures += check("degree kernels beat the libm path",
+                      unit_sin[0] < old_sin && unit_cos[0] < old_cos && unit_tan[0] < old_tan);
+
+    printf("\nWorst error in ulps (tan is a quotient of two)\n");
+    double limit[3] = {1, 1, 3};
+    for (int u = 0; u < 3; u++) {
+        AngleUnit unit = (AngleUnit)u;
+        double worst[3] = {0, 0, 0};
+        for (int i = 0; i < 300000; i++) {
+            // Small, medium and huge angles in equal parts
+            double scale = unit == ANGLE_RADIANS ? (i % 3 == 0 ? 7 : i % 3 == 1 ? 1000 : 1e6)
+                                                 : (i % 3 == 0 ? 720 : i % 3 == 1 ? 1e5 : 1e15);
+            double x = ((double)rand() / RAND_MAX * 2 - 1) * scale;
+            if (unit == ANGLE_RADIANS && fabs(x) >= RADIAN_REDUCTION_LIMIT) continue;
+            long double want[3];
+            reference(x, unit, want);
+            double got[3] = {sin_angle(x, unit), cos_angle(x, unit), 0};
+            bool finite = tan_angle(x, unit, &got[2]);
+            for (int f = 0; f < 3; f++) {
+                double e = f == 2 && !finite ? (want[1] == 0 ? 0 : 1e9) : ulps(got[f], want[f]);
+                if (e > worst[f]) worst[f] = e;
+            }
+        }
+        printf("  %-10s %10.2f %10.2f %10.2f\n", UNIT_NAMES[u], worst[0], worst[1], worst[2]);
+        char name[64];
+        snprintf(name, sizeof(name), "%s within 1 ulp (tan 3)", UNIT_NAMES[u]);
+        failures += check(name, worst[0] <= limit[0] && worst[1] <= limit[1] && worst[2] <= limit[2]);
+    }
+
+    printf("\nExact values\n");
+    double t = 0;
+    bool exact = true;
+    for (int k = -8; k <= 8; k++) {
+        double x = 90.0 * k;
+        exact = exact && sin_angle(x, ANGLE_DEGREES) == (k % 2 ? (((k % 4) + 4) % 4 == 1 ? 1 : -1) : 0);
+        exact = exact && cos_angle(x, ANGLE_DEGREES) == (k % 2 ? 0 : (((k % 4) + 4) % 4 == 0 ? 1 : -1));
+    }
+    failures += check("sin and cos at multiples of 90°", exact);
+    failures += check("sin 30°, cos 60°, sin 150°, sin -210° are ±0.5",
+                      sin_angle(30, ANGLE_DEGREES) == 0.5 && cos_angle(60, ANGLE_DEGREES) == 0.5 &&
+                      sin_angle(150, ANGLE_DEGREES) == 0.5 && sin_angle(-210, ANGLE_DEGREES) == 0.5);
+    exact = true;
+    for (int k = -4; k <= 4; k++) {
+        double want = k % 2 == 0 ? 1 : -1;
+        exact = exact && tan_angle(45 + 90.0 * k, ANGLE_DEGREES, &t) && t == (k % 2 ? -1 : 1) * want * want;
+        exact = exact && tan_angle(50 + 100.0 * k, ANGLE_GRADIANS, &t) && fabs(t) == 1;
+    }
+    failures += check("tan 45° + 90°k and 50 grad + 100k are ±1", exact);
+    // 90·3^29 is an odd multiple of 90 past the fast reduction's range
+    failures += check("tan 90°, -270°, 90·3^29° and 100 grad are poles",
+                      !tan_angle(90, ANGLE_DEGREES, &t) && !tan_angle(-270, ANGLE_DEGREES, &t) &&
+                      !tan_angle(6176733962839470.0, ANGLE_DEGREES, &t) && !tan_angle(100, ANGLE_GRADIANS, &t));
+    failures += check("sin 200 grad and cos 300 grad are 0",
+                      sin_angle(200, ANGLE_GRADIANS) == 0 && cos_angle(300, ANGLE_GRADIANS) == 0);
+    failures += check("sin 1e22° is exact reduction (1e22 mod 360 = 280)",
+                      sin_angle(1e22, ANGLE_DEGREES) == sin_angle(280, ANGLE_DEGREES));
+
+    // Through the VM, which the keypad and --batch use
+    ExprCompiler compiler;
+    Program program;
+    compiler.compile("tan(90)", 7, program);
+    EvalResult pole = program.run();
+    failures += check("tan(90) is invalid input in the VM", pole.status == EVAL_INVALID_INPUT);
+    compiler.set_angle_unit(ANGLE_RADIANS);
+    compiler.compile("cos(π)", strlen("cos(π)"), program);
+    failures += check("radian mode: cos(π) = -1", program.run().value == -1 && program.angle() == ANGLE_RADIANS);
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdio>
+
+// Timing and pass/fail reporting shared by the benchmarks
+
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Prints one line of the checks block; returns 1 on failure so main() can
+// add up failures for its exit status
+inline int check(const char *name, bool ok) {
+    printf("  %-52s %s\n", name, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,133 @@
+// Background evaluation: how long a slow precision-mode press takes on the
+// worker, how quickly a cancel stops it, and that the engine and the
+// worker's constant caches are sound afterwards. The GUI's responsiveness
+// depends on the submit and cancel times, not on the job.
+#include "../calc_engine.h"
+#include "../calc_worker.h"
+#include "bench_util.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Keys for a number, then the rest of the sequence
+static void type(CalcEngine &engine, const char *digits) {
+    for (const char *p = digits; *p; p++) engine.press((Command)(CMD_DIGIT_0 + (*p - '0')));
+}
+
+// Stands in for the main loop: the done callback only signals
+struct Completion {
+    std::mutex lock;
+    std::condition_variable signal;
+    bool done;
+    Completion() : done(false) {}
+
+    static void notify(void *data) {
+        Completion *c = static_cast<Completion *>(data);
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->done = true;
+        c->signal.notify_one();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!done) signal.wait(guard);
+        done = false;
+    }
+};
+
+int main() {
+    int failures = 0;
+    EngineWorker worker;
+    Completion completion;
+
+    // The first job starts the thread
+    CalcEngine engine;
+    engine.set_precision(1000);
+    type(engine, "2");
+    engine.press(CMD_ADD);
+    type(engine, "2");
+    worker.submit(engine, CMD_EQUALS, Completion::notify, &completion);
+    completion.wait();
+    failures += check("a quick job gives the usual result", strcmp(engine.display_text(), "4") == 0);
+
+    // A factorial past the exact limit: a million factors kept to 1000 digits
+    engine.press(CMD_ALL_CLEAR);
+    type(engine, "999999");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    worker.submit(engine, CMD_FACTORIAL, Completion::notify, &completion);
+    double submit_us = seconds_since(start) * 1e6;
+    // What a main loop waking every millisecond sees meanwhile
+    double worst_wake_ms = 0;
+    for (int i = 0; i < 100 && worker.busy(); i++) {
+        std::chrono::steady_clock::time_point sleep_start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double late = seconds_since(sleep_start) * 1e3 - 1;
+        if (late > worst_wake_ms) worst_wake_ms = late;
+    }
+    completion.wait();
+    double job_s = seconds_since(start);
+    std::string full = engine.display_text();
+    printf("999999! at 1000 digits: %.2f s on the worker, submit took %.0f us\n", job_s, submit_us);
+    printf("  a 1 ms timer on the calling thread ran at most %.2f ms late\n", worst_wake_ms);
+    failures += check("the job finishes with a result", full.compare(0, 9, "8.2639316") == 0);
+    failures += check("submitting does not wait for the job", submit_us < job_s * 1e4);
+    failures += check("the calling thread keeps running", worst_wake_ms < 50);
+
+    // Cancel the same press part way
+    engine.press(CMD_ALL_CLEAR);
+    type(engine, "999999");
+    worker.submit(engine, CMD_FACTORIAL, Completion::notify, &completion);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    start = std::chrono::steady_clock::now();
+    worker.cancel();
+    completion.wait();
+    double cancel_ms = seconds_since(start) * 1e3;
+    printf("Cancelled after 50 ms, stopped %.2f ms later\n", cancel_ms);
+    failures += check("cancelling stops it within 20 ms", cancel_ms < 20);
+    failures += check("a cancelled press shows why",
+                      strcmp(engine.display_text(), "Error") == 0 &&
+                      strcmp(engine.history_text(), "Error: Cancelled") == 0);
+    failures += check("the worker counted the cancel", worker.cancelled() == 1 && worker.jobs() == 3);
+
+    engine.press(CMD_ALL_CLEAR);
+    type(engine, "3");
+    engine.press(CMD_MULTIPLY);
+    type(engine, "3");
+    worker.submit(engine, CMD_EQUALS, Completion::notify, &completion);
+    completion.wait();
+    failures += check("the engine carries on after a cancel", strcmp(engine.display_text(), "9") == 0);
+
+    // π cut short at 100000 digits must not stay in the worker's cache
+    CalcEngine big;
+    big.set_precision(MAX_PRECISION_DIGITS);
+    worker.submit(big, CMD_PI, Completion::notify, &completion);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    start = std::chrono::steady_clock::now();
+    worker.cancel();
+    completion.wait();
+    printf("π at %zu digits cancelled in %.2f ms\n", MAX_PRECISION_DIGITS, seconds_since(start) * 1e3);
+    CalcEngine pi;
+    pi.set_precision(1000);
+    worker.submit(pi, CMD_PI, Completion::notify, &completion);
+    completion.wait();
+    std::string expected;
+    format_number(big_pi(1000), 1000, expected);
+    std::string got;
+    format_number(pi.precise_value(), 1000, got);
+    failures += check("constants are not cached from a cancelled job", got == expected);
+
+    // wait() is how the GUI takes the engine back for a menu action
+    engine.press(CMD_ALL_CLEAR);
+    type(engine, "999999");
+    worker.submit(engine, CMD_FACTORIAL, Completion::notify, &completion);
+    worker.cancel();
+    worker.wait();
+    failures += check("wait() returns once the job has stopped", !worker.busy());
+    completion.wait();
+
+    printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,299 @@
+#include "calc_batch.h"
+#include "calc_bignum.h"
+#include "calc_engine.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+#include "calc_registers.h"
+#include "calc_vecmath.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t IO_BUFFER_SIZE = 1 << 16;
+const size_t MAX_LINE_LENGTH = 4096;
+
+// A range stays within exactly representable point indices
+const double MAX_TABLE_POINTS = 9007199254740992.0;
+const double RANGE_SLACK = 4 * DBL_EPSILON; // A few ulps of (to - from) / step
+
+// Buffered writer so results go out in large fwrite blocks instead of one
+// stdio call per line
+class OutputBuffer {
+private:
+    FILE *out;
+    char buffer[IO_BUFFER_SIZE];
+    size_t used;
+
+public:
+    explicit OutputBuffer(FILE *f) : out(f), used(0) {}
+    ~OutputBuffer() { flush(); }
+
+    void write(const char *data, size_t len) {
+        if (used + len > IO_BUFFER_SIZE) flush();
+        if (len > IO_BUFFER_SIZE) {
+            fwrite(data, 1, len, out);
+            return;
+        }
+        memcpy(buffer + used, data, len);
+        used += len;
+    }
+
+    void flush() {
+        if (used > 0) fwrite(buffer, 1, used, out);
+        used = 0;
+    }
+};
+
+// Appends to a string instead, for BatchEvaluator
+class StringOutput {
+private:
+    std::string &text;
+
+public:
+    explicit StringOutput(std::string &t) : text(t) {}
+    void write(const char *data, size_t len) { text.append(data, len); }
+};
+
+// Precision mode: the exact digits, up to `digits` significant ones
+template <class Output>
+bool write_precise(const Program &program, const char *line, size_t digits, Output &output,
+                   Registers &registers, SymbolId target, SymbolId ans) {
+    BigFloat value;
+    EvalResult result = program.run_precise(line, digits, &value);
+    if (result.status != EVAL_OK) return false;
+    std::string text = value.to_exact_string();
+    if (target != NO_SYMBOL) registers.set(target, result.value, text.c_str());
+    registers.set(ans, result.value, text.c_str());
+    format_number(value, digits, text);
+    text.push_back('\n');
+    output.write(text.data(), text.size());
+    return true;
+}
+
+// Compiles into the same Program every line so its buffers are reused.
+// An assignment is compiled from just its expression.
+template <class Output>
+void evaluate_line(ExprCompiler &compiler, Program &program, const char *line, size_t len,
+                   size_t digits, Output &output, Registers &registers, SymbolId ans) {
+    SymbolId target = NO_SYMBOL;
+    size_t start;
+    size_t name_len = parse_assignment(line, len, &start);
+    if (name_len) {
+        while (*line == ' ' || *line == '\t') {
+            line++;
+            len--;
+            start--;
+        }
+        target = registers.intern(line, name_len);
+        line += start;
+        len -= start;
+    }
+    if (compiler.compile(line, len, program) && !program.uses_variable()) {
+        if (digits > 0) {
+            if (!write_precise(program, line, digits, output, registers, target, ans)) output.write("Error\n", 6);
+            return;
+        }
+        EvalResult result = program.run();
+        if (result.status == EVAL_OK) {
+            if (target != NO_SYMBOL) registers.set(target, result.value);
+            registers.set(ans, result.value);
+            // Full round-trip precision; fixed notation up to the buffer width
+            char text[FORMAT_BUFFER_SIZE + 1];
+            size_t n = format_number(result.value, text, FORMAT_BUFFER_SIZE - 1);
+            text[n] = '\n';
+            output.write(text, n + 1);
+            return;
+        }
+    }
+    output.write("Error\n", 6);
+}
+
+// Calls handle(line, len) for each line of in, without its newline. Lines
+// that fit in one read block are passed in place; others are gathered into
+// a buffer, and any longer than MAX_LINE_LENGTH arrive as NULL.
+template <class Handler>
+bool for_each_line(FILE *in, Handler handle) {
+    char input[IO_BUFFER_SIZE];
+    char line[MAX_LINE_LENGTH];
+    size_t line_len = 0;
+    bool overflow = false;
+
+    size_t n;
+    while ((n = fread(input, 1, sizeof(input), in)) > 0) {
+        size_t start = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (input[i] != '\n') continue;
+            // Whole line inside this block: no copy
+            if (line_len == 0 && !overflow) {
+                handle(input + start, i - start);
+            } else {
+                size_t part = i - start;
+                if (!overflow && line_len + part <= MAX_LINE_LENGTH) {
+                    memcpy(line + line_len, input + start, part);
+                    handle(line, line_len + part);
+                } else {
+                    handle(NULL, 0);
+                }
+                line_len = 0;
+                overflow = false;
+            }
+            start = i + 1;
+        }
+        // Carry the partial last line over to the next block
+        size_t part = n - start;
+        if (overflow || line_len + part > MAX_LINE_LENGTH) {
+            overflow = true;
+        } else {
+            memcpy(line + line_len, input + start, part);
+            line_len += part;
+        }
+    }
+    if (overflow) {
+        handle(NULL, 0);
+    } else if (line_len > 0) {
+        handle(line, line_len);
+    }
+    return !ferror(in);
+}
+
+// Evaluates one batch of table points and writes them out
+class TableWriter {
+private:
+    const Program &program;
+    const VecMath &math;
+    bool binary;
+    OutputBuffer &output;
+    std::vector<double> stack;
+    double y[VECTOR_BATCH];
+
+public:
+    TableWriter(const Program &p, bool binary_output, OutputBuffer &out)
+        : program(p), math(vecmath_best()), binary(binary_output), output(out) {}
+
+    void write(const double *x, size_t n) {
+        program.run_vector(x, y, n, math, stack);
+        if (binary) {
+            double pairs[2 * VECTOR_BATCH];
+            for (size_t i = 0; i < n; i++) {
+                pairs[2 * i] = x[i];
+                pairs[2 * i + 1] = y[i];
+            }
+            output.write(reinterpret_cast<const char *>(pairs), 2 * n * sizeof(double));
+            return;
+        }
+        char text[2 * FORMAT_BUFFER_SIZE + 2];
+        for (size_t i = 0; i < n; i++) {
+            size_t len = format_number(x[i], text, FORMAT_BUFFER_SIZE - 1);
+            text[len++] = ',';
+            len += format_number(y[i], text + len, FORMAT_BUFFER_SIZE - 1);
+            text[len++] = '\n';
+            output.write(text, len);
+        }
+    }
+};
+
+// One x per line; a line that is not a number gives NaN
+double parse_column_value(const char *line, size_t len) {
+    size_t i = 0;
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    bool negative = i < len && line[i] == '-';
+    if (i < len && (line[i] == '-' || line[i] == '+')) i++;
+    double value;
+    size_t n = parse_number(line + i, len - i, &value);
+    if (n == 0) return NAN;
+    for (i += n; i < len; i++) {
+        if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r') return NAN;
+    }
+    return negative ? -value : value;
+}
+
+} // namespace
+
+BatchEvaluator::BatchEvaluator() {
+    reset();
+}
+
+void BatchEvaluator::reset() {
+    // Names stay interned after clear(); start afresh once many have piled up
+    if (registers.size() > MAX_NAMES) registers = Registers();
+    registers.clear();
+    ans = registers.intern("ans", 3);
+    compiler.set_registers(&registers);
+}
+
+void BatchEvaluator::evaluate(const char *line, size_t len, size_t digits, std::string &out) {
+    StringOutput output(out);
+    if (len > MAX_LINE_LENGTH) {
+        output.write("Error\n", 6);
+        return;
+    }
+    evaluate_line(compiler, program, line, len, digits, output, registers, ans);
+}
+
+int run_batch(FILE *in, FILE *out, size_t digits) {
+    ExprCompiler compiler;
+    Program program;
+    Registers registers;
+    SymbolId ans = registers.intern("ans", 3);
+    compiler.set_registers(&registers);
+    OutputBuffer output(out);
+    bool ok = for_each_line(in, [&](const char *line, size_t len) {
+        if (line) {
+            evaluate_line(compiler, program, line, len, digits, output, registers, ans);
+        } else {
+            output.write("Error\n", 6);
+        }
+    });
+    output.flush();
+    return ok ? 0 : 1;
+}
+
+
+int run_table(const TableOptions &options, FILE *out) {
+    ExprCompiler compiler;
+    Program program;
+    if (!compiler.compile(options.expression, strlen(options.expression), program)) {
+        fprintf(stderr, "%s: %s\n", options.expression, compiler.error() ? compiler.error() : "Syntax error");
+        return 1;
+    }
+
+    OutputBuffer output(out);
+    TableWriter writer(program, options.binary, output);
+    double x[VECTOR_BATCH];
+    size_t n = 0;
+
+    if (options.column) {
+        bool ok = for_each_line(options.column, [&](const char *line, size_t len) {
+            if (line && len == 0) return; // Blank lines
+            x[n++] = line ? parse_column_value(line, len) : NAN;
+            if (n == VECTOR_BATCH) {
+                writer.write(x, n);
+                n = 0;
+            }
+        });
+        writer.write(x, n);
+        output.flush();
+        return ok ? 0 : 1;
+    }
+
+    // Points are from + i*step rather than a running sum, so the last one
+    // lands on `to` without drift; the slack admits it despite rounding in
+    // the division, and is relative so a long range gains no extra point
+    double span = (options.to - options.from) / options.step;
+    if (!std::isfinite(span) || span < 0 || span >= MAX_TABLE_POINTS) {
+        fprintf(stderr, "Table range must run from --from to --to in steps of --step\n");
+        return 1;
+    }
+    double count = floor(span * (1 + RANGE_SLACK)) + 1;
+    for (double done = 0; done < count; done += n) {
+        n = count - done < VECTOR_BATCH ? (size_t)(count - done) : VECTOR_BATCH;
+        for (size_t i = 0; i < n; i++) x[i] = options.from + (done + i) * options.step;
+        writer.write(x, n);
+    }
+    output.flush();
+    return 0;
+}
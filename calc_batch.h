@@ -0,0 +1,65 @@
+#ifndef CALC_BATCH_H
+#define CALC_BATCH_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include "calc_expr.h"
+#include "calc_registers.h"
+
+// Headless batch mode: reads one expression per line from `in` and writes
+// one result per line to `out`. Lines are expressions such as "12+3*4",
+// "2^10", "sin(30)" or "9!", compiled and evaluated by the same expression
+// engine the window uses on "=", so the arithmetic is identical to the
+// desktop app. Returns 0 on success.
+//
+// A line "name = expression" also stores its result under name, and "ans"
+// always holds the last result, so later lines can use both. Registers
+// last for the run only.
+//
+// With digits > 0 every line is evaluated in precision mode and printed
+// with up to that many significant digits.
+int run_batch(FILE *in, FILE *out, size_t digits = 0);
+
+// The same evaluation one line at a time, for callers with their own
+// input (the --serve workers). Keeps its compiler, program and registers
+// between lines; reset() forgets the registers, as between two runs.
+class BatchEvaluator {
+public:
+    static const size_t MAX_NAMES = 4096; // Interned names kept across reset()
+
+private:
+    ExprCompiler compiler;
+    Program program;
+    Registers registers;
+    SymbolId ans;
+
+    BatchEvaluator(const BatchEvaluator &);
+    BatchEvaluator &operator=(const BatchEvaluator &);
+
+public:
+    BatchEvaluator();
+
+    void reset();
+    // Appends the result, or "Error", and a newline to out
+    void evaluate(const char *line, size_t len, size_t digits, std::string &out);
+};
+
+// Table mode: evaluates one expression in x, such as "sin(x)^2" or
+// "x^3-2x", at every point of a range or of an input column. Points go
+// through Program::run_vector a batch at a time with the widest SIMD
+// kernels the CPU has, and results stream out as they are computed.
+struct TableOptions {
+    const char *expression;
+    double from;   // x = from, from+step, ... up to and including to
+    double to;
+    double step;
+    FILE *column;  // Or one x per line from here, when not NULL
+    bool binary;   // Native doubles x, f(x) per point instead of "x,f(x)" lines
+};
+
+// Points where the expression fails give NaN. Returns 0 on success, 1 with
+// a message on stderr for a bad expression or range.
+int run_table(const TableOptions &options, FILE *out);
+
+#endif // CALC_BATCH_H
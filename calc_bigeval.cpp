@@ -0,0 +1,234 @@
+#include "calc_expr.h"
+#include "calc_bignum.h"
+#include "calc_registers.h"
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Extra digits carried by inexact intermediates so the final rounding to
+// the requested precision stays correct across a chain of operations
+const size_t CHAIN_GUARD_DIGITS = 10;
+
+struct PreciseValue {
+    BigFloat x;
+    bool exact;
+};
+
+// Keep exact values exact while they stay a sensible size; round the rest
+// to the working precision
+void settle(PreciseValue &v, size_t working) {
+    if (!v.exact) {
+        v.x.round(working);
+    } else if (v.x.digits() > MAX_EXACT_DIGITS) {
+        v.exact = !v.x.round(working);
+    }
+}
+
+// a + b where a tiny b would force a huge exact mantissa: past the working
+// precision it only matters as a sticky digit
+void add_values(PreciseValue &a, const PreciseValue &b, size_t working) {
+    if (a.x.is_zero() || b.x.is_zero() ||
+        labs(a.x.magnitude() - b.x.magnitude()) <= (long)(working + MAX_EXACT_DIGITS)) {
+        a.x = a.x + b.x;
+        a.exact = a.exact && b.exact;
+        return;
+    }
+    bool a_larger = a.x.magnitude() > b.x.magnitude();
+    const BigFloat &big = a_larger ? a.x : b.x;
+    const BigFloat &small = a_larger ? b.x : a.x;
+    // big with one extra digit nudged toward small, below the rounding point
+    BigInt m = big.significand();
+    size_t pad = working + 2 > big.digits() ? working + 2 - big.digits() : 0;
+    m.mul_pow10(pad + 1);
+    BigInt sticky(small.is_negative() == big.is_negative() ? 1 : -1);
+    if (big.is_negative()) sticky.negate();
+    m += sticky;
+    a.x = BigFloat(m, big.exp10() - (long)pad - 1);
+    a.exact = false;
+}
+
+// The big trig functions take degrees: gradians convert exactly (×0.9),
+// radians at the working precision plus a few digits
+BigFloat to_degrees(const PreciseValue &v, AngleUnit unit, size_t working, bool *exact) {
+    if (unit == ANGLE_GRADIANS) {
+        BigFloat degrees = v.x * BigFloat(9);
+        degrees.scale10(-1);
+        return degrees;
+    }
+    *exact = false;
+    BigFloat degrees;
+    big_divide(v.x * BigFloat(180), big_pi(working + 5), working + 5, &degrees);
+    return degrees;
+}
+
+EvalStatus apply_precise(unsigned char op, PreciseValue &v, size_t working, AngleUnit unit) {
+    bool exact = false;
+    BigFloat r;
+    if (unit != ANGLE_DEGREES && (op == OP_SIN || op == OP_COS || op == OP_TAN)) {
+        bool converted_exact = true;
+        PreciseValue degrees = {to_degrees(v, unit, working, &converted_exact), v.exact && converted_exact};
+        v = degrees;
+    }
+    switch (op) {
+        case OP_NEG:
+            v.x.negate();
+            return EVAL_OK;
+        case OP_PERCENT:
+            v.x.scale10(-2);
+            return EVAL_OK;
+        case OP_SQUARE:
+            v.x = v.x * v.x;
+            return EVAL_OK;
+        case OP_SIN:
+            big_sin_degrees(v.x, working, &r, &exact);
+            break;
+        case OP_COS:
+            big_cos_degrees(v.x, working, &r, &exact);
+            break;
+        case OP_TAN:
+            if (!big_tan_degrees(v.x, working, &r, &exact)) return EVAL_INVALID_INPUT;
+            break;
+        case OP_LOG:
+            if (!big_log10(v.x, working, &r, &exact)) return EVAL_INVALID_INPUT;
+            break;
+        case OP_LN:
+            if (!big_ln(v.x, working, &r, &exact)) return EVAL_INVALID_INPUT;
+            break;
+        case OP_SQRT:
+            if (!big_sqrt(v.x, working, &r, &exact)) return EVAL_INVALID_INPUT;
+            break;
+        case OP_FACTORIAL:
+            if (!big_factorial(v.x, working, &r, &exact)) return EVAL_INVALID_INPUT;
+            break;
+        default:
+            return EVAL_INVALID_INPUT;
+    }
+    v.x = r;
+    v.exact = v.exact && exact;
+    return EVAL_OK;
+}
+
+} // namespace
+
+EvalResult Program::run_precise(const char *source, size_t digits, BigFloat *value, bool *exact) const {
+    EvalResult result = {EVAL_OK, 0.0, OP_PUSH};
+    if (variable) {
+        result.status = EVAL_INVALID_INPUT;
+        result.failed_op = OP_VARIABLE;
+        return result;
+    }
+    if (digits == 0) digits = 1;
+    size_t working = digits + CHAIN_GUARD_DIGITS;
+    std::vector<PreciseValue> stack;
+    stack.reserve(max_depth);
+    size_t k = 0;
+    size_t s = 0;
+
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        unsigned char op = code[ip];
+        if (op == OP_PUSH) {
+            const Token &tok = sources[k++];
+            PreciseValue v;
+            v.exact = true;
+            if (tok.type == TOK_CONSTANT) {
+                v.x = tok.op == CONST_PI ? big_pi(working) : big_e(working);
+                v.exact = false;
+            } else if (tok.end <= tok.start ||
+                       !BigFloat::parse(source + tok.start, tok.end - tok.start, &v.x)) {
+                if (!BigFloat::from_double(tok.value, &v.x)) {
+                    result.status = EVAL_INVALID_INPUT;
+                    return result;
+                }
+            }
+            stack.push_back(v);
+            continue;
+        }
+        if (op == OP_LOAD) {
+            SymbolId id = symbols[s++];
+            PreciseValue v;
+            v.exact = true;
+            const std::string &text = registers->exact_text(id);
+            if (!registers->is_defined(id) ||
+                (!BigFloat::parse(text.data(), text.size(), &v.x) &&
+                 !BigFloat::from_double(registers->value(id), &v.x))) {
+                result.status = EVAL_INVALID_INPUT;
+                result.failed_op = OP_LOAD;
+                return result;
+            }
+            stack.push_back(v);
+            continue;
+        }
+
+        EvalStatus status = EVAL_OK;
+        if (op == OP_ADD || op == OP_SUB || op == OP_MUL || op == OP_DIV || op == OP_POW ||
+            op == OP_NCR || op == OP_NPR) {
+            PreciseValue rhs = stack.back();
+            stack.pop_back();
+            PreciseValue &lhs = stack.back();
+            bool op_exact = true;
+            switch (op) {
+                case OP_ADD:
+                    add_values(lhs, rhs, working);
+                    break;
+                case OP_SUB:
+                    rhs.x.negate();
+                    add_values(lhs, rhs, working);
+                    break;
+                case OP_MUL:
+                    lhs.x = lhs.x * rhs.x;
+                    lhs.exact = lhs.exact && rhs.exact;
+                    break;
+                case OP_DIV:
+                    if (rhs.x.is_zero()) {
+                        status = EVAL_DIVISION_BY_ZERO;
+                    } else {
+                        big_divide(lhs.x, rhs.x, working, &lhs.x, &op_exact);
+                        lhs.exact = lhs.exact && rhs.exact && op_exact;
+                    }
+                    break;
+                case OP_POW:
+                    if (!big_pow(lhs.x, rhs.x, working, &lhs.x, &op_exact)) {
+                        status = EVAL_INVALID_INPUT;
+                    } else {
+                        lhs.exact = lhs.exact && rhs.exact && op_exact;
+                    }
+                    break;
+                case OP_NCR:
+                case OP_NPR:
+                    if (!(op == OP_NCR ? big_combinations(lhs.x, rhs.x, working, &lhs.x, &op_exact)
+                                       : big_permutations(lhs.x, rhs.x, working, &lhs.x, &op_exact))) {
+                        status = EVAL_INVALID_INPUT;
+                    } else {
+                        lhs.exact = lhs.exact && rhs.exact && op_exact;
+                    }
+                    break;
+            }
+        } else {
+            status = apply_precise(op, stack.back(), working, angle_unit);
+        }
+        if (big_cancelled()) status = EVAL_CANCELLED; // Whatever came out is meaningless
+        if (status != EVAL_OK) {
+            result.status = status;
+            result.failed_op = op;
+            return result;
+        }
+        settle(stack.back(), working);
+    }
+
+    if (big_cancelled()) { // In a constant pushed last
+        result.status = EVAL_CANCELLED;
+        return result;
+    }
+    if (stack.empty()) {
+        *value = BigFloat();
+        if (exact) *exact = true;
+        return result;
+    }
+    PreciseValue &top = stack.back();
+    if (!top.exact) top.x.round(digits);
+    *value = top.x;
+    if (exact) *exact = top.exact;
+    result.value = top.x.to_double();
+    return result;
+}
@@ -0,0 +1,1734 @@
+#include "calc_bignum.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+#include "calc_special.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+typedef std::vector<uint32_t> Limbs;
+
+// Set by BigCancelScope; see big_cancelled()
+thread_local const std::atomic<bool> *cancel_flag = NULL;
+
+// Operand sizes (in limbs) where the next multiplication algorithm wins
+const size_t KARATSUBA_THRESHOLD = 40;
+const size_t NTT_THRESHOLD = 1500;
+
+// Below this n, binary splitting of 2..n beats the prime swing
+const uint32_t PRIME_SWING_THRESHOLD = 1000;
+
+// Largest n for which nCr builds its prime factorisation; larger n with a
+// small r divide a falling product by r! instead
+const uint32_t MAX_SIEVE = 20000000;
+
+// Largest factor count for a rounded product (factorials and nPr/nCr past
+// the exact limit)
+const uint32_t MAX_ROUNDED_FACTORS = 20000000;
+
+// Γ(s) series terms allowed before giving up on a non-integer factorial
+const double MAX_GAMMA_TERMS = 400000;
+
+const uint32_t POW10_U32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Guard digits carried through a correctly rounded function, doubled on
+// each retry while the result sits too close to a rounding midpoint
+const size_t GUARD_DIGITS = 12;
+const int MAX_ROUNDING_RETRIES = 4;
+
+int compare_limbs(const uint32_t *a, size_t n, const uint32_t *b, size_t m) {
+    while (n > 0 && a[n - 1] == 0) n--;
+    while (m > 0 && b[m - 1] == 0) m--;
+    if (n != m) return n < m ? -1 : 1;
+    for (size_t i = n; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+void trim_limbs(Limbs &a) {
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+
+// out[offset..] += a, growing out as needed
+void add_limbs_at(Limbs &out, const uint32_t *a, size_t n, size_t offset) {
+    if (out.size() < offset + n + 1) out.resize(offset + n + 1, 0);
+    uint32_t carry = 0;
+    size_t i = 0;
+    for (; i < n; i++) {
+        uint32_t sum = out[offset + i] + a[i] + carry;
+        carry = sum >= BigInt::BASE;
+        out[offset + i] = carry ? sum - BigInt::BASE : sum;
+    }
+    for (size_t j = offset + i; carry; j++) {
+        if (j == out.size()) out.push_back(0);
+        uint32_t sum = out[j] + carry;
+        carry = sum >= BigInt::BASE;
+        out[j] = carry ? sum - BigInt::BASE : sum;
+    }
+}
+
+// a -= b where a >= b
+void sub_limbs(Limbs &a, const uint32_t *b, size_t m) {
+    uint32_t borrow = 0;
+    size_t i = 0;
+    for (; i < m; i++) {
+        uint32_t sub = b[i] + borrow;
+        borrow = a[i] < sub;
+        a[i] = borrow ? a[i] + BigInt::BASE - sub : a[i] - sub;
+    }
+    for (; borrow && i < a.size(); i++) {
+        borrow = a[i] == 0;
+        a[i] = borrow ? BigInt::BASE - 1 : a[i] - 1;
+    }
+}
+
+void mul_schoolbook(const uint32_t *a, size_t n, const uint32_t *b, size_t m, Limbs &out) {
+    out.assign(n + m, 0);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t ai = a[i];
+        if (ai == 0) continue;
+        uint64_t carry = 0;
+        for (size_t j = 0; j < m; j++) {
+            uint64_t cur = out[i + j] + ai * b[j] + carry;
+            carry = cur / BigInt::BASE;
+            out[i + j] = (uint32_t)(cur - carry * BigInt::BASE);
+        }
+        out[i + m] = (uint32_t)carry;
+    }
+}
+
+void multiply_limbs(const uint32_t *a, size_t n, const uint32_t *b, size_t m, Limbs &out);
+
+#ifdef __SIZEOF_INT128__
+// Number-theoretic transform modulo the prime 2^64 - 2^32 + 1, which has
+// roots of unity for every power-of-two size up to 2^32 and a cheap
+// reduction. Limbs are split into base-10^6 pieces; convolution sums stay
+// below the modulus for operands up to about 10^8 digits.
+const uint64_t NTT_MOD = 0xFFFFFFFF00000001ULL;
+const uint64_t NTT_EPSILON = 0xFFFFFFFFULL; // 2^64 mod NTT_MOD
+const uint64_t NTT_GENERATOR = 7;
+
+inline uint64_t ntt_reduce(unsigned __int128 x) {
+    uint64_t lo = (uint64_t)x;
+    uint64_t hi = (uint64_t)(x >> 64);
+    uint64_t hi_hi = hi >> 32;
+    uint64_t hi_lo = hi & NTT_EPSILON;
+    // 2^96 = -1 and 2^64 = 2^32 - 1 modulo NTT_MOD
+    uint64_t t = lo - hi_hi;
+    if (lo < hi_hi) t -= NTT_EPSILON;
+    uint64_t mid = hi_lo * NTT_EPSILON;
+    uint64_t r = t + mid;
+    if (r < mid) r += NTT_EPSILON;
+    if (r >= NTT_MOD) r -= NTT_MOD;
+    return r;
+}
+
+inline uint64_t ntt_mul(uint64_t a, uint64_t b) {
+    return ntt_reduce((unsigned __int128)a * b);
+}
+
+inline uint64_t ntt_add(uint64_t a, uint64_t b) {
+    uint64_t s = a + b;
+    if (s < a || s >= NTT_MOD) s -= NTT_MOD;
+    return s;
+}
+
+inline uint64_t ntt_sub(uint64_t a, uint64_t b) {
+    return a >= b ? a - b : a + (NTT_MOD - b);
+}
+
+uint64_t ntt_pow(uint64_t base, uint64_t e) {
+    uint64_t r = 1;
+    while (e) {
+        if (e & 1) r = ntt_mul(r, base);
+        base = ntt_mul(base, base);
+        e >>= 1;
+    }
+    return r;
+}
+
+void ntt_transform(std::vector<uint64_t> &a, bool inverse) {
+    size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    std::vector<uint64_t> twiddle(n / 2);
+    for (size_t len = 2; len <= n; len <<= 1) {
+        uint64_t w = ntt_pow(NTT_GENERATOR, (NTT_MOD - 1) / len);
+        if (inverse) w = ntt_pow(w, NTT_MOD - 2);
+        size_t half = len / 2;
+        twiddle[0] = 1;
+        for (size_t k = 1; k < half; k++) twiddle[k] = ntt_mul(twiddle[k - 1], w);
+        for (size_t i = 0; i < n; i += len) {
+            uint64_t *lo = &a[i];
+            uint64_t *hi = lo + half;
+            for (size_t k = 0; k < half; k++) {
+                uint64_t u = lo[k];
+                uint64_t v = ntt_mul(hi[k], twiddle[k]);
+                lo[k] = ntt_add(u, v);
+                hi[k] = ntt_sub(u, v);
+            }
+        }
+    }
+    if (inverse) {
+        uint64_t n_inv = ntt_pow(n, NTT_MOD - 2);
+        for (size_t i = 0; i < n; i++) a[i] = ntt_mul(a[i], n_inv);
+    }
+}
+
+// Two base-10^9 limbs make three base-10^6 pieces
+void to_pieces(const uint32_t *a, size_t n, std::vector<uint64_t> &out, size_t size) {
+    out.assign(size, 0);
+    for (size_t i = 0; i < n; i += 2) {
+        uint32_t lo = a[i];
+        uint32_t hi = i + 1 < n ? a[i + 1] : 0;
+        uint64_t *p = &out[3 * (i / 2)];
+        p[0] = lo % 1000000;
+        p[1] = lo / 1000000 + (hi % 1000) * 1000;
+        p[2] = hi / 1000;
+    }
+}
+
+void mul_ntt(const uint32_t *a, size_t n, const uint32_t *b, size_t m, Limbs &out) {
+    size_t pieces = 3 * ((n + 1) / 2 + (m + 1) / 2);
+    size_t size = 1;
+    while (size < pieces) size <<= 1;
+
+    std::vector<uint64_t> fa, fb;
+    to_pieces(a, n, fa, size);
+    to_pieces(b, m, fb, size);
+    ntt_transform(fa, false);
+    ntt_transform(fb, false);
+    for (size_t i = 0; i < size; i++) fa[i] = ntt_mul(fa[i], fb[i]);
+    ntt_transform(fa, true);
+
+    // Carry in base 10^6, then regroup three pieces into two limbs
+    uint64_t carry = 0;
+    for (size_t i = 0; i < pieces; i++) {
+        uint64_t cur = fa[i] + carry;
+        carry = cur / 1000000;
+        fa[i] = cur - carry * 1000000;
+    }
+    out.assign(pieces / 3 * 2, 0);
+    for (size_t i = 0; i + 2 < pieces; i += 3) {
+        uint32_t *limb = &out[i / 3 * 2];
+        limb[0] = (uint32_t)(fa[i] + (fa[i + 1] % 1000) * 1000000);
+        limb[1] = (uint32_t)(fa[i + 1] / 1000 + fa[i + 2] * 1000);
+    }
+}
+#endif
+
+void mul_karatsuba(const uint32_t *a, size_t n, const uint32_t *b, size_t m, Limbs &out) {
+    // n >= m > n / 2
+    size_t h = n / 2;
+    const uint32_t *a0 = a, *a1 = a + h;
+    const uint32_t *b0 = b, *b1 = b + h;
+    size_t n1 = n - h, m1 = m - h;
+
+    Limbs z0, z1, z2;
+    multiply_limbs(a0, h, b0, h, z0);
+    multiply_limbs(a1, n1, b1, m1, z2);
+
+    Limbs sa(a0, a0 + h), sb(b0, b0 + h);
+    add_limbs_at(sa, a1, n1, 0);
+    add_limbs_at(sb, b1, m1, 0);
+    trim_limbs(sa);
+    trim_limbs(sb);
+    multiply_limbs(sa.data(), sa.size(), sb.data(), sb.size(), z1);
+    sub_limbs(z1, z0.data(), z0.size());
+    sub_limbs(z1, z2.data(), z2.size());
+    trim_limbs(z1);
+
+    out.assign(n + m + 1, 0);
+    add_limbs_at(out, z0.data(), z0.size(), 0);
+    add_limbs_at(out, z1.data(), z1.size(), h);
+    add_limbs_at(out, z2.data(), z2.size(), 2 * h);
+}
+
+void multiply_limbs(const uint32_t *a, size_t n, const uint32_t *b, size_t m, Limbs &out) {
+    while (n > 0 && a[n - 1] == 0) n--;
+    while (m > 0 && b[m - 1] == 0) m--;
+    if (n < m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+    if (m == 0) {
+        out.clear();
+        return;
+    }
+    if (m < KARATSUBA_THRESHOLD) {
+        mul_schoolbook(a, n, b, m, out);
+#ifdef __SIZEOF_INT128__
+    } else if (m >= NTT_THRESHOLD) {
+        mul_ntt(a, n, b, m, out);
+#endif
+    } else if (2 * m <= n) {
+        // Lopsided: multiply m-limb slices of a so each product is balanced
+        out.assign(n + m, 0);
+        Limbs part;
+        for (size_t i = 0; i < n; i += m) {
+            size_t len = std::min(m, n - i);
+            multiply_limbs(a + i, len, b, m, part);
+            add_limbs_at(out, part.data(), part.size(), i);
+        }
+    } else {
+        mul_karatsuba(a, n, b, m, out);
+    }
+    trim_limbs(out);
+}
+
+// Knuth's algorithm D in base 10^9; v has at least two limbs
+void divide_limbs(const Limbs &u, const Limbs &v, Limbs *q, Limbs *r) {
+    size_t n = v.size(), m = u.size() - n;
+    uint32_t norm = BigInt::BASE / (v.back() + 1);
+
+    Limbs un(u.size() + 1, 0), vn(n, 0);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < u.size(); i++) {
+        uint64_t cur = (uint64_t)u[i] * norm + carry;
+        carry = cur / BigInt::BASE;
+        un[i] = (uint32_t)(cur - carry * BigInt::BASE);
+    }
+    un[u.size()] = (uint32_t)carry;
+    carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t cur = (uint64_t)v[i] * norm + carry;
+        carry = cur / BigInt::BASE;
+        vn[i] = (uint32_t)(cur - carry * BigInt::BASE);
+    }
+
+    Limbs quotient(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = (uint64_t)un[j + n] * BigInt::BASE + un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num - qhat * vn[n - 1];
+        while (qhat >= BigInt::BASE || qhat * vn[n - 2] > rhat * BigInt::BASE + un[j + n - 2]) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= BigInt::BASE) break;
+        }
+
+        // un[j..j+n] -= qhat × vn
+        int64_t borrow = 0;
+        carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i] + carry;
+            carry = p / BigInt::BASE;
+            int64_t t = (int64_t)un[i + j] - (int64_t)(p - carry * BigInt::BASE) - borrow;
+            borrow = t < 0;
+            un[i + j] = (uint32_t)(borrow ? t + BigInt::BASE : t);
+        }
+        int64_t top = (int64_t)un[j + n] - (int64_t)carry - borrow;
+        if (top < 0) {
+            // qhat was one too large: add vn back
+            qhat--;
+            uint32_t c = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint32_t sum = un[i + j] + vn[i] + c;
+                c = sum >= BigInt::BASE;
+                un[i + j] = c ? sum - BigInt::BASE : sum;
+            }
+            top += c;
+        }
+        un[j + n] = (uint32_t)top;
+        quotient[j] = (uint32_t)qhat;
+    }
+
+    if (q) {
+        trim_limbs(quotient);
+        q->swap(quotient);
+    }
+    if (r) {
+        un.resize(n);
+        uint64_t rem = 0;
+        for (size_t i = n; i-- > 0;) {
+            uint64_t cur = rem * BigInt::BASE + un[i];
+            un[i] = (uint32_t)(cur / norm);
+            rem = cur % norm;
+        }
+        trim_limbs(un);
+        r->swap(un);
+    }
+}
+
+// 5^n, used to divide exactly by 2^n as × 5^n × 10^-n
+BigInt pow5_int(size_t n) {
+    BigInt r(1);
+    while (n >= 13) {
+        r.mul_small(1220703125); // 5^13
+        n -= 13;
+    }
+    uint32_t tail = 1;
+    while (n-- > 0) tail *= 5;
+    r.mul_small(tail);
+    return r;
+}
+
+// Primes up to n, by a sieve over the odd numbers
+void primes_up_to(uint32_t n, std::vector<uint32_t> &primes) {
+    primes.clear();
+    if (n < 2) return;
+    primes.push_back(2);
+    std::vector<bool> composite(n / 2 + 1, false); // Index i is 2i+1
+    for (uint32_t i = 1; 2 * i + 1 <= n; i++) {
+        if (composite[i]) continue;
+        uint32_t p = 2 * i + 1;
+        primes.push_back(p);
+        for (uint64_t m = (uint64_t)p * p; m <= n; m += 2 * p) composite[m / 2] = true;
+    }
+}
+
+// Product of factors[lo..hi) by balanced splitting
+BigInt list_product(const std::vector<uint32_t> &factors, size_t lo, size_t hi) {
+    if (hi - lo <= 16) {
+        BigInt r(1);
+        uint64_t acc = 1;
+        for (size_t i = lo; i < hi; i++) {
+            if (acc * factors[i] >= BigInt::BASE) {
+                r.mul_small((uint32_t)acc);
+                acc = 1;
+            }
+            if (factors[i] >= BigInt::BASE) {
+                r *= BigInt((long long)factors[i]);
+            } else {
+                acc *= factors[i];
+            }
+        }
+        r.mul_small((uint32_t)acc);
+        return r;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    return list_product(factors, lo, mid) * list_product(factors, mid, hi);
+}
+
+// n! / ((n/2)!)², whose prime exponents are the odd quotients n / p^i
+BigInt prime_swing(uint32_t n, const std::vector<uint32_t> &primes, std::vector<uint32_t> &factors) {
+    factors.clear();
+    uint32_t root = (uint32_t)sqrt((double)n);
+    for (size_t i = 0; i < primes.size() && primes[i] <= n; i++) {
+        uint32_t p = primes[i];
+        if (p <= root) {
+            uint32_t power = 1;
+            for (uint32_t q = n / p; q > 0; q /= p) {
+                if (q & 1) power *= p;
+            }
+            if (power > 1) factors.push_back(power);
+        } else if (p <= n / 3) {
+            if ((n / p) & 1) factors.push_back(p);
+        } else if (p > n / 2) {
+            factors.push_back(p);
+        }
+    }
+    return list_product(factors, 0, factors.size());
+}
+
+BigInt swing_factorial(uint32_t n, const std::vector<uint32_t> &primes, std::vector<uint32_t> &factors) {
+    if (n <= MAX_SMALL_FACTORIAL) return BigInt((long long)small_factorial(n));
+    BigInt half = swing_factorial(n / 2, primes, factors);
+    return half * half * prime_swing(n, primes, factors);
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// BigInt
+
+BigInt::BigInt(long long value) : negative(value < 0) {
+    unsigned long long mag = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    while (mag) {
+        limbs.push_back((uint32_t)(mag % BASE));
+        mag /= BASE;
+    }
+}
+
+void BigInt::trim() {
+    trim_limbs(limbs);
+    if (limbs.empty()) negative = false;
+}
+
+size_t BigInt::digit_count() const {
+    if (limbs.empty()) return 1;
+    size_t digits = (limbs.size() - 1) * BASE_DIGITS;
+    uint32_t top = limbs.back();
+    while (top) {
+        digits++;
+        top /= 10;
+    }
+    return digits;
+}
+
+unsigned BigInt::digit(size_t pos) const {
+    size_t limb = pos / BASE_DIGITS;
+    if (limb >= limbs.size()) return 0;
+    return (limbs[limb] / POW10_U32[pos % BASE_DIGITS]) % 10;
+}
+
+size_t BigInt::trailing_zeros() const {
+    size_t zeros = 0;
+    size_t i = 0;
+    while (i < limbs.size() && limbs[i] == 0) {
+        zeros += BASE_DIGITS;
+        i++;
+    }
+    if (i == limbs.size()) return 0;
+    uint32_t limb = limbs[i];
+    while (limb % 10 == 0) {
+        zeros++;
+        limb /= 10;
+    }
+    return zeros;
+}
+
+int BigInt::compare_magnitude(const BigInt &a, const BigInt &b) {
+    return compare_limbs(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size());
+}
+
+int BigInt::compare(const BigInt &other) const {
+    if (negative != other.negative) return negative ? -1 : 1;
+    int c = compare_magnitude(*this, other);
+    return negative ? -c : c;
+}
+
+BigInt &BigInt::operator+=(const BigInt &other) {
+    if (negative == other.negative) {
+        add_limbs_at(limbs, other.limbs.data(), other.limbs.size(), 0);
+    } else if (compare_magnitude(*this, other) >= 0) {
+        sub_limbs(limbs, other.limbs.data(), other.limbs.size());
+    } else {
+        Limbs result = other.limbs;
+        sub_limbs(result, limbs.data(), limbs.size());
+        limbs.swap(result);
+        negative = other.negative;
+    }
+    trim();
+    return *this;
+}
+
+BigInt &BigInt::operator-=(const BigInt &other) {
+    negate();
+    *this += other;
+    negate();
+    return *this;
+}
+
+BigInt operator*(const BigInt &a, const BigInt &b) {
+    BigInt r;
+    multiply_limbs(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size(), r.limbs);
+    r.negative = a.negative != b.negative;
+    r.trim();
+    return r;
+}
+
+BigInt &BigInt::operator*=(const BigInt &other) {
+    *this = *this * other;
+    return *this;
+}
+
+void BigInt::mul_small(uint32_t factor) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < limbs.size(); i++) {
+        uint64_t cur = (uint64_t)limbs[i] * factor + carry;
+        carry = cur / BASE;
+        limbs[i] = (uint32_t)(cur - carry * BASE);
+    }
+    while (carry) {
+        limbs.push_back((uint32_t)(carry % BASE));
+        carry /= BASE;
+    }
+    trim();
+}
+
+void BigInt::add_small(uint32_t addend) {
+    BigInt other;
+    if (addend) other.limbs.push_back(addend);
+    *this += other;
+}
+
+uint32_t BigInt::div_small(uint32_t divisor) {
+    uint64_t rem = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        uint64_t cur = rem * BASE + limbs[i];
+        limbs[i] = (uint32_t)(cur / divisor);
+        rem = cur - (uint64_t)limbs[i] * divisor;
+    }
+    trim();
+    return (uint32_t)rem;
+}
+
+uint32_t BigInt::mod_small(uint32_t divisor) const {
+    uint64_t rem = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        rem = (rem * BASE + limbs[i]) % divisor;
+    }
+    return (uint32_t)rem;
+}
+
+void BigInt::mul_pow10(size_t n) {
+    if (limbs.empty()) return;
+    if (n % BASE_DIGITS) mul_small(POW10_U32[n % BASE_DIGITS]);
+    limbs.insert(limbs.begin(), n / BASE_DIGITS, 0);
+}
+
+void BigInt::div_pow10(size_t n) {
+    size_t whole = n / BASE_DIGITS;
+    if (whole >= limbs.size()) {
+        limbs.clear();
+        negative = false;
+        return;
+    }
+    limbs.erase(limbs.begin(), limbs.begin() + whole);
+    if (n % BASE_DIGITS) div_small(POW10_U32[n % BASE_DIGITS]);
+    trim();
+}
+
+void BigInt::divide(const BigInt &dividend, const BigInt &divisor, BigInt *quotient, BigInt *remainder) {
+    BigInt q, r;
+    if (compare_magnitude(dividend, divisor) < 0) {
+        r = dividend;
+    } else if (divisor.limbs.size() == 1) {
+        q = dividend;
+        q.negative = false;
+        uint32_t rem = q.div_small(divisor.limbs[0]);
+        if (rem) r.limbs.push_back(rem);
+    } else {
+        divide_limbs(dividend.limbs, divisor.limbs, &q.limbs, &r.limbs);
+    }
+    q.negative = dividend.negative != divisor.negative;
+    q.trim();
+    r.negative = dividend.negative;
+    r.trim();
+    if (quotient) *quotient = q;
+    if (remainder) *remainder = r;
+}
+
+BigInt BigInt::isqrt(const BigInt &n) {
+    if (n.limbs.empty()) return BigInt();
+
+    // Start just above the root: a double estimate from the top limbs,
+    // raised by one part in 10^9 to cover its error
+    size_t top = n.limbs.size() >= 3 ? 3 : n.limbs.size();
+    size_t shift = n.limbs.size() - top;
+    if (shift % 2) {
+        top++;
+        shift--;
+    }
+    double lead = 0;
+    for (size_t i = 0; i < top; i++) lead = lead * BASE + n.limbs[n.limbs.size() - 1 - i];
+    double root = sqrt(lead);
+    BigInt x;
+    while (root >= 1) {
+        double limb = fmod(root, (double)BASE);
+        x.limbs.push_back((uint32_t)limb);
+        root = floor(root / BASE);
+    }
+    x.trim();
+    x.limbs.insert(x.limbs.begin(), shift / 2, 0);
+    BigInt margin = x;
+    margin.div_pow10(BASE_DIGITS);
+    x += margin;
+    x.add_small(2);
+
+    // Newton from above decreases monotonically to floor(sqrt(n))
+    for (;;) {
+        BigInt y;
+        divide(n, x, &y, NULL);
+        y += x;
+        y.div_small(2);
+        if (compare_magnitude(y, x) >= 0) break;
+        x = y;
+    }
+    return x;
+}
+
+BigInt BigInt::range_product(uint32_t lo, uint32_t hi) {
+    if (lo > hi) return BigInt(1);
+    if (hi - lo < 16) {
+        BigInt r(1);
+        uint64_t acc = 1;
+        for (uint64_t i = lo; i <= hi; i++) {
+            if (acc * i >= BASE) {
+                r.mul_small((uint32_t)acc);
+                acc = 1;
+            }
+            acc *= i;
+        }
+        r.mul_small((uint32_t)acc);
+        return r;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    return range_product(lo, mid) * range_product(mid + 1, hi);
+}
+
+BigInt BigInt::factorial(uint32_t n) {
+    if (n <= MAX_SMALL_FACTORIAL) return BigInt((long long)small_factorial(n));
+    if (n < PRIME_SWING_THRESHOLD) return range_product(2, n);
+    std::vector<uint32_t> primes, factors;
+    primes_up_to(n, primes);
+    return swing_factorial(n, primes, factors);
+}
+
+BigInt BigInt::binomial(uint32_t n, uint32_t k) {
+    if (k > n) return BigInt();
+    if (k > n - k) k = n - k;
+    if (k == 0) return BigInt(1);
+    if (n > MAX_SIEVE) {
+        BigInt q;
+        divide(range_product(n - k + 1, n), factorial(k), &q, NULL);
+        return q;
+    }
+    // The exponent of p is the number of carries adding k and n-k in base p
+    // (Kummer), and p^e never exceeds n
+    std::vector<uint32_t> primes, factors;
+    primes_up_to(n, primes);
+    for (size_t i = 0; i < primes.size(); i++) {
+        uint32_t p = primes[i];
+        if (p > n - k) {
+            factors.push_back(p); // Primes in (n-k, n] divide the numerator once
+            continue;
+        }
+        uint32_t power = 1;
+        for (uint64_t q = p; q <= n; q *= p) {
+            if (n / q - k / q - (n - k) / q) power *= p;
+        }
+        if (power > 1) factors.push_back(power);
+    }
+    return list_product(factors, 0, factors.size());
+}
+
+bool BigInt::parse(const char *digits, size_t len) {
+    limbs.clear();
+    negative = false;
+    if (len == 0) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (digits[i] < '0' || digits[i] > '9') return false;
+    }
+    limbs.reserve(len / BASE_DIGITS + 1);
+    size_t end = len;
+    while (end > 0) {
+        size_t start = end >= (size_t)BASE_DIGITS ? end - BASE_DIGITS : 0;
+        uint32_t limb = 0;
+        for (size_t i = start; i < end; i++) limb = limb * 10 + (digits[i] - '0');
+        limbs.push_back(limb);
+        end = start;
+    }
+    trim();
+    return true;
+}
+
+void BigInt::append_to(std::string &out) const {
+    if (limbs.empty()) {
+        out.push_back('0');
+        return;
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", limbs.back());
+    out.append(buf);
+    for (size_t i = limbs.size() - 1; i-- > 0;) {
+        snprintf(buf, sizeof(buf), "%09u", limbs[i]);
+        out.append(buf, BASE_DIGITS);
+    }
+}
+
+std::string BigInt::to_string() const {
+    std::string s;
+    if (negative) s.push_back('-');
+    append_to(s);
+    return s;
+}
+
+bool BigInt::to_long(long *value) const {
+    if (limbs.size() > 2) return false; // Below 10^18 fits any 64-bit long
+    long long v = 0;
+    for (size_t i = limbs.size(); i-- > 0;) v = v * BASE + limbs[i];
+    if (sizeof(long) < 8 && (v > 2147483647LL)) return false;
+    *value = (long)(negative ? -v : v);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// BigFloat
+
+bool BigFloat::parse(const char *text, size_t len, BigFloat *value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+    }
+    std::string digits;
+    long exponent = 0;
+    bool any = false;
+    while (i < len && text[i] >= '0' && text[i] <= '9') {
+        digits.push_back(text[i++]);
+        any = true;
+    }
+    if (i < len && text[i] == '.') {
+        i++;
+        while (i < len && text[i] >= '0' && text[i] <= '9') {
+            digits.push_back(text[i++]);
+            exponent--;
+            any = true;
+        }
+    }
+    if (!any) return false;
+    if (i + 1 < len && (text[i] == 'e' || text[i] == 'E')) {
+        size_t j = i + 1;
+        bool exp_negative = false;
+        if (text[j] == '+' || text[j] == '-') {
+            exp_negative = text[j] == '-';
+            j++;
+        }
+        if (j < len && text[j] >= '0' && text[j] <= '9') {
+            long e = 0;
+            while (j < len && text[j] >= '0' && text[j] <= '9') {
+                if (e < 1000000000L) e = e * 10 + (text[j] - '0');
+                j++;
+            }
+            exponent += exp_negative ? -e : e;
+            i = j;
+        }
+    }
+    if (i != len) return false;
+
+    BigFloat result;
+    result.mantissa.parse(digits.data(), digits.size());
+    result.exponent = exponent;
+    if (negative) result.mantissa.negate();
+    result.normalize();
+    *value = result;
+    return true;
+}
+
+bool BigFloat::from_double(double value, BigFloat *out) {
+    if (value != value || value == HUGE_VAL || value == -HUGE_VAL) return false;
+    char text[FORMAT_BUFFER_SIZE];
+    size_t len = format_number(value, text, FORMAT_BUFFER_SIZE - 1);
+    return parse(text, len, out);
+}
+
+bool BigFloat::is_integer() const {
+    if (exponent >= 0 || mantissa.is_zero()) return true;
+    return (long)mantissa.trailing_zeros() >= -exponent;
+}
+
+void BigFloat::normalize() {
+    if (mantissa.is_zero()) {
+        exponent = 0;
+        return;
+    }
+    size_t zeros = mantissa.trailing_zeros();
+    if (zeros) {
+        mantissa.div_pow10(zeros);
+        exponent += (long)zeros;
+    }
+}
+
+bool BigFloat::round(size_t significant) {
+    if (significant == 0) significant = 1;
+    size_t d = digits();
+    if (mantissa.is_zero() || d <= significant) return false;
+
+    size_t drop = d - significant;
+    unsigned first = mantissa.digit(drop - 1);
+    bool sticky = false;
+    for (size_t limb = 0; limb < (drop - 1) / BigInt::BASE_DIGITS && !sticky; limb++) {
+        sticky = mantissa.limbs[limb] != 0;
+    }
+    if (!sticky) {
+        size_t limb = (drop - 1) / BigInt::BASE_DIGITS;
+        sticky = mantissa.limbs[limb] % POW10_U32[(drop - 1) % BigInt::BASE_DIGITS] != 0;
+    }
+
+    bool negative = mantissa.is_negative();
+    mantissa.div_pow10(drop);
+    exponent += (long)drop;
+    bool up = first > 5 || (first == 5 && (sticky || mantissa.is_odd()));
+    if (up) {
+        if (negative) mantissa.negate();
+        mantissa.add_small(1);
+        if (negative) mantissa.negate();
+    }
+    if (mantissa.is_zero()) exponent = 0;
+    normalize();
+    return first != 0 || sticky;
+}
+
+int BigFloat::compare(const BigFloat &other) const {
+    BigFloat diff = *this - other;
+    return diff.is_zero() ? 0 : (diff.is_negative() ? -1 : 1);
+}
+
+double BigFloat::to_double() const {
+    if (mantissa.is_zero()) return 0;
+    BigFloat lead = *this;
+    lead.round(20);
+    std::string text = lead.mantissa.to_string();
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "e%ld", lead.exponent);
+    text += suffix;
+    double value = 0;
+    bool negative = text[0] == '-';
+    parse_number(text.data() + negative, text.size() - negative, &value);
+    return negative ? -value : value;
+}
+
+bool BigFloat::to_long(long *value) const {
+    if (!is_integer()) return false;
+    if (magnitude() > 17) return false;
+    BigInt whole = mantissa;
+    if (exponent >= 0) {
+        whole.mul_pow10(exponent);
+    } else {
+        whole.div_pow10(-exponent);
+    }
+    return whole.to_long(value);
+}
+
+std::string BigFloat::to_exact_string() const {
+    std::string s = mantissa.to_string();
+    if (exponent != 0 && !mantissa.is_zero()) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "e%ld", exponent);
+        s += suffix;
+    }
+    return s;
+}
+
+BigFloat operator+(const BigFloat &a, const BigFloat &b) {
+    if (a.is_zero()) return b;
+    if (b.is_zero()) return a;
+    BigFloat r;
+    if (a.exponent >= b.exponent) {
+        r.mantissa = a.mantissa;
+        r.mantissa.mul_pow10(a.exponent - b.exponent);
+        r.mantissa += b.mantissa;
+        r.exponent = b.exponent;
+    } else {
+        r.mantissa = b.mantissa;
+        r.mantissa.mul_pow10(b.exponent - a.exponent);
+        r.mantissa += a.mantissa;
+        r.exponent = a.exponent;
+    }
+    r.normalize();
+    return r;
+}
+
+BigFloat operator-(const BigFloat &a, const BigFloat &b) {
+    BigFloat negated = b;
+    negated.negate();
+    return a + negated;
+}
+
+BigFloat operator*(const BigFloat &a, const BigFloat &b) {
+    BigFloat r;
+    r.mantissa = a.mantissa * b.mantissa;
+    r.exponent = a.exponent + b.exponent;
+    r.normalize();
+    return r;
+}
+
+// ---------------------------------------------------------------------------
+// Functions. The helpers below work at a fixed working precision and are
+// accurate to a few units in the last working digit; the public functions
+// add guard digits and round.
+
+namespace {
+
+BigFloat rounded(BigFloat x, size_t digits) {
+    x.round(digits);
+    return x;
+}
+
+// a / b to `digits` significant digits, truncated
+BigFloat divide_approx(const BigFloat &a, const BigFloat &b, size_t digits) {
+    BigInt num = a.significand();
+    long exponent = a.exp10() - b.exp10();
+    long need = (long)digits + (long)b.digits() - (long)a.digits() + 1;
+    if (need > 0) {
+        num.mul_pow10(need);
+        exponent -= need;
+    }
+    BigInt q;
+    BigInt::divide(num, b.significand(), &q, NULL);
+    return rounded(BigFloat(q, exponent), digits);
+}
+
+// x / d for a small positive integer d
+BigFloat divide_small(const BigFloat &x, uint32_t d, size_t digits) {
+    BigInt m = x.significand();
+    long exponent = x.exp10();
+    long need = (long)digits + 10 - (long)x.digits();
+    if (need > 0) {
+        m.mul_pow10(need);
+        exponent -= need;
+    }
+    m.div_small(d);
+    return rounded(BigFloat(m, exponent), digits);
+}
+
+BigFloat mul_round(const BigFloat &a, const BigFloat &b, size_t digits) {
+    return rounded(rounded(a, digits) * rounded(b, digits), digits);
+}
+
+// 2·atanh(1/n) = ln((n+1)/(n-1)) for an integer n >= 2
+BigFloat ln_ratio(uint32_t n, size_t digits) {
+    BigFloat power = divide_small(BigFloat(1), n, digits);
+    BigFloat sum = power;
+    uint64_t nn = (uint64_t)n * n;
+    for (uint32_t k = 1;; k++) {
+        power = nn < BigInt::BASE ? divide_small(power, (uint32_t)nn, digits)
+                                  : divide_small(divide_small(power, n, digits), n, digits);
+        if (power.is_zero()) break;
+        BigFloat term = divide_small(power, 2 * k + 1, digits);
+        if (term.is_zero() || term.magnitude() < sum.magnitude() - (long)digits - 2) break;
+        if (big_cancelled()) break;
+        sum = sum + term;
+        sum.round(digits);
+    }
+    return sum + sum;
+}
+
+// Constants are cached per thread at the highest precision asked for
+struct ConstantCache {
+    size_t digits;
+    BigFloat value;
+    ConstantCache() : digits(0) {}
+};
+
+thread_local ConstantCache ln2_cache, ln10_cache, pi_cache;
+
+BigFloat ln2(size_t digits) {
+    if (ln2_cache.digits < digits) {
+        BigFloat value = rounded(ln_ratio(3, digits + 5), digits + 2);
+        if (big_cancelled()) return value; // Never cache a cut-short value
+        ln2_cache.value = value;
+        ln2_cache.digits = digits;
+    }
+    return rounded(ln2_cache.value, digits + 2);
+}
+
+BigFloat ln10(size_t digits) {
+    if (ln10_cache.digits < digits) {
+        // ln 10 = 3 ln 2 + ln(5/4), and ln(5/4) = 2·atanh(1/9)
+        BigFloat l2 = ln2(digits + 5);
+        BigFloat value = rounded(l2 + l2 + l2 + ln_ratio(9, digits + 5), digits + 2);
+        if (big_cancelled()) return value;
+        ln10_cache.value = value;
+        ln10_cache.digits = digits;
+    }
+    return rounded(ln10_cache.value, digits + 2);
+}
+
+// Chudnovsky series by binary splitting
+const uint64_t CHUDNOVSKY_C3_OVER_24 = 10939058860032000ULL;
+
+void chudnovsky(uint32_t a, uint32_t b, BigInt &p, BigInt &q, BigInt &t) {
+    if (b - a == 1) {
+        if (a == 0) {
+            p = BigInt(1);
+            q = BigInt(1);
+        } else {
+            p = BigInt((long long)(6 * (uint64_t)a - 5) * (long long)(2 * (uint64_t)a - 1));
+            p *= BigInt((long long)(6 * (uint64_t)a - 1));
+            q = BigInt((long long)a * a);
+            q *= BigInt((long long)a);
+            q *= BigInt((long long)CHUDNOVSKY_C3_OVER_24);
+        }
+        t = p * BigInt(13591409LL + 545140134LL * a);
+        if (a & 1) t.negate();
+        return;
+    }
+    uint32_t m = a + (b - a) / 2;
+    BigInt p2, q2, t2;
+    chudnovsky(a, m, p, q, t);
+    if (b - a > 64 && big_cancelled()) return;
+    chudnovsky(m, b, p2, q2, t2);
+    t = t * q2 + p * t2;
+    p *= p2;
+    q *= q2;
+}
+
+BigFloat pi_value(size_t digits) {
+    if (pi_cache.digits < digits) {
+        size_t wp = digits + 5;
+        uint32_t terms = (uint32_t)(wp / 14 + 2);
+        BigInt p, q, t;
+        chudnovsky(0, terms, p, q, t);
+        if (big_cancelled()) return BigFloat(3);
+        BigFloat root;
+        big_sqrt(BigFloat(10005), wp, &root);
+        BigFloat numerator = BigFloat(q, 0) * BigFloat(426880) * root;
+        pi_cache.value = rounded(divide_approx(numerator, BigFloat(t, 0), wp), digits + 2);
+        pi_cache.digits = digits;
+    }
+    return rounded(pi_cache.value, digits + 2);
+}
+
+bool exp_approx(const BigFloat &x, size_t digits, BigFloat *out) {
+    if (x.is_zero()) {
+        *out = BigFloat(1);
+        return true;
+    }
+    // Results must keep a representable exponent
+    double approx = x.to_double();
+    if (!(fabs(approx) < 1e15)) return false;
+
+    // x = k·ln 10 + r with 0 <= r < ln 10
+    long k = (long)floor(approx / 2.302585092994046);
+    size_t k_digits = 0;
+    for (long t = k < 0 ? -k : k; t; t /= 10) k_digits++;
+    BigFloat r = x;
+    if (k != 0) {
+        r = rounded(x, digits + k_digits + 5) - BigFloat(k) * ln10(digits + k_digits + 5);
+    }
+
+    // exp(r) = exp(r / 2^s)^(2^s); halving is exact as × 5^s × 10^-s
+    size_t s = 4 + (size_t)sqrt((double)digits);
+    size_t wp = digits + s / 3 + 10;
+    BigFloat y = BigFloat(r.significand() * pow5_int(s), r.exp10() - (long)s);
+    y.round(wp);
+
+    BigFloat sum(1), term(1);
+    for (uint32_t i = 1;; i++) {
+        term = divide_small(mul_round(term, y, wp), i, wp);
+        if (term.is_zero() || term.magnitude() < -(long)wp - 2 || big_cancelled()) break;
+        sum = rounded(sum + term, wp);
+    }
+    for (size_t i = 0; i < s; i++) sum = mul_round(sum, sum, wp);
+    sum.scale10(k);
+    *out = sum;
+    return true;
+}
+
+// ln x for x > 0
+BigFloat ln_approx(const BigFloat &x, size_t digits) {
+    size_t wp = digits + 10;
+    long e = 0;
+    int halvings = 0;
+    BigFloat y = rounded(x, wp + 5);
+
+    // Near 1 the series is used directly so nothing cancels
+    bool near_one = y.compare(BigFloat(BigInt(75), -2)) >= 0 && y.compare(BigFloat(BigInt(15), -1)) < 0;
+    if (!near_one) {
+        e = y.magnitude();
+        y.scale10(-e);
+        // y in [1, 10): divide by 2^a into [0.75, 1.5)
+        while (y.compare(BigFloat(BigInt(15), -1)) >= 0) {
+            y = BigFloat(y.significand() * BigInt(5), y.exp10() - 1);
+            halvings++;
+        }
+    }
+
+    size_t e_digits = 0;
+    for (long t = e < 0 ? -e : e; t; t /= 10) e_digits++;
+    wp += e_digits;
+
+    // ln y = 2·atanh(z), z = (y-1)/(y+1)
+    BigFloat z = divide_approx(y - BigFloat(1), y + BigFloat(1), wp);
+    BigFloat z2 = mul_round(z, z, wp);
+    BigFloat power = z, sum = z;
+    if (!z.is_zero()) {
+        for (uint32_t k = 1;; k++) {
+            power = mul_round(power, z2, wp);
+            BigFloat term = divide_small(power, 2 * k + 1, wp);
+            if (term.is_zero() || term.magnitude() < sum.magnitude() - (long)wp - 2) break;
+            if (big_cancelled()) break;
+            sum = rounded(sum + term, wp);
+        }
+    }
+    BigFloat result = sum + sum;
+    if (e != 0) result = result + BigFloat(e) * ln10(wp);
+    if (halvings != 0) result = result + BigFloat(halvings) * ln2(wp);
+    return rounded(result, wp);
+}
+
+// sin or cos of t radians, |t| <= π/4
+BigFloat sin_series(const BigFloat &t, size_t digits, bool cosine) {
+    size_t wp = digits + 5;
+    BigFloat t2 = mul_round(t, t, wp);
+    BigFloat term = cosine ? BigFloat(1) : rounded(t, wp);
+    BigFloat sum = term;
+    for (uint32_t k = cosine ? 1 : 2;; k += 2) {
+        term = mul_round(term, t2, wp);
+        uint64_t d = (uint64_t)k * (k + 1);
+        term = d < BigInt::BASE ? divide_small(term, (uint32_t)d, wp)
+                                : divide_small(divide_small(term, k, wp), k + 1, wp);
+        term.negate();
+        if (term.is_zero() || term.magnitude() < -(long)wp - 2 || big_cancelled()) break;
+        sum = rounded(sum + term, wp);
+    }
+    return sum;
+}
+
+// x mod 360 exactly, in [0, 360)
+BigFloat reduce_degrees(const BigFloat &x) {
+    BigFloat r;
+    if (x.exp10() >= 0) {
+        // (m · 10^e) mod 360 from the pieces' residues
+        uint32_t m = x.significand().mod_small(360);
+        uint32_t p = 1;
+        for (long i = 0; i < x.exp10() && i < 8; i++) p = (p * 10) % 360;
+        // 10^e mod 360 is 280 for every e >= 3
+        if (x.exp10() >= 3) p = 280;
+        r = BigFloat((m * p) % 360);
+        if (x.is_negative() && !r.is_zero()) r = BigFloat(360) - r;
+        return r;
+    }
+    BigInt modulus(360);
+    modulus.mul_pow10(-x.exp10());
+    BigInt rem;
+    BigInt::divide(x.significand(), modulus, NULL, &rem);
+    r = BigFloat(rem, x.exp10());
+    if (r.is_negative()) r = r + BigFloat(360);
+    r.normalize();
+    return r;
+}
+
+// sin of an exactly reduced angle in degrees, [0, 360). Sets *exact for
+// the angles with rational sines.
+BigFloat sin_reduced(BigFloat r, size_t digits, bool *exact) {
+    bool negative = false;
+    if (r.compare(BigFloat(180)) >= 0) {
+        negative = true;
+        r = r - BigFloat(180);
+    }
+    if (r.compare(BigFloat(90)) > 0) r = BigFloat(180) - r;
+
+    BigFloat result;
+    *exact = true;
+    if (r.is_zero()) {
+        result = BigFloat(0);
+    } else if (r.compare(BigFloat(30)) == 0) {
+        result = BigFloat(BigInt(5), -1);
+    } else if (r.compare(BigFloat(90)) == 0) {
+        result = BigFloat(1);
+    } else {
+        *exact = false;
+        size_t wp = digits + 5;
+        bool cosine = r.compare(BigFloat(45)) > 0;
+        if (cosine) r = BigFloat(90) - r;
+        BigFloat t = divide_small(mul_round(r, pi_value(wp), wp), 180, wp);
+        result = sin_series(t, wp, cosine);
+    }
+    if (negative) result.negate();
+    return result;
+}
+
+// Round a guarded approximation to `digits`, unless it is too close to a
+// rounding midpoint to decide; then the caller retries with more guard
+bool round_if_safe(BigFloat approx, size_t digits, size_t guard, BigFloat *out) {
+    size_t d = approx.digits();
+    if (approx.is_zero() || d <= digits) {
+        *out = approx;
+        return true;
+    }
+    // Digits beyond `digits`, up to the guard, relative to the midpoint
+    size_t extra = std::min(d - digits, guard);
+    BigFloat low = approx;
+    low.round(digits + extra);
+    size_t low_digits = low.digits();
+    if (low_digits > digits) {
+        BigInt tail = low.significand();
+        if (tail.is_negative()) tail.negate();
+        BigInt head = tail;
+        head.div_pow10(low_digits - digits);
+        BigInt base_part = head;
+        base_part.mul_pow10(low_digits - digits);
+        tail -= base_part; // Digits after the cut
+        BigInt half(5);
+        half.mul_pow10(low_digits - digits - 1);
+        BigInt distance = tail - half;
+        if (distance.is_negative()) distance.negate();
+        // Error is a few units of the last guard digit
+        if (BigInt::compare_magnitude(distance, BigInt(1000)) <= 0 && low_digits - digits > 3) return false;
+    }
+    approx.round(digits);
+    *out = approx;
+    return true;
+}
+
+// Decimal digits of n! from Stirling, for choosing exact or rounded
+double factorial_digits(double n) {
+    return lgamma(n + 1) / 2.302585092994046;
+}
+
+// Shared argument checks for nCr and nPr: integers with 0 <= r <= n
+bool count_arguments(const BigFloat &n, const BigFloat &r, uint32_t *n_out, uint32_t *r_out) {
+    long nl, rl;
+    if (n.is_negative() || r.is_negative() || !n.to_long(&nl) || !r.to_long(&rl)) return false;
+    if (rl > nl || nl > 4294967295L) return false;
+    *n_out = (uint32_t)nl;
+    *r_out = (uint32_t)rl;
+    return true;
+}
+
+// lo × … × hi kept to `digits` significant digits as it grows
+BigFloat rounded_product(uint32_t lo, uint32_t hi, size_t digits) {
+    BigInt m(1);
+    long exponent = 0;
+    uint64_t acc = 1;
+    for (uint64_t i = lo; i <= hi; i++) {
+        if (acc * i >= BigInt::BASE) {
+            m.mul_small((uint32_t)acc);
+            acc = 1;
+            if (m.digit_count() > digits + 2 * BigInt::BASE_DIGITS) {
+                size_t drop = m.digit_count() - digits - BigInt::BASE_DIGITS;
+                m.div_pow10(drop);
+                exponent += (long)drop;
+                if (big_cancelled()) break;
+            }
+        }
+        acc *= i;
+    }
+    m.mul_small((uint32_t)acc);
+    BigFloat product(m, exponent);
+    product.round(digits);
+    return product;
+}
+
+// Correctly rounded lo × … × hi; each truncation above loses at most one
+// unit in `digits`, so log10(count) extra guard digits cover them all
+bool rounded_product_checked(uint32_t lo, uint32_t hi, size_t digits, BigFloat *out) {
+    if (hi >= lo && hi - lo > MAX_ROUNDED_FACTORS) return false;
+    size_t count_digits = 1;
+    for (uint32_t c = hi - lo + 1; c >= 10; c /= 10) count_digits++;
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        approx = rounded_product(lo, hi, digits + guard + count_digits);
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+// Γ(s) for s > 0 from the lower incomplete gamma series
+//   Γ(s) ≈ N^s e^-N Σ N^k / (s (s+1) … (s+k))
+// whose neglected tail Γ(s, N) is below 10^-digits of the result once
+// N >= 2s + 2·digits·ln 10
+bool gamma_positive(const BigFloat &s, size_t digits, BigFloat *out) {
+    double sd = s.to_double();
+    double w = (double)digits * 2.302585092994046 + 10;
+    double nd = ceil(2 * sd + 2 * w);
+    if (nd * 3 > MAX_GAMMA_TERMS) return false;
+    uint32_t n = (uint32_t)nd;
+    size_t extra = 2;
+    for (double t = nd; t >= 1; t /= 10) extra++;
+    size_t wp = digits + extra;
+
+    // A short decimal s = M·10^-d divides as ×10^d / (M + k·10^d), a
+    // single-limb division; anything longer takes the general path
+    BigFloat exact_s = s;
+    exact_s.normalize();
+    long scale = exact_s.exp10() < 0 ? -exact_s.exp10() : 0;
+    long m_value = 0;
+    bool fast = scale < 9 && exact_s.significand().limb_count() <= 1;
+    if (fast) {
+        BigFloat whole = exact_s;
+        whole.scale10(scale);
+        fast = whole.to_long(&m_value) && m_value > 0;
+    }
+    uint64_t step = 1;
+    for (long i = 0; i < scale; i++) step *= 10;
+
+    BigFloat term;
+    big_divide(BigFloat(1), s, wp, &term);
+    BigFloat sum = term;
+    for (uint32_t k = 1;; k++) {
+        term = BigFloat(term.significand() * BigInt((long long)n), term.exp10());
+        uint64_t denominator = (uint64_t)m_value + (uint64_t)k * step;
+        if (fast && denominator < 4294967296ULL) {
+            term.scale10(scale);
+            term = divide_small(term, (uint32_t)denominator, wp);
+        } else {
+            term = divide_approx(term, s + BigFloat(k), wp);
+        }
+        sum = rounded(sum + term, wp);
+        // Past the peak (k > N - s) the terms only shrink
+        if (k > nd - sd && term.magnitude() < sum.magnitude() - (long)wp - 2) break;
+        if (k > 3 * n || big_cancelled()) return false;
+    }
+
+    // N^s e^-N = exp(s ln N - N)
+    BigFloat log_n = ln_approx(BigFloat(n), wp + extra);
+    BigFloat power;
+    if (!exp_approx(mul_round(s, log_n, wp + extra) - BigFloat(n), wp, &power)) return false;
+    *out = mul_round(power, sum, wp);
+    return true;
+}
+
+// Γ(s) for any non-integer s; reflection Γ(s) = π / (sin(πs) Γ(1-s)) on
+// the left half, with sin(πs) taken as sin(180·s) in exact degrees
+bool gamma_approx(const BigFloat &s, size_t digits, BigFloat *out) {
+    if (s.compare(BigFloat(BigInt(5), -1)) >= 0) return gamma_positive(s, digits, out);
+    size_t wp = digits + 5;
+    BigFloat reflected;
+    if (!gamma_positive(BigFloat(1) - s, wp, &reflected)) return false;
+    BigFloat sine;
+    bool sine_exact;
+    big_sin_degrees(s * BigFloat(180), wp, &sine, &sine_exact);
+    if (sine.is_zero()) return false;
+    *out = divide_approx(pi_value(wp), mul_round(sine, reflected, wp), wp);
+    return true;
+}
+
+} // namespace
+
+bool big_divide(const BigFloat &a, const BigFloat &b, size_t digits, BigFloat *out, bool *exact) {
+    if (b.is_zero()) return false;
+    BigInt num = a.significand();
+    long exponent = a.exp10() - b.exp10();
+    long need = (long)digits + (long)b.digits() - (long)a.digits() + 2;
+    if (need > 0) {
+        num.mul_pow10(need);
+        exponent -= need;
+    }
+    BigInt q, r;
+    BigInt::divide(num, b.significand(), &q, &r);
+    // A nonzero remainder is a sticky digit below the quotient
+    if (!r.is_zero()) {
+        q.mul_small(10);
+        q.add_small(q.is_negative() ? 0 : 1);
+        if (q.is_negative()) {
+            q.negate();
+            q.add_small(1);
+            q.negate();
+        }
+        exponent--;
+    }
+    BigFloat result(q, exponent);
+    bool dropped = result.round(digits);
+    if (exact) *exact = r.is_zero() && !dropped;
+    result.normalize();
+    *out = result;
+    return true;
+}
+
+bool big_sqrt(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    if (x.is_negative()) return false;
+    if (x.is_zero()) {
+        *out = BigFloat(0);
+        if (exact) *exact = true;
+        return true;
+    }
+    BigFloat v = x;
+    bool input_rounded = v.round(2 * digits + 8);
+    BigInt m = v.significand();
+    long e = v.exp10();
+    long want = 2 * ((long)digits + 4) - (long)v.digits();
+    long s = want > 0 ? want : 0;
+    if ((e - s) % 2 != 0) s++;
+    m.mul_pow10(s);
+    BigInt root = BigInt::isqrt(m);
+    bool perfect = !input_rounded && (root * root).compare(m) == 0;
+    if (!perfect) {
+        // Sticky digit so rounding sees the remainder
+        root.mul_small(10);
+        root.add_small(1);
+        s += 2;
+    }
+    BigFloat result(root, (e - s) / 2);
+    bool dropped = result.round(digits);
+    if (exact) *exact = perfect && !dropped;
+    result.normalize();
+    *out = result;
+    return true;
+}
+
+bool big_exp(const BigFloat &x, size_t digits, BigFloat *out) {
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        if (!exp_approx(x, digits + guard, &approx)) return false;
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+bool big_ln(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    if (x.is_zero() || x.is_negative()) return false;
+    if (exact) *exact = false;
+    if (x.compare(BigFloat(1)) == 0) {
+        *out = BigFloat(0);
+        if (exact) *exact = true;
+        return true;
+    }
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        approx = ln_approx(x, digits + guard);
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+bool big_log10(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    if (x.is_zero() || x.is_negative()) return false;
+    if (exact) *exact = false;
+    // Powers of ten are exact
+    BigFloat n = x;
+    n.normalize();
+    if (n.significand().compare(BigInt(1)) == 0) {
+        *out = BigFloat(n.exp10());
+        if (exact) *exact = true;
+        return true;
+    }
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        size_t wp = digits + guard;
+        approx = divide_approx(ln_approx(x, wp), ln10(wp), wp);
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+bool big_pow(const BigFloat &x, const BigFloat &y, size_t digits, BigFloat *out, bool *exact) {
+    if (exact) *exact = false;
+    if (y.is_zero()) {
+        *out = BigFloat(1);
+        if (exact) *exact = true;
+        return true;
+    }
+    if (x.is_zero()) {
+        if (y.is_negative()) return false;
+        *out = BigFloat(0);
+        if (exact) *exact = true;
+        return true;
+    }
+
+    long n;
+    if (y.to_long(&n)) {
+        // Estimated size of the result decides exact or rounded powering
+        double magnitude = fabs((double)n) * ((double)x.magnitude() + 1);
+        if (fabs(magnitude) > 1e15) return false;
+        unsigned long count = n < 0 ? 0UL - (unsigned long)n : (unsigned long)n;
+        bool keep_exact = n > 0 && (double)x.digits() * count <= (double)MAX_EXACT_DIGITS;
+        size_t wp = digits + GUARD_DIGITS + 20;
+        BigFloat base = x, result(1);
+        bool lossless = true;
+        while (count) {
+            if (count & 1) {
+                result = result * base;
+                if (!keep_exact) lossless = !result.round(wp) && lossless;
+            }
+            count >>= 1;
+            if (count) {
+                base = base * base;
+                if (!keep_exact) lossless = !base.round(wp) && lossless;
+            }
+        }
+        if (n < 0) {
+            bool div_exact = false;
+            if (!big_divide(BigFloat(1), result, digits, out, &div_exact)) return false;
+            if (exact) *exact = lossless && div_exact;
+            return true;
+        }
+        if (keep_exact) {
+            *out = result;
+            if (exact) *exact = true;
+            return true;
+        }
+        *out = rounded(result, digits);
+        return true;
+    }
+
+    // Non-integer powers: exp(y · ln x), defined for x > 0
+    if (x.is_negative()) return false;
+    double scale = fabs(y.to_double() * log(fabs(x.to_double())) / 2.302585092994046);
+    size_t extra = 2;
+    while (scale >= 1) {
+        extra++;
+        scale /= 10;
+    }
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        size_t wp = digits + guard + extra;
+        if (!exp_approx(mul_round(y, ln_approx(x, wp), wp), wp, &approx)) return false;
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+bool big_sin_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    BigFloat r = reduce_degrees(x);
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    bool is_exact = false;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        approx = sin_reduced(r, digits + guard, &is_exact);
+        if (is_exact || round_if_safe(approx, digits, guard, out)) break;
+    }
+    if (is_exact) *out = approx;
+    if (exact) *exact = is_exact;
+    return true;
+}
+
+bool big_cos_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    return big_sin_degrees(x + BigFloat(90), digits, out, exact);
+}
+
+bool big_tan_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    BigFloat r = reduce_degrees(x);
+    BigFloat c = reduce_degrees(r + BigFloat(90));
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        bool sin_exact, cos_exact;
+        size_t wp = digits + guard;
+        BigFloat s = sin_reduced(r, wp, &sin_exact);
+        BigFloat co = sin_reduced(c, wp, &cos_exact);
+        if (co.is_zero()) return false; // tan 90°
+        if (sin_exact && cos_exact) {
+            return big_divide(s, co, digits, out, exact);
+        }
+        approx = divide_approx(s, co, wp);
+        if (round_if_safe(approx, digits, guard, out)) break;
+    }
+    if (exact) *exact = false;
+    return true;
+}
+
+bool big_factorial(const BigFloat &x, size_t digits, BigFloat *out, bool *exact) {
+    if (exact) *exact = false;
+    if (x.is_integer()) {
+        long n;
+        if (x.is_negative() || !x.to_long(&n) || n > (long)MAX_ROUNDED_FACTORS) return false;
+        if (factorial_digits((double)n) <= (double)MAX_EXACT_DIGITS) {
+            *out = BigFloat(BigInt::factorial((uint32_t)n), 0);
+            out->normalize();
+            if (exact) *exact = true;
+            return true;
+        }
+        return rounded_product_checked(2, (uint32_t)n, digits, out);
+    }
+
+    // Γ(x+1); far from zero the series would need too many terms
+    if (fabs(x.to_double()) > MAX_GAMMA_TERMS / 8) return false;
+    BigFloat s = x + BigFloat(1);
+    size_t guard = GUARD_DIGITS;
+    BigFloat approx;
+    for (int attempt = 0; attempt <= MAX_ROUNDING_RETRIES; attempt++, guard *= 2) {
+        if (!gamma_approx(s, digits + guard, &approx)) return false;
+        if (round_if_safe(approx, digits, guard, out)) return true;
+    }
+    *out = rounded(approx, digits);
+    return true;
+}
+
+bool big_combinations(const BigFloat &n, const BigFloat &r, size_t digits, BigFloat *out, bool *exact) {
+    uint32_t nn, rr;
+    if (exact) *exact = false;
+    if (!count_arguments(n, r, &nn, &rr)) return false;
+    uint32_t k = rr < nn - rr ? rr : nn - rr;
+    double size = factorial_digits(nn) - factorial_digits(k) - factorial_digits(nn - k);
+    if (size <= (double)MAX_EXACT_DIGITS) {
+        *out = BigFloat(BigInt::binomial(nn, k), 0);
+        out->normalize();
+        if (exact) *exact = true;
+        return true;
+    }
+    // Past the exact limit: falling product over k!, both rounded
+    if (k > MAX_ROUNDED_FACTORS) return false;
+    size_t guard = GUARD_DIGITS + 10;
+    BigFloat numerator, denominator;
+    if (!rounded_product_checked(nn - k + 1, nn, digits + guard, &numerator)) return false;
+    if (!rounded_product_checked(2, k, digits + guard, &denominator)) return false;
+    *out = rounded(divide_approx(numerator, denominator, digits + guard), digits);
+    return true;
+}
+
+bool big_permutations(const BigFloat &n, const BigFloat &r, size_t digits, BigFloat *out, bool *exact) {
+    uint32_t nn, rr;
+    if (exact) *exact = false;
+    if (!count_arguments(n, r, &nn, &rr)) return false;
+    if (rr == 0) {
+        *out = BigFloat(1);
+        if (exact) *exact = true;
+        return true;
+    }
+    double size = factorial_digits(nn) - factorial_digits(nn - rr);
+    if (size <= (double)MAX_EXACT_DIGITS) {
+        *out = BigFloat(BigInt::range_product(nn - rr + 1, nn), 0);
+        out->normalize();
+        if (exact) *exact = true;
+        return true;
+    }
+    return rounded_product_checked(nn - rr + 1, nn, digits, out);
+}
+
+BigCancelScope::BigCancelScope(const std::atomic<bool> *flag) : previous(cancel_flag) {
+    cancel_flag = flag;
+}
+
+BigCancelScope::~BigCancelScope() {
+    cancel_flag = previous;
+}
+
+bool big_cancelled() {
+    return cancel_flag && cancel_flag->load(std::memory_order_relaxed);
+}
+
+BigFloat big_pi(size_t digits) {
+    return rounded(pi_value(digits + 2), digits);
+}
+
+BigFloat big_e(size_t digits) {
+    BigFloat e;
+    big_exp(BigFloat(1), digits, &e);
+    return e;
+}
+
+void format_number(const BigFloat &num, size_t max_digits, std::string &out) {
+    out.clear();
+    BigFloat v = num;
+    v.round(max_digits);
+    v.normalize();
+    if (v.is_zero()) {
+        out = "0";
+        return;
+    }
+    if (v.is_negative()) out.push_back('-');
+    std::string digits;
+    v.significand().append_to(digits);
+    long mag = v.magnitude();
+
+    if (mag >= 0 && mag < (long)std::max(max_digits, (size_t)21)) {
+        // Integer part, then any fraction
+        if ((long)digits.size() <= mag + 1) {
+            out += digits;
+            out.append(mag + 1 - digits.size(), '0');
+        } else {
+            out.append(digits, 0, mag + 1);
+            out.push_back('.');
+            out.append(digits, mag + 1, std::string::npos);
+        }
+    } else if (mag < 0 && mag > -7) {
+        out += "0.";
+        out.append(-mag - 1, '0');
+        out += digits;
+    } else {
+        out.push_back(digits[0]);
+        if (digits.size() > 1) {
+            out.push_back('.');
+            out.append(digits, 1, std::string::npos);
+        }
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "e%c%ld", mag < 0 ? '-' : '+', mag < 0 ? -mag : mag);
+        out += suffix;
+    }
+}
@@ -0,0 +1,210 @@
+#ifndef CALC_BIGNUM_H
+#define CALC_BIGNUM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Arbitrary-precision numbers for precision mode.
+//
+// BigInt stores its magnitude in base 10^9 limbs so decimal rounding and
+// printing need no base conversion. Multiplication picks schoolbook,
+// Karatsuba or a number-theoretic transform by operand size.
+//
+// BigFloat is mantissa × 10^exponent. Addition, subtraction and
+// multiplication are exact; everything else takes a digit count and
+// returns a correctly rounded result.
+
+class BigInt {
+public:
+    static const uint32_t BASE = 1000000000;
+    static const int BASE_DIGITS = 9;
+
+private:
+    std::vector<uint32_t> limbs; // Little-endian, no leading zero limbs
+    bool negative;
+
+    void trim();
+
+    friend class BigFloat;
+
+public:
+    BigInt() : negative(false) {}
+    explicit BigInt(long long value);
+
+    bool is_zero() const { return limbs.empty(); }
+    bool is_negative() const { return negative; }
+    bool is_odd() const { return !limbs.empty() && (limbs[0] & 1); }
+    size_t limb_count() const { return limbs.size(); }
+
+    // Decimal digits in the magnitude (1 for zero)
+    size_t digit_count() const;
+
+    // Decimal digit at position pos, counted from the least significant
+    unsigned digit(size_t pos) const;
+
+    // Number of trailing decimal zeros (0 for zero)
+    size_t trailing_zeros() const;
+
+    void negate() { if (!limbs.empty()) negative = !negative; }
+
+    // Magnitude comparison: negative, zero or positive
+    static int compare_magnitude(const BigInt &a, const BigInt &b);
+    int compare(const BigInt &other) const;
+
+    BigInt &operator+=(const BigInt &other);
+    BigInt &operator-=(const BigInt &other);
+    BigInt &operator*=(const BigInt &other);
+
+    // In-place operations by a single limb (0 < factor < BASE). div_small
+    // truncates toward zero and returns the magnitude of the remainder.
+    void mul_small(uint32_t factor);
+    void add_small(uint32_t addend);
+    uint32_t div_small(uint32_t divisor);
+
+    // Multiply by 10^n, or drop the n lowest decimal digits (truncating)
+    void mul_pow10(size_t n);
+    void div_pow10(size_t n);
+
+    // Remainder of the magnitude modulo a small number
+    uint32_t mod_small(uint32_t divisor) const;
+
+    // Truncating division; either output may be NULL. divisor must be nonzero.
+    static void divide(const BigInt &dividend, const BigInt &divisor, BigInt *quotient, BigInt *remainder);
+
+    // floor(sqrt(n)) for n >= 0
+    static BigInt isqrt(const BigInt &n);
+
+    // Product lo × (lo+1) × … × hi by balanced splitting
+    static BigInt range_product(uint32_t lo, uint32_t hi);
+
+    // n! by the prime-swing recursion n! = ((n/2)!)² × swing(n), where the
+    // swing is built from its prime factorisation
+    static BigInt factorial(uint32_t n);
+
+    // n! / (k! (n-k)!) from its prime factorisation (k <= n)
+    static BigInt binomial(uint32_t n, uint32_t k);
+
+    // Decimal digits (no sign, no separators)
+    bool parse(const char *digits, size_t len);
+    void append_to(std::string &out) const;
+    std::string to_string() const;
+
+    // Value if it fits, for exponents and small arguments
+    bool to_long(long *value) const;
+
+    friend BigInt operator+(BigInt a, const BigInt &b) { return a += b; }
+    friend BigInt operator-(BigInt a, const BigInt &b) { return a -= b; }
+    friend BigInt operator*(const BigInt &a, const BigInt &b);
+};
+
+class BigFloat {
+private:
+    BigInt mantissa;
+    long exponent;
+
+public:
+    BigFloat() : exponent(0) {}
+    explicit BigFloat(long long value) : mantissa(value), exponent(0) {}
+    BigFloat(const BigInt &m, long e) : mantissa(m), exponent(e) {}
+
+    // Decimal text as accepted by the expression tokenizer ("12", "0.5",
+    // "1.5e-7", optionally signed). Returns false if text is not a number.
+    static bool parse(const char *text, size_t len, BigFloat *value);
+
+    // Shortest decimal that round-trips the double; false for NaN/Infinity
+    static bool from_double(double value, BigFloat *out);
+
+    const BigInt &significand() const { return mantissa; }
+    long exp10() const { return exponent; }
+
+    bool is_zero() const { return mantissa.is_zero(); }
+    bool is_negative() const { return mantissa.is_negative(); }
+    bool is_integer() const;
+    size_t digits() const { return mantissa.digit_count(); }
+
+    // Decimal exponent of the leading digit: 2 for 123, -1 for 0.5
+    long magnitude() const { return exponent + (long)digits() - 1; }
+
+    void negate() { mantissa.negate(); }
+    void scale10(long n) { exponent += n; }
+
+    // Strip trailing zeros from the mantissa into the exponent
+    void normalize();
+
+    // Round half-to-even to the given significant digits. Returns true if
+    // any nonzero digit was dropped.
+    bool round(size_t significant);
+
+    int compare(const BigFloat &other) const;
+    double to_double() const;
+    bool to_long(long *value) const; // Integers only
+
+    // Exact text that parse() reads back ("123e-2")
+    std::string to_exact_string() const;
+
+    friend BigFloat operator+(const BigFloat &a, const BigFloat &b);
+    friend BigFloat operator-(const BigFloat &a, const BigFloat &b);
+    friend BigFloat operator*(const BigFloat &a, const BigFloat &b);
+};
+
+// Correctly rounded functions at `digits` significant digits. Each returns
+// false when the input is outside its domain (or the result would not fit);
+// *exact, when given, reports whether the result needed no rounding.
+bool big_divide(const BigFloat &a, const BigFloat &b, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_sqrt(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_exp(const BigFloat &x, size_t digits, BigFloat *out);
+bool big_ln(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_log10(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_pow(const BigFloat &x, const BigFloat &y, size_t digits, BigFloat *out, bool *exact = NULL);
+
+// Trigonometry in degrees, like the keypad. The angle is reduced modulo
+// 360 exactly, so sin(30) is exactly 0.5 and sin(10^30) is still accurate.
+bool big_sin_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_cos_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_tan_degrees(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+
+// x! = Γ(x+1). Integers are exact while the result has at most
+// MAX_EXACT_DIGITS digits and correctly rounded beyond that; other real
+// x go through Γ, with the reflection formula for x < -1/2.
+bool big_factorial(const BigFloat &x, size_t digits, BigFloat *out, bool *exact = NULL);
+
+// nCr and nPr for integers 0 <= r <= n, on the same kernels
+bool big_combinations(const BigFloat &n, const BigFloat &r, size_t digits, BigFloat *out, bool *exact = NULL);
+bool big_permutations(const BigFloat &n, const BigFloat &r, size_t digits, BigFloat *out, bool *exact = NULL);
+
+BigFloat big_pi(size_t digits);
+BigFloat big_e(size_t digits);
+
+// Cooperative cancellation. While a BigCancelScope is alive on a thread,
+// the series, splitting and product loops on that thread poll its flag and
+// stop early once it is set, leaving meaningless results; the caller
+// checks big_cancelled() before using anything computed in the scope.
+class BigCancelScope {
+private:
+    const std::atomic<bool> *previous;
+
+    BigCancelScope(const BigCancelScope &);
+    BigCancelScope &operator=(const BigCancelScope &);
+
+public:
+    explicit BigCancelScope(const std::atomic<bool> *flag);
+    ~BigCancelScope();
+};
+
+bool big_cancelled();
+
+// Largest exact integer result kept before rounding to the working digits
+const size_t MAX_EXACT_DIGITS = 200000;
+
+// Upper bound for a user-chosen precision
+const size_t MAX_PRECISION_DIGITS = 100000;
+
+// Display text with at most max_digits significant digits. Plain notation
+// while the number fits in max_digits places, scientific ("1.5e+300")
+// beyond that.
+void format_number(const BigFloat &num, size_t max_digits, std::string &out);
+
+#endif // CALC_BIGNUM_H
@@ -0,0 +1,568 @@
+#include "calc_calculus.h"
+#include "calc_format.h"
+#include "calc_vecmath.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// Gauss–Kronrod 7/15 on [-1, 1] (QUADPACK qk15): Kronrod nodes from the
+// outside in, the odd ones shared with the 7-point Gauss rule, then the
+// centre
+const double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0
+};
+const double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+const double GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+const size_t KRONROD_POINTS = 15;
+
+// Error estimates are short, so anything small goes to "1.2e-14"
+const int ESTIMATE_WIDTH = 8;
+
+// Segments between exact re-sums of an adaptive integral
+const size_t RESUM_INTERVAL = 256;
+
+const int BRENT_ITERATIONS = 200;
+const int NEWTON_ITERATIONS = 100;
+
+// Ridders' method: each step divides h by RIDDERS_SHRINK; stop once the
+// error grows past RIDDERS_SAFE times the best seen
+const double RIDDERS_SHRINK = 1.4;
+const double RIDDERS_SAFE = 2.0;
+const int RIDDERS_STEPS = 10;
+
+// Signs compared directly: a product of tiny values underflows to zero
+bool opposite_signs(double a, double b) {
+    return (a < 0 && b > 0) || (a > 0 && b < 0);
+}
+
+bool same_sign(double a, double b) {
+    return (a < 0 && b < 0) || (a > 0 && b > 0);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// f at one or many points for one thread, counting evaluations. Points
+// where the program fails are NaN.
+class Sampler {
+private:
+    const Program &f;
+    const VecMath &math;
+    std::vector<double> stack;
+
+public:
+    uint64_t evaluations;
+
+    explicit Sampler(const Program &program) : f(program), math(vecmath_best()), evaluations(0) {}
+
+    double at(double x) {
+        evaluations++;
+        EvalResult result = f.run(x);
+        return result.status == EVAL_OK ? result.value : NAN;
+    }
+
+    void at(const double *x, double *out, size_t n) {
+        evaluations += n;
+        for (size_t i = 0; i < n; i += VECTOR_BATCH) {
+            f.run_vector(x + i, out + i, std::min(VECTOR_BATCH, n - i), math, stack);
+        }
+    }
+};
+
+size_t thread_count(const CalculusOptions &options) {
+    size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+// work(index) for index 0 to count - 1, each taken by the next free one
+// of `threads` threads (this one included); work(index, sampler)
+template <typename F>
+uint64_t for_each_index(const Program &f, size_t count, size_t threads, F work) {
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> evaluations(0);
+    auto loop = [&]() {
+        Sampler sampler(f);
+        for (size_t i = next++; i < count; i = next++) work(i, sampler);
+        evaluations += sampler.evaluations;
+    };
+    threads = std::min(threads, count);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++) workers.push_back(std::thread(loop));
+    loop();
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    return evaluations;
+}
+
+// Brent's method on [a, b] with f(a) and f(b) of opposite signs. NaN if f
+// stops being finite inside.
+double brent(Sampler &sampler, double a, double b, double fa, double fb) {
+    double c = a, fc = fa, d = b - a, e = d;
+    for (int iteration = 0; iteration < BRENT_ITERATIONS; iteration++) {
+        if ((fb > 0) == (fc > 0)) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (fabs(fc) < fabs(fb)) {
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        double tolerance = 2 * DBL_EPSILON * fabs(b) + DBL_MIN;
+        double half = (c - b) / 2;
+        if (fabs(half) <= tolerance || fb == 0) return b;
+        if (fabs(e) >= tolerance && fabs(fa) > fabs(fb)) {
+            // Secant, or inverse quadratic interpolation through a, b, c
+            double s = fb / fa, p, q;
+            if (a == c) {
+                p = 2 * half * s;
+                q = 1 - s;
+            } else {
+                double r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * half * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q;
+            p = fabs(p);
+            if (2 * p < std::min(3 * half * q - fabs(tolerance * q), fabs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = half;
+                e = d;
+            }
+        } else {
+            d = half;
+            e = d;
+        }
+        a = b;
+        fa = fb;
+        b += fabs(d) > tolerance ? d : copysign(tolerance, half);
+        fb = sampler.at(b);
+        if (!std::isfinite(fb)) return NAN;
+    }
+    return b;
+}
+
+// Central difference with a step suited to x and the scale of the search
+double slope(Sampler &sampler, double x, double scale) {
+    double h = 6e-6 * std::max(fabs(x), scale);
+    return (sampler.at(x + h) - sampler.at(x - h)) / (2 * h);
+}
+
+// Newton's method from x, staying inside [low, high]. NaN if it leaves or
+// the derivative vanishes before f does.
+double newton(Sampler &sampler, double x, double low, double high, double scale) {
+    for (int iteration = 0; iteration < NEWTON_ITERATIONS; iteration++) {
+        double fx = sampler.at(x);
+        if (fx == 0) return x;
+        double dfx = slope(sampler, x, scale);
+        if (!std::isfinite(fx) || !std::isfinite(dfx) || dfx == 0) return x;
+        double step = fx / dfx;
+        x -= step;
+        if (!(x >= low && x <= high)) return NAN;
+        if (fabs(step) <= 4 * DBL_EPSILON * fabs(x) + DBL_MIN) return x;
+    }
+    return x;
+}
+
+struct Segment {
+    double a, b;
+    double value;
+    double error;
+
+    bool operator<(const Segment &other) const { return error < other.error; }
+};
+
+// Kronrod estimate of the integral over [a, b] and |Kronrod − Gauss|;
+// false if f is not finite at a node, which goes in *bad
+bool kronrod(Sampler &sampler, double a, double b, Segment *segment, double *bad) {
+    double centre = (a + b) / 2, half = (b - a) / 2;
+    double x[KRONROD_POINTS], y[KRONROD_POINTS];
+    for (size_t i = 0; i < 7; i++) {
+        x[2 * i] = centre - half * KRONROD_NODES[i];
+        x[2 * i + 1] = centre + half * KRONROD_NODES[i];
+    }
+    x[14] = centre;
+    sampler.at(x, y, KRONROD_POINTS);
+    double kronrod_sum = KRONROD_WEIGHTS[7] * y[14], gauss_sum = GAUSS_WEIGHTS[3] * y[14];
+    for (size_t i = 0; i < 7; i++) {
+        double pair = y[2 * i] + y[2 * i + 1];
+        kronrod_sum += KRONROD_WEIGHTS[i] * pair;
+        if (i % 2 == 1) gauss_sum += GAUSS_WEIGHTS[i / 2] * pair;
+    }
+    segment->a = a;
+    segment->b = b;
+    segment->value = kronrod_sum * half;
+    segment->error = fabs((kronrod_sum - gauss_sum) * half);
+    for (size_t i = 0; i < KRONROD_POINTS; i++) {
+        if (!std::isfinite(y[i])) {
+            *bad = x[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+// One of the fixed pieces of an integral, refined until its error is
+// within its share of the tolerance
+struct Piece {
+    Segment first;
+    double value;
+    double error;
+    bool finite;
+    bool converged;
+    double bad; // Where f was not finite
+};
+
+void sum(const std::vector<Segment> &segments, Piece &piece) {
+    piece.value = piece.error = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        piece.value += segments[i].value;
+        piece.error += segments[i].error;
+    }
+}
+
+void refine(Sampler &sampler, Piece &piece, double target, uint64_t budget) {
+    piece.value = piece.first.value;
+    piece.error = piece.first.error;
+    piece.converged = piece.error <= target;
+    if (piece.converged || !piece.finite) return;
+    std::vector<Segment> heap(1, piece.first);
+    uint64_t start = sampler.evaluations;
+    while (piece.error > target) {
+        if (sampler.evaluations - start >= budget) return;
+        std::pop_heap(heap.begin(), heap.end());
+        Segment worst = heap.back();
+        heap.pop_back();
+        double middle = (worst.a + worst.b) / 2;
+        if (middle <= worst.a || middle >= worst.b) {
+            heap.push_back(worst);
+            break; // Can't be split any finer
+        }
+        Segment left, right;
+        if (!kronrod(sampler, worst.a, middle, &left, &piece.bad) ||
+            !kronrod(sampler, middle, worst.b, &right, &piece.bad)) {
+            piece.finite = false;
+            return;
+        }
+        heap.push_back(left);
+        std::push_heap(heap.begin(), heap.end());
+        heap.push_back(right);
+        std::push_heap(heap.begin(), heap.end());
+        piece.value += left.value + right.value - worst.value;
+        piece.error += left.error + right.error - worst.error;
+        // Summed afresh now and then so rounding in the totals doesn't build up
+        if (heap.size() % RESUM_INTERVAL == 0) sum(heap, piece);
+    }
+    sum(heap, piece);
+    piece.converged = piece.error <= target;
+}
+
+std::string not_finite(double x) {
+    char text[FORMAT_BUFFER_SIZE];
+    format_number(x, text);
+    return std::string("f is not finite at x = ") + text;
+}
+
+std::string with_commas(uint64_t n) {
+    std::string digits = std::to_string((unsigned long long)n), text;
+    for (size_t i = 0; i < digits.size(); i++) {
+        if (i && (digits.size() - i) % 3 == 0) text += ',';
+        text += digits[i];
+    }
+    return text;
+}
+
+} // namespace
+
+bool find_roots(const Program &f, double a, double b, const CalculusOptions &options, std::vector<double> *roots,
+                CalculusStats *stats, std::string *error) {
+    if (!std::isfinite(a) || !std::isfinite(b) || a == b) {
+        *error = "The interval needs two different finite ends";
+        return false;
+    }
+    if (a > b) std::swap(a, b);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t threads = thread_count(options);
+    const size_t cells = ROOT_SCAN_CELLS;
+    double width = (b - a) / cells;
+
+    // The grid, a slice per thread
+    std::vector<double> xs(cells + 1), ys(cells + 1);
+    for (size_t i = 0; i < cells; i++) xs[i] = a + i * width;
+    xs[cells] = b;
+    size_t slice = (cells + 1 + threads - 1) / threads;
+    uint64_t evaluations = for_each_index(f, threads, threads, [&](size_t t, Sampler &sampler) {
+        size_t begin = std::min(t * slice, cells + 1), end = std::min(begin + slice, cells + 1);
+        sampler.at(&xs[begin], &ys[begin], end - begin);
+    });
+
+    // Cells to refine: sign changes, and dips towards zero that don't cross
+    std::vector<size_t> brackets, dips;
+    std::vector<double> found;
+    for (size_t i = 0; i <= cells; i++) {
+        if (ys[i] == 0) found.push_back(xs[i]);
+        if (i < cells && opposite_signs(ys[i], ys[i + 1])) brackets.push_back(i);
+        if (i > 0 && i < cells && same_sign(ys[i - 1], ys[i]) && same_sign(ys[i], ys[i + 1]) &&
+            fabs(ys[i]) < fabs(ys[i - 1]) && fabs(ys[i]) <= fabs(ys[i + 1])) {
+            dips.push_back(i);
+        }
+    }
+
+    std::vector<double> refined(brackets.size() + dips.size(), NAN);
+    evaluations += for_each_index(f, refined.size(), threads, [&](size_t k, Sampler &sampler) {
+        if (k < brackets.size()) {
+            size_t i = brackets[k];
+            // From the scalar path, which can differ from the grid's last bit
+            double fa = sampler.at(xs[i]), fb = sampler.at(xs[i + 1]);
+            if (!opposite_signs(fa, fb)) return; // A grid point or its neighbour is the root
+            double root = brent(sampler, xs[i], xs[i + 1], fa, fb);
+            // A pole with a sign change narrows to huge values, a root to small
+            if (std::isfinite(root) && fabs(sampler.at(root)) <= std::min(fabs(fa), fabs(fb))) refined[k] = root;
+        } else {
+            size_t i = dips[k - brackets.size()];
+            double root = newton(sampler, xs[i], xs[i - 1], xs[i + 1], width);
+            double floor = sqrt(DBL_EPSILON) * (fabs(ys[i - 1]) + fabs(ys[i + 1]));
+            if (std::isfinite(root) && fabs(sampler.at(root)) <= floor) refined[k] = root;
+        }
+    });
+    for (size_t k = 0; k < refined.size(); k++) {
+        if (std::isfinite(refined[k])) found.push_back(refined[k]);
+    }
+
+    // A dip next to a sign change can find the same root twice
+    std::sort(found.begin(), found.end());
+    roots->clear();
+    for (size_t i = 0; i < found.size(); i++) {
+        if (roots->empty() || found[i] - roots->back() > width * 1e-6) roots->push_back(found[i]);
+    }
+    stats->evaluations = evaluations;
+    stats->threads = threads;
+    stats->seconds = seconds_since(start);
+    return true;
+}
+
+bool integrate(const Program &f, double a, double b, const CalculusOptions &options, double *value,
+               double *error_estimate, CalculusStats *stats, std::string *error) {
+    if (!std::isfinite(a) || !std::isfinite(b)) {
+        *error = "The interval needs finite ends";
+        return false;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t threads = thread_count(options);
+    double sign = 1;
+    if (a > b) {
+        std::swap(a, b);
+        sign = -1;
+    }
+    *value = *error_estimate = 0;
+    stats->evaluations = 0;
+    stats->threads = 1;
+    if (a == b) {
+        stats->seconds = seconds_since(start);
+        return true;
+    }
+
+    // A first estimate of every piece on this thread, which is all an easy
+    // integral needs
+    std::vector<Piece> pieces(INTEGRAL_PIECES);
+    double width = (b - a) / INTEGRAL_PIECES, total = 0, total_error = 0;
+    Sampler sampler(f);
+    for (size_t i = 0; i < INTEGRAL_PIECES; i++) {
+        double left = a + i * width, right = i + 1 == INTEGRAL_PIECES ? b : a + (i + 1) * width;
+        pieces[i].finite = kronrod(sampler, left, right, &pieces[i].first, &pieces[i].bad);
+        if (!pieces[i].finite) {
+            *error = not_finite(pieces[i].bad);
+            stats->evaluations = sampler.evaluations;
+            stats->seconds = seconds_since(start);
+            return false;
+        }
+        total += pieces[i].first.value;
+        total_error += pieces[i].first.error;
+    }
+    double tolerance = options.tolerance > 0 ? options.tolerance : CALCULUS_TOLERANCE;
+    double target = std::max(tolerance * fabs(total), 1e-300);
+    uint64_t evaluations = sampler.evaluations;
+
+    if (total_error > target) {
+        stats->threads = threads;
+        uint64_t budget = CALCULUS_MAX_EVALUATIONS / INTEGRAL_PIECES;
+        evaluations += for_each_index(f, INTEGRAL_PIECES, threads, [&](size_t i, Sampler &worker) {
+            refine(worker, pieces[i], target / INTEGRAL_PIECES, budget);
+        });
+    } else {
+        for (size_t i = 0; i < INTEGRAL_PIECES; i++) refine(sampler, pieces[i], target, 0);
+    }
+
+    // Summed in order, so the result doesn't depend on the threads
+    total = total_error = 0;
+    bool finite = true, converged = true;
+    double bad = 0;
+    for (size_t i = 0; i < INTEGRAL_PIECES; i++) {
+        total += pieces[i].value;
+        total_error += pieces[i].error;
+        if (!pieces[i].finite && finite) bad = pieces[i].bad;
+        finite = finite && pieces[i].finite;
+        converged = converged && pieces[i].converged;
+    }
+    *value = sign * total;
+    *error_estimate = total_error;
+    stats->evaluations = evaluations;
+    stats->seconds = seconds_since(start);
+    if (!finite) {
+        *error = not_finite(bad);
+        return false;
+    }
+    if (!converged && total_error > target) {
+        char estimate[FORMAT_BUFFER_SIZE];
+        format_number(total_error, estimate, ESTIMATE_WIDTH, 3);
+        *error = std::string("Did not converge; error estimate ") + estimate;
+        return false;
+    }
+    return true;
+}
+
+bool differentiate(const Program &f, double x, double *value, double *error_estimate, CalculusStats *stats,
+                   std::string *error) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Sampler sampler(f);
+    stats->threads = 1;
+    if (!std::isfinite(x) || !std::isfinite(sampler.at(x))) {
+        *error = not_finite(x);
+        stats->evaluations = sampler.evaluations;
+        stats->seconds = seconds_since(start);
+        return false;
+    }
+
+    // Starting step: a tenth of the scale of x, halved until f is finite
+    // on both sides
+    double h = 0.1 * std::max(fabs(x), 1.0);
+    double first = NAN;
+    for (int tries = 0; tries < 40 && !std::isfinite(first); tries++, h /= 2) {
+        first = (sampler.at(x + h) - sampler.at(x - h)) / (2 * h);
+        if (std::isfinite(first)) break;
+    }
+    if (!std::isfinite(first)) {
+        *error = not_finite(x);
+        stats->evaluations = sampler.evaluations;
+        stats->seconds = seconds_since(start);
+        return false;
+    }
+
+    // table[j] holds the j-times extrapolated estimate at the current step
+    double table[RIDDERS_STEPS], previous[RIDDERS_STEPS];
+    table[0] = first;
+    double best = first, best_error = HUGE_VAL;
+    for (int i = 1; i < RIDDERS_STEPS; i++) {
+        memcpy(previous, table, sizeof(table));
+        h /= RIDDERS_SHRINK;
+        table[0] = (sampler.at(x + h) - sampler.at(x - h)) / (2 * h);
+        if (!std::isfinite(table[0])) break;
+        double factor = RIDDERS_SHRINK * RIDDERS_SHRINK;
+        for (int j = 1; j <= i; j++) {
+            table[j] = (table[j - 1] * factor - previous[j - 1]) / (factor - 1);
+            factor *= RIDDERS_SHRINK * RIDDERS_SHRINK;
+            double change = std::max(fabs(table[j] - table[j - 1]), fabs(table[j] - previous[j - 1]));
+            if (change <= best_error) {
+                best_error = change;
+                best = table[j];
+            }
+        }
+        // Higher orders getting worse: rounding has taken over
+        if (fabs(table[i] - previous[i - 1]) >= RIDDERS_SAFE * best_error) break;
+    }
+    *value = best;
+    *error_estimate = best_error;
+    stats->evaluations = sampler.evaluations;
+    stats->seconds = seconds_since(start);
+    return true;
+}
+
+std::string calculus_cost(const CalculusStats &stats) {
+    char text[96];
+    double ms = stats.seconds * 1000;
+    double rate = stats.per_second();
+    const char *unit = "";
+    if (rate >= 1e6) {
+        rate /= 1e6;
+        unit = "M";
+    } else if (rate >= 1e3) {
+        rate /= 1e3;
+        unit = "k";
+    }
+    if (ms < 1000) {
+        snprintf(text, sizeof(text), " evaluations in %.*f ms, %.1f%s/s", ms < 10 ? 2 : 1, ms, rate, unit);
+    } else {
+        snprintf(text, sizeof(text), " evaluations in %.2f s, %.1f%s/s", stats.seconds, rate, unit);
+    }
+    return with_commas(stats.evaluations) + text;
+}
+
+int run_calculus(const CalculusCommand &command, FILE *out) {
+    bool roots = strcmp(command.op, "roots") == 0, area = strcmp(command.op, "integrate") == 0;
+    if (!roots && !area && strcmp(command.op, "derivative") != 0) {
+        fprintf(stderr, "Unknown calculus operation %s\n", command.op);
+        return 1;
+    }
+    ExprCompiler compiler;
+    compiler.set_angle_unit(command.unit);
+    Program program;
+    if (!compiler.compile(command.expression, strlen(command.expression), program)) {
+        fprintf(stderr, "%s: %s\n", command.expression, compiler.error() ? compiler.error() : "Syntax error");
+        return 1;
+    }
+
+    CalculusStats stats;
+    std::string error;
+    std::vector<double> results;
+    double value = 0, estimate = 0;
+    bool ok;
+    if (roots) {
+        ok = find_roots(program, command.a, command.b, command.options, &results, &stats, &error);
+    } else if (area) {
+        ok = integrate(program, command.a, command.b, command.options, &value, &estimate, &stats, &error);
+        results.push_back(value);
+    } else {
+        ok = differentiate(program, command.a, &value, &estimate, &stats, &error);
+        results.push_back(value);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    char text[FORMAT_BUFFER_SIZE];
+    for (size_t i = 0; i < results.size(); i++) {
+        format_number(results[i], text, FORMAT_BUFFER_SIZE - 1);
+        fprintf(out, "%s\n", text);
+    }
+    if (!roots) {
+        format_number(estimate, text, ESTIMATE_WIDTH, 3);
+        fprintf(stderr, "error estimate %s\n", text);
+    }
+    fprintf(stderr, "%s on %zu thread%s\n", calculus_cost(stats).c_str(), stats.threads,
+            stats.threads == 1 ? "" : "s");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef CALC_CALCULUS_H
+#define CALC_CALCULUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "calc_expr.h"
+
+// Roots, definite integrals and derivatives of an expression in x, for
+// View → Calculus and calculator --calculus. Every function takes the
+// expression compiled once into a Program; points are evaluated by
+// Program::run, or by Program::run_vector where many are needed at once.
+//
+// Work is split between threads, one per core unless options say
+// otherwise, the way calc_stats and calc_matrix split theirs: a root scan
+// samples [a, b] on a fixed grid in slices, then each cell with a sign
+// change (Brent) or a near-touch of zero (Newton) is refined by whichever
+// thread takes it next. An integral is split into fixed pieces, each
+// integrated adaptively to its share of the tolerance by the next free
+// thread. The pieces and the grid do not depend on the number of threads,
+// so neither do the results.
+
+struct CalculusOptions {
+    size_t threads;   // 0 for one per core
+    double tolerance; // Relative; 0 for CALCULUS_TOLERANCE
+};
+
+const double CALCULUS_TOLERANCE = 1e-10;
+const size_t ROOT_SCAN_CELLS = 4096;         // Grid [a, b] is sampled on
+const size_t INTEGRAL_PIECES = 16;           // Fixed split of [a, b]
+const uint64_t CALCULUS_MAX_EVALUATIONS = 10000000; // Gives up past this
+
+// Cost of the last call, for the history line
+struct CalculusStats {
+    uint64_t evaluations;
+    double seconds; // Wall time
+    size_t threads;
+
+    CalculusStats() : evaluations(0), seconds(0), threads(0) {}
+    double per_second() const { return seconds > 0 ? evaluations / seconds : 0; }
+};
+
+// Every root of f in [a, b], ascending: sign changes of f on the grid,
+// each narrowed by Brent's method, and points where |f| dips to zero
+// without crossing it (x² at 0), found by Newton's method with a numeric
+// derivative. Poles where f changes sign (tan(x) at 90) are not roots.
+// Roots closer together than a grid cell may be missed. False with a
+// message if the interval or expression is unusable.
+bool find_roots(const Program &f, double a, double b, const CalculusOptions &options, std::vector<double> *roots,
+                CalculusStats *stats, std::string *error);
+
+// Definite integral of f from a to b by adaptive Gauss–Kronrod (7-point
+// Gauss, 15-point Kronrod), to within tolerance × |value| or an absolute
+// 1e-300. *error_estimate is the sum of the pieces' |Kronrod − Gauss|.
+// False with a message if f is not finite somewhere it is sampled or the
+// tolerance is not met within CALCULUS_MAX_EVALUATIONS; *value is then
+// the best estimate.
+bool integrate(const Program &f, double a, double b, const CalculusOptions &options, double *value,
+               double *error_estimate, CalculusStats *stats, std::string *error);
+
+// f′(x) by Ridders' method: central differences at shrinking steps,
+// extrapolated to step 0. False with a message if f is not finite near x.
+bool differentiate(const Program &f, double x, double *value, double *error_estimate, CalculusStats *stats,
+                   std::string *error);
+
+// "4,305 evaluations in 1.2 ms, 3.6M/s", the tail of the history line
+std::string calculus_cost(const CalculusStats &stats);
+
+// Headless --calculus: OP is roots, integrate or derivative; roots and
+// integrate take an interval, derivative a point. Prints the results one
+// per line on out and the cost on stderr. Returns 0 on success, 1 with a
+// message on stderr.
+struct CalculusCommand {
+    const char *op;
+    const char *expression;
+    double a;
+    double b;
+    AngleUnit unit;
+    CalculusOptions options;
+};
+int run_calculus(const CalculusCommand &command, FILE *out);
+
+#endif // CALC_CALCULUS_H
@@ -0,0 +1,220 @@
+#include "calc_calculuspanel.h"
+#include "calc_format.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int DEFAULT_WIDTH = 300;
+
+// A labelled entry in row `top` of grid
+GtkWidget *field(GtkWidget *grid, int top, const char *label, const char *text) {
+    GtkWidget *caption = gtk_label_new(label);
+    gtk_label_set_xalign(GTK_LABEL(caption), 1.0);
+    gtk_grid_attach(GTK_GRID(grid), caption, 0, top, 1, 1);
+    GtkWidget *entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(entry), text);
+    gtk_widget_set_hexpand(entry, TRUE);
+    gtk_grid_attach(GTK_GRID(grid), entry, 1, top, 1, 1);
+    return entry;
+}
+
+// Entry text with surrounding spaces dropped, for the history line
+std::string text_of(GtkWidget *entry) {
+    gchar *text = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+    std::string result = text;
+    g_free(text);
+    return result;
+}
+
+} // namespace
+
+CalculusPanel::CalculusPanel(ResultFunc on_result, gpointer data) :
+    result(on_result),
+    result_data(data),
+    box(NULL),
+    function_entry(NULL),
+    from_entry(NULL),
+    to_entry(NULL),
+    list(NULL),
+    status(NULL) {}
+
+GtkWidget *CalculusPanel::create() {
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_size_request(box, DEFAULT_WIDTH, -1);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 3);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 5);
+    function_entry = field(grid, 0, "f(x)", "sin(x)");
+    from_entry = field(grid, 1, "a", "0");
+    to_entry = field(grid, 2, "b", "180");
+    gtk_widget_set_tooltip_text(from_entry, "Start of the interval, or the point for f′(a)");
+    gtk_box_pack_start(GTK_BOX(box), grid, FALSE, FALSE, 0);
+
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_set_homogeneous(GTK_BOX(row), TRUE);
+    GtkWidget *button = gtk_button_new_with_label("Roots");
+    gtk_widget_set_tooltip_text(button, "Every x in [a, b] where f(x) = 0");
+    g_signal_connect(button, "clicked", G_CALLBACK(on_roots_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), button, TRUE, TRUE, 0);
+    button = gtk_button_new_with_label("∫ a→b");
+    g_signal_connect(button, "clicked", G_CALLBACK(on_integral_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), button, TRUE, TRUE, 0);
+    button = gtk_button_new_with_label("f′(a)");
+    g_signal_connect(button, "clicked", G_CALLBACK(on_derivative_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), button, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(box), row, FALSE, FALSE, 0);
+
+    list = gtk_list_box_new();
+    gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(list), FALSE);
+    g_signal_connect(list, "row-activated", G_CALLBACK(on_row_activated), this);
+    gtk_style_context_add_class(gtk_widget_get_style_context(list), "history-list");
+    GtkWidget *scroller = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scroller, -1, 120);
+    gtk_container_add(GTK_CONTAINER(scroller), list);
+    gtk_box_pack_start(GTK_BOX(box), scroller, TRUE, TRUE, 0);
+
+    status = gtk_label_new("Enter f(x) and an interval");
+    gtk_label_set_xalign(GTK_LABEL(status), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(status), PANGO_ELLIPSIZE_END);
+    gtk_box_pack_start(GTK_BOX(box), status, FALSE, FALSE, 0);
+    return box;
+}
+
+bool CalculusPanel::compile_function() {
+    const char *text = gtk_entry_get_text(GTK_ENTRY(function_entry));
+    if (compiler.compile(text, strlen(text), program)) return true;
+    fail(std::string("f(x): ") + (compiler.error() ? compiler.error() : "Syntax error"));
+    return false;
+}
+
+// Value of the expression in entry, which may not use x
+bool CalculusPanel::read_bound(GtkWidget *entry, const char *name, double *value) {
+    const char *text = gtk_entry_get_text(GTK_ENTRY(entry));
+    Program bound;
+    if (!compiler.compile(text, strlen(text), bound)) {
+        fail(std::string(name) + ": " + (compiler.error() ? compiler.error() : "Syntax error"));
+        return false;
+    }
+    EvalResult r = bound.run();
+    if (bound.uses_variable() || r.status != EVAL_OK || !std::isfinite(r.value)) {
+        fail(std::string(name) + " must be a finite number");
+        return false;
+    }
+    *value = r.value;
+    return true;
+}
+
+// Lists `values`, enters the first and reports the cost
+void CalculusPanel::show(const CalculusStats &stats) {
+    GList *children = gtk_container_get_children(GTK_CONTAINER(list));
+    for (GList *child = children; child; child = child->next) gtk_widget_destroy(GTK_WIDGET(child->data));
+    g_list_free(children);
+    char text[FORMAT_BUFFER_SIZE];
+    for (size_t i = 0; i < values.size(); i++) {
+        format_number(values[i], text, FORMAT_BUFFER_SIZE - 1);
+        GtkWidget *number = gtk_label_new(text);
+        gtk_label_set_xalign(GTK_LABEL(number), 1.0);
+        gtk_label_set_selectable(GTK_LABEL(number), TRUE);
+        gtk_container_add(GTK_CONTAINER(list), number);
+    }
+    gtk_widget_show_all(list);
+
+    cost = calculus_cost(stats);
+    gchar *summary = g_strdup_printf("%s%s on %zu thread%s", values.empty() ? "No roots; " : "", cost.c_str(),
+                                     stats.threads, stats.threads == 1 ? "" : "s");
+    gtk_label_set_text(GTK_LABEL(status), summary);
+    g_free(summary);
+    if (!values.empty()) result(values[0], expressions[0].c_str(), cost.c_str(), result_data);
+}
+
+void CalculusPanel::fail(const std::string &message) {
+    GList *children = gtk_container_get_children(GTK_CONTAINER(list));
+    for (GList *child = children; child; child = child->next) gtk_widget_destroy(GTK_WIDGET(child->data));
+    g_list_free(children);
+    values.clear();
+    expressions.clear();
+    gtk_label_set_text(GTK_LABEL(status), message.c_str());
+}
+
+void CalculusPanel::roots() {
+    double a, b;
+    if (!compile_function() || !read_bound(from_entry, "a", &a) || !read_bound(to_entry, "b", &b)) return;
+    CalculusOptions options = {0, 0};
+    CalculusStats stats;
+    std::string error;
+    std::vector<double> found;
+    if (!find_roots(program, a, b, options, &found, &stats, &error)) {
+        fail(error);
+        return;
+    }
+    std::string head = text_of(function_entry) + " = 0, " + text_of(from_entry) + "…" + text_of(to_entry) + ": x";
+    values = found;
+    expressions.clear();
+    for (size_t i = 0; i < found.size(); i++) {
+        if (found.size() == 1) {
+            expressions.push_back(head);
+        } else {
+            gchar *which = g_strdup_printf(" (%zu of %zu)", i + 1, found.size());
+            expressions.push_back(head + which);
+            g_free(which);
+        }
+    }
+    show(stats);
+}
+
+void CalculusPanel::integral() {
+    double a, b;
+    if (!compile_function() || !read_bound(from_entry, "a", &a) || !read_bound(to_entry, "b", &b)) return;
+    CalculusOptions options = {0, 0};
+    CalculusStats stats;
+    std::string error;
+    double value = 0, estimate = 0;
+    if (!integrate(program, a, b, options, &value, &estimate, &stats, &error)) {
+        fail(error);
+        return;
+    }
+    values.assign(1, value);
+    expressions.assign(1, "∫ " + text_of(function_entry) + " dx, " + text_of(from_entry) + "…" + text_of(to_entry));
+    show(stats);
+}
+
+void CalculusPanel::derivative() {
+    double x;
+    if (!compile_function() || !read_bound(from_entry, "a", &x)) return;
+    CalculusStats stats;
+    std::string error;
+    double value = 0, estimate = 0;
+    if (!differentiate(program, x, &value, &estimate, &stats, &error)) {
+        fail(error);
+        return;
+    }
+    values.assign(1, value);
+    expressions.assign(1, "d/dx " + text_of(function_entry) + " at " + text_of(from_entry));
+    show(stats);
+}
+
+void CalculusPanel::on_roots_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    static_cast<CalculusPanel*>(data)->roots();
+}
+
+void CalculusPanel::on_integral_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    static_cast<CalculusPanel*>(data)->integral();
+}
+
+void CalculusPanel::on_derivative_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    static_cast<CalculusPanel*>(data)->derivative();
+}
+
+void CalculusPanel::on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data) {
+    (void)list_box;  // Suppress unused parameter warning
+    CalculusPanel *panel = static_cast<CalculusPanel*>(data);
+    int index = gtk_list_box_row_get_index(row);
+    if (index < 0 || (size_t)index >= panel->values.size()) return;
+    panel->result(panel->values[index], panel->expressions[index].c_str(), panel->cost.c_str(), panel->result_data);
+}
@@ -0,0 +1,64 @@
+#ifndef CALC_CALCULUSPANEL_H
+#define CALC_CALCULUSPANEL_H
+
+#include <gtk/gtk.h>
+#include <string>
+#include <vector>
+#include "calc_calculus.h"
+
+// View → Calculus: f(x) and the ends a and b of an interval (any
+// expression, so "2π" works), then Roots lists every root of f in [a, b],
+// ∫ integrates f from a to b and f′(a) differentiates it at a. The result,
+// or the first root, is entered as the current operand and the history
+// line shows what it was and what it cost; activating a row of the list
+// enters that one instead. Trig functions use the keypad's angle unit.
+class CalculusPanel {
+public:
+    // expression is the history line's left side ("∫ sin(x) dx, 0…180"),
+    // cost its tail (calculus_cost)
+    typedef void (*ResultFunc)(double value, const char *expression, const char *cost, gpointer data);
+
+private:
+    ResultFunc result;
+    gpointer result_data;
+
+    GtkWidget *box;
+    GtkWidget *function_entry;
+    GtkWidget *from_entry;
+    GtkWidget *to_entry;
+    GtkWidget *list;
+    GtkWidget *status;
+
+    ExprCompiler compiler;
+    Program program;
+    std::vector<double> values;          // Rows of the list
+    std::vector<std::string> expressions; // History line of each row
+    std::string cost;
+
+    bool compile_function();
+    bool read_bound(GtkWidget *entry, const char *name, double *value);
+    void show(const CalculusStats &stats);
+    void fail(const std::string &message);
+    void roots();
+    void integral();
+    void derivative();
+
+    static void on_roots_clicked(GtkButton *button, gpointer data);
+    static void on_integral_clicked(GtkButton *button, gpointer data);
+    static void on_derivative_clicked(GtkButton *button, gpointer data);
+    static void on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data);
+
+    CalculusPanel(const CalculusPanel &);
+    CalculusPanel &operator=(const CalculusPanel &);
+
+public:
+    CalculusPanel(ResultFunc on_result, gpointer data);
+
+    // Builds the widgets; the returned box is for the caller to pack
+    GtkWidget *create();
+
+    // Unit for the trig functions of f, a and b; follows View → angle
+    void set_angle_unit(AngleUnit unit) { compiler.set_angle_unit(unit); }
+};
+
+#endif // CALC_CALCULUSPANEL_H
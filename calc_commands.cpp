@@ -0,0 +1,10 @@
+#include "calc_commands.h"
+#include <cstring>
+
+Command command_for_label(const char *label) {
+    for (int i = CMD_NONE + 1; i < CMD_COUNT; i++) {
+        if (strcmp(COMMAND_TABLE[i].label, label) == 0) return static_cast<Command>(i);
+    }
+    if (strcmp(label, "^") == 0) return CMD_POWER; // Keyboard spelling of xʸ
+    return CMD_NONE;
+}
@@ -0,0 +1,170 @@
+#ifndef CALC_COMMANDS_H
+#define CALC_COMMANDS_H
+
+#include "calc_expr.h"
+
+// Every keypad action as a command ID. Buttons carry their ID and keys
+// map straight to one, so the input path never compares label strings.
+enum Command {
+    CMD_NONE,
+    CMD_DIGIT_0,
+    CMD_DIGIT_1,
+    CMD_DIGIT_2,
+    CMD_DIGIT_3,
+    CMD_DIGIT_4,
+    CMD_DIGIT_5,
+    CMD_DIGIT_6,
+    CMD_DIGIT_7,
+    CMD_DIGIT_8,
+    CMD_DIGIT_9,
+    CMD_DOUBLE_ZERO,
+    CMD_DECIMAL,
+    CMD_ALL_CLEAR,
+    CMD_CLEAR_ENTRY,
+    CMD_SIGN,
+    CMD_PERCENT,
+    CMD_BACKSPACE,
+    CMD_ADD,
+    CMD_SUBTRACT,
+    CMD_MULTIPLY,
+    CMD_DIVIDE,
+    CMD_POWER,
+    CMD_EQUALS,
+    CMD_MEMORY_ADD,
+    CMD_MEMORY_SUBTRACT,
+    CMD_MEMORY_RECALL,
+    CMD_MEMORY_CLEAR,
+    CMD_SIN,
+    CMD_COS,
+    CMD_TAN,
+    CMD_LOG,
+    CMD_LN,
+    CMD_SQRT,
+    CMD_SQUARE,
+    CMD_FACTORIAL,
+    CMD_PI,
+    CMD_E,
+    CMD_LPAREN,
+    CMD_RPAREN,
+    CMD_COMBINATIONS,
+    CMD_PERMUTATIONS,
+    CMD_COUNT
+};
+
+// What the engine does with a command; `arg` in CommandInfo refines it
+enum CommandKind {
+    KIND_NONE,
+    KIND_DIGIT,       // arg: digit value
+    KIND_DOUBLE_ZERO,
+    KIND_DECIMAL,
+    KIND_ALL_CLEAR,
+    KIND_CLEAR_ENTRY,
+    KIND_SIGN,
+    KIND_PERCENT,
+    KIND_BACKSPACE,
+    KIND_OPERATOR,    // arg: TokenType
+    KIND_EQUALS,
+    KIND_MEMORY_ADD,
+    KIND_MEMORY_SUBTRACT,
+    KIND_MEMORY_RECALL,
+    KIND_MEMORY_CLEAR,
+    KIND_FUNCTION,    // arg: OpCode
+    KIND_CONSTANT,    // arg: ConstantId
+    KIND_PAREN        // arg: TokenType
+};
+
+// Button colour group
+enum ButtonStyle {
+    STYLE_DIGIT,
+    STYLE_OPERATOR,
+    STYLE_FUNCTION,
+    STYLE_UTILITY,
+    STYLE_MEMORY,
+    STYLE_CLEAR,
+    STYLE_EQUALS
+};
+
+struct CommandInfo {
+    Command command;
+    const char *label;
+    CommandKind kind;
+    unsigned char arg;
+    ButtonStyle style;
+};
+
+// Indexed by Command; the static_assert below keeps it in enum order
+constexpr CommandInfo COMMAND_TABLE[CMD_COUNT] = {
+    {CMD_NONE, "", KIND_NONE, 0, STYLE_DIGIT},
+    {CMD_DIGIT_0, "0", KIND_DIGIT, 0, STYLE_DIGIT},
+    {CMD_DIGIT_1, "1", KIND_DIGIT, 1, STYLE_DIGIT},
+    {CMD_DIGIT_2, "2", KIND_DIGIT, 2, STYLE_DIGIT},
+    {CMD_DIGIT_3, "3", KIND_DIGIT, 3, STYLE_DIGIT},
+    {CMD_DIGIT_4, "4", KIND_DIGIT, 4, STYLE_DIGIT},
+    {CMD_DIGIT_5, "5", KIND_DIGIT, 5, STYLE_DIGIT},
+    {CMD_DIGIT_6, "6", KIND_DIGIT, 6, STYLE_DIGIT},
+    {CMD_DIGIT_7, "7", KIND_DIGIT, 7, STYLE_DIGIT},
+    {CMD_DIGIT_8, "8", KIND_DIGIT, 8, STYLE_DIGIT},
+    {CMD_DIGIT_9, "9", KIND_DIGIT, 9, STYLE_DIGIT},
+    {CMD_DOUBLE_ZERO, "00", KIND_DOUBLE_ZERO, 0, STYLE_DIGIT},
+    {CMD_DECIMAL, ".", KIND_DECIMAL, 0, STYLE_DIGIT},
+    {CMD_ALL_CLEAR, "AC", KIND_ALL_CLEAR, 0, STYLE_CLEAR},
+    {CMD_CLEAR_ENTRY, "CE", KIND_CLEAR_ENTRY, 0, STYLE_CLEAR},
+    {CMD_SIGN, "±", KIND_SIGN, 0, STYLE_UTILITY},
+    {CMD_PERCENT, "%", KIND_PERCENT, 0, STYLE_UTILITY},
+    {CMD_BACKSPACE, "⌫", KIND_BACKSPACE, 0, STYLE_UTILITY},
+    {CMD_ADD, "+", KIND_OPERATOR, TOK_PLUS, STYLE_OPERATOR},
+    {CMD_SUBTRACT, "-", KIND_OPERATOR, TOK_MINUS, STYLE_OPERATOR},
+    {CMD_MULTIPLY, "×", KIND_OPERATOR, TOK_MULTIPLY, STYLE_OPERATOR},
+    {CMD_DIVIDE, "÷", KIND_OPERATOR, TOK_DIVIDE, STYLE_OPERATOR},
+    {CMD_POWER, "xʸ", KIND_OPERATOR, TOK_POWER, STYLE_FUNCTION},
+    {CMD_EQUALS, "=", KIND_EQUALS, 0, STYLE_EQUALS},
+    {CMD_MEMORY_ADD, "M+", KIND_MEMORY_ADD, 0, STYLE_MEMORY},
+    {CMD_MEMORY_SUBTRACT, "M-", KIND_MEMORY_SUBTRACT, 0, STYLE_MEMORY},
+    {CMD_MEMORY_RECALL, "MR", KIND_MEMORY_RECALL, 0, STYLE_MEMORY},
+    {CMD_MEMORY_CLEAR, "MC", KIND_MEMORY_CLEAR, 0, STYLE_MEMORY},
+    {CMD_SIN, "sin", KIND_FUNCTION, OP_SIN, STYLE_FUNCTION},
+    {CMD_COS, "cos", KIND_FUNCTION, OP_COS, STYLE_FUNCTION},
+    {CMD_TAN, "tan", KIND_FUNCTION, OP_TAN, STYLE_FUNCTION},
+    {CMD_LOG, "log", KIND_FUNCTION, OP_LOG, STYLE_FUNCTION},
+    {CMD_LN, "ln", KIND_FUNCTION, OP_LN, STYLE_FUNCTION},
+    {CMD_SQRT, "√", KIND_FUNCTION, OP_SQRT, STYLE_FUNCTION},
+    {CMD_SQUARE, "x²", KIND_FUNCTION, OP_SQUARE, STYLE_FUNCTION},
+    {CMD_FACTORIAL, "!", KIND_FUNCTION, OP_FACTORIAL, STYLE_FUNCTION},
+    {CMD_PI, "π", KIND_CONSTANT, CONST_PI, STYLE_FUNCTION},
+    {CMD_E, "e", KIND_CONSTANT, CONST_E, STYLE_FUNCTION},
+    {CMD_LPAREN, "(", KIND_PAREN, TOK_LPAREN, STYLE_FUNCTION},
+    {CMD_RPAREN, ")", KIND_PAREN, TOK_RPAREN, STYLE_FUNCTION},
+    {CMD_COMBINATIONS, "nCr", KIND_OPERATOR, TOK_COMBINATION, STYLE_FUNCTION},
+    {CMD_PERMUTATIONS, "nPr", KIND_OPERATOR, TOK_PERMUTATION, STYLE_FUNCTION}
+};
+
+constexpr bool command_table_ordered(int i) {
+    return i == CMD_COUNT || (COMMAND_TABLE[i].command == i && command_table_ordered(i + 1));
+}
+
+static_assert(command_table_ordered(0), "COMMAND_TABLE must list commands in enum order");
+
+constexpr const CommandInfo &command_info(Command command) {
+    return COMMAND_TABLE[command];
+}
+
+// Button layout (8 rows, 5 columns for scientific calculator)
+const int KEYPAD_ROWS = 8;
+const int KEYPAD_COLUMNS = 5;
+
+constexpr Command KEYPAD_LAYOUT[KEYPAD_ROWS][KEYPAD_COLUMNS] = {
+    {CMD_ALL_CLEAR, CMD_CLEAR_ENTRY, CMD_SIN, CMD_COS, CMD_TAN},
+    {CMD_LOG, CMD_LN, CMD_SQRT, CMD_SQUARE, CMD_POWER},
+    {CMD_PI, CMD_E, CMD_FACTORIAL, CMD_PERCENT, CMD_DIVIDE},
+    {CMD_DIGIT_7, CMD_DIGIT_8, CMD_DIGIT_9, CMD_LPAREN, CMD_MULTIPLY},
+    {CMD_DIGIT_4, CMD_DIGIT_5, CMD_DIGIT_6, CMD_RPAREN, CMD_SUBTRACT},
+    {CMD_DIGIT_1, CMD_DIGIT_2, CMD_DIGIT_3, CMD_SIGN, CMD_ADD},
+    {CMD_DIGIT_0, CMD_DOUBLE_ZERO, CMD_DECIMAL, CMD_BACKSPACE, CMD_EQUALS},
+    {CMD_MEMORY_ADD, CMD_MEMORY_SUBTRACT, CMD_MEMORY_RECALL, CMD_MEMORY_CLEAR, CMD_COMBINATIONS}
+};
+
+// Reverse lookup for tools and scripts that name keys by their label.
+// Linear scan; not used on the input path.
+Command command_for_label(const char *label);
+
+#endif // CALC_COMMANDS_H
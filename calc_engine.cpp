@@ -0,0 +1,878 @@
+#include "calc_engine.h"
+#include "calc_format.h"
+#include "calc_special.h"
+#include <cmath>
+#include <cstdio>
+
+CalcEngine::CalcEngine() :
+    token_count(0),
+    current_value(0.0),
+    implied_parens(0),
+    new_calculation(true),
+    operator_pressed(false),
+    equals_pressed(false),
+    calculations(0),
+    key_refused(false),
+    error(false),
+    error_status(EVAL_OK),
+    error_op(0),
+    error_message(NULL),
+    active_slot(0),
+    precision(0),
+    text_dirty(true) {
+    char name[8];
+    for (size_t i = 0; i < MEMORY_SLOTS; i++) {
+        int len = snprintf(name, sizeof(name), "M%zu", i + 1);
+        memory_symbols[i] = registers.intern(name, len);
+    }
+    ans_symbol = registers.intern("ans", 3);
+    compiler.set_registers(&registers);
+    live.set_registers(&registers);
+}
+
+void CalcEngine::press(Command command) {
+    const CommandInfo &info = command_info(command);
+    key_refused = false;
+    // Keys that leave the displayed value alone keep a large n! showing
+    if (info.kind != KIND_OPERATOR && info.kind != KIND_MEMORY_ADD && info.kind != KIND_MEMORY_SUBTRACT &&
+        info.kind != KIND_MEMORY_CLEAR) {
+        large_text.clear();
+    }
+    switch (info.kind) {
+    case KIND_NONE:
+        return;
+    case KIND_DIGIT:
+    case KIND_DOUBLE_ZERO:
+        handle_number(info.label);
+        break;
+    case KIND_DECIMAL:
+        handle_decimal();
+        break;
+    case KIND_ALL_CLEAR:
+        handle_all_clear();
+        break;
+    case KIND_CLEAR_ENTRY:
+        handle_clear_entry();
+        break;
+    case KIND_SIGN:
+        handle_sign_change();
+        break;
+    case KIND_PERCENT:
+        handle_percentage();
+        break;
+    case KIND_BACKSPACE:
+        handle_backspace();
+        break;
+    case KIND_OPERATOR:
+        handle_operation(static_cast<TokenType>(info.arg));
+        break;
+    case KIND_EQUALS:
+        handle_equals();
+        break;
+    case KIND_MEMORY_ADD:
+        handle_memory_add();
+        break;
+    case KIND_MEMORY_SUBTRACT:
+        handle_memory_subtract();
+        break;
+    case KIND_MEMORY_RECALL:
+        handle_memory_recall();
+        break;
+    case KIND_MEMORY_CLEAR:
+        handle_memory_clear();
+        break;
+    case KIND_FUNCTION:
+        handle_scientific_function(info.arg);
+        break;
+    case KIND_CONSTANT:
+        handle_constant(static_cast<ConstantId>(info.arg));
+        break;
+    case KIND_PAREN:
+        handle_parenthesis(static_cast<TokenType>(info.arg));
+        break;
+    }
+    text_dirty = true;
+}
+
+// Standard mode evaluates in microseconds; precision mode can take seconds
+// on a large factorial or power
+bool CalcEngine::may_be_slow(Command command) const {
+    if (!precision) return false;
+    switch (command_info(command).kind) {
+    case KIND_EQUALS:
+    case KIND_BACKSPACE: // Shows the value of what is left
+    case KIND_FUNCTION:
+    case KIND_CONSTANT:
+    case KIND_PAREN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_binary_operator(TokenType type) {
+    return type == TOK_PLUS || type == TOK_MINUS || type == TOK_MULTIPLY ||
+           type == TOK_DIVIDE || type == TOK_POWER || type == TOK_COMBINATION ||
+           type == TOK_PERMUTATION;
+}
+
+bool CalcEngine::push_token(TokenType type, unsigned char op, double value) {
+    if (token_count == MAX_TOKENS) {
+        key_refused = true;
+        return false;
+    }
+    if (token_count == 0) exact_pool.clear(); // New expression
+    touch(token_count);
+    Token &tok = tokens[token_count++];
+    tok.type = type;
+    tok.op = op;
+    tok.symbol = 0;
+    tok.value = value;
+    tok.start = 0;
+    tok.end = 0;
+    return true;
+}
+
+// Push the displayed value as a number token
+bool CalcEngine::push_current() {
+    if (!push_token(TOK_NUMBER, 0, current_value)) return false;
+    if (precision) {
+        std::string text = big_current.to_exact_string();
+        set_exact_text(tokens[token_count - 1], text.data(), text.size());
+    }
+    return true;
+}
+
+// Point a number token at its exact decimal text for run_precise
+void CalcEngine::set_exact_text(Token &tok, const char *text, size_t len) {
+    tok.start = exact_pool.size();
+    exact_pool.append(text, len);
+    tok.end = exact_pool.size();
+}
+
+void CalcEngine::clear_current() {
+    current_value = 0;
+    big_current = BigFloat();
+}
+
+// A register's value, 0 if undefined; in precision mode also its exact
+// value, rounded to the precision
+double CalcEngine::register_value(SymbolId id, BigFloat *exact) const {
+    if (!registers.is_defined(id)) {
+        if (precision) *exact = BigFloat();
+        return 0.0;
+    }
+    double value = registers.value(id);
+    if (precision) {
+        const std::string &text = registers.exact_text(id);
+        if (!BigFloat::parse(text.data(), text.size(), exact) && !BigFloat::from_double(value, exact)) {
+            *exact = BigFloat();
+        }
+        exact->round(precision);
+    }
+    return value;
+}
+
+// Standard mode stores just the double, so it does not allocate
+void CalcEngine::store(SymbolId id, double value, const BigFloat &exact) {
+    if (precision) {
+        registers.set(id, value, exact.to_exact_string().c_str());
+    } else {
+        registers.set(id, value);
+    }
+}
+
+bool CalcEngine::insert_token(size_t at, TokenType type, unsigned char op) {
+    if (token_count == MAX_TOKENS) return false;
+    memmove(tokens + at + 1, tokens + at, (token_count - at) * sizeof(Token));
+    token_count++;
+    touch(at);
+    tokens[at].type = type;
+    tokens[at].op = op;
+    tokens[at].value = 0;
+    return true;
+}
+
+void CalcEngine::erase_token(size_t at) {
+    memmove(tokens + at, tokens + at + 1, (token_count - at - 1) * sizeof(Token));
+    token_count--;
+    touch(at);
+}
+
+bool CalcEngine::ends_with_operand() const {
+    if (token_count == 0) return false;
+    TokenType type = tokens[token_count - 1].type;
+    return type == TOK_NUMBER || type == TOK_CONSTANT || type == TOK_NAME || type == TOK_RPAREN ||
+           type == TOK_PERCENT || type == TOK_FACTORIAL || type == TOK_SQUARE;
+}
+
+bool CalcEngine::ends_with_operator() const {
+    return token_count > 0 && is_binary_operator(tokens[token_count - 1].type);
+}
+
+int CalcEngine::open_parens() const {
+    int open = 0;
+    for (size_t i = 0; i < token_count; i++) {
+        if (tokens[i].type == TOK_LPAREN) open++;
+        if (tokens[i].type == TOK_RPAREN) open--;
+    }
+    return open;
+}
+
+// Index of the first token of the trailing operand, e.g. the "-sin(30)"
+// in "2×-sin(30)". npos if the expression does not end in an operand.
+size_t CalcEngine::last_operand_start() const {
+    if (!ends_with_operand()) return std::string::npos;
+    size_t i = token_count - 1;
+
+    while (i > 0 && (tokens[i].type == TOK_PERCENT || tokens[i].type == TOK_FACTORIAL ||
+                     tokens[i].type == TOK_SQUARE)) {
+        i--;
+    }
+    if (tokens[i].type == TOK_RPAREN) {
+        int nesting = 0;
+        for (;;) {
+            if (tokens[i].type == TOK_RPAREN) nesting++;
+            if (tokens[i].type == TOK_LPAREN) nesting--;
+            if (nesting == 0) break;
+            if (i == 0) return std::string::npos;
+            i--;
+        }
+    } else if (tokens[i].type != TOK_NUMBER && tokens[i].type != TOK_CONSTANT && tokens[i].type != TOK_NAME) {
+        return std::string::npos;
+    }
+    while (i > 0 && tokens[i - 1].type == TOK_FUNCTION) {
+        i--;
+    }
+    // A minus is part of the operand when it is a sign, not a subtraction
+    if (i > 0 && tokens[i - 1].type == TOK_MINUS) {
+        if (i == 1 || is_binary_operator(tokens[i - 2].type) || tokens[i - 2].type == TOK_LPAREN) {
+            i--;
+        }
+    }
+    return i;
+}
+
+// True if tokens[start..] is one bracketed group such as "(2+3)"
+bool CalcEngine::is_bracketed(size_t start) const {
+    if (token_count - start < 2 || tokens[start].type != TOK_LPAREN) return false;
+    int nesting = 0;
+    size_t i = start;
+    for (; i < token_count; i++) {
+        if (tokens[i].type == TOK_LPAREN) nesting++;
+        if (tokens[i].type == TOK_RPAREN) nesting--;
+        if (nesting == 0) break;
+    }
+    return i == token_count - 1;
+}
+
+// Prepare the expression for a fresh operand: start over after "=", and
+// drop a finished operand (a result, constant or recalled value) that the
+// new one replaces
+void CalcEngine::begin_operand() {
+    if (equals_pressed) {
+        token_count = 0;
+        error = false;
+        return;
+    }
+    size_t start = last_operand_start();
+    if (start != std::string::npos) {
+        token_count = start;
+    }
+}
+
+// Start a new expression whose first operand is the last result
+void CalcEngine::continue_from_result() {
+    token_count = 0;
+    push_current();
+    equals_pressed = false;
+    new_calculation = true;
+}
+
+// Copy the entry digits into the display value and the trailing token.
+// The sign of a negated entry is a separate minus token in the expression.
+void CalcEngine::sync_entry() {
+    bool negative = entry[0] == '-';
+    double value = 0;
+    parse_number(entry.c_str() + (negative ? 1 : 0), entry.size() - (negative ? 1 : 0), &value);
+    tokens[token_count - 1].value = value;
+    touch(token_count - 1);
+    current_value = negative ? -value : value;
+    if (precision) {
+        const char *digits = entry.c_str() + (negative ? 1 : 0);
+        size_t len = entry.size() - (negative ? 1 : 0);
+        set_exact_text(tokens[token_count - 1], digits, len);
+        BigFloat::parse(entry.c_str(), entry.size(), &big_current);
+    }
+}
+
+// Run the compiled program; precision mode also sets big_current
+EvalResult CalcEngine::run_program() {
+    if (!precision) return program.run();
+    BigFloat value;
+    EvalResult result = program.run_precise(exact_pool.c_str(), precision, &value);
+    if (result.status == EVAL_OK) big_current = value;
+    return result;
+}
+
+// Compile and run tokens[start..]
+bool CalcEngine::evaluate(size_t start, double *value) {
+    if (!compiler.compile_tokens(tokens + start, token_count - start, program)) {
+        set_error(EVAL_OK, 0, compiler.error());
+        return false;
+    }
+    EvalResult result = run_program();
+    if (result.status != EVAL_OK) {
+        set_error(result.status, result.failed_op, NULL);
+        return false;
+    }
+    *value = result.value;
+    return true;
+}
+
+// After tokens[start..] evaluated to Infinity: if they are x! with x!
+// past the double range, keep it as text for the display, as
+// "1.24101807021768e+309"
+void CalcEngine::note_large_factorial(size_t start) {
+    if (precision || current_value != HUGE_VAL || token_count - start < 2 ||
+        tokens[token_count - 1].type != TOK_FACTORIAL ||
+        !compiler.compile_tokens(tokens + start, token_count - 1 - start, program)) {
+        return;
+    }
+    EvalResult operand = program.run();
+    double mantissa;
+    long long exponent;
+    int digits;
+    if (operand.status != EVAL_OK || !large_factorial(operand.value, &mantissa, &exponent, &digits)) return;
+    char text[32];
+    snprintf(text, sizeof(text), "%.*g", digits, mantissa);
+    if (text[0] == '1' && text[1] == '0' && text[2] == '\0') { // 9.99… rounded up
+        snprintf(text, sizeof(text), "1");
+        exponent++;
+    }
+    large_text.assign(text);
+    snprintf(text, sizeof(text), "e+%lld", exponent);
+    large_text.append(text);
+}
+
+void CalcEngine::set_error(EvalStatus status, unsigned char op, const char *message) {
+    error = true;
+    error_status = status;
+    error_op = op;
+    error_message = message;
+    clear_current();
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = true; // Next input starts over
+}
+
+void CalcEngine::handle_number(const char *num) {
+    bool double_zero = strcmp(num, "00") == 0;
+    if (new_calculation || operator_pressed || equals_pressed) {
+        begin_operand();
+        if (!push_token(TOK_NUMBER, 0, 0)) return;
+        entry.assign(double_zero ? "0" : num); // Don't start with "00"
+        new_calculation = false;
+        operator_pressed = false;
+        equals_pressed = false;
+    } else if (entry == "0" || entry == "-0") {
+        if (!double_zero) { // Replace leading zero, keep a single zero
+            entry.pop_back();
+            entry.append(num);
+        }
+    } else {
+        size_t digits = entry.size() - (entry[0] == '-' ? 1 : 0) - (strchr(entry.c_str(), '.') ? 1 : 0);
+        if (digits + strlen(num) > MAX_ENTRY_DIGITS) {
+            key_refused = true;
+            return;
+        }
+        entry.append(num);
+    }
+    sync_entry();
+}
+
+void CalcEngine::handle_decimal() {
+    if (new_calculation || operator_pressed || equals_pressed) {
+        begin_operand();
+        if (!push_token(TOK_NUMBER, 0, 0)) return;
+        entry.assign("0.");
+        new_calculation = false;
+        operator_pressed = false;
+        equals_pressed = false;
+    } else if (strchr(entry.c_str(), '.') == NULL) {
+        entry.push_back('.');
+    }
+    sync_entry();
+}
+
+void CalcEngine::handle_all_clear() { // Renamed from handle_clear
+    token_count = 0;
+    entry.clear();
+    clear_current();
+    error = false;
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_clear_entry() { // Clear current input only
+    begin_operand();
+    clear_current();
+    error = false;
+    new_calculation = true; // Ready for new input
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_backspace() { // Delete last character
+    if (equals_pressed) return; // Results are not editable
+
+    if (typing()) {
+        // Still typing a number: trim one digit
+        size_t digits = entry.size() - (entry[0] == '-' ? 1 : 0);
+        if (digits > 1) {
+            entry.pop_back();
+            sync_entry();
+            return;
+        }
+        begin_operand(); // The number and its sign
+    } else {
+        // Otherwise drop the last token (operator, bracket or finished operand)
+        if (token_count == 0) return;
+        token_count--;
+    }
+    resume_after_delete();
+}
+
+// After a deletion, bring the display back in step with the tokens left:
+// a trailing number is typed on again, any other trailing operand shows
+// its value, and a trailing operator waits for the next operand with the
+// one before it showing, as when it was pressed. Otherwise it shows 0.
+void CalcEngine::resume_after_delete() {
+    new_calculation = true;
+    operator_pressed = false;
+    if (token_count == 0) {
+        clear_current();
+        return;
+    }
+    operator_pressed = ends_with_operator();
+    if (operator_pressed) token_count--;
+    size_t start = last_operand_start();
+    size_t last = token_count - 1;
+    bool signed_number = start != std::string::npos && start + 1 == last && tokens[start].type == TOK_MINUS;
+    if (!operator_pressed && tokens[last].type == TOK_NUMBER && (start == last || signed_number) &&
+        retype_number(last, signed_number)) {
+        new_calculation = false;
+        return;
+    }
+    bool shown = false;
+    if (start != std::string::npos && compiler.compile_tokens(tokens + start, token_count - start, program)) {
+        EvalResult result = run_program();
+        shown = result.status == EVAL_OK;
+        if (shown) current_value = result.value;
+    }
+    if (!shown) clear_current();
+    if (operator_pressed) token_count++;
+}
+
+// Make tokens[index], the last token, the entry again, as the digits it
+// was typed with; false if it has no plain decimal form ("1e+30")
+bool CalcEngine::retype_number(size_t index, bool negative) {
+    const Token &tok = tokens[index];
+    char scratch[FORMAT_BUFFER_SIZE];
+    const char *text = scratch;
+    size_t len;
+    if (precision && tok.end > tok.start) {
+        text = exact_pool.data() + tok.start;
+        len = tok.end - tok.start;
+    } else {
+        len = format_number(tok.value, scratch, DISPLAY_WIDTH); // Round trip
+    }
+    size_t points = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '.') {
+            points++;
+        } else if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+    }
+    if (len == 0 || points > 1 || len - points > MAX_ENTRY_DIGITS) return false;
+    entry.assign(negative ? "-" : "");
+    entry.append(text, len);
+    sync_entry();
+    return true;
+}
+
+void CalcEngine::handle_sign_change() {
+    if (error || (precision ? big_current.is_zero() : current_value == 0)) return;
+
+    if (equals_pressed) { // Continue from the result
+        continue_from_result();
+    }
+    current_value = -current_value;
+    big_current.negate();
+    if (typing()) {
+        if (entry[0] == '-') {
+            entry.erase_front();
+        } else {
+            entry.insert_front('-');
+        }
+    }
+
+    if (operator_pressed) return; // Operand not in the expression yet
+    size_t start = last_operand_start();
+    if (start == std::string::npos) return;
+    if (tokens[start].type == TOK_MINUS) {
+        erase_token(start);
+    } else {
+        insert_token(start, TOK_MINUS, 0);
+    }
+}
+
+void CalcEngine::handle_percentage() {
+    if (error) return;
+
+    if (equals_pressed) {
+        continue_from_result();
+    } else if (!ends_with_operand()) {
+        if (!push_current()) return;
+    }
+    if (!push_token(TOK_PERCENT, 0, 0)) return;
+    current_value /= 100.0;
+    big_current.scale10(-2);
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_operation(TokenType op) {
+    if (error) return;
+
+    if (equals_pressed) {
+        // Start new expression with the result
+        continue_from_result();
+    } else if (ends_with_operator()) {
+        // Replace the previous operator instead of stacking two
+        token_count--;
+    } else if (!ends_with_operand()) {
+        if (!push_current()) return;
+    }
+    if (!push_token(op, 0, 0)) return;
+
+    operator_pressed = true;
+    new_calculation = true; // Next number will clear the entry
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_equals() {
+    if (equals_pressed || error || token_count == 0) {
+        return;
+    }
+
+    // "2+=" uses the displayed value as the missing operand
+    if (!ends_with_operand()) {
+        if (!push_current()) return;
+    }
+    double result;
+    if (!evaluate(0, &result)) return;
+
+    current_value = result;
+    if (last_operand_start() == 0) note_large_factorial(0); // Just n!
+    implied_parens = open_parens(); // Shown closed in the history
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = true; // Indicate that equals was pressed
+    calculations++;
+    store(ans_symbol, result, big_current);
+}
+
+// Scientific functions wrap the trailing operand, so "2+sin 30" keeps the
+// "2+" and shows the value of sin(30) immediately
+void CalcEngine::handle_scientific_function(unsigned char op) {
+    if (error) return;
+    if (token_count + 4 > MAX_TOKENS) return; // Room for operand, brackets and function
+
+    if (equals_pressed) {
+        continue_from_result();
+    }
+    size_t start = last_operand_start();
+    if (start == std::string::npos) {
+        start = token_count;
+        push_current();
+    }
+
+    // A lone number or an already bracketed operand needs no extra brackets
+    bool simple = token_count - start == 1;
+    bool bracketed = is_bracketed(start);
+    if (op == OP_SQUARE || op == OP_FACTORIAL) {
+        if (!simple && !bracketed) {
+            insert_token(start, TOK_LPAREN, 0);
+            push_token(TOK_RPAREN, 0, 0);
+        }
+        push_token(op == OP_SQUARE ? TOK_SQUARE : TOK_FACTORIAL, 0, 0);
+    } else {
+        if (!bracketed) {
+            insert_token(start, TOK_LPAREN, 0);
+            push_token(TOK_RPAREN, 0, 0);
+        }
+        insert_token(start, TOK_FUNCTION, op);
+    }
+
+    double result;
+    if (!evaluate(start, &result)) return;
+    current_value = result;
+    if (op == OP_FACTORIAL) note_large_factorial(start);
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_constant(ConstantId constant) {
+    begin_operand();
+    double value = constant == CONST_PI ? M_PI : M_E;
+    if (!push_token(TOK_CONSTANT, constant, value)) return;
+    current_value = value;
+    if (precision) big_current = constant == CONST_PI ? big_pi(precision) : big_e(precision);
+    if (big_cancelled()) {
+        set_error(EVAL_CANCELLED, 0, NULL);
+        return;
+    }
+    
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::handle_parenthesis(TokenType paren) {
+    if (paren == TOK_LPAREN) {
+        if (equals_pressed) {
+            token_count = 0;
+            error = false;
+        }
+        if (!push_token(TOK_LPAREN, 0, 0)) return;
+        clear_current();
+    } else {
+        // Only close a bracket that is open
+        if (equals_pressed || error || open_parens() <= 0) return;
+        if (token_count + 2 > MAX_TOKENS) return;
+        if (!ends_with_operand()) {
+            push_current();
+        }
+        push_token(TOK_RPAREN, 0, 0);
+
+        // Show the value of the group just closed
+        size_t start = last_operand_start();
+        if (start != std::string::npos &&
+            compiler.compile_tokens(tokens + start, token_count - start, program)) {
+            EvalResult group = run_program();
+            if (group.status == EVAL_OK) {
+                current_value = group.value;
+            }
+        }
+    }
+    
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+// Memory functions, on the selected slot
+void CalcEngine::handle_memory_add() {
+    if (error) return;
+    SymbolId slot = memory_symbols[active_slot];
+    BigFloat memory;
+    double value = register_value(slot, &memory) + current_value;
+    if (precision) {
+        memory = memory + big_current;
+        value = memory.to_double();
+    }
+    store(slot, value, memory);
+    new_calculation = true;
+    operator_pressed = false;
+}
+
+void CalcEngine::handle_memory_subtract() {
+    if (error) return;
+    SymbolId slot = memory_symbols[active_slot];
+    BigFloat memory;
+    double value = register_value(slot, &memory) - current_value;
+    if (precision) {
+        memory = memory - big_current;
+        value = memory.to_double();
+    }
+    store(slot, value, memory);
+    new_calculation = true;
+    operator_pressed = false;
+}
+
+void CalcEngine::handle_memory_recall() {
+    begin_operand();
+    current_value = register_value(memory_symbols[active_slot], &big_current);
+    if (!push_current()) return;
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+}
+
+void CalcEngine::recall(double value) {
+    begin_operand();
+    current_value = value;
+    if (precision) BigFloat::from_double(value, &big_current);
+    if (!push_current()) return;
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+    text_dirty = true;
+}
+
+void CalcEngine::handle_memory_clear() {
+    registers.remove(memory_symbols[active_slot]);
+    new_calculation = true;
+    operator_pressed = false;
+}
+
+void CalcEngine::select_memory_slot(size_t slot) {
+    if (slot < MEMORY_SLOTS) active_slot = slot;
+}
+
+void CalcEngine::insert_variable(SymbolId id) {
+    if (id >= registers.size() || !registers.is_defined(id)) return;
+    begin_operand();
+    double value = register_value(id, &big_current);
+    if (!push_token(TOK_NAME, 0, value)) return;
+    tokens[token_count - 1].symbol = id;
+    current_value = value;
+    new_calculation = true;
+    operator_pressed = false;
+    equals_pressed = false;
+    text_dirty = true;
+}
+
+bool CalcEngine::store_variable(const char *name, size_t len) {
+    if (error || !Registers::valid_name(name, len)) return false;
+    store(registers.intern(name, len), current_value, big_current);
+    new_calculation = true;
+    operator_pressed = false;
+    text_dirty = true;
+    return true;
+}
+
+// Text of one expression token; numbers are formatted into scratch
+static const char *token_text(const Token &tok, char *scratch) {
+    switch (tok.type) {
+        case TOK_NUMBER:
+            format_number(tok.value, scratch, DISPLAY_WIDTH, DISPLAY_DIGITS);
+            return scratch;
+        case TOK_CONSTANT: return tok.op == CONST_PI ? "π" : "e";
+        case TOK_FUNCTION: return opcode_name(tok.op);
+        case TOK_PLUS: return "+";
+        case TOK_MINUS: return "-";
+        case TOK_MULTIPLY: return "×";
+        case TOK_DIVIDE: return "÷";
+        case TOK_POWER: return "^";
+        case TOK_PERCENT: return "%";
+        case TOK_FACTORIAL: return "!";
+        case TOK_SQUARE: return "²";
+        case TOK_LPAREN: return "(";
+        case TOK_RPAREN: return ")";
+        case TOK_COMBINATION: return "nCr";
+        case TOK_PERMUTATION: return "nPr";
+        case TOK_VARIABLE: return "x";
+        case TOK_NAME: return ""; // Named by the engine's registers
+    }
+    return "";
+}
+
+void CalcEngine::render() const {
+    char scratch[FORMAT_BUFFER_SIZE];
+    display_buffer.clear();
+    history_buffer.clear();
+
+    if (error) {
+        display_buffer.assign("Error");
+        history_buffer.assign("Error: ");
+        if (error_status == EVAL_DIVISION_BY_ZERO) {
+            history_buffer.append("Division by zero");
+        } else if (error_status == EVAL_INVALID_INPUT) {
+            history_buffer.append("Invalid input for ");
+            history_buffer.append(opcode_name(error_op));
+        } else if (error_status == EVAL_CANCELLED) {
+            history_buffer.append("Cancelled");
+        } else if (error_message) {
+            history_buffer.append(error_message);
+        }
+        text_dirty = false;
+        return;
+    }
+
+    if (typing()) {
+        // display_text() returns the entry itself, which can outgrow display_buffer
+    } else if (precision) {
+        // Full digits for the display, the usual 15 for the history line
+        format_number(big_current, precision, precise_display);
+        format_number(big_current, DISPLAY_DIGITS, precise_scratch);
+        display_buffer.assign(precise_scratch.c_str());
+    } else if (!large_text.empty() && current_value == HUGE_VAL) {
+        display_buffer.assign(large_text.c_str());
+    } else {
+        format_number(current_value, scratch, DISPLAY_WIDTH, DISPLAY_DIGITS);
+        display_buffer.assign(scratch);
+    }
+
+    for (size_t i = 0; i < token_count; i++) {
+        const Token &tok = tokens[i];
+        if (i == token_count - 1 && typing()) {
+            // The number being typed keeps its digits ("2.", "0.50")
+            history_buffer.append(entry.c_str() + (entry[0] == '-' ? 1 : 0));
+        } else if (precision && tok.type == TOK_NUMBER && tok.end > tok.start) {
+            // Exact values may be beyond double range
+            BigFloat value;
+            BigFloat::parse(exact_pool.data() + tok.start, tok.end - tok.start, &value);
+            format_number(value, DISPLAY_DIGITS, precise_scratch);
+            history_buffer.append(precise_scratch.c_str());
+        } else if (tok.type == TOK_NAME) {
+            history_buffer.append(registers.name(tok.symbol));
+        } else {
+            history_buffer.append(token_text(tok, scratch));
+        }
+    }
+    if (equals_pressed) {
+        for (int i = 0; i < implied_parens; i++) {
+            history_buffer.push_back(')');
+        }
+        history_buffer.append(" = ");
+        history_buffer.append(display_buffer.c_str()); // Complete the expression
+    }
+    text_dirty = false;
+}
+
+PreviewStatus CalcEngine::preview(double seconds, double *value) {
+    if (error || equals_pressed || token_count == 0) return PREVIEW_NONE;
+    if (!live.update(tokens, token_count, seconds)) return PREVIEW_PENDING;
+    return live.value(value) ? PREVIEW_READY : PREVIEW_NONE;
+}
+
+const char *CalcEngine::display_text() const {
+    if (text_dirty) render();
+    if (!error && typing()) return entry.c_str();
+    if (precision && !error) return precise_display.c_str();
+    return display_buffer.c_str();
+}
+
+const char *CalcEngine::history_text() const {
+    if (text_dirty) render();
+    return history_buffer.c_str();
+}
+
+void CalcEngine::set_precision(size_t digits) {
+    if (digits == precision) return;
+    precision = digits;
+    handle_all_clear();
+    text_dirty = true;
+}
+
+void CalcEngine::set_angle_unit(AngleUnit unit) {
+    compiler.set_angle_unit(unit);
+    live.set_angle_unit(unit);
+    text_dirty = true;
+}
@@ -0,0 +1,184 @@
+#ifndef CALC_ENGINE_H
+#define CALC_ENGINE_H
+
+#include <string>
+#include "calc_bignum.h"
+#include "calc_commands.h"
+#include "calc_expr.h"
+#include "calc_preview.h"
+#include "calc_registers.h"
+#include "calc_string.h"
+
+// Headless calculator state machine. Holds everything the keypad
+// manipulates and performs all arithmetic; no GTK dependency so it can be
+// driven from the GUI, the batch mode or a benchmark alike.
+//
+// State is kept as typed values: the expression is a fixed array of
+// tokens whose numbers are doubles, the number being typed lives in a
+// fixed-capacity entry buffer, and the display value is a double. Text is
+// only produced when display_text()/history_text() are asked for, and no
+// keypress allocates once the compiler's buffers have warmed up. A key
+// that would overflow the entry or the token array is refused, and
+// refused() says so for the window to ring the bell.
+//
+// In precision mode (set_precision) the same tokens also point at exact
+// decimal text in exact_pool, "=" runs Program::run_precise, and the
+// display shows up to `precision` digits. That mode allocates freely.
+//
+// Memory and named values live in registers: M+, M−, MR and MC work on
+// the selected slot of M1…M10, "ans" holds the last result, and a name
+// inserted into the expression is read when it is evaluated.
+class CalcEngine {
+public:
+    static const size_t MAX_TOKENS = 128;
+    static const size_t MAX_ENTRY_DIGITS = 1000; // The largest precision on the View menu
+
+private:
+    Token tokens[MAX_TOKENS];  // Expression built so far
+    size_t token_count;
+    FixedString<MAX_ENTRY_DIGITS + 3> entry; // Digits of the number being typed, with sign and point
+    double current_value;      // Value in the main display
+    FixedString<32> large_text; // n! past the double range, shown for its Infinity; empty if none
+    int implied_parens;        // Brackets closed by "=" for the history line
+    bool new_calculation;
+    bool operator_pressed; // Manage input after an operator
+    bool equals_pressed;   // Manage input after equals
+    unsigned long calculations; // Results produced by "="
+    bool key_refused;      // The last press did not fit
+
+    // Error state, rendered as "Error" plus a message in the history
+    bool error;
+    EvalStatus error_status;
+    unsigned char error_op;
+    const char *error_message;
+
+    ExprCompiler compiler;
+    Program program;
+    ExprPreview live;       // Value so far, for preview()
+
+    Registers registers;
+    SymbolId memory_symbols[MEMORY_SLOTS];
+    size_t active_slot;
+    SymbolId ans_symbol;
+
+    // Precision mode; 0 is the standard double mode
+    size_t precision;
+    std::string exact_pool;    // Exact text of number tokens
+    BigFloat big_current;
+
+    // Rendered text, rebuilt lazily after a keypress
+    mutable FixedString<64> display_buffer;
+    mutable FixedString<4096> history_buffer;
+    mutable std::string precise_display;
+    mutable std::string precise_scratch;
+    mutable bool text_dirty;
+
+    bool typing() const { return !new_calculation && !operator_pressed && !equals_pressed; }
+    void touch(size_t index) { live.changed(index); }
+    bool push_token(TokenType type, unsigned char op, double value);
+    bool push_current();
+    void set_exact_text(Token &tok, const char *text, size_t len);
+    void clear_current();
+    double register_value(SymbolId id, BigFloat *exact) const;
+    void store(SymbolId id, double value, const BigFloat &exact);
+    bool insert_token(size_t at, TokenType type, unsigned char op);
+    void erase_token(size_t at);
+    bool ends_with_operand() const;
+    bool ends_with_operator() const;
+    int open_parens() const;
+    size_t last_operand_start() const;
+    bool is_bracketed(size_t start) const;
+    void begin_operand();
+    void continue_from_result();
+    void sync_entry();
+    EvalResult run_program();
+    bool evaluate(size_t start, double *value);
+    void set_error(EvalStatus status, unsigned char op, const char *message);
+    void note_large_factorial(size_t start);
+    void resume_after_delete();
+    bool retype_number(size_t index, bool negative);
+    void render() const;
+
+    void handle_number(const char *num);
+    void handle_decimal();
+    void handle_all_clear();
+    void handle_clear_entry();
+    void handle_backspace();
+    void handle_sign_change();
+    void handle_percentage();
+    void handle_operation(TokenType op);
+    void handle_equals();
+    void handle_scientific_function(unsigned char op);
+    void handle_constant(ConstantId constant);
+    void handle_parenthesis(TokenType paren);
+    void handle_memory_add();
+    void handle_memory_subtract();
+    void handle_memory_recall();
+    void handle_memory_clear();
+
+public:
+    CalcEngine();
+
+    // Feed one keypad command into the state machine
+    void press(Command command);
+
+    // Whether press(command) may run long enough to be worth doing off
+    // the UI thread: anything that evaluates, in precision mode. Under a
+    // BigCancelScope a cancelled press ends in an error reading
+    // "Cancelled".
+    bool may_be_slow(Command command) const;
+
+    // Text for the main display and the history line
+    const char *display_text() const;
+    const char *history_text() const;
+
+    double value() const { return current_value; }
+
+    // True when the last press was dropped because the entry already
+    // holds MAX_ENTRY_DIGITS digits or the expression MAX_TOKENS tokens
+    bool refused() const { return key_refused; }
+
+    // Value of the expression typed so far, for a line under the display:
+    // what "=" would give now with open brackets closed, leaving out a
+    // trailing operator that has no operand yet. Only tokens edited since
+    // the last call are read again (calc_preview.h), for at most `seconds`;
+    // PREVIEW_PENDING if that was not enough, to be called again. Computed
+    // in doubles, in precision mode too. PREVIEW_NONE after "=", on an
+    // error, or when what is typed has no value.
+    PreviewStatus preview(double seconds, double *value);
+
+    // Counts each "=" that produced a result, so a caller can tell a new
+    // history line from a repeated press
+    unsigned long calculation_count() const { return calculations; }
+
+    // Enter a value from elsewhere (a history line) as the current operand,
+    // as memory recall does
+    void recall(double value);
+
+    // Memory slot the memory keys work on, 0 to MEMORY_SLOTS - 1
+    void select_memory_slot(size_t slot);
+    size_t memory_slot() const { return active_slot; }
+    SymbolId memory_symbol(size_t slot) const { return memory_symbols[slot]; }
+
+    // Named values. insert_variable enters a defined register as the
+    // current operand, shown by name; store_variable saves the displayed
+    // value under a name, false if the name is not valid or there is an
+    // error showing.
+    Registers &variables() { return registers; }
+    const Registers &variables() const { return registers; }
+    void insert_variable(SymbolId id);
+    bool store_variable(const char *name, size_t len);
+
+    // Significant digits for precision mode, 0 for standard. Changing it
+    // starts a new calculation; registers carry over, rounded on use.
+    void set_precision(size_t digits);
+    size_t precision_digits() const { return precision; }
+
+    // Unit sin, cos and tan take, degrees by default. The entry is kept;
+    // the next result uses the new unit.
+    void set_angle_unit(AngleUnit unit);
+    AngleUnit angle_unit() const { return compiler.angle(); }
+    const BigFloat &precise_value() const { return big_current; }
+};
+
+#endif // CALC_ENGINE_H
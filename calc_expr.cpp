@@ -0,0 +1,623 @@
+#include "calc_expr.h"
+#include "calc_registers.h"
+#include "calc_special.h"
+#include "calc_trig.h"
+#include <cmath>
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Small on-stack VM stack; deeper programs fall back to the heap
+const size_t VM_LOCAL_STACK = 64;
+
+// Exact powers of ten for the fast number path
+const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool is_name_char(char c) {
+    return is_alpha(c) || is_digit(c) || c == '_';
+}
+
+bool starts_with(const char *text, size_t len, const char *prefix) {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(text, prefix, n) == 0;
+}
+
+// Fills in tok for a function, constant or x; false for any other word
+bool builtin_token(const char *word, size_t len, Token &tok) {
+    if (len == 3 && memcmp(word, "sin", 3) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_SIN;
+    } else if (len == 3 && memcmp(word, "cos", 3) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_COS;
+    } else if (len == 3 && memcmp(word, "tan", 3) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_TAN;
+    } else if (len == 3 && memcmp(word, "log", 3) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_LOG;
+    } else if (len == 2 && memcmp(word, "ln", 2) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_LN;
+    } else if (len == 4 && memcmp(word, "sqrt", 4) == 0) {
+        tok.type = TOK_FUNCTION;
+        tok.op = OP_SQRT;
+    } else if (len == 3 && memcmp(word, "nCr", 3) == 0) {
+        tok.type = TOK_COMBINATION;
+    } else if (len == 3 && memcmp(word, "nPr", 3) == 0) {
+        tok.type = TOK_PERMUTATION;
+    } else if (len == 1 && word[0] == 'x') {
+        tok.type = TOK_VARIABLE;
+    } else if (len == 2 && memcmp(word, "pi", 2) == 0) {
+        tok.type = TOK_CONSTANT;
+        tok.op = CONST_PI;
+        tok.value = M_PI;
+    } else if (len == 1 && word[0] == 'e') {
+        tok.type = TOK_CONSTANT;
+        tok.op = CONST_E;
+        tok.value = M_E;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Id of a register with a value, or NO_SYMBOL
+SymbolId defined_register(const Registers *registers, const char *name, size_t len) {
+    if (!registers) return NO_SYMBOL;
+    SymbolId id = registers->find(name, len);
+    return id != NO_SYMBOL && registers->is_defined(id) ? id : NO_SYMBOL;
+}
+
+// Slow path for long mantissas or large exponents: strtod with the
+// decimal point swapped for whatever the current locale expects
+double parse_number_slow(const char *text, size_t len) {
+    char local[64];
+    std::string heap;
+    char *copy = local;
+    if (len >= sizeof(local)) {
+        heap.assign(text, len);
+        copy = &heap[0];
+    } else {
+        memcpy(local, text, len);
+        local[len] = '\0';
+    }
+    char point = localeconv()->decimal_point[0];
+    for (size_t i = 0; i < len; i++) {
+        if (copy[i] == '.') copy[i] = point;
+    }
+    return strtod(copy, NULL);
+}
+
+} // namespace
+
+size_t parse_number(const char *text, size_t len, double *value) {
+    size_t i = 0;
+    unsigned long long mantissa = 0;
+    int digits = 0;     // Significant digits accumulated into mantissa
+    int exponent = 0;   // Decimal exponent applied to mantissa
+    bool any_digit = false;
+    bool exact = true;
+
+    // Leading zeros are not significant; after them every digit is, up to
+    // 19 of them, and the rest only scale the mantissa
+    while (i < len && text[i] == '0') {
+        any_digit = true;
+        i++;
+    }
+    while (i < len && is_digit(text[i])) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (text[i] - '0');
+            digits++;
+        } else {
+            exponent++;
+            exact = false;
+        }
+        i++;
+    }
+    if (i < len && text[i] == '.') {
+        i++;
+        if (mantissa == 0) {
+            while (i < len && text[i] == '0') {
+                any_digit = true;
+                exponent--;
+                i++;
+            }
+        }
+        while (i < len && is_digit(text[i])) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (text[i] - '0');
+                digits++;
+                exponent--;
+            } else {
+                exact = false;
+            }
+            i++;
+        }
+    }
+    if (!any_digit) return 0;
+
+    // Exponent only if followed by digits, so "2e" stays 2×e
+    if (i + 1 < len && (text[i] == 'e' || text[i] == 'E')) {
+        size_t j = i + 1;
+        bool negative = false;
+        if (text[j] == '+' || text[j] == '-') {
+            negative = text[j] == '-';
+            j++;
+        }
+        if (j < len && is_digit(text[j])) {
+            int e = 0;
+            while (j < len && is_digit(text[j])) {
+                if (e < 100000) e = e * 10 + (text[j] - '0');
+                j++;
+            }
+            exponent += negative ? -e : e;
+            i = j;
+        }
+    }
+
+    // Mantissa exactly representable and power of ten exact: one rounding,
+    // so the result is correctly rounded
+    if (exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double m = (double)mantissa;
+        *value = exponent < 0 ? m / POW10[-exponent] : m * POW10[exponent];
+    } else {
+        *value = parse_number_slow(text, i);
+    }
+    return i;
+}
+
+EvalStatus apply_unary(unsigned char op, double x, double *result, AngleUnit unit) {
+    switch (op) {
+        case OP_NEG:
+            *result = -x;
+            break;
+        case OP_PERCENT:
+            *result = x / 100.0;
+            break;
+        case OP_SQUARE:
+            *result = x * x;
+            break;
+        case OP_SIN:
+            *result = sin_angle(x, unit);
+            break;
+        case OP_COS:
+            *result = cos_angle(x, unit);
+            break;
+        case OP_TAN:
+            if (!tan_angle(x, unit, result)) return EVAL_INVALID_INPUT;
+            break;
+        case OP_LOG:
+            if (x <= 0) return EVAL_INVALID_INPUT;
+            *result = log10(x);
+            break;
+        case OP_LN:
+            if (x <= 0) return EVAL_INVALID_INPUT;
+            *result = log(x);
+            break;
+        case OP_SQRT:
+            if (x < 0) return EVAL_INVALID_INPUT;
+            *result = sqrt(x);
+            break;
+        case OP_FACTORIAL:
+            return factorial(x, result);
+        default:
+            return EVAL_INVALID_INPUT;
+    }
+    return EVAL_OK;
+}
+
+const char *opcode_name(unsigned char op) {
+    switch (op) {
+        case OP_ADD: return "+";
+        case OP_SUB: return "-";
+        case OP_MUL: return "×";
+        case OP_DIV: return "÷";
+        case OP_POW: return "^";
+        case OP_NEG: return "±";
+        case OP_PERCENT: return "%";
+        case OP_FACTORIAL: return "factorial";
+        case OP_SQUARE: return "x²";
+        case OP_SIN: return "sin";
+        case OP_COS: return "cos";
+        case OP_TAN: return "tan";
+        case OP_LOG: return "log";
+        case OP_LN: return "ln";
+        case OP_SQRT: return "√";
+        case OP_NCR: return "nCr";
+        case OP_NPR: return "nPr";
+        case OP_VARIABLE: return "x";
+        case OP_LOAD: return "register";
+    }
+    return "";
+}
+
+bool is_builtin_name(const char *word, size_t len) {
+    Token tok;
+    return builtin_token(word, len, tok);
+}
+
+void Program::clear() {
+    code.clear();
+    constants.clear();
+    sources.clear();
+    symbols.clear();
+    max_depth = 0;
+    variable = false;
+    angle_unit = ANGLE_DEGREES;
+}
+
+EvalResult Program::run(double x) const {
+    EvalResult result = {EVAL_OK, 0.0, OP_PUSH};
+    double local[VM_LOCAL_STACK];
+    std::vector<double> heap;
+    double *stack = local;
+    if (max_depth > VM_LOCAL_STACK) {
+        heap.resize(max_depth);
+        stack = &heap[0];
+    }
+
+    const unsigned char *ip = code.data();
+    const unsigned char *end = ip + code.size();
+    const double *k = constants.data();
+    const unsigned *s = symbols.data();
+    double *sp = stack; // Points one past the top
+
+    for (; ip != end; ++ip) {
+        switch (*ip) {
+            case OP_PUSH:
+                *sp++ = *k++;
+                break;
+            case OP_VARIABLE:
+                *sp++ = x;
+                break;
+            case OP_LOAD:
+                if (!registers->is_defined(*s)) {
+                    result.status = EVAL_INVALID_INPUT;
+                    result.failed_op = OP_LOAD;
+                    return result;
+                }
+                *sp++ = registers->value(*s++);
+                break;
+            case OP_ADD:
+                sp--;
+                sp[-1] += sp[0];
+                break;
+            case OP_SUB:
+                sp--;
+                sp[-1] -= sp[0];
+                break;
+            case OP_MUL:
+                sp--;
+                sp[-1] *= sp[0];
+                break;
+            case OP_DIV:
+                sp--;
+                if (sp[0] == 0) {
+                    result.status = EVAL_DIVISION_BY_ZERO;
+                    result.failed_op = OP_DIV;
+                    return result;
+                }
+                sp[-1] /= sp[0];
+                break;
+            case OP_POW:
+                sp--;
+                sp[-1] = pow(sp[-1], sp[0]);
+                break;
+            case OP_NEG:
+                sp[-1] = -sp[-1];
+                break;
+            case OP_NCR:
+            case OP_NPR: {
+                sp--;
+                EvalStatus status = *ip == OP_NCR ? combinations(sp[-1], sp[0], &sp[-1])
+                                                  : permutations(sp[-1], sp[0], &sp[-1]);
+                if (status != EVAL_OK) {
+                    result.status = status;
+                    result.failed_op = *ip;
+                    return result;
+                }
+                break;
+            }
+            default: {
+                EvalStatus status = apply_unary(*ip, sp[-1], &sp[-1], angle_unit);
+                if (status != EVAL_OK) {
+                    result.status = status;
+                    result.failed_op = *ip;
+                    return result;
+                }
+                break;
+            }
+        }
+    }
+    if (sp != stack) result.value = sp[-1];
+    return result;
+}
+
+bool ExprCompiler::tokenize(const char *text, size_t len) {
+    tokens.clear();
+    error_message = NULL;
+    size_t i = 0;
+    while (i < len) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            i++;
+            continue;
+        }
+
+        Token tok;
+        tok.op = 0;
+        tok.symbol = 0;
+        tok.value = 0;
+        tok.start = i;
+        size_t n = 1;
+
+        if (is_digit(c) || (c == '.' && i + 1 < len && is_digit(text[i + 1]))) {
+            tok.type = TOK_NUMBER;
+            n = parse_number(text + i, len - i, &tok.value);
+        } else if (c == '+') {
+            tok.type = TOK_PLUS;
+        } else if (c == '-') {
+            tok.type = TOK_MINUS;
+        } else if (c == '*') {
+            tok.type = TOK_MULTIPLY;
+        } else if (c == '/') {
+            tok.type = TOK_DIVIDE;
+        } else if (c == '^') {
+            tok.type = TOK_POWER;
+        } else if (c == '%') {
+            tok.type = TOK_PERCENT;
+        } else if (c == '!') {
+            tok.type = TOK_FACTORIAL;
+        } else if (c == '(') {
+            tok.type = TOK_LPAREN;
+        } else if (c == ')') {
+            tok.type = TOK_RPAREN;
+        } else if (starts_with(text + i, len - i, "×")) {
+            tok.type = TOK_MULTIPLY;
+            n = strlen("×");
+        } else if (starts_with(text + i, len - i, "÷")) {
+            tok.type = TOK_DIVIDE;
+            n = strlen("÷");
+        } else if (starts_with(text + i, len - i, "−")) {
+            tok.type = TOK_MINUS;
+            n = strlen("−");
+        } else if (starts_with(text + i, len - i, "²")) {
+            tok.type = TOK_SQUARE;
+            n = strlen("²");
+        } else if (starts_with(text + i, len - i, "√")) {
+            tok.type = TOK_FUNCTION;
+            tok.op = OP_SQRT;
+            n = strlen("√");
+        } else if (starts_with(text + i, len - i, "π")) {
+            tok.type = TOK_CONSTANT;
+            tok.op = CONST_PI;
+            tok.value = M_PI;
+            n = strlen("π");
+        } else if (is_alpha(c)) {
+            while (i + n < len && is_alpha(text[i + n])) n++;
+            // A register name may run on with digits ("x1", "rate_2"); a
+            // built-in one never does, so "x2" stays x×2 unless x2 is defined
+            size_t full = n;
+            while (i + full < len && is_name_char(text[i + full])) full++;
+            SymbolId id = NO_SYMBOL;
+            if (full > n) id = defined_register(registers, text + i, full);
+            if (id != NO_SYMBOL) {
+                n = full;
+            } else if (!builtin_token(text + i, n, tok)) {
+                id = defined_register(registers, text + i, n);
+                if (id == NO_SYMBOL) {
+                    error_message = "Unknown name";
+                    return false;
+                }
+            }
+            if (id != NO_SYMBOL) {
+                tok.type = TOK_NAME;
+                tok.symbol = id;
+            }
+        } else {
+            error_message = "Unexpected character";
+            return false;
+        }
+
+        i += n;
+        tok.end = i;
+        tokens.push_back(tok);
+    }
+    return true;
+}
+
+bool ExprCompiler::compile(const char *text, size_t len, Program &program) {
+    if (!tokenize(text, len)) {
+        program.clear();
+        return false;
+    }
+    return compile_tokens(program);
+}
+
+bool ExprCompiler::compile_tokens(Program &program) {
+    return compile_tokens(tokens.data(), tokens.size(), program);
+}
+
+bool ExprCompiler::compile_tokens(const Token *sequence, size_t count, Program &program) {
+    program.clear();
+    input = sequence;
+    input_count = count;
+    out = &program;
+    program.registers = registers;
+    program.angle_unit = angle_unit;
+    pos = 0;
+    depth = 0;
+    error_message = NULL;
+    if (count == 0) return fail("Empty expression");
+    if (!parse_expression(PREC_ADD)) return false;
+    if (pos != input_count) {
+        return fail(input[pos].type == TOK_RPAREN ? "Unbalanced parentheses" : "Syntax error");
+    }
+    return true;
+}
+
+bool ExprCompiler::fail(const char *message) {
+    error_message = message;
+    if (out) out->clear();
+    return false;
+}
+
+void ExprCompiler::emit(unsigned char op, int stack_effect) {
+    out->code.push_back(op);
+    depth += stack_effect;
+    if (depth > out->max_depth) out->max_depth = depth;
+}
+
+void ExprCompiler::push_constant(const Token &tok) {
+    out->constants.push_back(tok.value);
+    out->sources.push_back(tok);
+    emit(OP_PUSH, 1);
+}
+
+bool ExprCompiler::starts_operand(size_t index) const {
+    if (index >= input_count) return false;
+    TokenType type = input[index].type;
+    return type == TOK_NUMBER || type == TOK_CONSTANT || type == TOK_VARIABLE ||
+           type == TOK_NAME || type == TOK_FUNCTION || type == TOK_LPAREN;
+}
+
+// Precedence climbing over binary operators. ^ is right associative,
+// everything else left associative.
+bool ExprCompiler::parse_expression(int min_precedence) {
+    if (!parse_unary()) return false;
+
+    while (pos < input_count) {
+        TokenType type = input[pos].type;
+        int precedence;
+        unsigned char op;
+        bool implicit = false;
+        if (type == TOK_PLUS) {
+            precedence = PREC_ADD;
+            op = OP_ADD;
+        } else if (type == TOK_MINUS) {
+            precedence = PREC_ADD;
+            op = OP_SUB;
+        } else if (type == TOK_MULTIPLY) {
+            precedence = PREC_MUL;
+            op = OP_MUL;
+        } else if (type == TOK_DIVIDE) {
+            precedence = PREC_MUL;
+            op = OP_DIV;
+        } else if (type == TOK_COMBINATION) {
+            precedence = PREC_COUNT;
+            op = OP_NCR;
+        } else if (type == TOK_PERMUTATION) {
+            precedence = PREC_COUNT;
+            op = OP_NPR;
+        } else if (type == TOK_POWER) {
+            precedence = PREC_POW;
+            op = OP_POW;
+        } else if (starts_operand(pos)) {
+            precedence = PREC_MUL;
+            op = OP_MUL;
+            implicit = true;
+        } else {
+            break;
+        }
+        if (precedence < min_precedence) break;
+
+        if (!implicit) pos++;
+        int next_min = (op == OP_POW) ? precedence : precedence + 1;
+        if (!parse_expression(next_min)) return false;
+        emit(op, -1);
+    }
+    return true;
+}
+
+// Prefix sign. Binds looser than ^ and nCr so -2^2 is -(2^2).
+bool ExprCompiler::parse_unary() {
+    if (pos < input_count && input[pos].type == TOK_MINUS) {
+        pos++;
+        if (!parse_expression(PREC_COUNT)) return false;
+        emit(OP_NEG, 0);
+        return true;
+    }
+    if (pos < input_count && input[pos].type == TOK_PLUS) {
+        pos++;
+        return parse_expression(PREC_COUNT);
+    }
+    return parse_postfix();
+}
+
+bool ExprCompiler::parse_postfix() {
+    if (!parse_primary()) return false;
+    while (pos < input_count) {
+        TokenType type = input[pos].type;
+        if (type == TOK_PERCENT) {
+            emit(OP_PERCENT, 0);
+        } else if (type == TOK_FACTORIAL) {
+            emit(OP_FACTORIAL, 0);
+        } else if (type == TOK_SQUARE) {
+            emit(OP_SQUARE, 0);
+        } else {
+            break;
+        }
+        pos++;
+    }
+    return true;
+}
+
+bool ExprCompiler::parse_primary() {
+    if (pos >= input_count) return fail("Incomplete expression");
+    const Token &tok = input[pos];
+    switch (tok.type) {
+        case TOK_NUMBER:
+        case TOK_CONSTANT:
+            pos++;
+            push_constant(tok);
+            return true;
+        case TOK_VARIABLE:
+            pos++;
+            out->variable = true;
+            emit(OP_VARIABLE, 1);
+            return true;
+        case TOK_NAME:
+            if (!registers) return fail("Unknown name");
+            pos++;
+            out->symbols.push_back(tok.symbol);
+            emit(OP_LOAD, 1);
+            return true;
+        case TOK_LPAREN:
+            pos++;
+            if (!parse_expression(PREC_ADD)) return false;
+            // Missing closing brackets at the end are implied
+            if (pos < input_count) {
+                if (input[pos].type != TOK_RPAREN) return fail("Syntax error");
+                pos++;
+            }
+            return true;
+        case TOK_FUNCTION: {
+            unsigned char op = tok.op;
+            pos++;
+            // sin(…) takes the bracket, sin 30 / sin -30 the next operand
+            bool ok = (pos < input_count && input[pos].type == TOK_MINUS) ? parse_unary() : parse_primary();
+            if (!ok) return false;
+            emit(op, 0);
+            return true;
+        }
+        default:
+            return fail(tok.type == TOK_RPAREN ? "Unbalanced parentheses" : "Syntax error");
+    }
+}
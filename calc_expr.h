@@ -0,0 +1,217 @@
+#ifndef CALC_EXPR_H
+#define CALC_EXPR_H
+
+#include <cstddef>
+#include <vector>
+
+class BigFloat;
+class Registers;
+struct VecMath;
+
+// Expression compiler and evaluator. Text such as "2+3×(4-1)²" is split
+// into tokens, compiled by precedence climbing into a flat bytecode
+// program and run on a small stack VM. A compiled Program can be run any
+// number of times without re-parsing.
+
+enum TokenType {
+    TOK_NUMBER,
+    TOK_CONSTANT,   // π or e, value already filled in
+    TOK_FUNCTION,   // sin, cos, tan, log, ln, √
+    TOK_PLUS,
+    TOK_MINUS,
+    TOK_MULTIPLY,
+    TOK_DIVIDE,
+    TOK_POWER,
+    TOK_PERCENT,
+    TOK_FACTORIAL,
+    TOK_SQUARE,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_COMBINATION, // nCr
+    TOK_PERMUTATION, // nPr
+    TOK_VARIABLE,    // x, for table mode
+    TOK_NAME         // A named register, by id in Token::symbol
+};
+
+// Bytecode instructions, one byte each. OP_PUSH takes the next entry of
+// Program::constants, so no operand bytes are stored in the code stream;
+// OP_VARIABLE pushes the value of x the program is run at, and OP_LOAD the
+// register named by the next entry of Program::symbols.
+enum OpCode {
+    OP_PUSH,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_NEG,
+    OP_PERCENT,
+    OP_FACTORIAL,
+    OP_SQUARE,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_LOG,
+    OP_LN,
+    OP_SQRT,
+    OP_NCR,
+    OP_NPR,
+    OP_VARIABLE,
+    OP_LOAD
+};
+
+// Identifies a TOK_CONSTANT in Token::op
+enum ConstantId {
+    CONST_PI,
+    CONST_E
+};
+
+// What sin, cos and tan take their argument in. Degrees, like the keypad,
+// unless the compiler is told otherwise.
+enum AngleUnit {
+    ANGLE_DEGREES,
+    ANGLE_RADIANS,
+    ANGLE_GRADIANS
+};
+
+// Binary operator precedence; implicit multiplication ("2π", "3(4+1)")
+// binds like an explicit ×, and nCr/nPr between × and ^. A prefix sign
+// takes an operand of PREC_COUNT, so -2^2 is -(2^2) but -2×3 is (-2)×3.
+const int PREC_ADD = 1;
+const int PREC_MUL = 2;
+const int PREC_COUNT = 3;
+const int PREC_POW = 4;
+
+struct Token {
+    TokenType type;
+    unsigned char op;  // OpCode for functions, ConstantId for constants
+    unsigned symbol;   // Register id for names
+    double value;      // For numbers and constants
+    size_t start;      // Byte range in the source text
+    size_t end;
+};
+
+enum EvalStatus {
+    EVAL_OK,
+    EVAL_DIVISION_BY_ZERO,
+    EVAL_INVALID_INPUT,
+    EVAL_CANCELLED // run_precise stopped by a BigCancelScope
+};
+
+struct EvalResult {
+    EvalStatus status;
+    double value;
+    unsigned char failed_op; // OpCode that rejected its input
+};
+
+class Program {
+private:
+    std::vector<unsigned char> code;
+    std::vector<double> constants;
+    std::vector<Token> sources; // Token behind each constant, for run_precise
+    std::vector<unsigned> symbols; // Register ids for OP_LOAD
+    const Registers *registers;
+    size_t max_depth;
+    bool variable;
+    AngleUnit angle_unit;
+
+    friend class ExprCompiler;
+
+public:
+    Program() : registers(NULL), max_depth(0), variable(false), angle_unit(ANGLE_DEGREES) {}
+
+    void clear();
+    bool empty() const { return code.empty(); }
+    size_t size() const { return code.size(); }
+
+    // True if the expression mentions x; only table mode supplies one
+    bool uses_variable() const { return variable; }
+    AngleUnit angle() const { return angle_unit; }
+
+    // Registers are read when the program runs, not when it is compiled,
+    // so storing a new value needs no recompile. A register removed since
+    // fails as invalid input to OP_LOAD.
+    EvalResult run(double x = 0.0) const;
+
+    // Run at n <= VECTOR_BATCH values of x at once (calc_veceval.cpp), one
+    // opcode at a time over whole columns with the given math kernels.
+    // Points where run() would fail come out as NaN. stack is scratch
+    // space, kept by the caller so repeated batches do not allocate.
+    void run_vector(const double *x, double *out, size_t n, const VecMath &math,
+                    std::vector<double> &stack) const;
+
+    // Run in precision mode at `digits` significant digits (calc_bigeval.cpp).
+    // Numbers are read exactly from their byte range in source, or from
+    // their double value when the range is empty; registers from their
+    // exact text when they have one. Exact results stay exact;
+    // *exact, if given, says which it was. Programs using x are rejected.
+    EvalResult run_precise(const char *source, size_t digits, BigFloat *value, bool *exact = NULL) const;
+};
+
+class ExprCompiler {
+private:
+    std::vector<Token> tokens;
+    const Token *input;   // Tokens being compiled
+    size_t input_count;
+    size_t pos;
+    Program *out;
+    size_t depth;
+    const char *error_message;
+    const Registers *registers;
+    AngleUnit angle_unit;
+
+    void emit(unsigned char op, int stack_effect);
+    void push_constant(const Token &tok);
+    bool parse_expression(int min_precedence);
+    bool parse_unary();
+    bool parse_postfix();
+    bool parse_primary();
+    bool starts_operand(size_t index) const;
+    bool fail(const char *message);
+
+public:
+    ExprCompiler() :
+        input(NULL), input_count(0), pos(0), out(NULL), depth(0), error_message(NULL), registers(NULL),
+        angle_unit(ANGLE_DEGREES) {}
+
+    // Registers whose defined names text may use, and that compiled
+    // programs read; NULL for none
+    void set_registers(const Registers *r) { registers = r; }
+
+    // Unit for the trig functions of programs compiled from now on
+    void set_angle_unit(AngleUnit unit) { angle_unit = unit; }
+    AngleUnit angle() const { return angle_unit; }
+
+    // Split text into tokens; the result stays available through token()
+    bool tokenize(const char *text, size_t len);
+
+    // Tokenize and compile text into program, reusing its storage
+    bool compile(const char *text, size_t len, Program &program);
+
+    // Compile the tokens left by the last tokenize()
+    bool compile_tokens(Program &program);
+
+    // Compile a token sequence built elsewhere (the keypad engine keeps its
+    // expression as tokens and never goes through text)
+    bool compile_tokens(const Token *sequence, size_t count, Program &program);
+
+    size_t token_count() const { return tokens.size(); }
+    const Token &token(size_t index) const { return tokens[index]; }
+    const char *error() const { return error_message; }
+};
+
+// Apply a single unary opcode; shared by the VM and the keypad functions.
+// tan at a pole is invalid input.
+EvalStatus apply_unary(unsigned char op, double x, double *result, AngleUnit unit = ANGLE_DEGREES);
+
+// True for the names the tokenizer reserves: functions, constants and x
+bool is_builtin_name(const char *word, size_t len);
+
+// Display name of an opcode for error messages ("log", "√", ...)
+const char *opcode_name(unsigned char op);
+
+// Locale-independent decimal parser for "123", "0.5", "1.5e-7". Returns the
+// number of bytes consumed, or 0 if text does not start with a number.
+size_t parse_number(const char *text, size_t len, double *value);
+
+#endif // CALC_EXPR_H
@@ -0,0 +1,447 @@
+#include "calc_format.h"
+#include "calc_expr.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers") using 64-bit "do-it-yourself" floating point values.
+
+const uint64_t DP_SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+const uint64_t DP_EXPONENT_MASK = 0x7FF0000000000000ULL;
+const uint64_t DP_HIDDEN_BIT = 0x0010000000000000ULL;
+const int DP_SIGNIFICAND_SIZE = 52;
+const int DP_EXPONENT_BIAS = 0x3FF + DP_SIGNIFICAND_SIZE;
+const int DIY_SIGNIFICAND_SIZE = 64;
+
+const uint32_t POW10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+const uint64_t POW10_64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340
+const uint64_t CACHED_POWERS_F[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+const int16_t CACHED_POWERS_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+struct DiyFp {
+    uint64_t f;
+    int e;
+
+    DiyFp() : f(0), e(0) {}
+    DiyFp(uint64_t fp, int exp) : f(fp), e(exp) {}
+
+    explicit DiyFp(double d) {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        int biased_e = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+        uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+        if (biased_e != 0) {
+            f = significand + DP_HIDDEN_BIT;
+            e = biased_e - DP_EXPONENT_BIAS;
+        } else {
+            f = significand;
+            e = 1 - DP_EXPONENT_BIAS;
+        }
+    }
+
+    DiyFp operator-(const DiyFp &rhs) const {
+        return DiyFp(f - rhs.f, e);
+    }
+
+    // Product rounded to the upper 64 bits
+    DiyFp operator*(const DiyFp &rhs) const {
+        const uint64_t M32 = 0xFFFFFFFFULL;
+        uint64_t a = f >> 32, b = f & M32;
+        uint64_t c = rhs.f >> 32, d = rhs.f & M32;
+        uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+        tmp += 1ULL << 31;
+        return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+    }
+
+    DiyFp normalize() const {
+        DiyFp res = *this;
+        while (!(res.f & (1ULL << 63))) {
+            res.f <<= 1;
+            res.e--;
+        }
+        return res;
+    }
+
+    DiyFp normalize_boundary() const {
+        DiyFp res = *this;
+        while (!(res.f & (DP_HIDDEN_BIT << 1))) {
+            res.f <<= 1;
+            res.e--;
+        }
+        res.f <<= (DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2);
+        res.e -= (DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2);
+        return res;
+    }
+
+    // Boundaries m-, m+ of the rounding interval, sharing m+'s exponent
+    void normalized_boundaries(DiyFp *minus, DiyFp *plus) const {
+        DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalize_boundary();
+        DiyFp mi = (f == DP_HIDDEN_BIT) ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+        mi.f <<= mi.e - pl.e;
+        mi.e = pl.e;
+        *plus = pl;
+        *minus = mi;
+    }
+};
+
+DiyFp cached_power(int e, int *k) {
+    // dk = (-61 - e) * log10(2) + 347, rounded up
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ik++;
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    return DiyFp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+}
+
+void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+int count_decimal_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= POW10_32[digits]) digits++;
+    return digits;
+}
+
+// Generates the digits of mp and stops as soon as the rest fits in delta.
+// *near_boundary is set when the candidate one digit shorter missed the
+// (deliberately narrowed) interval by no more than the approximation
+// error, so it might still round-trip.
+void digit_gen(const DiyFp &w, const DiyFp &mp, uint64_t delta, char *buffer, int *len, int *k,
+               bool *near_boundary) {
+    const DiyFp one(1ULL << -mp.e, mp.e);
+    const DiyFp wp_w = mp - w;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_decimal_digits(p1);
+    *len = 0;
+    *near_boundary = false;
+
+    // Error of the 64-bit approximations in current units, and the
+    // shortfall of the previous (one digit shorter) candidate
+    uint64_t slack = 8;
+    bool have_previous = false;
+    uint64_t previous_low = 0;
+    uint64_t previous_high = 0;
+    uint64_t previous_slack = 0;
+
+    while (kappa > 0) {
+        uint32_t d = p1 / POW10_32[kappa - 1];
+        p1 %= POW10_32[kappa - 1];
+        if (d || *len) buffer[(*len)++] = (char)('0' + d);
+        kappa--;
+        uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+        uint64_t ten_kappa = (uint64_t)POW10_32[kappa] << -one.e;
+        if (tmp <= delta) {
+            *k += kappa;
+            *near_boundary = have_previous && (previous_low <= previous_slack || previous_high <= previous_slack);
+            grisu_round(buffer, *len, delta, tmp, ten_kappa, wp_w.f);
+            return;
+        }
+        if (*len > 0) {
+            have_previous = true;
+            previous_low = tmp - delta;
+            previous_high = ten_kappa - tmp;
+            previous_slack = slack;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        slack *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len) buffer[(*len)++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            *near_boundary = have_previous && (previous_low <= previous_slack || previous_high <= previous_slack);
+            int index = -kappa;
+            grisu_round(buffer, *len, delta, p2, one.f, wp_w.f * (index < 20 ? POW10_64[index] : 0));
+            return;
+        }
+        if (*len > 0) {
+            have_previous = true;
+            previous_low = p2 - delta;
+            previous_high = one.f - p2;
+            previous_slack = slack;
+        }
+    }
+}
+
+// Digits of a positive finite value: value = digits × 10^k
+void grisu2(double value, char *buffer, int *len, int *k, bool *near_boundary) {
+    const DiyFp v(value);
+    DiyFp w_m, w_p;
+    v.normalized_boundaries(&w_m, &w_p);
+
+    const DiyFp c_mk = cached_power(w_p.e, k);
+    const DiyFp w = v.normalize() * c_mk;
+    DiyFp wp = w_p * c_mk;
+    DiyFp wm = w_m * c_mk;
+    wm.f++;
+    wp.f--;
+    digit_gen(w, wp, wp.f - wm.f, buffer, len, k, near_boundary);
+}
+
+const double POW10_EXACT[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parse digits × 10^k back into a double. Exact mantissas with small
+// exponents take one correctly rounded multiply or divide; anything else
+// goes through the full parser.
+double digits_value(const char *digits, int len, int k) {
+    uint64_t mantissa = 0;
+    for (int i = 0; i < len; i++) {
+        mantissa = mantissa * 10 + (uint64_t)(digits[i] - '0');
+    }
+    if (mantissa < (1ULL << 53) && k >= -22 && k <= 22) {
+        double m = (double)mantissa;
+        return k < 0 ? m / POW10_EXACT[-k] : m * POW10_EXACT[k];
+    }
+
+    char text[40];
+    memcpy(text, digits, len);
+    int n = len;
+    text[n++] = 'e';
+    if (k < 0) {
+        text[n++] = '-';
+        k = -k;
+    }
+    char exp[8];
+    int e = 0;
+    do {
+        exp[e++] = (char)('0' + k % 10);
+        k /= 10;
+    } while (k > 0);
+    while (e > 0) text[n++] = exp[--e];
+    double result = 0;
+    parse_number(text, n, &result);
+    return result;
+}
+
+// Grisu2 can return one digit more than needed when the shortest
+// candidate sits in the safety margin of its interval. digit_gen flags
+// those rare cases; try the two neighbours one digit shorter and keep
+// whichever still parses back to value, nearest first.
+void shorten(double value, char *digits, int *len, int *k) {
+    while (*len > 1) {
+        int n = *len - 1;
+        char down[20];
+        char up[20];
+        memcpy(down, digits, n);
+        memcpy(up, digits, n);
+
+        // Round up the truncated digits; all nines carries into a new digit
+        int i = n - 1;
+        while (i >= 0 && up[i] == '9') up[i--] = '0';
+        int up_len = n;
+        int up_k = *k + 1;
+        if (i >= 0) {
+            up[i]++;
+        } else {
+            up[0] = '1';
+            up_len = 1;
+            up_k = *k + 1 + n;
+        }
+
+        bool prefer_up = digits[n] >= '5';
+        const char *first = prefer_up ? up : down;
+        const char *second = prefer_up ? down : up;
+        int first_len = prefer_up ? up_len : n, second_len = prefer_up ? n : up_len;
+        int first_k = prefer_up ? up_k : *k + 1, second_k = prefer_up ? *k + 1 : up_k;
+
+        if (digits_value(first, first_len, first_k) == value) {
+            memcpy(digits, first, first_len);
+            *len = first_len;
+            *k = first_k;
+        } else if (digits_value(second, second_len, second_k) == value) {
+            memcpy(digits, second, second_len);
+            *len = second_len;
+            *k = second_k;
+        } else {
+            return;
+        }
+    }
+}
+
+// Round digits to max_digits significant digits, half up
+void round_digits(char *digits, int *len, int *k, int max_digits) {
+    if (*len <= max_digits) return;
+    bool round_up = digits[max_digits] >= '5';
+    *k += *len - max_digits;
+    *len = max_digits;
+    if (round_up) {
+        int i = *len - 1;
+        while (i >= 0 && digits[i] == '9') {
+            digits[i--] = '0';
+        }
+        if (i >= 0) {
+            digits[i]++;
+        } else {
+            digits[0] = '1';
+            *k += *len;
+            *len = 1;
+        }
+    }
+    // Drop trailing zeros into the exponent
+    while (*len > 1 && digits[*len - 1] == '0') {
+        (*len)--;
+        (*k)++;
+    }
+}
+
+size_t write_exponent(char *p, int e) {
+    char *start = p;
+    *p++ = 'e';
+    if (e < 0) {
+        *p++ = '-';
+        e = -e;
+    } else {
+        *p++ = '+';
+    }
+    if (e >= 100) {
+        *p++ = (char)('0' + e / 100);
+        e %= 100;
+        *p++ = (char)('0' + e / 10);
+    } else if (e >= 10) {
+        *p++ = (char)('0' + e / 10);
+    }
+    *p++ = (char)('0' + e % 10);
+    return p - start;
+}
+
+} // namespace
+
+size_t format_number(double num, char *buf, int width, int max_digits) {
+    char *p = buf;
+    if (width > (int)FORMAT_BUFFER_SIZE - 1) width = (int)FORMAT_BUFFER_SIZE - 1;
+    if (num != num) {
+        memcpy(buf, "NaN", 4);
+        return 3;
+    }
+    if (num < 0 || (num == 0 && 1 / num < 0)) {
+        *p++ = '-';
+        num = -num;
+    }
+    if (num == 0) {
+        // Show plain 0 rather than -0
+        memcpy(buf, "0", 2);
+        return 1;
+    }
+    if (num > 1.7976931348623157e308) {
+        memcpy(p, "Infinity", 9);
+        return p - buf + 8;
+    }
+
+    char digits[20];
+    int len;
+    int k;
+    bool near_boundary;
+    grisu2(num, digits, &len, &k, &near_boundary);
+    if (near_boundary) shorten(num, digits, &len, &k);
+    if (max_digits < 17) round_digits(digits, &len, &k, max_digits);
+
+    // Position of the decimal point relative to the first digit
+    int point = len + k;
+    int sign = (int)(p - buf);
+    int fixed_len;
+    if (point <= 0) {
+        fixed_len = 2 - point + len;           // 0.000ddd
+    } else if (point >= len) {
+        fixed_len = point;                     // ddd000
+    } else {
+        fixed_len = len + 1;                   // dd.ddd
+    }
+
+    if (sign + fixed_len <= width) {
+        if (point <= 0) {
+            *p++ = '0';
+            *p++ = '.';
+            for (int i = 0; i < -point; i++) *p++ = '0';
+            memcpy(p, digits, len);
+            p += len;
+        } else if (point >= len) {
+            memcpy(p, digits, len);
+            p += len;
+            for (int i = len; i < point; i++) *p++ = '0';
+        } else {
+            memcpy(p, digits, point);
+            p += point;
+            *p++ = '.';
+            memcpy(p, digits + point, len - point);
+            p += len - point;
+        }
+    } else {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        p += write_exponent(p, point - 1);
+    }
+    *p = '\0';
+    return p - buf;
+}
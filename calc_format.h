@@ -0,0 +1,29 @@
+#ifndef CALC_FORMAT_H
+#define CALC_FORMAT_H
+
+#include <cstddef>
+
+// Number formatting for the display, history and batch output.
+//
+// format_number writes the shortest decimal string that parses back to
+// exactly the same double (Grisu2 digit generation with a shortness
+// check), using fixed notation when it fits in `width` characters and
+// scientific notation ("1.5e-12") otherwise. Output never depends on the
+// locale and never touches the heap.
+
+// Characters available in the main display
+const int DISPLAY_WIDTH = 20;
+
+// Significant digits shown in the display. Fewer than the 17 a double can
+// need, so binary noise such as 0.1+0.2 = 0.30000000000000004 reads 0.3.
+const int DISPLAY_DIGITS = 15;
+
+// Large enough for any output of format_number
+const size_t FORMAT_BUFFER_SIZE = 32;
+
+// Format num into buf (size >= FORMAT_BUFFER_SIZE) and return its length.
+// max_digits below 17 rounds the shortest digits to that many significant
+// digits; 17 or more gives the exact round-trip form.
+size_t format_number(double num, char *buf, int width = DISPLAY_WIDTH, int max_digits = 17);
+
+#endif // CALC_FORMAT_H
@@ -0,0 +1,370 @@
+#include "calc_history.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = {'C', 'A', 'L', 'C', 'L', 'O', 'G', '1'};
+const size_t MAGIC_SIZE = sizeof(MAGIC);
+const size_t HEADER_SIZE = 20; // checksum, length, split, time, value
+const size_t TRAILER_SIZE = 2;
+const size_t MAX_LINE = 0xFFFF;
+
+const size_t MIN_MAP = 1 << 20;
+const int BUCKET_BITS = 12;
+const uint32_t BUCKETS = 1 << BUCKET_BITS;
+const size_t SEGMENT_RECORDS = 1 << 15; // A few milliseconds to index
+const size_t BIGRAM_WORDS = (1 << 16) / 64;
+
+uint32_t fnv1a(const unsigned char *data, size_t n) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint16_t read_u16(const unsigned char *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t read_u32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t trigram_bucket(const unsigned char *p) {
+    uint32_t t = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (t * 2654435761u) >> (32 - BUCKET_BITS);
+}
+
+} // namespace
+
+HistoryLog::HistoryLog() :
+    fd(-1), writable(false), appended(false), map(NULL), map_capacity(0), scanned_end(MAGIC_SIZE),
+    indexed_count(0) {}
+
+HistoryLog::~HistoryLog() {
+    close();
+}
+
+bool HistoryLog::fail(const char *what) {
+    error_text = what;
+    if (errno) {
+        error_text += ": ";
+        error_text += strerror(errno);
+    }
+    return false;
+}
+
+// Size of the valid record at offset, or 0 if there is none before end.
+// The checksum is only worth its time when looking for a crash's damage.
+size_t HistoryLog::valid_record(const unsigned char *data, size_t offset, size_t end, bool verify) const {
+    if (end - offset < HEADER_SIZE + TRAILER_SIZE) return 0;
+    const unsigned char *p = data + offset;
+    size_t length = read_u16(p + 4), split = read_u16(p + 6);
+    size_t size = HEADER_SIZE + length + TRAILER_SIZE;
+    if (length == 0 || split > length || end - offset < size) return 0;
+    if (read_u16(p + HEADER_SIZE + length) != length) return 0;
+    if (verify && fnv1a(p + 4, HEADER_SIZE - 4 + length) != read_u32(p)) return 0;
+    return size;
+}
+
+#ifndef _WIN32
+
+bool HistoryLog::open(const char *path, bool read_only) {
+    close();
+    errno = 0;
+    writable = !read_only;
+    fd = ::open(path, (read_only ? O_RDONLY : O_RDWR | O_CREAT | O_APPEND) | O_CLOEXEC, 0644);
+    if (fd < 0) return fail(path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fail(path);
+        close();
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    char magic[MAGIC_SIZE];
+    if (size < MAGIC_SIZE && writable) {
+        // New, or cut short while being created
+        if (ftruncate(fd, 0) != 0 || write(fd, MAGIC, MAGIC_SIZE) != (ssize_t)MAGIC_SIZE) {
+            fail(path);
+            close();
+            return false;
+        }
+        size = MAGIC_SIZE;
+    } else if (size < MAGIC_SIZE || pread(fd, magic, MAGIC_SIZE, 0) != (ssize_t)MAGIC_SIZE ||
+               memcmp(magic, MAGIC, MAGIC_SIZE) != 0) {
+        errno = 0;
+        fail("not a calculator history log");
+        close();
+        return false;
+    }
+    if (!check_tail(size)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// The last record, found from its trailer, must be whole; otherwise the
+// file is walked and cut back after the last one that is
+bool HistoryLog::check_tail(size_t size) {
+    if (size == MAGIC_SIZE) return true;
+    unsigned char trailer[TRAILER_SIZE];
+    if (pread(fd, trailer, TRAILER_SIZE, size - TRAILER_SIZE) == (ssize_t)TRAILER_SIZE) {
+        size_t record = HEADER_SIZE + read_u16(trailer) + TRAILER_SIZE;
+        if (size - MAGIC_SIZE >= record) {
+            std::vector<unsigned char> last(record);
+            if (pread(fd, &last[0], record, size - record) == (ssize_t)record &&
+                valid_record(&last[0], 0, record, true) == record) {
+                return true;
+            }
+        }
+    }
+
+    if (!map_file(size)) return false;
+    size_t end = MAGIC_SIZE;
+    while (size_t record = valid_record(map, end, size, true)) end += record;
+    if (writable && ftruncate(fd, end) != 0) return fail("cannot cut back a damaged history log");
+    return true;
+}
+
+bool HistoryLog::map_file(size_t size) {
+    if (map) munmap(const_cast<unsigned char *>(map), map_capacity);
+    map = NULL;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t capacity = std::max(size * 2, MIN_MAP);
+    capacity = (capacity + page - 1) / page * page;
+    void *p = mmap(NULL, capacity, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        map_capacity = 0;
+        return fail("cannot map the history log");
+    }
+    map = static_cast<const unsigned char *>(p);
+    map_capacity = capacity;
+    return true;
+}
+
+void HistoryLog::close() {
+    if (fd < 0) return;
+    if (appended) fsync(fd);
+    if (map) munmap(const_cast<unsigned char *>(map), map_capacity);
+    ::close(fd);
+    fd = -1;
+    appended = false;
+    map = NULL;
+    map_capacity = 0;
+    scanned_end = MAGIC_SIZE;
+    offsets.clear();
+    indexed_count = 0;
+    segments.clear();
+}
+
+bool HistoryLog::append(const char *line, size_t split, double value, uint32_t time) {
+    errno = 0;
+    if (fd < 0 || !writable) return fail("history log is not open for writing");
+    size_t length = strlen(line);
+    if (length == 0 || length > MAX_LINE || split > length) return fail("history line is empty or too long");
+
+    unsigned char record[HEADER_SIZE + MAX_LINE + TRAILER_SIZE];
+    uint16_t length16 = (uint16_t)length, split16 = (uint16_t)split;
+    memcpy(record + 4, &length16, 2);
+    memcpy(record + 6, &split16, 2);
+    memcpy(record + 8, &time, 4);
+    memcpy(record + 12, &value, 8);
+    memcpy(record + HEADER_SIZE, line, length);
+    memcpy(record + HEADER_SIZE + length, &length16, 2);
+    uint32_t checksum = fnv1a(record + 4, HEADER_SIZE - 4 + length);
+    memcpy(record, &checksum, 4);
+
+    // One write() lands the record at the end even with other writers
+    size_t size = HEADER_SIZE + length + TRAILER_SIZE, done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, record + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return fail("cannot append to the history log");
+        done += n;
+    }
+    appended = true;
+    return true;
+}
+
+bool HistoryLog::refresh() {
+    if (fd < 0) return false;
+    struct stat st;
+    errno = 0;
+    if (fstat(fd, &st) != 0) return fail("cannot read the history log");
+    size_t size = (size_t)st.st_size;
+    if (size <= scanned_end) return true;
+    if (size > map_capacity && !map_file(size)) return false;
+
+    // Appends are whole when they land, and open() dealt with any damage,
+    // so the walk only follows lengths. A record still being written
+    // elsewhere is picked up next time.
+    while (size_t record = valid_record(map, scanned_end, size, false)) {
+        offsets.push_back(scanned_end);
+        scanned_end += record;
+    }
+    return true;
+}
+
+#else
+
+// No memory mapping here; history stays off
+bool HistoryLog::open(const char *path, bool read_only) {
+    (void)path;
+    (void)read_only;
+    errno = 0;
+    return fail("history is not supported on this platform");
+}
+bool HistoryLog::check_tail(size_t) { return false; }
+bool HistoryLog::map_file(size_t) { return false; }
+void HistoryLog::close() {}
+bool HistoryLog::append(const char *, size_t, double, uint32_t) { return false; }
+bool HistoryLog::refresh() { return false; }
+
+#endif
+
+HistoryEntry HistoryLog::entry(size_t record) const {
+    const unsigned char *p = map + offsets[record];
+    HistoryEntry e;
+    e.line = reinterpret_cast<const char *>(p + HEADER_SIZE);
+    e.length = read_u16(p + 4);
+    e.split = read_u16(p + 6);
+    e.time = read_u32(p + 8);
+    memcpy(&e.value, p + 12, 8);
+    return e;
+}
+
+// Indexes the next SEGMENT_RECORDS records: counts per bucket, then fills
+// them, so postings come out in record order. A record's repeated
+// trigrams are skipped by remembering the last record to add to a bucket.
+bool HistoryLog::index_more() {
+    if (!index_pending()) return false;
+    segments.push_back(Segment());
+    Segment &segment = segments.back();
+    const size_t *first = &offsets[indexed_count];
+    segment.starts.assign(BUCKETS + 1, 0);
+    segment.bigrams.assign(BIGRAM_WORDS, 0);
+    std::vector<uint32_t> last(BUCKETS, UINT32_MAX);
+    for (uint32_t r = 0; r < SEGMENT_RECORDS; r++) {
+        const unsigned char *line = map + first[r] + HEADER_SIZE;
+        size_t length = read_u16(map + first[r] + 4);
+        for (size_t i = 0; i < length; i++) {
+            // The last byte pairs with 0, so every byte starts a bigram
+            uint32_t bigram = (uint32_t)line[i] << 8 | (i + 1 < length ? line[i + 1] : 0);
+            segment.bigrams[bigram / 64] |= (uint64_t)1 << (bigram % 64);
+        }
+        for (size_t i = 0; i + 3 <= length; i++) {
+            uint32_t b = trigram_bucket(line + i);
+            if (last[b] == r) continue;
+            last[b] = r;
+            segment.starts[b + 1]++;
+        }
+    }
+    for (uint32_t b = 0; b < BUCKETS; b++) segment.starts[b + 1] += segment.starts[b];
+    segment.postings.resize(segment.starts[BUCKETS]);
+    std::vector<uint32_t> fill(segment.starts.begin(), segment.starts.end() - 1);
+    last.assign(BUCKETS, UINT32_MAX);
+    for (uint32_t r = 0; r < SEGMENT_RECORDS; r++) {
+        const unsigned char *line = map + first[r] + HEADER_SIZE;
+        size_t length = read_u16(map + first[r] + 4);
+        for (size_t i = 0; i + 3 <= length; i++) {
+            uint32_t b = trigram_bucket(line + i);
+            if (last[b] == r) continue;
+            last[b] = r;
+            segment.postings[fill[b]++] = (uint16_t)r;
+        }
+    }
+    indexed_count += SEGMENT_RECORDS;
+    return index_pending();
+}
+
+bool HistoryLog::index_pending() const {
+    return offsets.size() - indexed_count >= SEGMENT_RECORDS;
+}
+
+bool HistoryLog::matches(size_t record, const char *query, size_t length, bool prefix) const {
+    HistoryEntry e = entry(record);
+    if (length > e.length) return false;
+    if (prefix) return memcmp(e.line, query, length) == 0;
+    return memmem(e.line, e.length, query, length) != NULL;
+}
+
+void HistoryLog::scan(size_t from, size_t to, const char *query, size_t length, bool prefix, size_t limit,
+                      std::vector<size_t> &out) const {
+    for (size_t r = to; r > from && out.size() < limit; r--) {
+        if (matches(r - 1, query, length, prefix)) out.push_back(r - 1);
+    }
+}
+
+// Queries of three bytes or more: candidates hold every trigram of the
+// query, so walk the shortest list from the newest end, stepping the
+// others' cursors down alongside. Shorter ones scan the segment, unless
+// its bigrams show the query cannot be there; an empty one matches all.
+void HistoryLog::search_segment(size_t segment, const char *query, size_t length, bool prefix, size_t limit,
+                                std::vector<size_t> &out) const {
+    const Segment &s = segments[segment];
+    size_t base = segment * SEGMENT_RECORDS;
+    if (length == 0) {
+        scan(base, base + SEGMENT_RECORDS, query, length, prefix, limit, out);
+        return;
+    }
+    if (length < 3) {
+        const unsigned char *q = reinterpret_cast<const unsigned char *>(query);
+        const uint64_t *row = &s.bigrams[q[0] * 4]; // Bigrams starting with q[0]
+        bool present = length == 2 ? (row[q[1] / 64] >> (q[1] % 64) & 1) != 0 : (row[0] | row[1] | row[2] | row[3]) != 0;
+        if (present) scan(base, base + SEGMENT_RECORDS, query, length, prefix, limit, out);
+        return;
+    }
+    struct List {
+        const uint16_t *begin, *cursor;
+        bool operator<(const List &other) const { return cursor - begin < other.cursor - other.begin; }
+    };
+    List lists[16]; // A long query's first few trigrams narrow it enough
+    size_t count = 0;
+    uint32_t seen[16];
+    for (size_t i = 0; i + 3 <= length && count < 16; i++) {
+        uint32_t b = trigram_bucket(reinterpret_cast<const unsigned char *>(query) + i);
+        if (std::find(seen, seen + count, b) != seen + count) continue;
+        seen[count] = b;
+        lists[count].begin = s.postings.data() + s.starts[b];
+        lists[count].cursor = s.postings.data() + s.starts[b + 1];
+        count++;
+    }
+    std::sort(lists, lists + count);
+    List &shortest = lists[0];
+    while (shortest.cursor > shortest.begin && out.size() < limit) {
+        uint16_t r = *--shortest.cursor;
+        bool candidate = true;
+        for (size_t i = 1; i < count && candidate; i++) {
+            List &list = lists[i];
+            while (list.cursor > list.begin && list.cursor[-1] > r) list.cursor--;
+            candidate = list.cursor > list.begin && list.cursor[-1] == r;
+        }
+        if (candidate && matches(base + r, query, length, prefix)) out.push_back(base + r);
+    }
+}
+
+void HistoryLog::search(const char *query, bool prefix, size_t limit, std::vector<size_t> &out) {
+    out.clear();
+    refresh();
+    size_t length = strlen(query);
+    scan(indexed_count, offsets.size(), query, length, prefix, limit, out);
+    for (size_t segment = segments.size(); segment > 0 && out.size() < limit; segment--) {
+        search_segment(segment - 1, query, length, prefix, limit, out);
+    }
+}
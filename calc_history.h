@@ -0,0 +1,106 @@
+#ifndef CALC_HISTORY_H
+#define CALC_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every completed calculation, kept across sessions in an append-only
+// file and searched through a memory map of it.
+//
+// The file is an 8-byte magic followed by records, in native byte order:
+//
+//   u32 checksum   FNV-1a of everything after it up to the trailer
+//   u16 length     bytes of line
+//   u16 split      bytes of line before " = "
+//   u32 time       seconds since 1970
+//   f64 value      the result
+//   line           "expression = result" as the history line showed it
+//   u16 length     again, so the last record can be found from the end
+//
+// Each record goes out in one write() to the end of the file, so a crash
+// can only leave a partial record at the end. open() checks just the last
+// record; if that fails it walks the file and cuts it back after the last
+// good one. Nothing is read until the first search maps the file, and
+// the index is built a segment at a time by index_more(), for a caller to
+// spread over idle time; records not yet indexed are scanned.
+struct HistoryEntry {
+    const char *line; // Not terminated; points into the map
+    size_t length;
+    size_t split;
+    double value;
+    uint32_t time;
+};
+
+class HistoryLog {
+private:
+    int fd;
+    bool writable;
+    bool appended; // Synced on close
+
+    // Mapping; capacity runs past the end of the file so growth seldom
+    // needs a new one, and only bytes up to scanned_end are ever read
+    const unsigned char *map;
+    size_t map_capacity;
+    size_t scanned_end;
+    std::vector<size_t> offsets; // Record starts, oldest first
+
+    // Trigram index in segments of 32768 records; in each, bucket b lists
+    // the records holding a trigram that hashes to b, in order, and a bit
+    // is set for every byte pair that occurs. Records past the last
+    // segment are scanned.
+    struct Segment {
+        std::vector<uint32_t> starts;
+        std::vector<uint16_t> postings;
+        std::vector<uint64_t> bigrams;
+    };
+    std::vector<Segment> segments;
+    size_t indexed_count;
+
+    std::string error_text;
+
+    bool fail(const char *what);
+    bool check_tail(size_t size);
+    size_t valid_record(const unsigned char *data, size_t offset, size_t end, bool verify) const;
+    bool map_file(size_t size);
+    void search_segment(size_t segment, const char *query, size_t length, bool prefix, size_t limit,
+                        std::vector<size_t> &out) const;
+    bool matches(size_t record, const char *query, size_t length, bool prefix) const;
+    void scan(size_t from, size_t to, const char *query, size_t length, bool prefix, size_t limit,
+              std::vector<size_t> &out) const;
+
+public:
+    HistoryLog();
+    ~HistoryLog();
+
+    // Opens or creates the log. Cheap: reads only the last record.
+    // Read-only logs can be searched but not appended to.
+    bool open(const char *path, bool read_only = false);
+    void close();
+    bool is_open() const { return fd >= 0; }
+    const char *error() const { return error_text.c_str(); }
+
+    // Appends one calculation; line is "expression = result" with the
+    // expression split bytes long. Not synced until close().
+    bool append(const char *line, size_t split, double value, uint32_t time);
+
+    // Maps records written since the last call, by this process or any
+    // other. search() calls it.
+    bool refresh();
+
+    // Indexes one more segment of records; true while more are waiting
+    bool index_more();
+    bool index_pending() const;
+
+    size_t count() const { return offsets.size(); }
+    HistoryEntry entry(size_t record) const;
+
+    // Records whose line contains query (or starts with it), newest first,
+    // at most limit of them
+    void search(const char *query, bool prefix, size_t limit, std::vector<size_t> &out);
+
+    size_t indexed() const { return indexed_count; }
+};
+
+#endif // CALC_HISTORY_H
@@ -0,0 +1,115 @@
+#include "calc_historypanel.h"
+#include <string>
+
+namespace {
+
+const size_t MAX_ROWS = 200;
+const int DEFAULT_WIDTH = 300;
+
+} // namespace
+
+HistoryPanel::HistoryPanel(HistoryLog &history, RecallFunc on_recall, gpointer data) :
+    log(history),
+    recall(on_recall),
+    recall_data(data),
+    box(NULL),
+    entry(NULL),
+    prefix_check(NULL),
+    list(NULL),
+    status(NULL),
+    index_source(0),
+    search_count(0),
+    slowest_ms(0) {}
+
+HistoryPanel::~HistoryPanel() {
+    if (index_source) g_source_remove(index_source);
+}
+
+GtkWidget *HistoryPanel::create() {
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_size_request(box, DEFAULT_WIDTH, -1);
+
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Search history");
+    g_signal_connect(entry, "search-changed", G_CALLBACK(on_search_changed), this);
+    prefix_check = gtk_check_button_new_with_label("Starts with");
+    g_signal_connect(prefix_check, "toggled", G_CALLBACK(on_search_changed), this);
+    gtk_box_pack_start(GTK_BOX(row), entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(row), prefix_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), row, FALSE, FALSE, 0);
+
+    list = gtk_list_box_new();
+    gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(list), FALSE);
+    g_signal_connect(list, "row-activated", G_CALLBACK(on_row_activated), this);
+    GtkWidget *scroller = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scroller), list);
+    gtk_style_context_add_class(gtk_widget_get_style_context(list), "history-list");
+    gtk_box_pack_start(GTK_BOX(box), scroller, TRUE, TRUE, 0);
+
+    status = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(status), 0.0);
+    gtk_box_pack_start(GTK_BOX(box), status, FALSE, FALSE, 0);
+    return box;
+}
+
+void HistoryPanel::update() {
+    if (!list) return;
+    const char *query = gtk_entry_get_text(GTK_ENTRY(entry));
+    bool prefix = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(prefix_check));
+    gint64 start = g_get_monotonic_time();
+    log.search(query, prefix, MAX_ROWS, results);
+    double ms = (g_get_monotonic_time() - start) / 1000.0;
+    search_count++;
+    if (ms > slowest_ms) slowest_ms = ms;
+    if (log.index_pending() && !index_source) {
+        index_source = g_idle_add_full(G_PRIORITY_LOW, on_index_idle, this, NULL);
+    }
+
+    // Only the lines shown get widgets
+    GList *children = gtk_container_get_children(GTK_CONTAINER(list));
+    for (GList *child = children; child; child = child->next) gtk_widget_destroy(GTK_WIDGET(child->data));
+    g_list_free(children);
+    std::string text;
+    for (size_t i = 0; i < results.size(); i++) {
+        HistoryEntry e = log.entry(results[i]);
+        text.assign(e.line, e.length);
+        GtkWidget *label = gtk_label_new(text.c_str());
+        gtk_label_set_xalign(GTK_LABEL(label), 1.0);
+        gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_START);
+        gtk_container_add(GTK_CONTAINER(list), label);
+    }
+    gtk_widget_show_all(list);
+
+    char summary[96];
+    if (!log.is_open()) {
+        g_snprintf(summary, sizeof(summary), "History unavailable");
+    } else if (query[0]) {
+        g_snprintf(summary, sizeof(summary), "%s%zu matches of %zu", results.size() == MAX_ROWS ? "Newest " : "",
+                   results.size(), log.count());
+    } else {
+        g_snprintf(summary, sizeof(summary), "%zu calculations", log.count());
+    }
+    gtk_label_set_text(GTK_LABEL(status), summary);
+}
+
+gboolean HistoryPanel::on_index_idle(gpointer data) {
+    HistoryPanel *panel = static_cast<HistoryPanel*>(data);
+    if (panel->log.index_more()) return G_SOURCE_CONTINUE;
+    panel->index_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void HistoryPanel::on_search_changed(GtkWidget *widget, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    static_cast<HistoryPanel*>(data)->update();
+}
+
+void HistoryPanel::on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data) {
+    (void)list_box;  // Suppress unused parameter warning
+    HistoryPanel *panel = static_cast<HistoryPanel*>(data);
+    int index = gtk_list_box_row_get_index(row);
+    if (index < 0 || (size_t)index >= panel->results.size()) return;
+    panel->recall(panel->log.entry(panel->results[index]).value, panel->recall_data);
+}
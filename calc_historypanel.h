@@ -0,0 +1,52 @@
+#ifndef CALC_HISTORYPANEL_H
+#define CALC_HISTORYPANEL_H
+
+#include <gtk/gtk.h>
+#include <vector>
+#include "calc_history.h"
+
+// View → History: a search entry over the history log and the newest
+// matching lines under it. Activating a line enters its result as the
+// current operand. The log belongs to the caller, which keeps appending
+// to it while the panel is closed. The log is indexed in idle time after
+// the first search, a segment per callback.
+class HistoryPanel {
+public:
+    typedef void (*RecallFunc)(double value, gpointer data);
+
+private:
+    HistoryLog &log;
+    RecallFunc recall;
+    gpointer recall_data;
+
+    GtkWidget *box;
+    GtkWidget *entry;
+    GtkWidget *prefix_check;
+    GtkWidget *list;
+    GtkWidget *status;
+    std::vector<size_t> results;
+    guint index_source;
+
+    // For the g_debug summary
+    unsigned long search_count;
+    double slowest_ms;
+
+    static void on_search_changed(GtkWidget *widget, gpointer data);
+    static void on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data);
+    static gboolean on_index_idle(gpointer data);
+
+public:
+    HistoryPanel(HistoryLog &history, RecallFunc on_recall, gpointer data);
+    ~HistoryPanel();
+
+    // Builds the widgets; the returned box is for the caller to pack
+    GtkWidget *create();
+
+    // Runs the search again, after an append or when the panel is shown
+    void update();
+
+    unsigned long searches() const { return search_count; }
+    double slowest_search_ms() const { return slowest_ms; }
+};
+
+#endif // CALC_HISTORYPANEL_H
@@ -0,0 +1,277 @@
+#include "calc_keypad.h"
+#include "calc_theme.h"
+
+namespace {
+
+// Smallest key and the gap between keys; spare room is shared out evenly
+const int KEY_WIDTH = 70;
+const int KEY_HEIGHT = 60;
+const int KEY_SPACING = 8;
+
+// Start of cell `i` of `count` along `length`, gaps included
+int cell_start(int i, int count, int length) {
+    return i * (length + KEY_SPACING) / count;
+}
+
+} // namespace
+
+Keypad::Keypad(PressFunc on_press, gpointer data) :
+    press(on_press),
+    press_data(data),
+    area(NULL),
+    hovered(-1),
+    pressed(-1),
+    focused(0),
+    draw_count(0),
+    painted_keys(0),
+    painted_pixels(0) {
+    for (int s = 0; s < STYLE_COUNT; s++) styles[s] = NULL;
+    for (int row = 0; row < KEYPAD_ROWS; row++) {
+        for (int column = 0; column < KEYPAD_COLUMNS; column++) {
+            Key &key = keys[row * KEYPAD_COLUMNS + column];
+            key.command = KEYPAD_LAYOUT[row][column];
+            key.layout = NULL;
+            key.width = key.height = 0;
+        }
+    }
+    while (focused < KEYPAD_ROWS * KEYPAD_COLUMNS - 1 && keys[focused].command == CMD_NONE) focused++;
+}
+
+Keypad::~Keypad() {
+    clear_layouts();
+    for (int s = 0; s < STYLE_COUNT; s++) {
+        if (styles[s]) g_object_unref(styles[s]);
+    }
+}
+
+GtkWidget *Keypad::create() {
+    area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(area, KEYPAD_COLUMNS * (KEY_WIDTH + KEY_SPACING) - KEY_SPACING,
+                                KEYPAD_ROWS * (KEY_HEIGHT + KEY_SPACING) - KEY_SPACING);
+    gtk_widget_set_can_focus(area, TRUE);
+    gtk_style_context_add_class(gtk_widget_get_style_context(area), "keypad");
+    gtk_widget_add_events(area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK |
+                                GDK_LEAVE_NOTIFY_MASK | GDK_KEY_PRESS_MASK);
+    g_signal_connect(area, "draw", G_CALLBACK(on_draw), this);
+    g_signal_connect(area, "button-press-event", G_CALLBACK(on_button_press), this);
+    g_signal_connect(area, "button-release-event", G_CALLBACK(on_button_release), this);
+    g_signal_connect(area, "motion-notify-event", G_CALLBACK(on_motion), this);
+    g_signal_connect(area, "leave-notify-event", G_CALLBACK(on_leave), this);
+    g_signal_connect(area, "focus-in-event", G_CALLBACK(on_focus_changed), this);
+    g_signal_connect(area, "focus-out-event", G_CALLBACK(on_focus_changed), this);
+    g_signal_connect(area, "style-updated", G_CALLBACK(on_style_updated), this);
+
+    AtkObject *accessible = gtk_widget_get_accessible(area);
+    atk_object_set_role(accessible, ATK_ROLE_PUSH_BUTTON);
+    atk_object_set_name(accessible, command_info(keys[focused].command).label);
+    atk_object_set_description(accessible, "Keypad: arrow keys pick a key, Space presses it");
+    return area;
+}
+
+// A "button.<class>" style context under the area's for each ButtonStyle,
+// made on the first draw, once the area's path is complete
+void Keypad::create_styles() {
+    GtkStyleContext *parent = gtk_widget_get_style_context(area);
+    for (int s = 0; s < STYLE_COUNT; s++) {
+        GtkWidgetPath *path = gtk_widget_path_copy(gtk_style_context_get_path(parent));
+        gtk_widget_path_append_type(path, GTK_TYPE_BUTTON);
+        gtk_widget_path_iter_set_object_name(path, -1, "button");
+        gtk_widget_path_iter_add_class(path, -1, button_style_class(static_cast<ButtonStyle>(s)));
+        styles[s] = gtk_style_context_new();
+        gtk_style_context_set_path(styles[s], path);
+        gtk_style_context_set_parent(styles[s], parent);
+        gtk_widget_path_unref(path);
+    }
+}
+
+void Keypad::clear_layouts() {
+    for (int i = 0; i < KEYPAD_ROWS * KEYPAD_COLUMNS; i++) {
+        if (keys[i].layout) g_object_unref(keys[i].layout);
+        keys[i].layout = NULL;
+    }
+}
+
+GdkRectangle Keypad::key_rect(int index) const {
+    int width = gtk_widget_get_allocated_width(area), height = gtk_widget_get_allocated_height(area);
+    int row = index / KEYPAD_COLUMNS, column = index % KEYPAD_COLUMNS;
+    GdkRectangle rect;
+    rect.x = cell_start(column, KEYPAD_COLUMNS, width);
+    rect.y = cell_start(row, KEYPAD_ROWS, height);
+    rect.width = cell_start(column + 1, KEYPAD_COLUMNS, width) - KEY_SPACING - rect.x;
+    rect.height = cell_start(row + 1, KEYPAD_ROWS, height) - KEY_SPACING - rect.y;
+    return rect;
+}
+
+// Index of the key under (x, y); -1 between keys or outside
+int Keypad::key_at(double x, double y) const {
+    int width = gtk_widget_get_allocated_width(area), height = gtk_widget_get_allocated_height(area);
+    if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+    int column = (int)(x * KEYPAD_COLUMNS / (width + KEY_SPACING));
+    int row = (int)(y * KEYPAD_ROWS / (height + KEY_SPACING));
+    if (column >= KEYPAD_COLUMNS || row >= KEYPAD_ROWS) return -1;
+    int index = row * KEYPAD_COLUMNS + column;
+    GdkRectangle rect = key_rect(index);
+    if (x >= rect.x + rect.width || y >= rect.y + rect.height) return -1; // In the gap
+    return keys[index].command == CMD_NONE ? -1 : index;
+}
+
+void Keypad::redraw_key(int index) {
+    if (index < 0 || !area) return;
+    GdkRectangle rect = key_rect(index);
+    gtk_widget_queue_draw_area(area, rect.x, rect.y, rect.width, rect.height);
+}
+
+void Keypad::set_hovered(int index) {
+    if (index == hovered) return;
+    redraw_key(hovered);
+    hovered = index;
+    redraw_key(hovered);
+}
+
+void Keypad::focus_key(int index) {
+    if (index == focused) return;
+    redraw_key(focused);
+    focused = index;
+    redraw_key(focused);
+    atk_object_set_name(gtk_widget_get_accessible(area), command_info(keys[focused].command).label);
+}
+
+bool Keypad::key_press(const GdkEventKey *event) {
+    if (!area || !gtk_widget_has_focus(area)) return false;
+    int row_step = 0, column_step = 0;
+    switch (event->keyval) {
+        case GDK_KEY_Left: column_step = -1; break;
+        case GDK_KEY_Right: column_step = 1; break;
+        case GDK_KEY_Up: row_step = -1; break;
+        case GDK_KEY_Down: row_step = 1; break;
+        case GDK_KEY_space:
+        case GDK_KEY_KP_Space:
+            press(keys[focused].command, press_data);
+            return true;
+        default:
+            return false;
+    }
+    // Wrap at the edges, skipping empty cells
+    int row = focused / KEYPAD_COLUMNS, column = focused % KEYPAD_COLUMNS;
+    do {
+        row = (row + row_step + KEYPAD_ROWS) % KEYPAD_ROWS;
+        column = (column + column_step + KEYPAD_COLUMNS) % KEYPAD_COLUMNS;
+    } while (keys[row * KEYPAD_COLUMNS + column].command == CMD_NONE);
+    focus_key(row * KEYPAD_COLUMNS + column);
+    return true;
+}
+
+void Keypad::draw_key(cairo_t *cr, int index) {
+    Key &key = keys[index];
+    GtkStyleContext *context = styles[command_info(key.command).style];
+    if (!key.layout) {
+        gtk_style_context_set_state(context, GTK_STATE_FLAG_NORMAL);
+        PangoFontDescription *font = NULL;
+        gtk_style_context_get(context, GTK_STATE_FLAG_NORMAL, "font", &font, NULL);
+        key.layout = gtk_widget_create_pango_layout(area, command_info(key.command).label);
+        pango_layout_set_font_description(key.layout, font);
+        pango_font_description_free(font);
+        pango_layout_get_pixel_size(key.layout, &key.width, &key.height);
+    }
+
+    int state = GTK_STATE_FLAG_NORMAL;
+    if (index == hovered) state |= GTK_STATE_FLAG_PRELIGHT;
+    if (index == pressed && index == hovered) state |= GTK_STATE_FLAG_ACTIVE;
+    bool focus = index == focused && gtk_widget_has_visible_focus(area);
+    if (focus) state |= GTK_STATE_FLAG_FOCUSED;
+    gtk_style_context_set_state(context, static_cast<GtkStateFlags>(state));
+
+    // The stylesheet fades hovered and pressed keys with opacity, which
+    // GTK applies per widget; here it is applied per key
+    double opacity = 1;
+    gtk_style_context_get(context, static_cast<GtkStateFlags>(state), "opacity", &opacity, NULL);
+    if (opacity < 1) cairo_push_group(cr);
+
+    GdkRectangle rect = key_rect(index);
+    gtk_render_background(context, cr, rect.x, rect.y, rect.width, rect.height);
+    gtk_render_frame(context, cr, rect.x, rect.y, rect.width, rect.height);
+    GdkRGBA color;
+    gtk_style_context_get_color(context, static_cast<GtkStateFlags>(state), &color);
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_move_to(cr, rect.x + (rect.width - key.width) / 2, rect.y + (rect.height - key.height) / 2);
+    pango_cairo_show_layout(cr, key.layout);
+    if (focus) gtk_render_focus(context, cr, rect.x + 3, rect.y + 3, rect.width - 6, rect.height - 6);
+
+    if (opacity < 1) {
+        cairo_pop_group_to_source(cr);
+        cairo_paint_with_alpha(cr, opacity);
+    }
+    painted_keys++;
+}
+
+// Only keys inside the clip, which is the queued key rectangles after a
+// hover or press
+void Keypad::draw(cairo_t *cr) {
+    GdkRectangle clip;
+    if (!gdk_cairo_get_clip_rectangle(cr, &clip)) return;
+    if (!styles[0]) create_styles();
+    draw_count++;
+    painted_pixels += (double)clip.width * clip.height;
+    for (int i = 0; i < KEYPAD_ROWS * KEYPAD_COLUMNS; i++) {
+        if (keys[i].command == CMD_NONE) continue;
+        GdkRectangle rect = key_rect(i);
+        if (gdk_rectangle_intersect(&rect, &clip, NULL)) draw_key(cr, i);
+    }
+}
+
+gboolean Keypad::on_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    static_cast<Keypad*>(data)->draw(cr);
+    return FALSE;
+}
+
+// Like a GtkButton, a key fires on release over the key it was pressed on
+gboolean Keypad::on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    Keypad *keypad = static_cast<Keypad*>(data);
+    if (event->type != GDK_BUTTON_PRESS || event->button != 1) return FALSE;
+    gtk_widget_grab_focus(widget);
+    keypad->pressed = keypad->key_at(event->x, event->y);
+    keypad->set_hovered(keypad->pressed);
+    if (keypad->pressed >= 0) keypad->focus_key(keypad->pressed);
+    keypad->redraw_key(keypad->pressed);
+    return TRUE;
+}
+
+gboolean Keypad::on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    Keypad *keypad = static_cast<Keypad*>(data);
+    if (event->button != 1 || keypad->pressed < 0) return FALSE;
+    int index = keypad->pressed;
+    keypad->pressed = -1;
+    keypad->redraw_key(index);
+    if (keypad->key_at(event->x, event->y) == index) keypad->press(keypad->keys[index].command, keypad->press_data);
+    return TRUE;
+}
+
+gboolean Keypad::on_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    Keypad *keypad = static_cast<Keypad*>(data);
+    keypad->set_hovered(keypad->key_at(event->x, event->y));
+    return FALSE;
+}
+
+gboolean Keypad::on_leave(GtkWidget *widget, GdkEventCrossing *event, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    (void)event;   // Suppress unused parameter warning
+    static_cast<Keypad*>(data)->set_hovered(-1);
+    return FALSE;
+}
+
+gboolean Keypad::on_focus_changed(GtkWidget *widget, GdkEventFocus *event, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    (void)event;   // Suppress unused parameter warning
+    Keypad *keypad = static_cast<Keypad*>(data);
+    keypad->redraw_key(keypad->focused);
+    return FALSE;
+}
+
+// A theme switch can change fonts as well as colours: lay labels out again
+void Keypad::on_style_updated(GtkWidget *widget, gpointer data) {
+    static_cast<Keypad*>(data)->clear_layouts();
+    gtk_widget_queue_draw(widget);
+}
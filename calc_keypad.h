@@ -0,0 +1,78 @@
+#ifndef CALC_KEYPAD_H
+#define CALC_KEYPAD_H
+
+#include <gtk/gtk.h>
+#include "calc_commands.h"
+
+// The KEYPAD_LAYOUT grid as one GtkDrawingArea instead of a GtkButton per
+// key, which saves a widget, style context and label layout per key at
+// startup and in memory.
+//
+// Keys are drawn with Cairo through one style context per ButtonStyle,
+// each styled as a "button" node with the style's class, so the theme
+// stylesheets apply unchanged. Labels are laid out once and kept until
+// the style changes. Presses are hit-tested here; hovering or pressing a
+// key redraws only that key's rectangle. The area takes keyboard focus:
+// arrow keys move the focused key, Space presses it, and the accessible
+// object is named after the focused key so screen readers follow it.
+class Keypad {
+public:
+    typedef void (*PressFunc)(Command command, gpointer data);
+
+    Keypad(PressFunc on_press, gpointer data);
+    ~Keypad();
+
+    // Builds the widget; the returned area is for the caller to pack
+    GtkWidget *create();
+
+    // Arrow keys and Space while the keypad has focus; false for any other
+    // key, which the window handles as a shortcut or leaves to GTK
+    bool key_press(const GdkEventKey *event);
+
+    // Summary for the g_debug line at exit
+    unsigned long draws() const { return draw_count; }
+    unsigned long keys_painted() const { return painted_keys; }
+    double pixels_painted() const { return painted_pixels; }
+
+private:
+    static const int STYLE_COUNT = STYLE_EQUALS + 1;
+
+    struct Key {
+        Command command;
+        PangoLayout *layout; // NULL until drawn, and after a style change
+        int width, height;   // Of the layout, in pixels
+    };
+
+    PressFunc press;
+    gpointer press_data;
+    GtkWidget *area;
+    GtkStyleContext *styles[STYLE_COUNT];
+    Key keys[KEYPAD_ROWS * KEYPAD_COLUMNS];
+    int hovered; // Key indexes, -1 for none
+    int pressed;
+    int focused;
+
+    unsigned long draw_count;
+    unsigned long painted_keys;
+    double painted_pixels;
+
+    void create_styles();
+    void clear_layouts();
+    GdkRectangle key_rect(int index) const;
+    int key_at(double x, double y) const;
+    void redraw_key(int index);
+    void set_hovered(int index);
+    void focus_key(int index);
+    void draw_key(cairo_t *cr, int index);
+    void draw(cairo_t *cr);
+
+    static gboolean on_draw(GtkWidget *widget, cairo_t *cr, gpointer data);
+    static gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data);
+    static gboolean on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data);
+    static gboolean on_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data);
+    static gboolean on_leave(GtkWidget *widget, GdkEventCrossing *event, gpointer data);
+    static gboolean on_focus_changed(GtkWidget *widget, GdkEventFocus *event, gpointer data);
+    static void on_style_updated(GtkWidget *widget, gpointer data);
+};
+
+#endif // CALC_KEYPAD_H
@@ -0,0 +1,139 @@
+#include "calc_latency.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char *const STAGE_NAMES[LatencyTracker::STAGES] = {"commit", "paint", "present"};
+
+} // namespace
+
+void LatencyHistogram::reset() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    sum = 0;
+    smallest = UINT64_MAX;
+    largest = 0;
+}
+
+// Values below 2^(SUB_BITS+1) have a bucket each; above, the top
+// SUB_BITS+1 bits pick the bucket
+size_t LatencyHistogram::bucket(uint64_t value) {
+    const uint64_t limit = (1ULL << MAX_BITS) - 1;
+    if (value > limit) value = limit;
+    if (value < (2ULL << SUB_BITS)) return (size_t)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS;
+    return ((size_t)(shift + 1) << SUB_BITS) + (size_t)((value >> shift) - (1ULL << SUB_BITS));
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t index) {
+    if (index < (2u << SUB_BITS)) return index;
+    int shift = (int)(index >> SUB_BITS) - 1;
+    uint64_t sub = (index & ((1u << SUB_BITS) - 1)) + (1u << SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t microseconds) {
+    uint64_t value = microseconds > 0 ? (uint64_t)microseconds : 0;
+    counts[bucket(value)]++;
+    total++;
+    sum += value;
+    if (value < smallest) smallest = value;
+    if (value > largest) largest = value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; i++) counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    if (other.smallest < smallest) smallest = other.smallest;
+    if (other.largest > largest) largest = other.largest;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)ceil(p * (double)total);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) return bucket_high(i) < largest ? bucket_high(i) : largest;
+    }
+    return largest;
+}
+
+void LatencyTracker::remove(size_t index) {
+    memmove(pending + index, pending + index + 1, (pending_count - index - 1) * sizeof(Pending));
+    pending_count--;
+}
+
+void LatencyTracker::record_input(int64_t now) {
+    if (pending_count == MAX_PENDING) {
+        remove(0);
+        dropped++;
+    }
+    Pending &p = pending[pending_count++];
+    p.input = now;
+    p.frame = -1;
+    p.painted = false;
+}
+
+void LatencyTracker::record_commit(int64_t now, int64_t frame) {
+    for (size_t i = 0; i < pending_count; i++) {
+        if (pending[i].frame >= 0) continue;
+        pending[i].frame = frame;
+        stages[TO_COMMIT].record(now - pending[i].input);
+    }
+}
+
+void LatencyTracker::record_paint(int64_t now, int64_t frame) {
+    for (size_t i = 0; i < pending_count; i++) {
+        Pending &p = pending[i];
+        if (p.painted || p.frame < 0 || p.frame > frame) continue;
+        p.painted = true;
+        stages[TO_PAINT].record(now - p.input);
+    }
+}
+
+void LatencyTracker::record_presentation(int64_t frame, int64_t when) {
+    for (size_t i = pending_count; i-- > 0;) {
+        if (!pending[i].painted || pending[i].frame != frame) continue;
+        if (when > 0) {
+            stages[TO_PRESENT].record(when - pending[i].input);
+        } else {
+            unpresented++;
+        }
+        remove(i);
+    }
+}
+
+int64_t LatencyTracker::awaiting_presentation() const {
+    for (size_t i = 0; i < pending_count; i++) {
+        if (pending[i].painted) return pending[i].frame;
+    }
+    return -1;
+}
+
+void LatencyTracker::print(FILE *out) const {
+    fprintf(out, "Keypress latency in microseconds, from the input handler to:\n");
+    fprintf(out, "  %-8s %8s %8s %8s %8s %8s %8s %10s\n", "", "count", "p50", "p90", "p99", "p99.9", "max", "mean");
+    for (int s = 0; s < STAGES; s++) {
+        const LatencyHistogram &h = stages[s];
+        fprintf(out, "  %-8s %8llu %8llu %8llu %8llu %8llu %8llu %10.1f\n", STAGE_NAMES[s],
+                (unsigned long long)h.count(), (unsigned long long)h.percentile(0.5),
+                (unsigned long long)h.percentile(0.9), (unsigned long long)h.percentile(0.99),
+                (unsigned long long)h.percentile(0.999), (unsigned long long)h.max(), h.mean());
+    }
+    if (dropped || unpresented) {
+        fprintf(out, "  %lu inputs never shown, %lu shown without a presentation time\n", dropped, unpresented);
+    }
+}
+
+size_t LatencyTracker::summary(char *buf, size_t size) const {
+    const LatencyHistogram &paint = stages[TO_PAINT];
+    int n = snprintf(buf, size, "%llu keys  paint p50 %.1f ms  p99 %.1f ms  max %.1f ms",
+                     (unsigned long long)paint.count(), paint.percentile(0.5) / 1000.0,
+                     paint.percentile(0.99) / 1000.0, paint.max() / 1000.0);
+    return n < 0 ? 0 : (size_t)n;
+}
@@ -0,0 +1,118 @@
+#ifndef CALC_LATENCY_H
+#define CALC_LATENCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Keypress latency for --stats and the debug overlay. Times are monotonic
+// microseconds (g_get_monotonic_time(), which GDK frame timings also use).
+//
+// LatencyHistogram counts values in log-linear buckets, HDR-style: exact
+// below 64 µs, then 32 buckets per power of two, so any percentile read
+// back is within about 3% of the true value while recording is an index
+// computation and an increment.
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 5;                       // 32 buckets per doubling
+    static const int MAX_BITS = 36;                      // Values up to about 19 hours
+    static const size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t smallest;
+    uint64_t largest;
+
+    static size_t bucket(uint64_t value);
+    static uint64_t bucket_high(size_t index); // Largest value counted in a bucket
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset();
+    void record(int64_t microseconds);
+    // Adds another histogram's values, as if recorded here
+    void merge(const LatencyHistogram &other);
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? smallest : 0; }
+    uint64_t max() const { return largest; }
+    double mean() const { return total ? (double)sum / total : 0.0; }
+
+    // Value at or below which fraction p (0..1) of the values fall
+    uint64_t percentile(double p) const;
+};
+
+// Follows each input from the event handler to the display commit that
+// shows it, the paint of that frame, and the frame reaching the screen.
+// Keypresses that arrive between two frames share one commit. The calls
+// are inline and test `enabled` first, so while disabled each costs one
+// branch and call sites need no guard.
+class LatencyTracker {
+public:
+    static const size_t MAX_PENDING = 64; // Inputs in flight; older ones are dropped
+
+    enum Stage {
+        TO_COMMIT,  // Input → display text pushed to the widgets
+        TO_PAINT,   // Input → frame painted
+        TO_PRESENT, // Input → frame shown, when the compositor reports it
+        STAGES
+    };
+
+private:
+    struct Pending {
+        int64_t input;
+        int64_t frame; // Frame counter of the commit, or -1 before it
+        bool painted;
+    };
+
+    bool enabled;
+    Pending pending[MAX_PENDING];
+    size_t pending_count;
+    LatencyHistogram stages[STAGES];
+    unsigned long dropped;     // Inputs pushed out before they were shown
+    unsigned long unpresented; // Frames whose presentation time was unknown
+
+    void remove(size_t index);
+    void record_input(int64_t now);
+    void record_commit(int64_t now, int64_t frame);
+    void record_paint(int64_t now, int64_t frame);
+    void record_presentation(int64_t frame, int64_t when);
+
+public:
+    LatencyTracker() : enabled(false), pending_count(0), dropped(0), unpresented(0) {}
+
+    void enable() { enabled = true; }
+    bool is_enabled() const { return enabled; }
+
+    // An input event was handled at time now
+    void input(int64_t now) {
+        if (enabled) record_input(now);
+    }
+    // The display was committed during frame `frame`
+    void committed(int64_t now, int64_t frame) {
+        if (enabled) record_commit(now, frame);
+    }
+    // Frame `frame` finished painting
+    void painted(int64_t now, int64_t frame) {
+        if (enabled) record_paint(now, frame);
+    }
+    // Frame `frame` was presented at `when`; 0 if the compositor did not say
+    void presented(int64_t frame, int64_t when) {
+        if (enabled) record_presentation(frame, when);
+    }
+
+    // Oldest frame still waiting for its presentation time, or -1
+    int64_t awaiting_presentation() const;
+
+    const LatencyHistogram &stage(Stage s) const { return stages[s]; }
+
+    // One line per stage: count, p50, p90, p99, p99.9, max, mean
+    void print(FILE *out) const;
+    // Short summary for the overlay
+    size_t summary(char *buf, size_t size) const;
+};
+
+#endif // CALC_LATENCY_H
@@ -0,0 +1,673 @@
+#include "calc_matrix.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+#include "calc_vecmath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Multiply blocking, in doubles (see gemm in calc_matrix_impl.h). MC is a
+// multiple of every MR.
+const size_t GEMM_KC = 256;
+const size_t GEMM_MC = 96;
+const size_t GEMM_NC = 2048;
+
+// Columns factored at a time by LU before the trailing update
+const size_t LU_BLOCK = 64;
+
+// Rows of C handed to each thread are a multiple of this, so only the last
+// thread has a partial micro-kernel block
+const size_t ROW_GRAIN = 12;
+
+// Sweeps of implicit QL per eigenvalue before giving up
+const int QL_ITERATIONS = 60;
+
+double *aligned_alloc_doubles(size_t count) {
+    if (count == 0) return NULL;
+    void *p = NULL;
+#ifdef _WIN32
+    p = _aligned_malloc(count * sizeof(double), MATRIX_ROW_ALIGN * sizeof(double));
+#else
+    if (posix_memalign(&p, MATRIX_ROW_ALIGN * sizeof(double), count * sizeof(double)) != 0) p = NULL;
+#endif
+    if (!p) abort();
+    return (double *)p;
+}
+
+void aligned_free(double *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+class AlignedBuffer {
+private:
+    double *values;
+
+    AlignedBuffer(const AlignedBuffer &);
+    AlignedBuffer &operator=(const AlignedBuffer &);
+
+public:
+    explicit AlignedBuffer(size_t count) : values(aligned_alloc_doubles(count)) {}
+    ~AlignedBuffer() { aligned_free(values); }
+    double *data() { return values; }
+};
+
+struct MatrixKernels {
+    const char *name;
+    size_t mr;
+    void (*gemm)(size_t m, size_t n, size_t k, const double *a, size_t lda, const double *b, size_t ldb,
+                 double *c, size_t ldc, bool subtract);
+    void (*axpy)(size_t n, double s, const double *x, double *y);
+    double (*dot)(size_t n, const double *x, const double *y);
+};
+
+namespace vec128 {
+#define VEC_WIDTH 2
+#if defined(__x86_64__)
+#define VEC_NAME "sse2"
+#else
+#define VEC_NAME "vec128"
+#endif
+#define GEMM_MR 4
+#include "calc_matrix_impl.h"
+#undef VEC_WIDTH
+#undef VEC_NAME
+#undef GEMM_MR
+} // namespace vec128
+
+// Built and picked under the same conditions as the table kernels' AVX2 set
+#ifdef CALC_VECMATH_AVX2
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+#define VEC_WIDTH 4
+#define VEC_NAME "avx2"
+#define GEMM_MR 6
+#include "calc_matrix_impl.h"
+#undef VEC_WIDTH
+#undef VEC_NAME
+#undef GEMM_MR
+} // namespace avx2
+#pragma GCC pop_options
+#endif
+
+const MatrixKernels *best_kernels() {
+#ifdef CALC_VECMATH_AVX2
+    if (vecmath_has_avx2()) return &avx2::KERNELS;
+#endif
+    return &vec128::KERNELS;
+}
+
+const MatrixKernels *active_kernels = best_kernels();
+
+size_t padded_stride(size_t cols) {
+    return (cols + MATRIX_ROW_ALIGN - 1) / MATRIX_ROW_ALIGN * MATRIX_ROW_ALIGN;
+}
+
+// C ± A·B, the rows of C split between threads when there is enough work
+void parallel_gemm(size_t m, size_t n, size_t k, const double *a, size_t lda, const double *b, size_t ldb,
+                   double *c, size_t ldc, bool subtract, size_t threads) {
+    const MatrixKernels &kernels = *active_kernels;
+    if (m == 0 || n == 0 || k == 0) return;
+    if (threads == 0) {
+        threads = 2.0 * m * n * k < MATRIX_PARALLEL_FLOPS ? 1 : std::thread::hardware_concurrency();
+    }
+    size_t rows = (m + threads - 1) / threads;
+    rows = (rows + ROW_GRAIN - 1) / ROW_GRAIN * ROW_GRAIN;
+    if (threads <= 1 || rows >= m) {
+        kernels.gemm(m, n, k, a, lda, b, ldb, c, ldc, subtract);
+        return;
+    }
+    // The first rows are done on this thread
+    std::vector<std::thread> workers;
+    for (size_t r = rows; r < m; r += rows) {
+        size_t count = std::min(rows, m - r);
+        workers.push_back(std::thread([=, &kernels]() {
+            kernels.gemm(count, n, k, a + r * lda, lda, b, ldb, c + r * ldc, ldc, subtract);
+        }));
+    }
+    kernels.gemm(rows, n, k, a, lda, b, ldb, c, ldc, subtract);
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+double largest_magnitude(const Matrix &a) {
+    double largest = 0;
+    for (size_t r = 0; r < a.rows(); r++) {
+        for (size_t c = 0; c < a.cols(); c++) largest = std::max(largest, fabs(a(r, c)));
+    }
+    return largest;
+}
+
+} // namespace
+
+const char *matrix_status_message(MatrixStatus status) {
+    switch (status) {
+    case MATRIX_OK:
+        return "OK";
+    case MATRIX_SHAPE:
+        return "Matrix sizes don't match";
+    case MATRIX_SINGULAR:
+        return "Matrix is singular";
+    case MATRIX_NOT_SYMMETRIC:
+        return "Matrix is not symmetric";
+    case MATRIX_NO_CONVERGENCE:
+        return "Eigenvalues did not converge";
+    }
+    return "Matrix error";
+}
+
+Matrix::Matrix(size_t rows, size_t cols)
+    : row_count(rows), col_count(cols), stride(padded_stride(cols)), values(NULL) {
+    if (rows && cols) {
+        values = aligned_alloc_doubles(rows * stride);
+        memset(values, 0, rows * stride * sizeof(double));
+    }
+}
+
+Matrix::Matrix(const Matrix &other)
+    : row_count(other.row_count), col_count(other.col_count), stride(other.stride), values(NULL) {
+    if (other.values) {
+        values = aligned_alloc_doubles(row_count * stride);
+        memcpy(values, other.values, row_count * stride * sizeof(double));
+    }
+}
+
+Matrix::Matrix(Matrix &&other)
+    : row_count(other.row_count), col_count(other.col_count), stride(other.stride), values(other.values) {
+    other.row_count = other.col_count = other.stride = 0;
+    other.values = NULL;
+}
+
+Matrix &Matrix::operator=(const Matrix &other) {
+    if (this != &other) {
+        Matrix copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Matrix &Matrix::operator=(Matrix &&other) {
+    std::swap(row_count, other.row_count);
+    std::swap(col_count, other.col_count);
+    std::swap(stride, other.stride);
+    std::swap(values, other.values);
+    return *this;
+}
+
+Matrix::~Matrix() {
+    aligned_free(values);
+}
+
+Matrix Matrix::identity(size_t n) {
+    Matrix m(n, n);
+    for (size_t i = 0; i < n; i++) m(i, i) = 1;
+    return m;
+}
+
+MatrixStatus matrix_multiply(const Matrix &a, const Matrix &b, Matrix *c, size_t threads) {
+    if (a.cols() != b.rows() || a.empty() || b.empty()) return MATRIX_SHAPE;
+    Matrix product(a.rows(), b.cols());
+    parallel_gemm(a.rows(), b.cols(), a.cols(), a.row(0), a.row_stride(), b.row(0), b.row_stride(), product.row(0),
+                  product.row_stride(), false, threads);
+    *c = std::move(product);
+    return MATRIX_OK;
+}
+
+// In blocks of 8×8 so both sides are read a cache line at a time
+Matrix matrix_transpose(const Matrix &a) {
+    Matrix t(a.cols(), a.rows());
+    const size_t block = 8;
+    for (size_t r0 = 0; r0 < a.rows(); r0 += block) {
+        size_t r1 = std::min(r0 + block, a.rows());
+        for (size_t c0 = 0; c0 < a.cols(); c0 += block) {
+            size_t c1 = std::min(c0 + block, a.cols());
+            for (size_t r = r0; r < r1; r++) {
+                for (size_t c = c0; c < c1; c++) t(c, r) = a(r, c);
+            }
+        }
+    }
+    return t;
+}
+
+// Right-looking blocked LU. Each LU_BLOCK-wide panel is factored a column
+// at a time, swapping whole rows; then its rows of U to the right are
+// solved for and the rest of the matrix updated with one multiply.
+MatrixStatus LuDecomposition::factor(const Matrix &a, size_t threads) {
+    if (!a.is_square() || a.empty()) return MATRIX_SHAPE;
+    const MatrixKernels &kernels = *active_kernels;
+    size_t n = a.rows();
+    lu = a;
+    pivots.assign(n, 0);
+    sign = 1;
+    singular = false;
+
+    // A pivot this small next to its column of A is zero but for rounding
+    std::vector<double> tolerance(n, 0.0);
+    for (size_t r = 0; r < n; r++) {
+        for (size_t c = 0; c < n; c++) tolerance[c] = std::max(tolerance[c], fabs(a(r, c)));
+    }
+    for (size_t c = 0; c < n; c++) tolerance[c] *= n * DBL_EPSILON;
+
+    size_t ld = lu.row_stride();
+    for (size_t k0 = 0; k0 < n; k0 += LU_BLOCK) {
+        size_t k1 = std::min(k0 + LU_BLOCK, n);
+        for (size_t j = k0; j < k1; j++) {
+            size_t p = j;
+            double best = fabs(lu(j, j));
+            for (size_t i = j + 1; i < n; i++) {
+                if (fabs(lu(i, j)) > best) {
+                    best = fabs(lu(i, j));
+                    p = i;
+                }
+            }
+            pivots[j] = p;
+            if (p != j) {
+                std::swap_ranges(lu.row(j), lu.row(j) + n, lu.row(p));
+                sign = -sign;
+            }
+            if (best <= tolerance[j]) singular = true;
+            if (best == 0) continue;
+            double pivot = lu(j, j);
+            for (size_t i = j + 1; i < n; i++) {
+                double l = lu(i, j) / pivot;
+                lu(i, j) = l;
+                if (l != 0) kernels.axpy(k1 - j - 1, -l, lu.row(j) + j + 1, lu.row(i) + j + 1);
+            }
+        }
+        if (k1 == n) break;
+        for (size_t j = k0; j < k1; j++) {
+            for (size_t i = j + 1; i < k1; i++) {
+                if (lu(i, j) != 0) kernels.axpy(n - k1, -lu(i, j), lu.row(j) + k1, lu.row(i) + k1);
+            }
+        }
+        parallel_gemm(n - k1, n - k1, k1 - k0, lu.row(k1) + k0, ld, lu.row(k0) + k1, ld, lu.row(k1) + k1, ld, true,
+                      threads);
+    }
+    return MATRIX_OK;
+}
+
+double LuDecomposition::determinant() const {
+    if (singular) return 0;
+    double det = sign;
+    for (size_t i = 0; i < lu.rows(); i++) det *= lu(i, i);
+    return det;
+}
+
+// Forward then back substitution a row of X at a time, so every step is
+// a multiple of one row added to another
+MatrixStatus LuDecomposition::solve(const Matrix &b, Matrix *x) const {
+    size_t n = lu.rows();
+    if (b.rows() != n || b.empty() || lu.empty()) return MATRIX_SHAPE;
+    if (singular) return MATRIX_SINGULAR;
+    const MatrixKernels &kernels = *active_kernels;
+    Matrix y(b);
+    size_t m = y.cols();
+    for (size_t i = 0; i < n; i++) {
+        if (pivots[i] != i) std::swap_ranges(y.row(i), y.row(i) + m, y.row(pivots[i]));
+    }
+    for (size_t i = 1; i < n; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (lu(i, j) != 0) kernels.axpy(m, -lu(i, j), y.row(j), y.row(i));
+        }
+    }
+    for (size_t i = n; i-- > 0;) {
+        for (size_t j = i + 1; j < n; j++) {
+            if (lu(i, j) != 0) kernels.axpy(m, -lu(i, j), y.row(j), y.row(i));
+        }
+        double *row = y.row(i);
+        double pivot = lu(i, i);
+        for (size_t c = 0; c < m; c++) row[c] /= pivot;
+    }
+    *x = std::move(y);
+    return MATRIX_OK;
+}
+
+MatrixStatus LuDecomposition::inverse(Matrix *x) const {
+    return solve(Matrix::identity(lu.rows()), x);
+}
+
+MatrixStatus matrix_determinant(const Matrix &a, double *result) {
+    LuDecomposition lu;
+    MatrixStatus status = lu.factor(a);
+    if (status == MATRIX_OK) *result = lu.determinant();
+    return status;
+}
+
+MatrixStatus matrix_inverse(const Matrix &a, Matrix *result) {
+    LuDecomposition lu;
+    MatrixStatus status = lu.factor(a);
+    if (status != MATRIX_OK) return status;
+    return lu.inverse(result);
+}
+
+MatrixStatus matrix_solve(const Matrix &a, const Matrix &b, Matrix *x) {
+    if (!a.is_square()) return matrix_least_squares(a, b, x);
+    LuDecomposition lu;
+    MatrixStatus status = lu.factor(a);
+    if (status != MATRIX_OK) return status;
+    return lu.solve(b, x);
+}
+
+// Householder QR applied to A and B together, then back substitution
+// with R. Reflections are applied a row at a time: w = vᵀ·(rows below),
+// then each row less its multiple of w.
+MatrixStatus matrix_least_squares(const Matrix &a, const Matrix &b, Matrix *x) {
+    size_t m = a.rows(), n = a.cols(), p = b.cols();
+    if (a.empty() || b.empty() || b.rows() != m || m < n) return MATRIX_SHAPE;
+    const MatrixKernels &kernels = *active_kernels;
+    Matrix r(a), y(b);
+    std::vector<double> w(std::max(n, p));
+
+    for (size_t j = 0; j < n; j++) {
+        double scale = 0, original = 0;
+        for (size_t i = 0; i < m; i++) original = std::max(original, fabs(a(i, j)));
+        for (size_t i = j; i < m; i++) scale = std::max(scale, fabs(r(i, j)));
+        if (scale <= m * DBL_EPSILON * original || scale == 0) return MATRIX_SINGULAR;
+        double squares = 0;
+        for (size_t i = j; i < m; i++) squares += (r(i, j) / scale) * (r(i, j) / scale);
+        double norm = scale * sqrt(squares);
+        double alpha = r(j, j) > 0 ? -norm : norm;
+        // v = x - alpha·e1 overwrites column j; H = I - tau·v·vᵀ
+        r(j, j) -= alpha;
+        double tau = -1 / (alpha * r(j, j));
+
+        Matrix *targets[2] = {&r, &y};
+        size_t first[2] = {j + 1, 0};
+        size_t last[2] = {n, p};
+        for (int t = 0; t < 2; t++) {
+            Matrix &target = *targets[t];
+            size_t count = last[t] - first[t];
+            if (count == 0) continue;
+            std::fill(w.begin(), w.begin() + count, 0.0);
+            for (size_t i = j; i < m; i++) kernels.axpy(count, r(i, j), target.row(i) + first[t], w.data());
+            for (size_t i = j; i < m; i++) kernels.axpy(count, -tau * r(i, j), w.data(), target.row(i) + first[t]);
+        }
+        r(j, j) = alpha;
+    }
+
+    Matrix result(n, p);
+    for (size_t i = n; i-- > 0;) {
+        double *row = result.row(i);
+        memcpy(row, y.row(i), p * sizeof(double));
+        for (size_t c = i + 1; c < n; c++) kernels.axpy(p, -r(i, c), result.row(c), row);
+        for (size_t c = 0; c < p; c++) row[c] /= r(i, i);
+    }
+    *x = std::move(result);
+    return MATRIX_OK;
+}
+
+// Householder reduction to tridiagonal form (values only), then implicit
+// QL with Wilkinson shifts on the diagonal d and subdiagonal e
+MatrixStatus matrix_symmetric_eigenvalues(const Matrix &a, std::vector<double> *values) {
+    if (!a.is_square() || a.empty()) return MATRIX_SHAPE;
+    size_t n = a.rows();
+    double tolerance = 1e-10 * largest_magnitude(a);
+    Matrix s(a);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (fabs(a(i, j) - a(j, i)) > tolerance) return MATRIX_NOT_SYMMETRIC;
+            s(i, j) = s(j, i) = (a(i, j) + a(j, i)) / 2;
+        }
+    }
+
+    const MatrixKernels &kernels = *active_kernels;
+    std::vector<double> d(n), e(n, 0.0), v(n), q(n);
+    for (size_t k = 0; k + 2 < n; k++) {
+        // Reflect x = s[k+1.., k] onto alpha·e1 and apply on both sides of
+        // the trailing block: S -= v·wᵀ + w·vᵀ
+        size_t m = n - k - 1;
+        double *x = v.data();
+        for (size_t i = 0; i < m; i++) x[i] = s(k + 1 + i, k);
+        double scale = 0;
+        for (size_t i = 0; i < m; i++) scale = std::max(scale, fabs(x[i]));
+        d[k] = s(k, k);
+        if (scale == 0) {
+            e[k] = 0;
+            continue;
+        }
+        double squares = 0;
+        for (size_t i = 0; i < m; i++) squares += (x[i] / scale) * (x[i] / scale);
+        double norm = scale * sqrt(squares);
+        double alpha = x[0] > 0 ? -norm : norm;
+        e[k] = alpha;
+        x[0] -= alpha;
+        double tau = -1 / (alpha * x[0]);
+        for (size_t i = 0; i < m; i++) q[i] = tau * kernels.dot(m, s.row(k + 1 + i) + k + 1, x);
+        double half = tau / 2 * kernels.dot(m, x, q.data());
+        kernels.axpy(m, -half, x, q.data());
+        for (size_t i = 0; i < m; i++) {
+            double *row = s.row(k + 1 + i) + k + 1;
+            kernels.axpy(m, -x[i], q.data(), row);
+            kernels.axpy(m, -q[i], x, row);
+        }
+    }
+    if (n >= 2) {
+        d[n - 2] = s(n - 2, n - 2);
+        e[n - 2] = s(n - 1, n - 2);
+    }
+    d[n - 1] = s(n - 1, n - 1);
+
+    for (size_t l = 0; l < n; l++) {
+        int iterations = 0;
+        size_t m;
+        do {
+            for (m = l; m + 1 < n; m++) {
+                double dd = fabs(d[m]) + fabs(d[m + 1]);
+                if (fabs(e[m]) <= DBL_EPSILON * dd) break;
+            }
+            if (m == l) break;
+            if (iterations++ == QL_ITERATIONS) return MATRIX_NO_CONVERGENCE;
+            double g = (d[l + 1] - d[l]) / (2 * e[l]);
+            double r = hypot(g, 1.0);
+            g = d[m] - d[l] + e[l] / (g + copysign(r, g));
+            double sn = 1, cs = 1, p = 0;
+            bool underflow = false;
+            for (size_t i = m; i-- > l;) {
+                double f = sn * e[i], b = cs * e[i];
+                r = hypot(f, g);
+                e[i + 1] = r;
+                if (r == 0) {
+                    d[i + 1] -= p;
+                    e[m] = 0;
+                    underflow = true;
+                    break;
+                }
+                sn = f / r;
+                cs = g / r;
+                g = d[i + 1] - p;
+                r = (d[i] - g) * sn + 2 * cs * b;
+                p = sn * r;
+                d[i + 1] = g + p;
+                g = cs * r - b;
+            }
+            if (underflow) continue;
+            d[l] -= p;
+            e[l] = g;
+            e[m] = 0;
+        } while (true);
+    }
+    std::sort(d.begin(), d.end());
+    *values = d;
+    return MATRIX_OK;
+}
+
+// Numbers are separated by spaces, tabs or commas; rows by newlines or
+// semicolons
+bool matrix_parse(const char *text, size_t len, Matrix *m, std::string *error) {
+    std::vector<double> values;
+    size_t rows = 0, cols = 0, in_row = 0;
+    const char *p = text, *end = text + len;
+    while (true) {
+        if (p == end || *p == '\n' || *p == ';') {
+            if (in_row) {
+                if (rows && in_row != cols) {
+                    *error = "Row " + std::to_string(rows + 1) + " has " + std::to_string(in_row) +
+                             " numbers, not " + std::to_string(cols);
+                    return false;
+                }
+                cols = in_row;
+                rows++;
+                in_row = 0;
+                if (rows > MATRIX_MAX_TEXT_SIZE) {
+                    *error = "More than " + std::to_string(MATRIX_MAX_TEXT_SIZE) + " rows";
+                    return false;
+                }
+            }
+            if (p == end) break;
+            p++;
+            continue;
+        }
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',') {
+            p++;
+            continue;
+        }
+        const char *start = p;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+') p++;
+        double value;
+        size_t n = parse_number(p, end - p, &value);
+        p += n;
+        if (n == 0 || (p < end && !strchr(" \t\r,;\n", *p))) {
+            const char *stop = start;
+            while (stop < end && !strchr(" \t\r,;\n", *stop)) stop++;
+            *error = "Not a number: " + std::string(start, stop);
+            return false;
+        }
+        values.push_back(negative ? -value : value);
+        if (++in_row > MATRIX_MAX_TEXT_SIZE) {
+            *error = "More than " + std::to_string(MATRIX_MAX_TEXT_SIZE) + " columns";
+            return false;
+        }
+    }
+    if (rows == 0) {
+        *error = "No numbers";
+        return false;
+    }
+    Matrix result(rows, cols);
+    for (size_t r = 0; r < rows; r++) memcpy(result.row(r), &values[r * cols], cols * sizeof(double));
+    *m = std::move(result);
+    return true;
+}
+
+std::string matrix_format(const Matrix &m) {
+    std::string text;
+    char number[FORMAT_BUFFER_SIZE];
+    for (size_t r = 0; r < m.rows(); r++) {
+        for (size_t c = 0; c < m.cols(); c++) {
+            if (c) text += ' ';
+            text.append(number, format_number(m(r, c), number, FORMAT_BUFFER_SIZE - 1));
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+const char *matrix_kernels() {
+    return active_kernels->name;
+}
+
+bool matrix_use_kernels(const char *name) {
+    if (strcmp(name, vec128::KERNELS.name) == 0) {
+        active_kernels = &vec128::KERNELS;
+        return true;
+    }
+#ifdef CALC_VECMATH_AVX2
+    if (strcmp(name, avx2::KERNELS.name) == 0 && vecmath_has_avx2()) {
+        active_kernels = &avx2::KERNELS;
+        return true;
+    }
+#endif
+    return false;
+}
+
+namespace {
+
+bool read_matrix(const char *path, Matrix *m) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    std::string text;
+    char block[65536];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), in)) > 0) text.append(block, n);
+    bool failed = ferror(in) != 0;
+    if (in != stdin) fclose(in);
+    if (failed) {
+        fprintf(stderr, "%s: read error\n", path);
+        return false;
+    }
+    std::string error;
+    if (!matrix_parse(text.data(), text.size(), m, &error)) {
+        fprintf(stderr, "%s: %s\n", path, error.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int run_matrix(const char *op, const char *a_path, const char *b_path, FILE *out) {
+    static const char *const BINARY[] = {"multiply", "solve", "lstsq"};
+    static const char *const UNARY[] = {"transpose", "det", "inverse", "eig"};
+    bool binary = false, known = false;
+    for (size_t i = 0; i < sizeof(BINARY) / sizeof(BINARY[0]); i++) {
+        if (strcmp(op, BINARY[i]) == 0) binary = known = true;
+    }
+    for (size_t i = 0; i < sizeof(UNARY) / sizeof(UNARY[0]); i++) {
+        if (strcmp(op, UNARY[i]) == 0) known = true;
+    }
+    if (!known) {
+        fprintf(stderr, "Unknown matrix operation %s\n", op);
+        return 1;
+    }
+    if (binary && !b_path) {
+        fprintf(stderr, "%s needs a second matrix\n", op);
+        return 1;
+    }
+
+    Matrix a, b, result;
+    if (!read_matrix(a_path, &a) || (binary && !read_matrix(b_path, &b))) return 1;
+    MatrixStatus status = MATRIX_OK;
+    if (strcmp(op, "multiply") == 0) {
+        status = matrix_multiply(a, b, &result);
+    } else if (strcmp(op, "solve") == 0) {
+        status = matrix_solve(a, b, &result);
+    } else if (strcmp(op, "lstsq") == 0) {
+        status = matrix_least_squares(a, b, &result);
+    } else if (strcmp(op, "transpose") == 0) {
+        result = matrix_transpose(a);
+    } else if (strcmp(op, "inverse") == 0) {
+        status = matrix_inverse(a, &result);
+    } else if (strcmp(op, "det") == 0) {
+        double det = 0;
+        status = matrix_determinant(a, &det);
+        result = Matrix(1, 1);
+        result(0, 0) = det;
+    } else {
+        std::vector<double> values;
+        status = matrix_symmetric_eigenvalues(a, &values);
+        result = Matrix(values.size(), 1);
+        for (size_t i = 0; i < values.size(); i++) result(i, 0) = values[i];
+    }
+    if (status != MATRIX_OK) {
+        fprintf(stderr, "%s\n", matrix_status_message(status));
+        return 1;
+    }
+    fputs(matrix_format(result).c_str(), out);
+    return 0;
+}
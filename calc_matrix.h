@@ -0,0 +1,125 @@
+#ifndef CALC_MATRIX_H
+#define CALC_MATRIX_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Dense matrices of doubles for View → Matrices and calculator --matrix.
+//
+// A Matrix is row-major in one 64-byte aligned buffer, each row padded to
+// a multiple of MATRIX_ROW_ALIGN doubles so every row starts aligned.
+//
+// Multiply is blocked for the caches the way BLIS does it: KC×NR panels
+// of B and MC×KC blocks of A are packed into contiguous buffers and an
+// MR×NR micro-kernel keeps its block of C in registers. The kernels are
+// written once with GCC vector types in calc_matrix_impl.h and built for
+// SSE2 and AVX2 with FMA; the widest the CPU supports is used. LU is
+// right-looking and blocked, so nearly all of its work is the trailing
+// update done by the same multiply kernel. Products and updates of more
+// than MATRIX_PARALLEL_FLOPS split the rows of C between threads, one
+// per core.
+//
+// QR (Householder) solves least squares, and symmetric eigenvalues come
+// from Householder tridiagonalisation and implicit QL; both update whole
+// rows at a time, which vectorises, but are not blocked.
+
+const size_t MATRIX_ROW_ALIGN = 8;          // Doubles; 64 bytes
+const double MATRIX_PARALLEL_FLOPS = 2e7;   // Smaller products run on one thread
+const size_t MATRIX_MAX_TEXT_SIZE = 1000;   // Rows or columns matrix_parse accepts
+
+enum MatrixStatus {
+    MATRIX_OK,
+    MATRIX_SHAPE,         // Sizes don't fit the operation
+    MATRIX_SINGULAR,
+    MATRIX_NOT_SYMMETRIC,
+    MATRIX_NO_CONVERGENCE
+};
+
+const char *matrix_status_message(MatrixStatus status);
+
+class Matrix {
+private:
+    size_t row_count;
+    size_t col_count;
+    size_t stride; // Doubles from one row to the next
+    double *values;
+
+public:
+    Matrix() : row_count(0), col_count(0), stride(0), values(NULL) {}
+    Matrix(size_t rows, size_t cols); // Zeros
+    Matrix(const Matrix &other);
+    Matrix(Matrix &&other);
+    Matrix &operator=(const Matrix &other);
+    Matrix &operator=(Matrix &&other);
+    ~Matrix();
+
+    static Matrix identity(size_t n);
+
+    size_t rows() const { return row_count; }
+    size_t cols() const { return col_count; }
+    size_t row_stride() const { return stride; }
+    bool empty() const { return row_count == 0 || col_count == 0; }
+    bool is_square() const { return row_count == col_count; }
+
+    double *row(size_t r) { return values + r * stride; }
+    const double *row(size_t r) const { return values + r * stride; }
+    double &operator()(size_t r, size_t c) { return values[r * stride + c]; }
+    double operator()(size_t r, size_t c) const { return values[r * stride + c]; }
+};
+
+// C = A × B. threads 0 means one per core once the product is large
+// enough to be worth it.
+MatrixStatus matrix_multiply(const Matrix &a, const Matrix &b, Matrix *c, size_t threads = 0);
+Matrix matrix_transpose(const Matrix &a);
+
+// A = P·L·U with partial pivoting, L unit lower and U upper packed in one
+// matrix. A pivot that is zero, or zero but for rounding next to the
+// largest entry of its column, makes it singular: the determinant is 0
+// and there is no solve or inverse.
+class LuDecomposition {
+private:
+    Matrix lu;
+    std::vector<size_t> pivots; // Row swapped with row i at step i
+    int sign;
+    bool singular;
+
+public:
+    LuDecomposition() : sign(1), singular(false) {}
+
+    MatrixStatus factor(const Matrix &a, size_t threads = 0);
+    bool is_singular() const { return singular; }
+    double determinant() const;
+    // X with A·X = B, for any number of columns of B
+    MatrixStatus solve(const Matrix &b, Matrix *x) const;
+    MatrixStatus inverse(Matrix *x) const;
+};
+
+MatrixStatus matrix_determinant(const Matrix &a, double *result);
+MatrixStatus matrix_inverse(const Matrix &a, Matrix *result);
+// Square A: LU. More rows than columns: least squares through QR.
+MatrixStatus matrix_solve(const Matrix &a, const Matrix &b, Matrix *x);
+MatrixStatus matrix_least_squares(const Matrix &a, const Matrix &b, Matrix *x);
+// Ascending; A must be symmetric to within rounding
+MatrixStatus matrix_symmetric_eigenvalues(const Matrix &a, std::vector<double> *values);
+
+// Rows separated by newlines or semicolons, numbers by spaces, tabs or
+// commas, so "1 2; 3 4" is a 2×2 matrix; blank lines are ignored.
+// False with a message if rows differ in length or something is not a
+// number.
+bool matrix_parse(const char *text, size_t len, Matrix *m, std::string *error);
+// One row per line, shortest round-trip numbers separated by spaces
+std::string matrix_format(const Matrix &m);
+
+// Kernel set in use ("sse2" or "avx2"); matrix_use_kernels() picks one
+// by name for benchmarks, false if the CPU lacks it
+const char *matrix_kernels();
+bool matrix_use_kernels(const char *name);
+
+// Headless --matrix: OP is multiply, transpose, det, inverse, solve,
+// lstsq or eig; A and B are files ("-" for stdin) in matrix_parse form.
+// Returns 0 on success, 1 with a message on stderr.
+int run_matrix(const char *op, const char *a_path, const char *b_path, FILE *out);
+
+#endif // CALC_MATRIX_H
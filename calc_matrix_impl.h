@@ -0,0 +1,161 @@
+// Matrix kernels for calc_matrix.cpp, which includes this file once per
+// vector width, each time inside its own namespace (and, for AVX2, inside
+// a target pragma). No include guard on purpose.
+//
+// The includer defines:
+//   VEC_WIDTH     doubles per vector
+//   VEC_NAME      name reported by matrix_kernels()
+//   GEMM_MR       rows of C in the micro-kernel's registers
+//
+// The micro-kernel holds an MR × NR block of C, NR being two vectors, in
+// 2·MR accumulators and streams a packed column of A and row of B through
+// them. MR is picked so the accumulators, two B vectors and an A splat
+// fit the register file: 4 for the 16 XMM registers, 6 for the 16 YMM.
+
+typedef double vd __attribute__((vector_size(VEC_WIDTH * 8)));
+
+const size_t MR = GEMM_MR;
+const size_t NR = 2 * VEC_WIDTH;
+
+inline vd load(const double *p) {
+    vd v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(double *p, vd v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+inline vd splat(double a) {
+    return vd() + a;
+}
+
+// Rows [0, m) × columns [0, k) of A as panels of MR rows, each stored
+// column by column (element (i, p) of a panel at p·MR + i). The last
+// panel is padded with zero rows.
+void pack_a(size_t m, size_t k, const double *a, size_t lda, double *packed) {
+    for (size_t i0 = 0; i0 < m; i0 += MR) {
+        size_t rows = m - i0 < MR ? m - i0 : MR;
+        for (size_t i = 0; i < MR; i++) {
+            const double *src = a + (i0 + i) * lda;
+            for (size_t p = 0; p < k; p++) packed[p * MR + i] = i < rows ? src[p] : 0;
+        }
+        packed += MR * k;
+    }
+}
+
+// Rows [0, k) × columns [0, n) of B as panels of NR columns, each stored
+// row by row. The last panel is padded with zero columns.
+void pack_b(size_t k, size_t n, const double *b, size_t ldb, double *packed) {
+    for (size_t j0 = 0; j0 < n; j0 += NR) {
+        size_t cols = n - j0 < NR ? n - j0 : NR;
+        for (size_t p = 0; p < k; p++) {
+            const double *src = b + p * ldb + j0;
+            if (cols == NR) {
+                store(packed, load(src));
+                store(packed + VEC_WIDTH, load(src + VEC_WIDTH));
+            } else {
+                for (size_t j = 0; j < NR; j++) packed[j] = j < cols ? src[j] : 0;
+            }
+            packed += NR;
+        }
+    }
+}
+
+// C[0, m) × [0, n) ± one packed A panel times one packed B panel, k deep
+inline void micro_kernel(size_t k, const double *a, const double *b, double *c, size_t ldc, size_t m, size_t n,
+                         bool subtract) {
+    vd acc[MR][2];
+    for (size_t i = 0; i < MR; i++) acc[i][0] = acc[i][1] = vd();
+    for (size_t p = 0; p < k; p++) {
+        vd b0 = load(b);
+        vd b1 = load(b + VEC_WIDTH);
+#pragma GCC unroll 8
+        for (size_t i = 0; i < MR; i++) {
+            vd ai = splat(a[i]);
+            acc[i][0] += ai * b0;
+            acc[i][1] += ai * b1;
+        }
+        a += MR;
+        b += NR;
+    }
+    if (subtract) {
+        for (size_t i = 0; i < MR; i++) {
+            acc[i][0] = -acc[i][0];
+            acc[i][1] = -acc[i][1];
+        }
+    }
+    if (m == MR && n == NR) {
+        for (size_t i = 0; i < MR; i++) {
+            double *row = c + i * ldc;
+            store(row, load(row) + acc[i][0]);
+            store(row + VEC_WIDTH, load(row + VEC_WIDTH) + acc[i][1]);
+        }
+        return;
+    }
+    double tile[MR * NR];
+    for (size_t i = 0; i < MR; i++) {
+        store(tile + i * NR, acc[i][0]);
+        store(tile + i * NR + VEC_WIDTH, acc[i][1]);
+    }
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) c[i * ldc + j] += tile[i * NR + j];
+    }
+}
+
+// C ± A·B, m × n by k deep, on this thread. B is packed GEMM_KC rows by
+// GEMM_NC columns at a time (for the L3 cache), A GEMM_MC rows by GEMM_KC
+// at a time (for L2), and each micro-kernel call reads an MR × KC sliver
+// of A and a KC × NR sliver of B (L1).
+void gemm(size_t m, size_t n, size_t k, const double *a, size_t lda, const double *b, size_t ldb, double *c,
+          size_t ldc, bool subtract) {
+    AlignedBuffer packed_a(GEMM_MC * GEMM_KC);
+    AlignedBuffer packed_b((GEMM_NC + NR) * GEMM_KC);
+    for (size_t jc = 0; jc < n; jc += GEMM_NC) {
+        size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (size_t pc = 0; pc < k; pc += GEMM_KC) {
+            size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            pack_b(kc, nc, b + pc * ldb + jc, ldb, packed_b.data());
+            for (size_t ic = 0; ic < m; ic += GEMM_MC) {
+                size_t mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                pack_a(mc, kc, a + ic * lda + pc, lda, packed_a.data());
+                for (size_t jr = 0; jr < nc; jr += NR) {
+                    size_t nr = nc - jr < NR ? nc - jr : NR;
+                    for (size_t ir = 0; ir < mc; ir += MR) {
+                        size_t mr = mc - ir < MR ? mc - ir : MR;
+                        micro_kernel(kc, packed_a.data() + ir * kc, packed_b.data() + jr * kc,
+                                     c + (ic + ir) * ldc + jc + jr, ldc, mr, nr, subtract);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// y += s·x
+void axpy(size_t n, double s, const double *x, double *y) {
+    vd vs = splat(s);
+    size_t i = 0;
+    for (; i + 2 * VEC_WIDTH <= n; i += 2 * VEC_WIDTH) {
+        store(y + i, load(y + i) + vs * load(x + i));
+        store(y + i + VEC_WIDTH, load(y + i + VEC_WIDTH) + vs * load(x + i + VEC_WIDTH));
+    }
+    for (; i < n; i++) y[i] += s * x[i];
+}
+
+double dot(size_t n, const double *x, const double *y) {
+    vd s0 = vd(), s1 = vd();
+    size_t i = 0;
+    for (; i + 2 * VEC_WIDTH <= n; i += 2 * VEC_WIDTH) {
+        s0 += load(x + i) * load(y + i);
+        s1 += load(x + i + VEC_WIDTH) * load(y + i + VEC_WIDTH);
+    }
+    s0 += s1;
+    double sum = 0;
+    for (int j = 0; j < VEC_WIDTH; j++) sum += s0[j];
+    for (; i < n; i++) sum += x[i] * y[i];
+    return sum;
+}
+
+const MatrixKernels KERNELS = {VEC_NAME, MR, gemm, axpy, dot};
@@ -0,0 +1,210 @@
+#include "calc_matrixpanel.h"
+#include <cstring>
+#include <string>
+
+namespace {
+
+const int DEFAULT_WIDTH = 320;
+
+struct MatrixOp {
+    const char *label;
+    const char *op; // As for run_matrix
+    bool needs_b;
+};
+
+const MatrixOp OPS[] = {
+    {"A × B", "multiply", true},
+    {"Aᵀ", "transpose", false},
+    {"A⁻¹", "inverse", false},
+    {"det A", "det", false},
+    {"Solve A·X = B", "solve", true},
+    {"Eigenvalues", "eig", false},
+};
+const int OP_COLUMNS = 3;
+
+} // namespace
+
+MatrixPanel::MatrixPanel(RecallFunc on_recall, gpointer data) :
+    recall(on_recall),
+    recall_data(data),
+    box(NULL),
+    a_view(NULL),
+    a_label(NULL),
+    b_view(NULL),
+    b_label(NULL),
+    result_view(NULL),
+    status(NULL),
+    use_button(NULL),
+    enter_button(NULL) {}
+
+// A monospaced text box holding text, in a scroller
+GtkWidget *MatrixPanel::editor(const char *text, GtkWidget **view) {
+    *view = gtk_text_view_new();
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(*view), TRUE);
+    gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(*view)), text, -1);
+    GtkWidget *scroller = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scroller, -1, 80);
+    gtk_container_add(GTK_CONTAINER(scroller), *view);
+    return scroller;
+}
+
+GtkWidget *MatrixPanel::create() {
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_size_request(box, DEFAULT_WIDTH, -1);
+
+    a_label = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(a_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(box), a_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), editor("2 1\n1 3\n", &a_view), TRUE, TRUE, 0);
+    b_label = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(b_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(box), b_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), editor("1\n2\n", &b_view), TRUE, TRUE, 0);
+    g_signal_connect(gtk_text_view_get_buffer(GTK_TEXT_VIEW(a_view)), "changed", G_CALLBACK(on_text_changed), this);
+    g_signal_connect(gtk_text_view_get_buffer(GTK_TEXT_VIEW(b_view)), "changed", G_CALLBACK(on_text_changed), this);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 3);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 3);
+    gtk_grid_set_column_homogeneous(GTK_GRID(grid), TRUE);
+    for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++) {
+        GtkWidget *button = gtk_button_new_with_label(OPS[i].label);
+        g_object_set_data(G_OBJECT(button), "matrix-op", (gpointer)&OPS[i]);
+        g_signal_connect(button, "clicked", G_CALLBACK(on_op_clicked), this);
+        gtk_grid_attach(GTK_GRID(grid), button, i % OP_COLUMNS, i / OP_COLUMNS, 1, 1);
+    }
+    gtk_box_pack_start(GTK_BOX(box), grid, FALSE, FALSE, 0);
+
+    result_view = gtk_text_view_new();
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(result_view), TRUE);
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(result_view), FALSE);
+    GtkWidget *scroller = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scroller, -1, 80);
+    gtk_container_add(GTK_CONTAINER(scroller), result_view);
+    gtk_box_pack_start(GTK_BOX(box), scroller, TRUE, TRUE, 0);
+
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    use_button = gtk_button_new_with_label("Use as A");
+    g_signal_connect(use_button, "clicked", G_CALLBACK(on_use_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), use_button, FALSE, FALSE, 0);
+    enter_button = gtk_button_new_with_label("Enter Value");
+    gtk_widget_set_tooltip_text(enter_button, "Enter a 1×1 result as the current operand");
+    g_signal_connect(enter_button, "clicked", G_CALLBACK(on_enter_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), enter_button, FALSE, FALSE, 0);
+    gtk_widget_set_sensitive(use_button, FALSE);
+    gtk_widget_set_sensitive(enter_button, FALSE);
+    gtk_box_pack_start(GTK_BOX(box), row, FALSE, FALSE, 0);
+
+    status = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(status), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(status), PANGO_ELLIPSIZE_END);
+    gtk_box_pack_start(GTK_BOX(box), status, FALSE, FALSE, 0);
+
+    on_text_changed(NULL, this);
+    return box;
+}
+
+// Parses the text of view into m and labels it with its size, or with why
+// it isn't a matrix
+bool MatrixPanel::read(GtkWidget *view, GtkWidget *label, const char *name, Matrix *m) {
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view));
+    GtkTextIter start, end;
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    gchar *text = gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
+    std::string error;
+    bool ok = matrix_parse(text, strlen(text), m, &error);
+    g_free(text);
+    gchar *caption = ok ? g_strdup_printf("%s   %zu×%zu", name, m->rows(), m->cols())
+                        : g_strdup_printf("%s   %s", name, error.c_str());
+    gtk_label_set_text(GTK_LABEL(label), caption);
+    g_free(caption);
+    return ok;
+}
+
+void MatrixPanel::run(const char *op) {
+    Matrix a, b;
+    const MatrixOp *info = NULL;
+    for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++) {
+        if (strcmp(OPS[i].op, op) == 0) info = &OPS[i];
+    }
+    if (!info) return;
+    bool ok = read(a_view, a_label, "A", &a);
+    if (info->needs_b) ok = read(b_view, b_label, "B", &b) && ok;
+    if (!ok) {
+        gtk_label_set_text(GTK_LABEL(status), "Fix the matrices above first");
+        return;
+    }
+
+    gint64 started = g_get_monotonic_time();
+    MatrixStatus outcome = MATRIX_OK;
+    Matrix answer;
+    if (strcmp(op, "multiply") == 0) {
+        outcome = matrix_multiply(a, b, &answer);
+    } else if (strcmp(op, "transpose") == 0) {
+        answer = matrix_transpose(a);
+    } else if (strcmp(op, "inverse") == 0) {
+        outcome = matrix_inverse(a, &answer);
+    } else if (strcmp(op, "det") == 0) {
+        double det = 0;
+        outcome = matrix_determinant(a, &det);
+        answer = Matrix(1, 1);
+        answer(0, 0) = det;
+    } else if (strcmp(op, "solve") == 0) {
+        outcome = matrix_solve(a, b, &answer);
+    } else {
+        std::vector<double> values;
+        outcome = matrix_symmetric_eigenvalues(a, &values);
+        answer = Matrix(values.size(), 1);
+        for (size_t i = 0; i < values.size(); i++) answer(i, 0) = values[i];
+    }
+    if (outcome == MATRIX_OK) result = std::move(answer);
+    show(info->label, outcome, started);
+}
+
+// The result, or the error in place of it
+void MatrixPanel::show(const char *what, MatrixStatus outcome, gint64 started) {
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(result_view));
+    bool ok = outcome == MATRIX_OK;
+    gtk_text_buffer_set_text(buffer, ok ? matrix_format(result).c_str() : "", -1);
+    gtk_widget_set_sensitive(use_button, ok);
+    gtk_widget_set_sensitive(enter_button, ok && result.rows() == 1 && result.cols() == 1);
+    gchar *summary;
+    if (ok) {
+        summary = g_strdup_printf("%s: %zu×%zu in %.1f ms", what, result.rows(), result.cols(),
+                                  (g_get_monotonic_time() - started) / 1000.0);
+    } else {
+        summary = g_strdup_printf("%s: %s", what, matrix_status_message(outcome));
+    }
+    gtk_label_set_text(GTK_LABEL(status), summary);
+    g_free(summary);
+}
+
+void MatrixPanel::on_text_changed(GtkTextBuffer *buffer, gpointer data) {
+    (void)buffer;  // Suppress unused parameter warning
+    MatrixPanel *panel = static_cast<MatrixPanel*>(data);
+    Matrix m;
+    read(panel->a_view, panel->a_label, "A", &m);
+    read(panel->b_view, panel->b_label, "B", &m);
+}
+
+void MatrixPanel::on_op_clicked(GtkButton *button, gpointer data) {
+    const MatrixOp *info = static_cast<const MatrixOp*>(g_object_get_data(G_OBJECT(button), "matrix-op"));
+    static_cast<MatrixPanel*>(data)->run(info->op);
+}
+
+void MatrixPanel::on_use_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    MatrixPanel *panel = static_cast<MatrixPanel*>(data);
+    if (panel->result.empty()) return;
+    gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(panel->a_view)),
+                             matrix_format(panel->result).c_str(), -1);
+}
+
+void MatrixPanel::on_enter_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    MatrixPanel *panel = static_cast<MatrixPanel*>(data);
+    if (panel->result.rows() != 1 || panel->result.cols() != 1) return;
+    panel->recall(panel->result(0, 0), panel->recall_data);
+}
@@ -0,0 +1,52 @@
+#ifndef CALC_MATRIXPANEL_H
+#define CALC_MATRIXPANEL_H
+
+#include <gtk/gtk.h>
+#include "calc_matrix.h"
+
+// View → Matrices: A and B typed or pasted into two text boxes, one row
+// per line (or "1 2; 3 4"), each labelled with its size as it is edited.
+// The buttons multiply, transpose, invert, solve A·X = B (least squares
+// when A has more rows than columns), and take the determinant or the
+// eigenvalues of A. The result can be copied into A to chain operations,
+// and a determinant entered as the current operand.
+class MatrixPanel {
+public:
+    typedef void (*RecallFunc)(double value, gpointer data);
+
+private:
+    RecallFunc recall;
+    gpointer recall_data;
+
+    GtkWidget *box;
+    GtkWidget *a_view;
+    GtkWidget *a_label;
+    GtkWidget *b_view;
+    GtkWidget *b_label;
+    GtkWidget *result_view;
+    GtkWidget *status;
+    GtkWidget *use_button;
+    GtkWidget *enter_button;
+    Matrix result;
+
+    static GtkWidget *editor(const char *text, GtkWidget **view);
+    static bool read(GtkWidget *view, GtkWidget *label, const char *name, Matrix *m);
+    void run(const char *op);
+    void show(const char *what, MatrixStatus status, gint64 started);
+
+    static void on_text_changed(GtkTextBuffer *buffer, gpointer data);
+    static void on_op_clicked(GtkButton *button, gpointer data);
+    static void on_use_clicked(GtkButton *button, gpointer data);
+    static void on_enter_clicked(GtkButton *button, gpointer data);
+
+    MatrixPanel(const MatrixPanel &);
+    MatrixPanel &operator=(const MatrixPanel &);
+
+public:
+    MatrixPanel(RecallFunc on_recall, gpointer data);
+
+    // Builds the widgets; the returned box is for the caller to pack
+    GtkWidget *create();
+};
+
+#endif // CALC_MATRIXPANEL_H
@@ -0,0 +1,177 @@
+#include "calc_plot.h"
+#include "calc_vecmath.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int INITIAL_SPACING = 4;     // Pixels between the first samples
+const double TOLERANCE = 0.25;     // Pixels a chord may stray from the curve
+const double MIN_WIDTH = 1.0 / 16; // Pixels; narrower intervals are not split
+const double BREAK_HEIGHT = 16;    // Pixels; a jump this tall left at MIN_WIDTH is a break
+const size_t MAX_COLUMN_POINTS = 16 * PLOT_TILE_SIZE;
+
+// Enough for every column on screen at the current and neighbouring
+// levels; returned references stay valid because this is reserved up front
+const size_t MAX_CACHED_COLUMNS = 256;
+
+// Whether the halves of [a, b] split at mid need splitting again: where
+// the curve starts or stops failing, or where mid is off the chord
+void check_split(const PlotPoint &a, const PlotPoint &mid, const PlotPoint &b, double tolerance,
+                 unsigned char *left, unsigned char *right) {
+    bool fa = a.y == a.y, fm = mid.y == mid.y, fb = b.y == b.y;
+    if (fa && fm && fb) {
+        *left = *right = fabs(mid.y - 0.5 * (a.y + b.y)) > tolerance;
+    } else {
+        *left = fa != fm;
+        *right = fm != fb;
+    }
+}
+
+} // namespace
+
+PlotCurve::PlotCurve() : use_clock(0) {
+    counters.hits = counters.misses = counters.evaluations = 0;
+    columns.reserve(MAX_CACHED_COLUMNS);
+}
+
+int plot_level(double units_per_pixel) {
+    int exponent;
+    frexp(units_per_pixel, &exponent); // units = f·2^exponent, f in [0.5, 1)
+    return exponent - 1;
+}
+
+double plot_level_units(int level) {
+    return ldexp(1.0, level);
+}
+
+void PlotViewport::zoom(double factor, double sx, double sy) {
+    double x = plot_x(sx), y = plot_y(sy);
+    units_x *= factor;
+    units_y *= factor;
+    center_x = x - (sx - width * 0.5) * units_x;
+    center_y = y + (sy - height * 0.5) * units_y;
+}
+
+bool PlotCurve::set_expression(const char *expression, const char **error) {
+    ExprCompiler compiler;
+    Program compiled;
+    if (!compiler.compile(expression, strlen(expression), compiled)) {
+        if (error) *error = compiler.error();
+        return false;
+    }
+    text = expression;
+    program = compiled;
+    columns.clear();
+    return true;
+}
+
+// ys[i] = f(xs[i]) for i < count; failures and infinities become NaN
+void PlotCurve::evaluate(size_t count) {
+    ys.resize(count);
+    const VecMath &math = vecmath_best();
+    for (size_t i = 0; i < count; i += VECTOR_BATCH) {
+        size_t n = count - i < VECTOR_BATCH ? count - i : VECTOR_BATCH;
+        program.run_vector(&xs[i], &ys[i], n, math, stack);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!std::isfinite(ys[i])) ys[i] = NAN;
+    }
+    counters.evaluations += count;
+}
+
+void PlotCurve::sample(int level_x, int level_y, long long index, std::vector<PlotPoint> &out) {
+    double unit_x = plot_level_units(level_x);
+    double tolerance = TOLERANCE * plot_level_units(level_y);
+    double min_width = MIN_WIDTH * unit_x;
+
+    // Evenly spaced to start with, every interval marked for splitting
+    size_t intervals = PLOT_TILE_SIZE / INITIAL_SPACING;
+    double x0 = (double)index * PLOT_TILE_SIZE * unit_x;
+    xs.resize(intervals + 1);
+    for (size_t i = 0; i <= intervals; i++) xs[i] = x0 + (double)(i * INITIAL_SPACING) * unit_x;
+    evaluate(intervals + 1);
+    pending.resize(intervals + 1);
+    for (size_t i = 0; i <= intervals; i++) {
+        pending[i].x = xs[i];
+        pending[i].y = ys[i];
+    }
+    refine.assign(intervals, 1);
+
+    // Each pass evaluates the midpoints of every marked interval together
+    for (;;) {
+        xs.clear();
+        for (size_t i = 0; i + 1 < pending.size(); i++) {
+            if (refine[i] && pending[i + 1].x - pending[i].x > min_width) {
+                xs.push_back(0.5 * (pending[i].x + pending[i + 1].x));
+            }
+        }
+        if (xs.empty() || pending.size() + xs.size() > MAX_COLUMN_POINTS) break;
+        evaluate(xs.size());
+
+        out.clear();
+        next_refine.clear();
+        size_t m = 0;
+        for (size_t i = 0; i + 1 < pending.size(); i++) {
+            out.push_back(pending[i]);
+            if (!refine[i] || pending[i + 1].x - pending[i].x <= min_width) {
+                next_refine.push_back(refine[i]);
+                continue;
+            }
+            PlotPoint mid = {xs[m], ys[m]};
+            m++;
+            unsigned char left, right;
+            check_split(pending[i], mid, pending[i + 1], tolerance, &left, &right);
+            out.push_back(mid);
+            next_refine.push_back(left);
+            next_refine.push_back(right);
+        }
+        out.push_back(pending.back());
+        pending.swap(out);
+        refine.swap(next_refine);
+    }
+
+    // Intervals still marked at the finest width with a tall step between
+    // finite ends are jumps; runs of failed points collapse to one
+    double break_height = BREAK_HEIGHT * plot_level_units(level_y);
+    out.clear();
+    for (size_t i = 0; i < pending.size(); i++) {
+        const PlotPoint &p = pending[i];
+        bool failed = p.y != p.y;
+        if (!failed || out.empty() || out.back().y == out.back().y) out.push_back(p);
+        if (i + 1 == pending.size() || !refine[i] || failed) continue;
+        const PlotPoint &q = pending[i + 1];
+        if (q.x - p.x <= min_width && fabs(q.y - p.y) > break_height) {
+            PlotPoint gap = {0.5 * (p.x + q.x), NAN};
+            out.push_back(gap);
+        }
+    }
+}
+
+const std::vector<PlotPoint> &PlotCurve::tile_samples(int level_x, int level_y, long long index) {
+    use_clock++;
+    Column *oldest = NULL;
+    for (size_t i = 0; i < columns.size(); i++) {
+        Column &column = columns[i];
+        if (column.index == index && column.level_x == level_x && column.level_y == level_y) {
+            column.last_use = use_clock;
+            counters.hits++;
+            return column.points;
+        }
+        if (!oldest || column.last_use < oldest->last_use) oldest = &column;
+    }
+
+    // Reuse the least recently used column's storage once the cache is full
+    Column *column = oldest;
+    if (columns.size() < MAX_CACHED_COLUMNS) {
+        columns.push_back(Column());
+        column = &columns.back();
+    }
+    column->level_x = level_x;
+    column->level_y = level_y;
+    column->index = index;
+    column->last_use = use_clock;
+    counters.misses++;
+    sample(level_x, level_y, index, column->points);
+    return column->points;
+}
@@ -0,0 +1,99 @@
+#ifndef CALC_PLOT_H
+#define CALC_PLOT_H
+
+#include "calc_expr.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Function plotting without the drawing: where samples go and which work
+// can be kept across frames. The plane is cut into square tiles of
+// PLOT_TILE_SIZE pixels on a power-of-two grid. At level L one tile pixel
+// is 2^L plot units, so tile column c covers x from c·T·2^L to
+// (c+1)·T·2^L. Panning only uncovers new tiles, and zooming by less than
+// a factor of two keeps the level and draws the same tiles scaled.
+
+const int PLOT_TILE_SIZE = 256;
+
+// Level whose pixels are no coarser than units_per_pixel, so a tile drawn
+// to screen is shrunk by a factor in (0.5, 1], never stretched
+int plot_level(double units_per_pixel);
+
+// Plot units per tile pixel at a level: 2^level
+double plot_level_units(int level);
+
+// Screen mapping. Screen y grows downwards, plot y upwards.
+struct PlotViewport {
+    double center_x, center_y; // Plot point at the middle of the screen
+    double units_x, units_y;   // Plot units per screen pixel
+    int width, height;         // Screen size in pixels
+
+    double screen_x(double x) const { return width * 0.5 + (x - center_x) / units_x; }
+    double screen_y(double y) const { return height * 0.5 - (y - center_y) / units_y; }
+    double plot_x(double sx) const { return center_x + (sx - width * 0.5) * units_x; }
+    double plot_y(double sy) const { return center_y - (sy - height * 0.5) * units_y; }
+
+    // Scale by factor (< 1 zooms in) keeping the plot point under (sx, sy)
+    // where it is
+    void zoom(double factor, double sx, double sy);
+};
+
+// One sample; a NaN y also marks where the curve must not be joined up
+struct PlotPoint {
+    double x, y;
+};
+
+// Cache counters, shown in the debug overlay
+struct PlotSampleStats {
+    unsigned long hits;        // Tile columns served from the cache
+    unsigned long misses;      // Tile columns sampled
+    unsigned long evaluations; // Points evaluated for them
+};
+
+// One y = f(x) curve and its sampled tile columns
+class PlotCurve {
+private:
+    struct Column {
+        int level_x, level_y;
+        long long index;
+        unsigned long last_use;
+        std::vector<PlotPoint> points;
+    };
+
+    std::string text;
+    Program program;
+    std::vector<Column> columns; // Least recently used is evicted first
+    unsigned long use_clock;
+    PlotSampleStats counters;
+
+    // Scratch for sample(), kept so resampling does not allocate
+    std::vector<PlotPoint> pending;
+    std::vector<unsigned char> refine, next_refine;
+    std::vector<double> xs, ys, stack;
+
+    void sample(int level_x, int level_y, long long index, std::vector<PlotPoint> &out);
+    void evaluate(size_t count);
+
+public:
+    PlotCurve();
+
+    // Compiles an expression in x; on failure the curve is unchanged and
+    // *error, if given, says why
+    bool set_expression(const char *expression, const char **error = NULL);
+    const char *expression() const { return text.c_str(); }
+
+    // Samples across tile column index at level_x, sorted by x and
+    // including both edges so neighbouring columns join. They start every
+    // four pixels and intervals are halved wherever the midpoint
+    // strays from the straight line by more than a fraction of a pixel at
+    // level_y, down to a sixteenth of a pixel, so they gather at bends and
+    // steep parts. A NaN y separates pieces that must not be joined: gaps
+    // where f fails, and jumps such as the poles of tan. The reference
+    // stays valid until the column is evicted, and only the least recently
+    // used of a few hundred columns ever is.
+    const std::vector<PlotPoint> &tile_samples(int level_x, int level_y, long long index);
+
+    const PlotSampleStats &stats() const { return counters; }
+};
+
+#endif // CALC_PLOT_H
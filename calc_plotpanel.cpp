@@ -0,0 +1,511 @@
+#include "calc_plotpanel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+const double LINE_WIDTH = 2.0;
+const double DEFAULT_SPAN = 20.0;       // Plot units across at reset: x from -10 to 10
+const int DEFAULT_WIDTH = 440;
+const int DEFAULT_HEIGHT = 320;
+const size_t MAX_TILES = 128;           // Non-empty ones hold 256 KB each
+const gint64 RENDER_BUDGET_US = 8000;   // New tiles per frame, half a 60 fps frame
+const double GRID_SPACING = 80;         // Pixels between grid lines, roughly
+const double ZOOM_STEP = 1.1;           // Per scroll wheel notch
+const double MIN_UNITS = 1e-10;         // Plot units per pixel, zoomed all the way in
+const double MAX_UNITS = 1e10;
+const double SMOOTHING = 0.1;           // Weight of the newest frame in the averages
+const double COORDINATE_LIMIT = 1e6;    // Tile pixels; further points are clamped
+
+const struct {
+    double red, green, blue;
+} CURVE_COLOURS[PLOT_MAX_CURVES] = {
+    {0.12, 0.47, 0.71},
+    {0.84, 0.15, 0.16},
+    {0.17, 0.63, 0.17},
+    {0.58, 0.40, 0.74},
+    {1.00, 0.50, 0.05},
+    {0.09, 0.75, 0.81},
+};
+
+// Floor of n/2, for the parent of a tile with a negative index
+long long half_index(long long n) {
+    return n >= 0 ? n / 2 : -((1 - n) / 2);
+}
+
+double clamp(double v, double lo, double hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Adds a→b to the path, cut to the band of tile rows that can show it.
+// *pen says whether the path already ends at a.
+void add_segment(cairo_t *cr, double ax, double ay, double bx, double by, bool *pen) {
+    const double lo = -LINE_WIDTH, hi = PLOT_TILE_SIZE + LINE_WIDTH;
+    double t0 = 0, t1 = 1, dy = by - ay;
+    if (dy == 0) {
+        if (ay < lo || ay > hi) t0 = 2;
+    } else {
+        double ta = (lo - ay) / dy, tb = (hi - ay) / dy;
+        if (ta > tb) std::swap(ta, tb);
+        t0 = ta > 0 ? ta : 0;
+        t1 = tb < 1 ? tb : 1;
+    }
+    if (t0 > t1) {
+        *pen = false;
+        return;
+    }
+    if (!*pen) cairo_move_to(cr, ax + t0 * (bx - ax), ay + t0 * dy);
+    cairo_line_to(cr, ax + t1 * (bx - ax), ay + t1 * dy);
+    *pen = t1 == 1;
+}
+
+// Paints a tile surface stretched over a screen rectangle
+void paint_surface(cairo_t *cr, cairo_surface_t *surface, double left, double top, double right, double bottom) {
+    cairo_save(cr);
+    cairo_rectangle(cr, left, top, right - left, bottom - top);
+    cairo_clip(cr);
+    cairo_translate(cr, left, top);
+    cairo_scale(cr, (right - left) / PLOT_TILE_SIZE, (bottom - top) / PLOT_TILE_SIZE);
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD); // No faded edges between tiles
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+// Round number of plot units near `pixels` screen pixels apart: 1, 2 or 5 × 10^n
+double grid_step(double units_per_pixel, double pixels) {
+    double raw = units_per_pixel * pixels;
+    double step = pow(10.0, floor(log10(raw)));
+    if (raw > 5 * step) return 10 * step;
+    if (raw > 2 * step) return 5 * step;
+    if (raw > step) return 2 * step;
+    return step;
+}
+
+} // namespace
+
+PlotPanel::PlotPanel() :
+    box(NULL),
+    entry(NULL),
+    area(NULL),
+    curve_count(0),
+    view_placed(false),
+    frame_count(0),
+    dragging(false),
+    drag_x(0),
+    drag_y(0),
+    show_frame_time(g_getenv("G_MESSAGES_DEBUG") != NULL),
+    last_frame_start(0),
+    draw_ms(0),
+    interval_ms(0),
+    tiles_rendered(0),
+    tiles_deferred(0) {
+    view.width = DEFAULT_WIDTH;
+    view.height = DEFAULT_HEIGHT;
+    reset_view();
+    tiles.reserve(MAX_TILES);
+}
+
+PlotPanel::~PlotPanel() {
+    clear_tiles();
+}
+
+GtkWidget *PlotPanel::create() {
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *label = gtk_label_new("y =");
+    entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "sin(x), x^2-1, ...");
+    g_signal_connect(entry, "activate", G_CALLBACK(on_plot_clicked), this);
+    GtkWidget *plot_button = gtk_button_new_with_label("Plot");
+    g_signal_connect(plot_button, "clicked", G_CALLBACK(on_plot_clicked), this);
+    GtkWidget *clear_button = gtk_button_new_with_label("Clear");
+    g_signal_connect(clear_button, "clicked", G_CALLBACK(on_clear_clicked), this);
+    gtk_box_pack_start(GTK_BOX(row), label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(row), entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(row), plot_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(row), clear_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), row, FALSE, FALSE, 0);
+
+    area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(area, DEFAULT_WIDTH, DEFAULT_HEIGHT);
+    gtk_style_context_add_class(gtk_widget_get_style_context(area), "plot");
+    gtk_widget_add_events(area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK |
+                                GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+    g_signal_connect(area, "draw", G_CALLBACK(on_draw), this);
+    g_signal_connect(area, "button-press-event", G_CALLBACK(on_button_press), this);
+    g_signal_connect(area, "button-release-event", G_CALLBACK(on_button_release), this);
+    g_signal_connect(area, "motion-notify-event", G_CALLBACK(on_motion), this);
+    g_signal_connect(area, "scroll-event", G_CALLBACK(on_scroll), this);
+    gtk_box_pack_start(GTK_BOX(box), area, TRUE, TRUE, 0);
+    return box;
+}
+
+bool PlotPanel::add_curve(const char *expression, const char **error) {
+    if (curve_count == PLOT_MAX_CURVES) {
+        *error = "No more curves; Clear first";
+        return false;
+    }
+    if (!curves[curve_count].set_expression(expression, error)) return false;
+    curve_count++;
+    clear_tiles();
+    if (area) gtk_widget_queue_draw(area);
+    return true;
+}
+
+void PlotPanel::clear_curves() {
+    curve_count = 0;
+    clear_tiles();
+    if (area) gtk_widget_queue_draw(area);
+}
+
+PlotSampleStats PlotPanel::sample_stats() const {
+    PlotSampleStats total = {0, 0, 0};
+    for (int i = 0; i < PLOT_MAX_CURVES; i++) {
+        total.hits += curves[i].stats().hits;
+        total.misses += curves[i].stats().misses;
+        total.evaluations += curves[i].stats().evaluations;
+    }
+    return total;
+}
+
+void PlotPanel::reset_view() {
+    view.center_x = 0;
+    view.center_y = 0;
+    view.units_x = DEFAULT_SPAN / view.width;
+    view.units_y = view.units_x;
+}
+
+void PlotPanel::clear_tiles() {
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].surface) cairo_surface_destroy(tiles[i].surface);
+    }
+    tiles.clear();
+}
+
+PlotPanel::Tile *PlotPanel::find_tile(int level_x, int level_y, long long column, long long row) {
+    for (size_t i = 0; i < tiles.size(); i++) {
+        Tile &tile = tiles[i];
+        if (tile.column == column && tile.row == row && tile.level_x == level_x && tile.level_y == level_y) {
+            tile.last_use = frame_count;
+            return &tile;
+        }
+    }
+    return NULL;
+}
+
+// Strokes one curve across a tile. The neighbouring columns contribute the
+// few samples within a line width of the edges, so lines cross tile
+// boundaries without a notch.
+void PlotPanel::stroke_curve(cairo_t *cr, PlotCurve &curve, int level_x, int level_y, long long column,
+                             long long row) {
+    double ux = plot_level_units(level_x), uy = plot_level_units(level_y);
+    double x0 = (double)column * PLOT_TILE_SIZE * ux;
+    double x1 = x0 + PLOT_TILE_SIZE * ux;
+    double y_top = (double)(row + 1) * PLOT_TILE_SIZE * uy;
+
+    const std::vector<PlotPoint> &left = curve.tile_samples(level_x, level_y, column - 1);
+    const std::vector<PlotPoint> &middle = curve.tile_samples(level_x, level_y, column);
+    const std::vector<PlotPoint> &right = curve.tile_samples(level_x, level_y, column + 1);
+    size_t left_start = left.size();
+    while (left_start > 0 && left[left_start - 1].x >= x0 - LINE_WIDTH * ux) left_start--;
+    if (left_start > 0) left_start--;
+    size_t right_end = 0;
+    while (right_end < right.size() && right[right_end].x <= x1 + LINE_WIDTH * ux) right_end++;
+    if (right_end < right.size()) right_end++;
+
+    bool pen = false, have_previous = false;
+    double px = 0, py = 0;
+    auto visit = [&](const PlotPoint &p) {
+        if (p.y != p.y) {
+            have_previous = pen = false;
+            return;
+        }
+        double tx = (p.x - x0) / ux;
+        double ty = clamp((y_top - p.y) / uy, -COORDINATE_LIMIT, COORDINATE_LIMIT);
+        if (have_previous) add_segment(cr, px, py, tx, ty, &pen);
+        px = tx;
+        py = ty;
+        have_previous = true;
+    };
+    for (size_t i = left_start; i < left.size(); i++) visit(left[i]);
+    for (size_t i = 0; i < middle.size(); i++) visit(middle[i]);
+    for (size_t i = 0; i < right_end; i++) visit(right[i]);
+}
+
+PlotPanel::Tile *PlotPanel::render_tile(int level_x, int level_y, long long column, long long row) {
+    Tile *tile = NULL;
+    if (tiles.size() < MAX_TILES) {
+        tiles.push_back(Tile());
+        tile = &tiles.back();
+    } else {
+        tile = &tiles[0];
+        for (size_t i = 1; i < tiles.size(); i++) {
+            if (tiles[i].last_use < tile->last_use) tile = &tiles[i];
+        }
+        if (tile->surface) cairo_surface_destroy(tile->surface);
+    }
+    tile->level_x = level_x;
+    tile->level_y = level_y;
+    tile->column = column;
+    tile->row = row;
+    tile->last_use = frame_count;
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, PLOT_TILE_SIZE, PLOT_TILE_SIZE);
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_line_width(cr, LINE_WIDTH);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+    bool empty = true;
+    for (int i = 0; i < curve_count; i++) {
+        stroke_curve(cr, curves[i], level_x, level_y, column, row);
+        if (!cairo_has_current_point(cr)) continue;
+        empty = false;
+        cairo_set_source_rgb(cr, CURVE_COLOURS[i].red, CURVE_COLOURS[i].green, CURVE_COLOURS[i].blue);
+        cairo_stroke(cr);
+    }
+    cairo_destroy(cr);
+
+    // Most of the plane is blank; those tiles are remembered without pixels
+    if (empty) {
+        cairo_surface_destroy(surface);
+        surface = NULL;
+    }
+    tile->surface = surface;
+    tiles_rendered++;
+    return tile;
+}
+
+// Paints one tile of the current level, rendering it if the frame's budget
+// allows; otherwise paints its parent enlarged and returns false
+bool PlotPanel::paint_tile(cairo_t *cr, int level_x, int level_y, long long column, long long row,
+                           gint64 deadline) {
+    Tile *tile = find_tile(level_x, level_y, column, row);
+    if (!tile && g_get_monotonic_time() < deadline) tile = render_tile(level_x, level_y, column, row);
+
+    double span_x = PLOT_TILE_SIZE * plot_level_units(level_x);
+    double span_y = PLOT_TILE_SIZE * plot_level_units(level_y);
+    // Whole pixels, so neighbouring tiles meet without a blended seam
+    double left = round(view.screen_x(column * span_x)), right = round(view.screen_x((column + 1) * span_x));
+    double top = round(view.screen_y((row + 1) * span_y)), bottom = round(view.screen_y(row * span_y));
+    if (tile) {
+        if (tile->surface) paint_surface(cr, tile->surface, left, top, right, bottom);
+        return true;
+    }
+
+    tiles_deferred++;
+    long long parent_column = half_index(column), parent_row = half_index(row);
+    Tile *parent = find_tile(level_x + 1, level_y + 1, parent_column, parent_row);
+    if (parent && parent->surface) {
+        cairo_save(cr);
+        cairo_rectangle(cr, left, top, right - left, bottom - top);
+        cairo_clip(cr);
+        paint_surface(cr, parent->surface,
+                      round(view.screen_x(parent_column * 2 * span_x)),
+                      round(view.screen_y((parent_row + 1) * 2 * span_y)),
+                      round(view.screen_x((parent_column + 1) * 2 * span_x)),
+                      round(view.screen_y(parent_row * 2 * span_y)));
+        cairo_restore(cr);
+    }
+    return false;
+}
+
+void PlotPanel::draw_grid(cairo_t *cr, const GdkRGBA &color) {
+    double step_x = grid_step(view.units_x, GRID_SPACING);
+    double step_y = grid_step(view.units_y, GRID_SPACING);
+    double axis_x = clamp(view.screen_x(0), 0, view.width - 1);  // Where the y axis, or its label column, is
+    double axis_y = clamp(view.screen_y(0), 12, view.height - 4); // Where the x axis, or its label row, is
+    char label[32];
+
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue, 0.12);
+    for (double k = ceil(view.plot_x(0) / step_x); k * step_x <= view.plot_x(view.width); k++) {
+        double sx = floor(view.screen_x(k * step_x)) + 0.5;
+        cairo_move_to(cr, sx, 0);
+        cairo_line_to(cr, sx, view.height);
+    }
+    for (double k = ceil(view.plot_y(view.height) / step_y); k * step_y <= view.plot_y(0); k++) {
+        double sy = floor(view.screen_y(k * step_y)) + 0.5;
+        cairo_move_to(cr, 0, sy);
+        cairo_line_to(cr, view.width, sy);
+    }
+    cairo_stroke(cr);
+
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue, 0.6);
+    cairo_move_to(cr, floor(view.screen_x(0)) + 0.5, 0);
+    cairo_line_to(cr, floor(view.screen_x(0)) + 0.5, view.height);
+    cairo_move_to(cr, 0, floor(view.screen_y(0)) + 0.5);
+    cairo_line_to(cr, view.width, floor(view.screen_y(0)) + 0.5);
+    cairo_stroke(cr);
+
+    cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 10);
+    for (double k = ceil(view.plot_x(0) / step_x); k * step_x <= view.plot_x(view.width); k++) {
+        if (k == 0) continue;
+        snprintf(label, sizeof(label), "%g", k * step_x);
+        cairo_move_to(cr, view.screen_x(k * step_x) + 2, axis_y - 2);
+        cairo_show_text(cr, label);
+    }
+    for (double k = ceil(view.plot_y(view.height) / step_y); k * step_y <= view.plot_y(0); k++) {
+        if (k == 0) continue;
+        snprintf(label, sizeof(label), "%g", k * step_y);
+        cairo_move_to(cr, axis_x + 2, view.screen_y(k * step_y) - 2);
+        cairo_show_text(cr, label);
+    }
+}
+
+void PlotPanel::draw_legend(cairo_t *cr) {
+    cairo_set_font_size(cr, 12);
+    for (int i = 0; i < curve_count; i++) {
+        double y = 18 + 16 * i;
+        cairo_set_source_rgb(cr, CURVE_COLOURS[i].red, CURVE_COLOURS[i].green, CURVE_COLOURS[i].blue);
+        cairo_rectangle(cr, 8, y - 5, 12, 3);
+        cairo_fill(cr);
+        cairo_move_to(cr, 26, y);
+        cairo_show_text(cr, curves[i].expression());
+    }
+}
+
+void PlotPanel::draw_frame_time(cairo_t *cr, const GdkRGBA &color) {
+    PlotSampleStats samples = sample_stats();
+    char text[160];
+    snprintf(text, sizeof(text), "draw %.2f ms, %.0f fps | %zu tiles, %lu drawn, %lu deferred | columns %lu sampled, %lu reused",
+             draw_ms, interval_ms > 0 ? 1000 / interval_ms : 0.0, tiles.size(), tiles_rendered, tiles_deferred,
+             samples.misses, samples.hits);
+    cairo_set_font_size(cr, 10);
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue, 0.8);
+    cairo_move_to(cr, 6, view.height - 6);
+    cairo_show_text(cr, text);
+}
+
+void PlotPanel::draw(cairo_t *cr) {
+    gint64 start = g_get_monotonic_time();
+    frame_count++;
+
+    int width = gtk_widget_get_allocated_width(area), height = gtk_widget_get_allocated_height(area);
+    if (!view_placed) {
+        view.width = width;
+        view.height = height;
+        reset_view();
+        view_placed = true;
+    }
+    // A resize keeps the scale and the centre
+    view.width = width;
+    view.height = height;
+
+    GtkStyleContext *style = gtk_widget_get_style_context(area);
+    GdkRGBA color;
+    gtk_style_context_get_color(style, gtk_style_context_get_state(style), &color);
+    gtk_render_background(style, cr, 0, 0, width, height);
+    draw_grid(cr, color);
+
+    int level_x = plot_level(view.units_x), level_y = plot_level(view.units_y);
+    double span_x = PLOT_TILE_SIZE * plot_level_units(level_x);
+    double span_y = PLOT_TILE_SIZE * plot_level_units(level_y);
+    if (curve_count > 0) {
+        long long first_column = (long long)floor(view.plot_x(0) / span_x);
+        long long last_column = (long long)floor(view.plot_x(width) / span_x);
+        long long first_row = (long long)floor(view.plot_y(height) / span_y);
+        long long last_row = (long long)floor(view.plot_y(0) / span_y);
+        gint64 deadline = start + RENDER_BUDGET_US;
+        bool complete = true;
+        for (long long row = last_row; row >= first_row; row--) {
+            for (long long column = first_column; column <= last_column; column++) {
+                complete = paint_tile(cr, level_x, level_y, column, row, deadline) && complete;
+            }
+        }
+        // Tiles left over get the next frame
+        if (!complete) gtk_widget_queue_draw(area);
+    }
+    draw_legend(cr);
+
+    gint64 end = g_get_monotonic_time();
+    double elapsed = (end - start) / 1000.0;
+    draw_ms = draw_ms == 0 ? elapsed : draw_ms + SMOOTHING * (elapsed - draw_ms);
+    if (last_frame_start != 0) {
+        double interval = (start - last_frame_start) / 1000.0;
+        interval_ms = interval_ms == 0 ? interval : interval_ms + SMOOTHING * (interval - interval_ms);
+    }
+    last_frame_start = start;
+    if (show_frame_time) draw_frame_time(cr, color);
+}
+
+void PlotPanel::plot_entry_text() {
+    const char *text = gtk_entry_get_text(GTK_ENTRY(entry));
+    if (*text == '\0') return;
+    const char *error = NULL;
+    GtkStyleContext *style = gtk_widget_get_style_context(entry);
+    if (add_curve(text, &error)) {
+        gtk_entry_set_text(GTK_ENTRY(entry), "");
+        gtk_style_context_remove_class(style, "error");
+        gtk_widget_set_tooltip_text(entry, NULL);
+    } else {
+        gtk_style_context_add_class(style, "error");
+        gtk_widget_set_tooltip_text(entry, error);
+    }
+}
+
+gboolean PlotPanel::on_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    static_cast<PlotPanel*>(data)->draw(cr);
+    return FALSE;
+}
+
+gboolean PlotPanel::on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    PlotPanel *panel = static_cast<PlotPanel*>(data);
+    if (event->button != 1) return FALSE;
+    if (event->type == GDK_2BUTTON_PRESS) {
+        panel->reset_view();
+        gtk_widget_queue_draw(widget);
+        return TRUE;
+    }
+    panel->dragging = true;
+    panel->drag_x = event->x;
+    panel->drag_y = event->y;
+    return TRUE;
+}
+
+gboolean PlotPanel::on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    if (event->button == 1) static_cast<PlotPanel*>(data)->dragging = false;
+    return TRUE;
+}
+
+// Motion events only move the view; the redraw they queue happens once
+// per frame however many arrive
+gboolean PlotPanel::on_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+    PlotPanel *panel = static_cast<PlotPanel*>(data);
+    if (!panel->dragging) return FALSE;
+    panel->view.center_x -= (event->x - panel->drag_x) * panel->view.units_x;
+    panel->view.center_y += (event->y - panel->drag_y) * panel->view.units_y;
+    panel->drag_x = event->x;
+    panel->drag_y = event->y;
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+gboolean PlotPanel::on_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    PlotPanel *panel = static_cast<PlotPanel*>(data);
+    double notches = 0;
+    if (event->direction == GDK_SCROLL_UP) notches = -1;
+    else if (event->direction == GDK_SCROLL_DOWN) notches = 1;
+    else if (event->direction == GDK_SCROLL_SMOOTH) notches = event->delta_y;
+    double factor = pow(ZOOM_STEP, notches);
+    double units = panel->view.units_x * factor;
+    if (notches == 0 || units < MIN_UNITS || units > MAX_UNITS) return TRUE;
+    panel->view.zoom(factor, event->x, event->y);
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+void PlotPanel::on_plot_clicked(GtkWidget *widget, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    static_cast<PlotPanel*>(data)->plot_entry_text();
+}
+
+void PlotPanel::on_clear_clicked(GtkWidget *widget, gpointer data) {
+    (void)widget;  // Suppress unused parameter warning
+    static_cast<PlotPanel*>(data)->clear_curves();
+}
@@ -0,0 +1,91 @@
+#ifndef CALC_PLOTPANEL_H
+#define CALC_PLOTPANEL_H
+
+#include <gtk/gtk.h>
+#include <vector>
+#include "calc_plot.h"
+
+const int PLOT_MAX_CURVES = 6;
+
+// View → Plot: an entry for y = f(x) and a GtkDrawingArea with up to
+// PLOT_MAX_CURVES curves. Drag to pan, scroll to zoom, double-click to go
+// back to x from -10 to 10.
+//
+// Curves are stroked into tile surfaces on the grid from calc_plot.h and
+// kept, so a frame is mostly painting cached tiles; only tiles a pan
+// uncovers, or a zoom past a factor of two, are drawn again, and their
+// samples come from each PlotCurve's own cache. New tiles get a time
+// budget per frame; the rest show their parent tile enlarged until a
+// later frame gets to them. With G_MESSAGES_DEBUG set the panel shows how
+// long each frame took.
+class PlotPanel {
+private:
+    struct Tile {
+        int level_x, level_y;
+        long long column, row;
+        unsigned long last_use;
+        cairo_surface_t *surface;
+    };
+
+    GtkWidget *box;
+    GtkWidget *entry;
+    GtkWidget *area;
+
+    PlotCurve curves[PLOT_MAX_CURVES];
+    int curve_count;
+    PlotViewport view;
+    bool view_placed; // Centred once the area has a size
+
+    std::vector<Tile> tiles; // Least recently used is freed first
+    unsigned long frame_count;
+
+    bool dragging;
+    double drag_x, drag_y;
+
+    // Debug overlay and the g_debug summary
+    bool show_frame_time;
+    gint64 last_frame_start;
+    double draw_ms;     // Smoothed time spent in the draw handler
+    double interval_ms; // Smoothed time between frames
+    unsigned long tiles_rendered;
+    unsigned long tiles_deferred;
+
+    void reset_view();
+    void clear_tiles();
+    Tile *find_tile(int level_x, int level_y, long long column, long long row);
+    Tile *render_tile(int level_x, int level_y, long long column, long long row);
+    void stroke_curve(cairo_t *cr, PlotCurve &curve, int level_x, int level_y, long long column, long long row);
+    bool paint_tile(cairo_t *cr, int level_x, int level_y, long long column, long long row, gint64 deadline);
+    void draw_grid(cairo_t *cr, const GdkRGBA &color);
+    void draw_legend(cairo_t *cr);
+    void draw_frame_time(cairo_t *cr, const GdkRGBA &color);
+    void draw(cairo_t *cr);
+    void plot_entry_text();
+
+    static gboolean on_draw(GtkWidget *widget, cairo_t *cr, gpointer data);
+    static gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data);
+    static gboolean on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data);
+    static gboolean on_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data);
+    static gboolean on_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data);
+    static void on_plot_clicked(GtkWidget *widget, gpointer data);
+    static void on_clear_clicked(GtkWidget *widget, gpointer data);
+
+public:
+    PlotPanel();
+    ~PlotPanel();
+
+    // Builds the widgets; the returned box is for the caller to pack
+    GtkWidget *create();
+
+    // Adds y = expression; false with *error set if it does not compile
+    // or every curve slot is taken
+    bool add_curve(const char *expression, const char **error);
+    void clear_curves();
+
+    // Summary for the g_debug line at exit
+    unsigned long frames() const { return frame_count; }
+    unsigned long rendered_tiles() const { return tiles_rendered; }
+    PlotSampleStats sample_stats() const;
+};
+
+#endif // CALC_PLOTPANEL_H
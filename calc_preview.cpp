@@ -0,0 +1,306 @@
+#include "calc_preview.h"
+#include "calc_registers.h"
+#include "calc_special.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Tokens read between looks at the clock
+const size_t CLOCK_INTERVAL = 8;
+
+// Prefix operators take an operand of this precedence, as in
+// ExprCompiler::parse_unary; functions of a primary give way to anything
+const int PREFIX_OPERAND = PREC_COUNT;
+const int FUNCTION_OPERAND = PREC_POW + 1;
+
+// The VM's binary arithmetic, with its failures
+bool apply_binary(unsigned char op, double a, double b, double *result) {
+    switch (op) {
+        case OP_ADD:
+            *result = a + b;
+            return true;
+        case OP_SUB:
+            *result = a - b;
+            return true;
+        case OP_MUL:
+            *result = a * b;
+            return true;
+        case OP_DIV:
+            if (b == 0) return false;
+            *result = a / b;
+            return true;
+        case OP_POW:
+            *result = pow(a, b);
+            return true;
+        case OP_NCR:
+            return combinations(a, b, result) == EVAL_OK;
+        case OP_NPR:
+            return permutations(a, b, result) == EVAL_OK;
+    }
+    return false;
+}
+
+// Precedence and opcode of a binary operator token; false for others
+bool binary_operator(TokenType type, int *precedence, unsigned char *op) {
+    switch (type) {
+        case TOK_PLUS:
+            *precedence = PREC_ADD;
+            *op = OP_ADD;
+            return true;
+        case TOK_MINUS:
+            *precedence = PREC_ADD;
+            *op = OP_SUB;
+            return true;
+        case TOK_MULTIPLY:
+            *precedence = PREC_MUL;
+            *op = OP_MUL;
+            return true;
+        case TOK_DIVIDE:
+            *precedence = PREC_MUL;
+            *op = OP_DIV;
+            return true;
+        case TOK_COMBINATION:
+            *precedence = PREC_COUNT;
+            *op = OP_NCR;
+            return true;
+        case TOK_PERMUTATION:
+            *precedence = PREC_COUNT;
+            *op = OP_NPR;
+            return true;
+        case TOK_POWER:
+            *precedence = PREC_POW;
+            *op = OP_POW;
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+ExprPreview::ExprPreview() :
+    registers(NULL),
+    registers_version(0),
+    angle_unit(ANGLE_DEGREES),
+    valid(0),
+    first_name(SIZE_MAX),
+    ready(false),
+    ready_count(0),
+    reads(0) {
+    State start = {-1, -1, 0, 0, true, false, -1};
+    states.push_back(start);
+}
+
+void ExprPreview::set_angle_unit(AngleUnit unit) {
+    if (unit == angle_unit) return;
+    angle_unit = unit;
+    changed(0);
+}
+
+void ExprPreview::changed(size_t index) {
+    if (index < valid) valid = index;
+    ready = false;
+}
+
+bool ExprPreview::update(const Token *tokens, size_t count, double seconds) {
+    ready = false;
+    if (registers && registers->version() != registers_version) {
+        registers_version = registers->version();
+        if (first_name != SIZE_MAX) changed(first_name);
+    }
+    if (valid > count) valid = count;
+    if (first_name >= valid) first_name = SIZE_MAX;
+    // Nodes made after checkpoint `valid` belong to the tokens being re-read
+    values.resize(states[valid].values_used);
+    ops.resize(states[valid].ops_used);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t done = 0; valid < count; done++) {
+        if (done && done % CLOCK_INTERVAL == 0 &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > seconds) {
+            return false;
+        }
+        State s = states[valid];
+        read(s, tokens[valid], valid ? &tokens[valid - 1] : NULL, valid);
+        s.values_used = values.size();
+        s.ops_used = ops.size();
+        if (states.size() == valid + 1) {
+            states.push_back(s);
+        } else {
+            states[valid + 1] = s;
+        }
+        valid++;
+        reads++;
+    }
+    ready = true;
+    ready_count = count;
+    return true;
+}
+
+bool ExprPreview::value(double *result) const {
+    if (!ready) return false;
+    const State &end = states[ready_count];
+    if (end.failed || end.complete < 0) return false;
+    // Apply what is still waiting, innermost first, as the closing
+    // brackets and the end of the expression would
+    const State &s = states[end.complete];
+    if (s.value < 0) return false;
+    double top = values[s.value].value;
+    int rest = values[s.value].below;
+    for (int o = s.op; o >= 0; o = ops[o].below) {
+        const OpNode &node = ops[o];
+        switch (node.kind) {
+            case PENDING_BINARY: {
+                if (rest < 0) return false;
+                double left = values[rest].value;
+                rest = values[rest].below;
+                if (!apply_binary(node.op, left, top, &top)) return false;
+                break;
+            }
+            case PENDING_SIGN:
+                top = -top;
+                break;
+            case PENDING_FUNCTION:
+            case PENDING_SIGNED:
+                if (apply_unary(node.op, top, &top, angle_unit) != EVAL_OK) return false;
+                break;
+            case PENDING_PLUS:
+            case PENDING_BRACKET:
+                break;
+        }
+    }
+    *result = top;
+    return true;
+}
+
+void ExprPreview::push_value(State &s, double value) {
+    ValueNode node = {value, s.value};
+    values.push_back(node);
+    s.value = (int)values.size() - 1;
+}
+
+void ExprPreview::push_op(State &s, Pending kind, unsigned char op, int right) {
+    OpNode node = {kind, op, right, s.op};
+    ops.push_back(node);
+    s.op = (int)ops.size() - 1;
+}
+
+// Apply the operator on top to the values on top
+bool ExprPreview::reduce(State &s) {
+    const OpNode node = ops[s.op];
+    s.op = node.below;
+    if (node.kind == PENDING_PLUS || node.kind == PENDING_BRACKET) return true;
+    if (s.value < 0) return false;
+    double top = values[s.value].value;
+    s.value = values[s.value].below;
+    double result;
+    if (node.kind == PENDING_BINARY) {
+        if (s.value < 0) return false;
+        double left = values[s.value].value;
+        s.value = values[s.value].below;
+        if (!apply_binary(node.op, left, top, &result)) return false;
+    } else if (node.kind == PENDING_SIGN) {
+        result = -top;
+    } else if (apply_unary(node.op, top, &result, angle_unit) != EVAL_OK) {
+        return false;
+    }
+    push_value(s, result);
+    return true;
+}
+
+// Before an operator of `precedence`: finish every operand that ends
+// there, back to the innermost open bracket
+bool ExprPreview::reduce_above(State &s, int precedence) {
+    while (s.op >= 0 && ops[s.op].kind != PENDING_BRACKET && ops[s.op].right > precedence) {
+        if (!reduce(s)) return false;
+    }
+    return true;
+}
+
+// A primary just ended: apply the functions waiting for it (sin cos 30)
+bool ExprPreview::reduce_functions(State &s) {
+    while (s.op >= 0 && ops[s.op].kind == PENDING_FUNCTION) {
+        if (!reduce(s)) return false;
+    }
+    return true;
+}
+
+// tok where an operand is expected, as ExprCompiler::parse_unary and
+// parse_primary read it
+bool ExprPreview::operand(State &s, const Token &tok, const Token *previous, size_t index) {
+    // A function takes a signed operand whole (sin -30^2), anything else
+    // as a primary
+    bool after_function = previous && previous->type == TOK_FUNCTION;
+    switch (tok.type) {
+        case TOK_NUMBER:
+        case TOK_CONSTANT:
+            push_value(s, tok.value);
+            s.expecting = false;
+            return reduce_functions(s);
+        case TOK_NAME:
+            if (!registers || !registers->is_defined(tok.symbol)) return false;
+            push_value(s, registers->value(tok.symbol));
+            if (index < first_name) first_name = index;
+            s.expecting = false;
+            return reduce_functions(s);
+        case TOK_LPAREN:
+            push_op(s, PENDING_BRACKET, 0, PREC_ADD);
+            return true;
+        case TOK_FUNCTION:
+            push_op(s, PENDING_FUNCTION, tok.op, FUNCTION_OPERAND);
+            return true;
+        case TOK_MINUS:
+            if (after_function) {
+                unsigned char function = ops[s.op].op;
+                s.op = ops[s.op].below;
+                push_op(s, PENDING_SIGNED, function, PREFIX_OPERAND);
+            }
+            push_op(s, PENDING_SIGN, OP_NEG, PREFIX_OPERAND);
+            return true;
+        case TOK_PLUS:
+            if (after_function) return false;
+            push_op(s, PENDING_PLUS, 0, PREFIX_OPERAND);
+            return true;
+        default:
+            return false; // x has no value here; operators need an operand first
+    }
+}
+
+// Advance s over tokens[index] = tok
+void ExprPreview::read(State &s, const Token &tok, const Token *previous, size_t index) {
+    if (s.failed) return;
+    bool ok;
+    int precedence;
+    unsigned char op;
+    if (s.expecting) {
+        ok = operand(s, tok, previous, index);
+    } else if (binary_operator(tok.type, &precedence, &op)) {
+        ok = reduce_above(s, precedence);
+        push_op(s, PENDING_BINARY, op, op == OP_POW ? precedence : precedence + 1);
+        s.expecting = true;
+    } else if (tok.type == TOK_PERCENT || tok.type == TOK_FACTORIAL || tok.type == TOK_SQUARE) {
+        unsigned char postfix = tok.type == TOK_PERCENT ? OP_PERCENT : tok.type == TOK_FACTORIAL ? OP_FACTORIAL : OP_SQUARE;
+        double result;
+        ok = apply_unary(postfix, values[s.value].value, &result, angle_unit) == EVAL_OK;
+        s.value = values[s.value].below;
+        push_value(s, result);
+    } else if (tok.type == TOK_RPAREN) {
+        ok = reduce_above(s, PREC_ADD - 1);
+        if (ok && s.op >= 0) {
+            s.op = ops[s.op].below; // The bracket
+            ok = reduce_functions(s);
+        } else {
+            ok = false; // Unbalanced
+        }
+    } else {
+        // An operand straight after one multiplies it: 2π, 3(4+1)
+        ok = reduce_above(s, PREC_MUL);
+        push_op(s, PENDING_BINARY, OP_MUL, PREC_MUL + 1);
+        s.expecting = true;
+        ok = ok && operand(s, tok, previous, index);
+    }
+    s.failed = !ok;
+    if (ok && !s.expecting) s.complete = (int)index + 1;
+}
@@ -0,0 +1,118 @@
+#ifndef CALC_PREVIEW_H
+#define CALC_PREVIEW_H
+
+#include <cstddef>
+#include <vector>
+#include "calc_expr.h"
+
+class Registers;
+
+enum PreviewStatus {
+    PREVIEW_NONE,
+    PREVIEW_READY,
+    PREVIEW_PENDING
+};
+
+// Live value of a token expression while it is being typed, for the line
+// under the keypad display.
+//
+// Compiling and running the whole expression on every keystroke costs
+// time in proportion to its length. Instead the tokens are read left to
+// right by an operator-precedence evaluator with the same grammar as
+// ExprCompiler, and its state after every token is kept as a checkpoint:
+// the value stack and the operators still waiting for their right operand.
+// Both stacks are linked lists in append-only pools, so a checkpoint is a
+// pair of indexes and saving one copies nothing. An edit at token i rolls
+// back to checkpoint i and reads only the tokens from there, so typing a
+// digit, an operator or a bracket at the end costs the same however long
+// the expression is; so does reading off the value, which only applies
+// the waiting operators.
+//
+// Operators are applied as soon as precedence allows, with the VM's
+// arithmetic, so where the expression compiles and runs the value is the
+// one "=" would give, to the bit.
+class ExprPreview {
+public:
+    ExprPreview();
+
+    // Registers that names are read from; values changed since the last
+    // update are read again
+    void set_registers(const Registers *r) { registers = r; }
+
+    // Unit for sin, cos and tan; a change re-reads every token
+    void set_angle_unit(AngleUnit unit);
+
+    // Tokens from index on have been replaced, inserted or removed since
+    // the last update. Tokens past the end need no call: shortening the
+    // expression is seen by update.
+    void changed(size_t index);
+
+    // Read tokens[0..count) as far as the last update left off, giving up
+    // after `seconds` of work. True when every token has been read; false
+    // leaves the rest for the next call.
+    bool update(const Token *tokens, size_t count, double seconds);
+
+    // Value of tokens[0..count) from the last complete update, with open
+    // brackets closed and a trailing operator, bracket or function that
+    // has no operand yet left out. False if no operand has been typed, the
+    // tokens are not a valid expression, or evaluating them fails.
+    bool value(double *result) const;
+
+    // Tokens read by updates since construction, for benchmarks
+    unsigned long long tokens_read() const { return reads; }
+
+private:
+    enum Pending {
+        PENDING_BINARY,    // op of the two values on top
+        PENDING_SIGN,      // Prefix minus
+        PENDING_PLUS,      // Prefix plus, no-op but binds like minus
+        PENDING_FUNCTION,  // Function of the next primary (sin 30, sin(…))
+        PENDING_SIGNED,    // Function of a signed operand (sin -30)
+        PENDING_BRACKET
+    };
+
+    struct ValueNode {
+        double value;
+        int below; // -1 at the bottom
+    };
+
+    struct OpNode {
+        Pending kind;
+        unsigned char op;
+        int right; // Least precedence its right operand goes on through
+        int below;
+    };
+
+    // Evaluator state after some prefix of the tokens
+    struct State {
+        int value;          // Top ValueNode, -1 if none
+        int op;             // Top OpNode, -1 if none
+        size_t values_used; // Pool sizes, to roll back to
+        size_t ops_used;
+        bool expecting;     // An operand comes next
+        bool failed;        // Not valid, or evaluating failed
+        int complete;       // Last checkpoint at or before this one that ended an operand; -1 if none
+    };
+
+    const Registers *registers;
+    unsigned long registers_version;
+    AngleUnit angle_unit;
+    std::vector<ValueNode> values;
+    std::vector<OpNode> ops;
+    std::vector<State> states; // states[i] is after tokens[0..i)
+    size_t valid;              // states[0..valid] are up to date
+    size_t first_name;         // First token read from a register; SIZE_MAX if none
+    bool ready;                // states[ready_count] is the last complete update
+    size_t ready_count;
+    unsigned long long reads;
+
+    void push_value(State &s, double value);
+    void push_op(State &s, Pending kind, unsigned char op, int right);
+    bool reduce(State &s);
+    bool reduce_above(State &s, int precedence);
+    bool reduce_functions(State &s);
+    bool operand(State &s, const Token &tok, const Token *previous, size_t index);
+    void read(State &s, const Token &tok, const Token *previous, size_t index);
+};
+
+#endif // CALC_PREVIEW_H
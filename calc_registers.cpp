@@ -0,0 +1,244 @@
+#include "calc_registers.h"
+#include "calc_expr.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = {'C', 'A', 'L', 'C', 'R', 'E', 'G', '1'};
+const size_t HEADER_SIZE = 16;        // Magic, count, checksum
+const size_t RECORD_HEADER_SIZE = 11; // Name length, exact length, value
+const size_t MIN_TABLE = 64;
+
+uint32_t fnv1a(const unsigned char *data, size_t n, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t name_hash(const char *name, size_t len) {
+    return fnv1a(reinterpret_cast<const unsigned char *>(name), len);
+}
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool is_name_char(char c) {
+    return is_alpha(c) || (c >= '0' && c <= '9') || c == '_';
+}
+
+void put_bytes(std::string &out, const void *data, size_t n) {
+    out.append(static_cast<const char *>(data), n);
+}
+
+} // namespace
+
+Registers::Registers() : table(MIN_TABLE, 0), changes(0) {}
+
+// Table slot holding name, or the empty slot where it would go
+size_t Registers::probe(const char *name, size_t len, uint32_t hash) const {
+    size_t mask = table.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t entry = table[i];
+        if (entry == 0) return i;
+        SymbolId id = entry - 1;
+        if (hashes[id] == hash && strlen(this->name(id)) == len && memcmp(this->name(id), name, len) == 0) {
+            return i;
+        }
+    }
+}
+
+// Doubles the table, keeping it at most half full
+void Registers::grow() {
+    table.assign(table.size() * 2, 0);
+    size_t mask = table.size() - 1;
+    for (SymbolId id = 0; id < hashes.size(); id++) {
+        size_t i = hashes[id] & mask;
+        while (table[i] != 0) i = (i + 1) & mask;
+        table[i] = id + 1;
+    }
+}
+
+SymbolId Registers::intern(const char *name, size_t len) {
+    uint32_t hash = name_hash(name, len);
+    size_t slot = probe(name, len, hash);
+    if (table[slot] != 0) return table[slot] - 1;
+
+    SymbolId id = (SymbolId)values.size();
+    name_start.push_back((uint32_t)names.size());
+    names.append(name, len);
+    names.push_back('\0');
+    hashes.push_back(hash);
+    values.push_back(NAN);
+    defined.push_back(0);
+    exact.push_back(std::string());
+    table[slot] = id + 1;
+    if (values.size() * 2 > table.size()) grow();
+    return id;
+}
+
+SymbolId Registers::find(const char *name, size_t len) const {
+    uint32_t entry = table[probe(name, len, name_hash(name, len))];
+    return entry == 0 ? NO_SYMBOL : entry - 1;
+}
+
+void Registers::set(SymbolId id, double value, const char *exact_text) {
+    values[id] = value;
+    defined[id] = 1;
+    if (exact_text) {
+        exact[id] = exact_text;
+    } else {
+        exact[id].clear();
+    }
+    changes++;
+}
+
+// Ids stay allocated, so programs compiled against the name still run
+void Registers::remove(SymbolId id) {
+    values[id] = NAN;
+    defined[id] = 0;
+    exact[id].clear();
+    changes++;
+}
+
+void Registers::clear() {
+    for (SymbolId id = 0; id < values.size(); id++) {
+        if (defined[id]) remove(id);
+    }
+}
+
+bool Registers::valid_name(const char *name, size_t len) {
+    if (len == 0 || len > MAX_NAME_LENGTH || !is_alpha(name[0])) return false;
+    for (size_t i = 1; i < len; i++) {
+        if (!is_name_char(name[i])) return false;
+    }
+    return !is_builtin_name(name, len);
+}
+
+size_t parse_assignment(const char *line, size_t len, size_t *expression) {
+    size_t i = 0;
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    size_t start = i;
+    while (i < len && is_name_char(line[i])) i++;
+    size_t name_len = i - start;
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    if (i == len || line[i] != '=' || !Registers::valid_name(line + start, name_len)) return 0;
+    *expression = i + 1;
+    return name_len;
+}
+
+// Snapshot: magic, u32 count, u32 FNV-1a of the records, then per defined
+// register u8 name length, u16 exact length, f64 value, name, exact text
+bool Registers::save(const char *path) const {
+    std::string records;
+    uint32_t count = 0;
+    for (SymbolId id = 0; id < values.size(); id++) {
+        if (!defined[id]) continue;
+        const char *n = name(id);
+        unsigned char name_len = (unsigned char)strlen(n);
+        uint16_t exact_len = exact[id].size() <= 0xFFFF ? (uint16_t)exact[id].size() : 0;
+        put_bytes(records, &name_len, 1);
+        put_bytes(records, &exact_len, 2);
+        put_bytes(records, &values[id], 8);
+        put_bytes(records, n, name_len);
+        put_bytes(records, exact[id].data(), exact_len);
+        count++;
+    }
+    uint32_t checksum = fnv1a(reinterpret_cast<const unsigned char *>(records.data()), records.size());
+
+    std::string temp = std::string(path) + ".tmp";
+    FILE *f = fopen(temp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(MAGIC, 1, sizeof(MAGIC), f) == sizeof(MAGIC) && fwrite(&count, 4, 1, f) == 1 &&
+              fwrite(&checksum, 4, 1, f) == 1 && fwrite(records.data(), 1, records.size(), f) == records.size();
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    if (ok) ::remove(path); // rename() does not replace there
+#endif
+    if (!ok || rename(temp.c_str(), path) != 0) {
+        ::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Registers::load(const char *path) {
+    std::vector<unsigned char> copy;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)HEADER_SIZE) {
+        size = (size_t)st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    data = static_cast<const unsigned char *>(map);
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    unsigned char block[4096];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0) copy.insert(copy.end(), block, block + n);
+    fclose(f);
+    if (copy.size() < HEADER_SIZE) return false;
+    data = copy.data();
+    size = copy.size();
+#endif
+
+    // Check everything before changing anything
+    uint32_t count, checksum;
+    memcpy(&count, data + 8, 4);
+    memcpy(&checksum, data + 12, 4);
+    bool ok = memcmp(data, MAGIC, sizeof(MAGIC)) == 0 &&
+              fnv1a(data + HEADER_SIZE, size - HEADER_SIZE) == checksum;
+    size_t offset = HEADER_SIZE;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        if (size - offset < RECORD_HEADER_SIZE) {
+            ok = false;
+            break;
+        }
+        uint16_t exact_len;
+        memcpy(&exact_len, data + offset + 1, 2);
+        size_t record = RECORD_HEADER_SIZE + data[offset] + exact_len;
+        ok = size - offset >= record && valid_name(reinterpret_cast<const char *>(data) + offset + RECORD_HEADER_SIZE,
+                                                   data[offset]);
+        offset += record;
+    }
+    ok = ok && offset == size;
+
+    if (ok) {
+        clear();
+        offset = HEADER_SIZE;
+        std::string text;
+        for (uint32_t i = 0; i < count; i++) {
+            const char *name = reinterpret_cast<const char *>(data) + offset + RECORD_HEADER_SIZE;
+            size_t name_len = data[offset];
+            uint16_t exact_len;
+            double value;
+            memcpy(&exact_len, data + offset + 1, 2);
+            memcpy(&value, data + offset + 3, 8);
+            text.assign(name + name_len, exact_len);
+            set(intern(name, name_len), value, exact_len ? text.c_str() : NULL);
+            offset += RECORD_HEADER_SIZE + name_len + exact_len;
+        }
+    }
+#ifndef _WIN32
+    munmap(const_cast<unsigned char *>(data), size);
+#endif
+    (void)copy;
+    return ok;
+}
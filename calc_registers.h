@@ -0,0 +1,73 @@
+#ifndef CALC_REGISTERS_H
+#define CALC_REGISTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Named registers: memory slots M1…M10, "ans" and whatever names the user
+// stores values under ("rate", "x1"). Names are interned once into dense
+// ids through a flat open-addressing table; compiled programs carry the
+// ids, so evaluating "rate×12" indexes an array and never hashes.
+//
+// The registers persist in a small snapshot file, written whole to a
+// temporary file and renamed over the old one, and memory-mapped to read.
+
+typedef uint32_t SymbolId;
+const SymbolId NO_SYMBOL = 0xFFFFFFFFu;
+
+const size_t MEMORY_SLOTS = 10;
+const size_t MAX_NAME_LENGTH = 32;
+
+class Registers {
+private:
+    std::string names;                // Every name, each followed by a NUL
+    std::vector<uint32_t> name_start; // By id
+    std::vector<uint32_t> hashes;     // By id
+    std::vector<uint32_t> table;      // id + 1, or 0 for an empty slot
+    std::vector<double> values;       // By id; NaN while undefined
+    std::vector<unsigned char> defined;
+    std::vector<std::string> exact;   // Exact decimal text from precision mode, or empty
+    unsigned long changes;
+
+    size_t probe(const char *name, size_t len, uint32_t hash) const;
+    void grow();
+
+public:
+    Registers();
+
+    // Id for a name, adding it (undefined) if new
+    SymbolId intern(const char *name, size_t len);
+    // Id for a known name, or NO_SYMBOL; never adds
+    SymbolId find(const char *name, size_t len) const;
+
+    size_t size() const { return values.size(); }
+    const char *name(SymbolId id) const { return names.c_str() + name_start[id]; }
+    bool is_defined(SymbolId id) const { return defined[id] != 0; }
+    double value(SymbolId id) const { return values[id]; }
+    const std::string &exact_text(SymbolId id) const { return exact[id]; }
+
+    // Sets a value; exact_text, if given, is its full decimal form for
+    // precision mode. Does not allocate without exact_text.
+    void set(SymbolId id, double value, const char *exact_text = NULL);
+    void remove(SymbolId id);
+    void clear();
+
+    // Bumped by every change, for callers deciding when to save
+    unsigned long version() const { return changes; }
+
+    // A letter, then letters, digits or '_', and not a built-in name
+    static bool valid_name(const char *name, size_t len);
+
+    // Replaces the defined registers with a snapshot's; false, leaving
+    // them alone, if the file is missing or damaged
+    bool load(const char *path);
+    bool save(const char *path) const;
+};
+
+// "name = expression": the length of name, with *expression set to where
+// the expression starts, or 0 if line is not an assignment
+size_t parse_assignment(const char *line, size_t len, size_t *expression);
+
+#endif // CALC_REGISTERS_H
@@ -0,0 +1,434 @@
+#include "calc_server.h"
+#include "calc_batch.h"
+#include "calc_bignum.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t READ_CHUNK = 65536;
+const size_t READS_PER_WAKEUP = 16;        // Then other connections get a turn
+const size_t MAX_IN_FLIGHT = 1024;         // Requests queued per connection before reading pauses
+const size_t MAX_PENDING_OUTPUT = 4 << 20; // Reply bytes a slow reader may leave unread
+const size_t HEADER_SIZE = 8;              // id and digits, or the reply's length and id
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+uint32_t get_u32(const char *p) {
+    const unsigned char *b = (const unsigned char *)p;
+    return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+void put_u32(char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (char)(value >> (8 * i));
+}
+
+} // namespace
+
+struct EvalServer::Connection {
+    int fd;
+    std::string input; // Unparsed bytes; I/O thread only
+    bool read_closed;  // Peer finished sending; I/O thread only
+    std::mutex lock;   // Guards output
+    std::string output;
+    std::atomic<bool> dead; // Closed or failed; replies are dropped
+    std::atomic<size_t> in_flight;
+
+    explicit Connection(int f) : fd(f), read_closed(false), dead(false), in_flight(0) {}
+    // Workers may still hold a reply for it, so the descriptor is closed
+    // only when the last reference goes
+    ~Connection() {
+#ifndef _WIN32
+        close(fd);
+#endif
+    }
+};
+
+struct EvalServer::Job {
+    ConnectionPtr conn;
+    uint32_t id;
+    uint32_t digits;
+    std::string text;
+};
+
+struct EvalServer::Worker {
+    std::mutex lock; // Guards jobs
+    std::deque<Job *> jobs;
+    std::thread thread;
+    BatchEvaluator evaluator;
+    std::string reply; // Grows to the largest reply, then is reused
+};
+
+EvalServer::EvalServer()
+    : listen_fd(-1), stopping(false), next_worker(0), queued(0), request_count(0), expression_count(0),
+      connection_count(0), wake_pending(false) {
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+EvalServer::~EvalServer() {
+    stop();
+}
+
+#ifndef _WIN32
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+// Writes as much as the socket takes now; false if it failed for good
+static bool send_some(int fd, const char *data, size_t len, size_t *sent) {
+    *sent = 0;
+    while (*sent < len) {
+        ssize_t n = send(fd, data + *sent, len - *sent, SEND_FLAGS);
+        if (n > 0) {
+            *sent += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+bool EvalServer::start(const char *path, size_t threads) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return false;
+    }
+    // A socket file nobody answers on is left over from an earlier run
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "%s: already being served\n", path);
+        close(fd);
+        return false;
+    }
+    if (errno == ECONNREFUSED) unlink(path);
+    close(fd);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        chmod(path, 0600) != 0 || listen(listen_fd, 128) != 0 || !set_nonblocking(listen_fd) ||
+        pipe(wake_pipe) != 0 || !set_nonblocking(wake_pipe[0]) || !set_nonblocking(wake_pipe[1])) {
+        perror(path);
+        if (listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    socket_path = path;
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    stopping = false;
+    for (size_t i = 0; i < threads; i++) workers.push_back(new Worker());
+    for (size_t i = 0; i < threads; i++) workers[i]->thread = std::thread(&EvalServer::work, this, i);
+    io_thread = std::thread(&EvalServer::io_loop, this);
+    return true;
+}
+
+void EvalServer::stop() {
+    if (listen_fd < 0) return;
+    stopping = true;
+    wake_io();
+    {
+        std::lock_guard<std::mutex> lock(idle_lock);
+    }
+    work_ready.notify_all();
+    io_thread.join();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->thread.join();
+        for (size_t j = 0; j < workers[i]->jobs.size(); j++) delete workers[i]->jobs[j];
+        delete workers[i];
+    }
+    workers.clear();
+    queued = 0;
+    connections.clear();
+    close(listen_fd);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    listen_fd = wake_pipe[0] = wake_pipe[1] = -1;
+    unlink(socket_path.c_str());
+}
+
+// At most one wakeup byte is outstanding however many workers finish
+void EvalServer::wake_io() {
+    if (wake_pending.exchange(true)) return;
+    char byte = 0;
+    if (write(wake_pipe[1], &byte, 1) < 0) wake_pending = false;
+}
+
+void EvalServer::io_loop() {
+    std::vector<struct pollfd> fds;
+    char drain[64];
+    while (!stopping) {
+        fds.clear();
+        struct pollfd wake = {wake_pipe[0], POLLIN, 0};
+        struct pollfd listener = {listen_fd, POLLIN, 0};
+        fds.push_back(wake);
+        fds.push_back(listener);
+        for (size_t i = 0; i < connections.size(); i++) {
+            Connection &conn = *connections[i];
+            short events = 0;
+            bool has_output;
+            {
+                std::lock_guard<std::mutex> lock(conn.lock);
+                has_output = !conn.output.empty();
+                if (conn.output.size() < MAX_PENDING_OUTPUT && !conn.read_closed && conn.in_flight < MAX_IN_FLIGHT) {
+                    events |= POLLIN;
+                }
+            }
+            if (has_output) events |= POLLOUT;
+            // Nothing to wait for: leave it out rather than spin on POLLHUP
+            struct pollfd pfd = {events ? conn.fd : -1, events, 0};
+            fds.push_back(pfd);
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (fds[0].revents) {
+            wake_pending = false;
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        size_t polled = connections.size();
+        if (fds[1].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+                if (!set_nonblocking(fd)) {
+                    close(fd);
+                    continue;
+                }
+                connections.push_back(ConnectionPtr(new Connection(fd)));
+                connection_count++;
+            }
+        }
+        for (size_t i = 0; i < polled; i++) {
+            const ConnectionPtr &conn = connections[i];
+            short revents = fds[i + 2].revents;
+            if (revents & (POLLERR | POLLNVAL)) {
+                conn->dead = true;
+                continue;
+            }
+            if ((revents & (POLLIN | POLLHUP)) && !read_requests(conn)) conn->dead = true;
+            if (revents & POLLOUT) flush_output(*conn);
+        }
+        // Drop connections that failed, or whose peer is done and has
+        // every reply
+        size_t kept = 0;
+        for (size_t i = 0; i < connections.size(); i++) {
+            Connection &conn = *connections[i];
+            bool finished = conn.dead;
+            if (!finished && conn.read_closed && conn.in_flight == 0) {
+                std::lock_guard<std::mutex> lock(conn.lock);
+                finished = conn.output.empty();
+            }
+            if (finished) {
+                conn.dead = true;
+            } else {
+                connections[kept++].swap(connections[i]);
+            }
+        }
+        connections.resize(kept);
+    }
+}
+
+// Reads what has arrived and queues each complete request. False for a
+// read error or a malformed frame.
+bool EvalServer::read_requests(const ConnectionPtr &conn) {
+    char buffer[READ_CHUNK];
+    for (size_t reads = 0; reads < READS_PER_WAKEUP; reads++) {
+        ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            conn->input.append(buffer, (size_t)n);
+            if ((size_t)n < sizeof(buffer)) break;
+        } else if (n == 0) {
+            conn->read_closed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    const std::string &input = conn->input;
+    size_t at = 0;
+    while (input.size() - at >= 4) {
+        uint32_t len = get_u32(input.data() + at);
+        if (len < HEADER_SIZE || len > MAX_REQUEST_SIZE) return false;
+        if (input.size() - at - 4 < len) break;
+        const char *frame = input.data() + at + 4;
+        Job *job = new Job();
+        job->conn = conn;
+        job->id = get_u32(frame);
+        job->digits = get_u32(frame + 4);
+        job->text.assign(frame + HEADER_SIZE, len - HEADER_SIZE);
+        conn->in_flight++;
+        submit(job);
+        at += 4 + len;
+    }
+    conn->input.erase(0, at);
+    return true;
+}
+
+void EvalServer::flush_output(Connection &conn) {
+    std::lock_guard<std::mutex> lock(conn.lock);
+    size_t sent;
+    if (!send_some(conn.fd, conn.output.data(), conn.output.size(), &sent)) conn.dead = true;
+    conn.output.erase(0, sent);
+}
+
+void EvalServer::submit(Job *job) {
+    Worker &worker = *workers[next_worker++ % workers.size()];
+    // Counted before it can be taken, so take() never drops queued below 0
+    {
+        std::lock_guard<std::mutex> lock(idle_lock);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        worker.jobs.push_back(job);
+    }
+    work_ready.notify_one();
+}
+
+// Oldest job of this worker's own queue, else the newest of another's
+EvalServer::Job *EvalServer::take(size_t self) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (victim.jobs.empty()) continue;
+        Job *job;
+        if (i == 0) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+        } else {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+        }
+        queued--;
+        return job;
+    }
+    return NULL;
+}
+
+void EvalServer::work(size_t self) {
+    while (!stopping) {
+        Job *job = take(self);
+        if (!job) {
+            std::unique_lock<std::mutex> lock(idle_lock);
+            work_ready.wait(lock, [this] { return stopping || queued > 0; });
+            continue;
+        }
+        evaluate(*workers[self], *job);
+        delete job;
+    }
+}
+
+void EvalServer::evaluate(Worker &worker, Job &job) {
+    std::string &reply = worker.reply;
+    reply.assign(HEADER_SIZE, '\0');
+    worker.evaluator.reset();
+    const char *line = job.text.data();
+    const char *end = line + job.text.size();
+    unsigned long lines = 0;
+    while (line < end) {
+        const char *newline = (const char *)memchr(line, '\n', end - line);
+        const char *line_end = newline ? newline : end;
+        if (job.digits > MAX_PRECISION_DIGITS) {
+            reply.append("Error\n", 6);
+        } else {
+            worker.evaluator.evaluate(line, line_end - line, job.digits, reply);
+        }
+        lines++;
+        line = newline ? newline + 1 : end;
+    }
+    put_u32(&reply[0], (uint32_t)(reply.size() - 4));
+    put_u32(&reply[4], job.id);
+    request_count++;
+    expression_count += lines;
+
+    // Send straight from this thread when nothing is waiting ahead of it
+    Connection &conn = *job.conn;
+    bool pending = false;
+    {
+        std::lock_guard<std::mutex> lock(conn.lock);
+        if (!conn.dead) {
+            size_t sent = 0;
+            if (conn.output.empty() && !send_some(conn.fd, reply.data(), reply.size(), &sent)) {
+                conn.dead = true;
+            } else {
+                conn.output.append(reply, sent, std::string::npos);
+            }
+            pending = !conn.output.empty();
+        }
+    }
+    size_t left = --conn.in_flight;
+    if (pending || left == 0 || left == MAX_IN_FLIGHT - 1) wake_io();
+}
+
+int run_server(const char *path, size_t threads) {
+    // Every thread inherits the mask, so only sigwait() sees these
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    EvalServer server;
+    if (!server.start(path, threads)) return 1;
+    fprintf(stderr, "Serving on %s with %zu evaluator threads\n", path, server.thread_count());
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server.stop();
+    fprintf(stderr, "%lu requests, %lu expressions, %lu connections\n", server.requests(), server.expressions(),
+            server.connections_accepted());
+    return 0;
+}
+
+#else
+
+bool EvalServer::start(const char *path, size_t threads) {
+    (void)threads;
+    fprintf(stderr, "%s: --serve needs Unix domain sockets\n", path);
+    return false;
+}
+
+void EvalServer::stop() {}
+
+int run_server(const char *path, size_t threads) {
+    EvalServer server;
+    return server.start(path, threads) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef CALC_SERVER_H
+#define CALC_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// calculator --serve: evaluates expressions for other programs over a Unix
+// domain socket, without a process per expression.
+//
+// Every message either way is a frame: a u32 length, then that many bytes.
+// A request is a u32 id, a u32 digit count (0 for double precision, as
+// --batch) and one or more expressions separated by '\n'. The reply is the
+// u32 id followed by one line per expression, exactly as --batch prints
+// it. The lines of a request are evaluated in order, so "r = 2\nr^10"
+// works; requests share nothing. A client may send any number of requests
+// without waiting for replies, which carry the request's id and can come
+// back in any order. Integers are little-endian.
+//
+// One thread does all socket I/O with poll(). Requests go to a pool of
+// evaluator threads, each with its own compiler, registers and reply
+// buffer reused from request to request. A thread takes work from the
+// front of its own queue and, when that is empty, steals from the back of
+// another's.
+
+const size_t MAX_REQUEST_SIZE = 1 << 20; // Larger frames close the connection
+
+class EvalServer {
+private:
+    struct Connection;
+    struct Job;
+    struct Worker;
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+
+    std::string socket_path;
+    int listen_fd;
+    int wake_pipe[2]; // Written to wake the I/O thread
+    std::thread io_thread;
+    std::vector<Worker *> workers;
+    std::vector<ConnectionPtr> connections; // Owned by the I/O thread
+    std::atomic<bool> stopping;
+    std::atomic<size_t> next_worker;
+
+    // Idle workers sleep here until something is queued
+    std::mutex idle_lock;
+    std::condition_variable work_ready;
+    std::atomic<size_t> queued; // Jobs submitted and not yet taken; counted before the push
+
+    std::atomic<unsigned long> request_count;
+    std::atomic<unsigned long> expression_count;
+    std::atomic<unsigned long> connection_count;
+    std::atomic<bool> wake_pending;
+
+    void io_loop();
+    bool read_requests(const ConnectionPtr &conn);
+    void flush_output(Connection &conn);
+    void submit(Job *job);
+    Job *take(size_t self);
+    void work(size_t self);
+    void evaluate(Worker &worker, Job &job);
+    void wake_io();
+
+    EvalServer(const EvalServer &);
+    EvalServer &operator=(const EvalServer &);
+
+public:
+    EvalServer();
+    ~EvalServer();
+
+    // Listens on path and starts `threads` evaluators, 0 for one per core.
+    // False with a message on stderr if the socket can't be set up.
+    bool start(const char *path, size_t threads);
+    // Closes every connection, joins the threads and removes the socket
+    void stop();
+    bool is_running() const { return listen_fd >= 0; }
+
+    size_t thread_count() const { return workers.size(); }
+    unsigned long requests() const { return request_count; }
+    unsigned long expressions() const { return expression_count; }
+    unsigned long connections_accepted() const { return connection_count; }
+};
+
+// Headless --serve: serves until SIGINT or SIGTERM, then prints totals on
+// stderr. Returns 0 on a clean shutdown.
+int run_server(const char *path, size_t threads);
+
+#endif // CALC_SERVER_H
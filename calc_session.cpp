@@ -0,0 +1,412 @@
+#include "calc_session.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const char MAGIC[8] = {'C', 'A', 'L', 'C', 'S', 'E', 'S', '1'};
+
+// Bytes below EV_SLOT are keypresses
+enum EventTag {
+    EV_SLOT = 0x80,  // u8 slot
+    EV_INSERT,       // name
+    EV_STORE,        // name
+    EV_RECALL,       // f64
+    EV_PRECISION,    // u32 digits
+    EV_DEFINE,       // name, f64 value, u32 length + exact text
+    EV_CHECK,        // u32 digest, u32 length + display, u32 length + history
+    EV_ANGLE         // u8 AngleUnit
+};
+
+static_assert((int)CMD_COUNT <= (int)EV_SLOT, "command IDs must fit below the event tags");
+
+const uint32_t DIGEST_START = 2166136261u;
+
+// FNV-1a over the display and history text, each followed by a NUL
+uint32_t fold_text(uint32_t digest, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text;; p++) {
+        digest = (digest ^ *p) * 16777619u;
+        if (*p == 0) return digest;
+    }
+}
+
+uint32_t fold_output(uint32_t digest, const CalcEngine &engine) {
+    return fold_text(fold_text(digest, engine.display_text()), engine.history_text());
+}
+
+bool same_text(const char *recorded, size_t len, const char *text) {
+    return strncmp(recorded, text, len) == 0 && text[len] == '\0';
+}
+
+// Bounds-checked reading of a session; ok() turns false past the end
+class Reader {
+private:
+    const unsigned char *at;
+    const unsigned char *end;
+    bool good;
+
+public:
+    Reader(const char *data, size_t len)
+        : at((const unsigned char *)data), end((const unsigned char *)data + len), good(true) {}
+
+    bool ok() const { return good; }
+    bool done() const { return at == end; }
+
+    const char *bytes(size_t len) {
+        if (!good || (size_t)(end - at) < len) {
+            good = false;
+            return NULL;
+        }
+        const char *p = (const char *)at;
+        at += len;
+        return p;
+    }
+    unsigned u8() {
+        const char *p = bytes(1);
+        return p ? (unsigned char)*p : 0;
+    }
+    uint32_t u32() {
+        const unsigned char *p = (const unsigned char *)bytes(4);
+        return p ? p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24 : 0;
+    }
+    double f64() {
+        const unsigned char *p = (const unsigned char *)bytes(8);
+        uint64_t bits = 0;
+        for (int i = 7; p && i >= 0; i--) bits = bits << 8 | p[i];
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    // u8 length + name, or u32 length + text
+    const char *name(size_t *len) {
+        *len = u8();
+        return bytes(*len);
+    }
+    const char *text(size_t *len) {
+        *len = u32();
+        return bytes(*len);
+    }
+};
+
+} // namespace
+
+SessionRecorder::~SessionRecorder() {
+    if (file) fclose(file);
+}
+
+void SessionRecorder::put(const void *bytes, size_t len) {
+    if (len && fwrite(bytes, 1, len, file) != len) failed = true;
+}
+
+void SessionRecorder::put_u16(unsigned value) {
+    unsigned char b[2] = {(unsigned char)value, (unsigned char)(value >> 8)};
+    put(b, 2);
+}
+
+void SessionRecorder::put_u32(uint32_t value) {
+    put_u16(value & 0xFFFF);
+    put_u16(value >> 16);
+}
+
+void SessionRecorder::put_f64(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32((uint32_t)bits);
+    put_u32((uint32_t)(bits >> 32));
+}
+
+void SessionRecorder::put_name(const char *name, size_t len) {
+    unsigned char n = (unsigned char)(len < MAX_NAME_LENGTH ? len : MAX_NAME_LENGTH);
+    put(&n, 1);
+    put(name, n);
+}
+
+void SessionRecorder::put_check(const CalcEngine &engine) {
+    unsigned char tag = EV_CHECK;
+    put(&tag, 1);
+    put_u32(digest);
+    const char *display = engine.display_text();
+    put_u32((uint32_t)strlen(display));
+    put(display, strlen(display));
+    const char *history = engine.history_text();
+    put_u32((uint32_t)strlen(history));
+    put(history, strlen(history));
+}
+
+// Every input event ends here, once the engine has handled it
+void SessionRecorder::recorded(const CalcEngine &engine) {
+    events++;
+    digest = fold_output(digest, engine);
+}
+
+bool SessionRecorder::open(const char *path, const CalcEngine &engine) {
+    file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    digest = DIGEST_START;
+    events = 0;
+    failed = false;
+    put(MAGIC, sizeof(MAGIC));
+
+    // The replay starts from a fresh engine, so carry over what the
+    // snapshot loaded and any mode already set
+    const Registers &registers = engine.variables();
+    for (SymbolId id = 0; id < registers.size(); id++) {
+        if (!registers.is_defined(id)) continue;
+        unsigned char tag = EV_DEFINE;
+        put(&tag, 1);
+        put_name(registers.name(id), strlen(registers.name(id)));
+        put_f64(registers.value(id));
+        const std::string &exact = registers.exact_text(id);
+        put_u32((uint32_t)exact.size());
+        put(exact.data(), exact.size());
+        recorded(engine);
+    }
+    if (engine.precision_digits()) set_precision(engine.precision_digits(), engine);
+    if (engine.angle_unit() != ANGLE_DEGREES) set_angle_unit(engine.angle_unit(), engine);
+    if (engine.memory_slot()) select_memory_slot(engine.memory_slot(), engine);
+    return !failed;
+}
+
+void SessionRecorder::press(Command command, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char byte = (unsigned char)command;
+    put(&byte, 1);
+    recorded(engine);
+    if (command == CMD_EQUALS) put_check(engine);
+}
+
+void SessionRecorder::select_memory_slot(size_t slot, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char b[2] = {EV_SLOT, (unsigned char)slot};
+    put(b, 2);
+    recorded(engine);
+}
+
+void SessionRecorder::insert_variable(SymbolId id, const CalcEngine &engine) {
+    if (!file) return;
+    const Registers &registers = engine.variables();
+    if (id >= registers.size()) return;
+    unsigned char tag = EV_INSERT;
+    put(&tag, 1);
+    put_name(registers.name(id), strlen(registers.name(id)));
+    recorded(engine);
+}
+
+void SessionRecorder::store_variable(const char *name, size_t len, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char tag = EV_STORE;
+    put(&tag, 1);
+    put_name(name, len);
+    recorded(engine);
+}
+
+void SessionRecorder::recall(double value, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char tag = EV_RECALL;
+    put(&tag, 1);
+    put_f64(value);
+    recorded(engine);
+}
+
+void SessionRecorder::set_precision(size_t digits, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char tag = EV_PRECISION;
+    put(&tag, 1);
+    put_u32((uint32_t)digits);
+    recorded(engine);
+}
+
+void SessionRecorder::set_angle_unit(AngleUnit unit, const CalcEngine &engine) {
+    if (!file) return;
+    unsigned char b[2] = {EV_ANGLE, (unsigned char)unit};
+    put(b, 2);
+    recorded(engine);
+}
+
+bool SessionRecorder::close(const CalcEngine &engine) {
+    if (!file) return true;
+    put_check(engine);
+    if (fclose(file) != 0) failed = true;
+    file = NULL;
+    return !failed;
+}
+
+bool Session::load(const char *path) {
+    data.clear();
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        load_error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    bool read_failed = ferror(f) != 0;
+    fclose(f);
+    if (read_failed) {
+        load_error = std::string(path) + ": read error";
+        return false;
+    }
+    return validate();
+}
+
+// Walks the events once so replay can trust the layout
+bool Session::validate() {
+    keystroke_count = 0;
+    event_count = 0;
+    if (data.size() < sizeof(MAGIC) || memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        load_error = "not a session file";
+        return false;
+    }
+    Reader in(data.data() + sizeof(MAGIC), data.size() - sizeof(MAGIC));
+    size_t len;
+    while (in.ok() && !in.done()) {
+        unsigned tag = in.u8();
+        if (tag < EV_SLOT) {
+            if (tag == CMD_NONE || tag >= CMD_COUNT) break;
+            keystroke_count++;
+            event_count++;
+            continue;
+        }
+        switch (tag) {
+            case EV_SLOT:
+                if (in.u8() >= MEMORY_SLOTS) tag = 0;
+                break;
+            case EV_INSERT:
+            case EV_STORE:
+                in.name(&len);
+                break;
+            case EV_RECALL:
+                in.f64();
+                break;
+            case EV_PRECISION:
+                if (in.u32() > MAX_PRECISION_DIGITS) tag = 0;
+                break;
+            case EV_ANGLE:
+                if (in.u8() > ANGLE_GRADIANS) tag = 0;
+                break;
+            case EV_DEFINE:
+                in.name(&len);
+                in.f64();
+                in.text(&len);
+                break;
+            case EV_CHECK:
+                in.u32();
+                in.text(&len);
+                in.text(&len);
+                break;
+            default:
+                tag = 0;
+        }
+        if (tag == 0) break;
+        if (tag != EV_CHECK) event_count++;
+    }
+    if (!in.ok() || !in.done()) {
+        load_error = "damaged session file";
+        return false;
+    }
+    return true;
+}
+
+bool Session::replay(CalcEngine &engine, bool verify, ReplayReport *report) const {
+    ReplayReport r = ReplayReport();
+    Reader in(data.data() + sizeof(MAGIC), data.size() - sizeof(MAGIC));
+    uint32_t digest = DIGEST_START;
+    std::string name;
+    size_t len;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (!in.done()) {
+        unsigned tag = in.u8();
+        if (tag < EV_SLOT) {
+            engine.press((Command)tag);
+            r.keystrokes++;
+        } else if (tag == EV_CHECK) {
+            uint32_t expected = in.u32();
+            size_t display_len, history_len;
+            const char *display = in.text(&display_len);
+            const char *history = in.text(&history_len);
+            r.checks++;
+            if (!verify) continue;
+            if (expected != digest || !same_text(display, display_len, engine.display_text()) ||
+                !same_text(history, history_len, engine.history_text())) {
+                if (r.mismatches++ == 0) {
+                    r.mismatch_event = r.events;
+                    r.expected_display.assign(display, display_len);
+                    r.expected_history.assign(history, history_len);
+                    r.actual_display = engine.display_text();
+                    r.actual_history = engine.history_text();
+                }
+                digest = expected; // Report later drift on its own
+            }
+            continue;
+        } else {
+            switch (tag) {
+                case EV_SLOT:
+                    engine.select_memory_slot(in.u8());
+                    break;
+                case EV_INSERT: {
+                    const char *p = in.name(&len);
+                    engine.insert_variable(engine.variables().find(p, len));
+                    break;
+                }
+                case EV_STORE: {
+                    const char *p = in.name(&len);
+                    engine.store_variable(p, len);
+                    break;
+                }
+                case EV_RECALL:
+                    engine.recall(in.f64());
+                    break;
+                case EV_PRECISION:
+                    engine.set_precision(in.u32());
+                    break;
+                case EV_ANGLE:
+                    engine.set_angle_unit((AngleUnit)in.u8());
+                    break;
+                case EV_DEFINE: {
+                    const char *p = in.name(&len);
+                    SymbolId id = engine.variables().intern(p, len);
+                    double value = in.f64();
+                    const char *exact = in.text(&len);
+                    name.assign(exact, len);
+                    engine.variables().set(id, value, len ? name.c_str() : NULL);
+                    break;
+                }
+            }
+        }
+        r.events++;
+        if (verify) digest = fold_output(digest, engine);
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (report) *report = r;
+    return r.mismatches == 0;
+}
+
+int replay_session(const char *path, unsigned long repeat, bool verify, FILE *out) {
+    Session session;
+    if (!session.load(path)) {
+        fprintf(stderr, "%s: %s\n", path, session.error());
+        return 1;
+    }
+    double seconds = 0;
+    ReplayReport report;
+    for (unsigned long i = 0; i < repeat; i++) {
+        CalcEngine engine;
+        session.replay(engine, verify, &report);
+        seconds += report.seconds;
+        if (report.mismatches) break;
+    }
+    double rate = seconds > 0 ? session.keystrokes() * (double)repeat / seconds : 0;
+    fprintf(out, "%s: %lu events, %lu keystrokes, %lu checks%s, %.0f keystrokes/s\n", path, report.events,
+            report.keystrokes, report.checks, verify ? "" : " (not verified)", rate);
+    if (report.mismatches == 0) return 0;
+    fprintf(out, "  %lu of %lu checks differ; first after event %lu\n", report.mismatches, report.checks,
+            report.mismatch_event);
+    fprintf(out, "  expected: %s | %s\n", report.expected_history.c_str(), report.expected_display.c_str());
+    fprintf(out, "  got:      %s | %s\n", report.actual_history.c_str(), report.actual_display.c_str());
+    return 1;
+}
@@ -0,0 +1,105 @@
+#ifndef CALC_SESSION_H
+#define CALC_SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "calc_engine.h"
+
+// Keypad sessions recorded to a file and replayed headless against
+// CalcEngine, for regression checks and as a load generator.
+//
+// A session file is "CALCSES1" followed by events. A keypress is one byte,
+// its command ID. Other engine inputs carry a tag byte and their operands:
+// memory slot, inserted or stored name, recalled value, precision, angle
+// unit, and at
+// the start the registers that were defined. After each "=" and at the
+// end a check event holds the display and history text and a digest of
+// the text after every event so far, so a replay that drifts between
+// checks is caught too. Numbers are little-endian.
+
+// Outcome of one replay. Without verification the engine never renders
+// text, so the time is the state machine alone.
+struct ReplayReport {
+    unsigned long events;
+    unsigned long keystrokes;
+    unsigned long checks;
+    unsigned long mismatches;
+    double seconds;
+    // First check that failed
+    unsigned long mismatch_event; // Events replayed before it
+    std::string expected_display, expected_history;
+    std::string actual_display, actual_history;
+};
+
+class SessionRecorder {
+private:
+    FILE *file;
+    uint32_t digest;
+    unsigned long events;
+    bool failed;
+
+    void put(const void *bytes, size_t len);
+    void put_u16(unsigned value);
+    void put_u32(uint32_t value);
+    void put_f64(double value);
+    void put_name(const char *name, size_t len);
+    void put_check(const CalcEngine &engine);
+    void recorded(const CalcEngine &engine);
+
+public:
+    SessionRecorder() : file(NULL), digest(0), events(0), failed(false) {}
+    ~SessionRecorder();
+
+    // Start a session file from the engine's current registers, memory
+    // slot, precision and angle unit; false with a message on stderr if it can't be
+    // created
+    bool open(const char *path, const CalcEngine &engine);
+    bool is_open() const { return file != NULL; }
+    unsigned long event_count() const { return events; }
+
+    // Call after the engine has handled the input. Each returns at once
+    // when no session is open.
+    void press(Command command, const CalcEngine &engine);
+    void select_memory_slot(size_t slot, const CalcEngine &engine);
+    void insert_variable(SymbolId id, const CalcEngine &engine);
+    void store_variable(const char *name, size_t len, const CalcEngine &engine);
+    void recall(double value, const CalcEngine &engine);
+    void set_precision(size_t digits, const CalcEngine &engine);
+    void set_angle_unit(AngleUnit unit, const CalcEngine &engine);
+
+    // Final check and close; false if anything failed to write
+    bool close(const CalcEngine &engine);
+};
+
+class Session {
+private:
+    std::string data;
+    std::string load_error;
+    unsigned long keystroke_count;
+    unsigned long event_count;
+
+    bool validate();
+
+public:
+    Session() : keystroke_count(0), event_count(0) {}
+
+    // Reads and checks a whole session file; false with error() set
+    bool load(const char *path);
+    const char *error() const { return load_error.c_str(); }
+
+    unsigned long keystrokes() const { return keystroke_count; }
+    unsigned long events() const { return event_count; }
+
+    // Feeds every event to a fresh engine. True when every check matched
+    // (or verify is false).
+    bool replay(CalcEngine &engine, bool verify, ReplayReport *report) const;
+};
+
+// calculator --replay: replays a session file `repeat` times, each from a
+// fresh engine, and prints the keystroke rate and the first mismatch.
+// Returns 0 when every check matched.
+int replay_session(const char *path, unsigned long repeat, bool verify, FILE *out);
+
+#endif // CALC_SESSION_H
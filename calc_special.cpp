@@ -0,0 +1,156 @@
+#include "calc_special.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Below this many factors nCr/nPr multiply in long double; above it
+// log-Gamma is both faster and no less accurate
+const double MAX_PRODUCT_TERMS = 1000;
+
+// ln of the largest finite double
+const long double LOG_DOUBLE_MAX = 709.782712893383973096L;
+
+// Largest integer a double holds exactly
+const double MAX_EXACT_INTEGER = 9007199254740992.0;
+
+// 0! … 170!, each correctly rounded from the exact integer
+struct FactorialTable {
+    double values[MAX_DOUBLE_FACTORIAL + 1];
+    FactorialTable();
+};
+
+// Nearest double to the integer in limbs[0..n) (base 2^32, little-endian)
+double round_limbs(const uint32_t *limbs, size_t n) {
+    if (n < 3) return (double)(((uint64_t)(n == 2 ? limbs[1] : 0) << 32) | limbs[0]);
+
+    // Leading 64 bits; everything below folds into the last bit so the
+    // conversion can tell an exact half from just above it
+    size_t top = n - 1;
+    int shift = 0;
+    while (!(limbs[top] & (0x80000000u >> shift))) shift++;
+    uint64_t high = ((uint64_t)limbs[top] << 32) | limbs[top - 1];
+    uint32_t third = limbs[top - 2];
+    uint64_t lead = shift ? (high << shift) | (third >> (32 - shift)) : high;
+    bool sticky = (uint32_t)(third << shift) != 0;
+    for (size_t i = 0; i + 2 < top; i++) {
+        if (limbs[i]) sticky = true;
+    }
+    if (sticky) lead |= 1;
+    return ldexp((double)lead, 32 * (int)(n - 2) - shift);
+}
+
+FactorialTable::FactorialTable() {
+    uint32_t limbs[40] = {1};
+    size_t n = 1;
+    values[0] = 1;
+    for (int i = 1; i <= MAX_DOUBLE_FACTORIAL; i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < n; j++) {
+            uint64_t cur = (uint64_t)limbs[j] * i + carry;
+            limbs[j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        if (carry) limbs[n++] = (uint32_t)carry;
+        values[i] = round_limbs(limbs, n);
+    }
+}
+
+const FactorialTable &factorial_table() {
+    static const FactorialTable table;
+    return table;
+}
+
+bool is_count(double x) {
+    return x >= 0 && x == floor(x) && x <= MAX_EXACT_INTEGER;
+}
+
+// exp(log_value) with overflow to Infinity
+double exp_or_infinity(long double log_value) {
+    if (log_value > LOG_DOUBLE_MAX) return HUGE_VAL;
+    return (double)expl(log_value);
+}
+
+} // namespace
+
+EvalStatus factorial(double x, double *result) {
+    if (x != x) return EVAL_INVALID_INPUT;
+    if (x == floor(x)) {
+        if (x < 0) return EVAL_INVALID_INPUT; // Poles of Γ
+        *result = x <= MAX_DOUBLE_FACTORIAL ? factorial_table().values[(int)x] : HUGE_VAL;
+        return EVAL_OK;
+    }
+    *result = x > MAX_DOUBLE_FACTORIAL + 1 ? HUGE_VAL : tgamma(x + 1);
+    return EVAL_OK;
+}
+
+bool large_factorial(double x, double *mantissa, long long *exponent, int *digits) {
+    if (!(x > MAX_DOUBLE_FACTORIAL) || x == HUGE_VAL) return false; // Also NaN
+    if (x < MAX_DOUBLE_FACTORIAL + 1 && tgamma(x + 1) != HUGE_VAL) return false;
+    long double log10_value = lgammal((long double)x + 1) / logl(10.0L);
+    // The fraction, and so the mantissa, carries the log's absolute error:
+    // about an ulp of a long double, times the log itself
+    int good = (int)floorl(-log10l(log10_value * LDBL_EPSILON * 2));
+    if (good < 1) return false;
+    long double whole = floorl(log10_value);
+    *exponent = (long long)whole;
+    *mantissa = (double)powl(10.0L, log10_value - whole);
+    *digits = good < DBL_DIG ? good : DBL_DIG;
+    return true;
+}
+
+EvalStatus combinations(double n, double r, double *result) {
+    if (!is_count(n) || !is_count(r) || r > n) return EVAL_INVALID_INPUT;
+    double k = r < n - r ? r : n - r;
+
+    // Exact while the running binomial fits in 64 bits: c stays C(n-k+i, i)
+    uint64_t c = 1;
+    uint64_t base = (uint64_t)(n - k);
+    uint64_t i = 1;
+    for (; i <= (uint64_t)k; i++) {
+        uint64_t factor = base + i;
+        if (c > UINT64_MAX / factor) break;
+        c = c * factor / i;
+    }
+    if (i > (uint64_t)k) {
+        *result = (double)c;
+        return EVAL_OK;
+    }
+
+    if (k <= MAX_PRODUCT_TERMS) {
+        long double product = c;
+        for (; i <= (uint64_t)k; i++) product = product * (long double)(base + i) / (long double)i;
+        *result = (double)product;
+        return EVAL_OK;
+    }
+    *result = exp_or_infinity(lgammal((long double)n + 1) - lgammal((long double)k + 1) -
+                              lgammal((long double)(n - k) + 1));
+    return EVAL_OK;
+}
+
+EvalStatus permutations(double n, double r, double *result) {
+    if (!is_count(n) || !is_count(r) || r > n) return EVAL_INVALID_INPUT;
+
+    uint64_t p = 1;
+    uint64_t top = (uint64_t)n;
+    uint64_t i = 0;
+    for (; i < (uint64_t)r; i++) {
+        uint64_t factor = top - i;
+        if (p > UINT64_MAX / factor) break;
+        p *= factor;
+    }
+    if (i == (uint64_t)r) {
+        *result = (double)p;
+        return EVAL_OK;
+    }
+
+    if (r <= MAX_PRODUCT_TERMS) {
+        long double product = p;
+        for (; i < (uint64_t)r; i++) product *= (long double)(top - i);
+        *result = (double)product; // Infinity past the double range
+        return EVAL_OK;
+    }
+    *result = exp_or_infinity(lgammal((long double)n + 1) - lgammal((long double)(n - r) + 1));
+    return EVAL_OK;
+}
@@ -0,0 +1,40 @@
+#ifndef CALC_SPECIAL_H
+#define CALC_SPECIAL_H
+
+#include "calc_expr.h"
+
+// Factorial, Gamma and the counting functions in double precision, shared
+// by the expression VM and the keypad.
+//
+// Integer factorials come from a table built once with exact integer
+// arithmetic, so every n! up to 170! is correctly rounded. Real arguments
+// go through Gamma, and nCr/nPr switch to log-Gamma when their
+// intermediate factorials would overflow a double. Factorials past the
+// double range can still be written out from log-Gamma.
+
+// Largest n whose n! is a finite double
+const int MAX_DOUBLE_FACTORIAL = 170;
+
+// n! for n <= 20 fits exactly in 64 bits
+constexpr unsigned long long small_factorial(unsigned n) {
+    return n < 2 ? 1ULL : n * small_factorial(n - 1);
+}
+
+const unsigned MAX_SMALL_FACTORIAL = 20;
+
+// x! = Γ(x+1) for real x. Negative integers are poles; results past the
+// double range are Infinity, as with ^.
+EvalStatus factorial(double x, double *result);
+
+// x! past the double range as mantissa × 10^exponent, 1 <= mantissa < 10,
+// from log-Gamma, for the keypad to show instead of Infinity. *digits is
+// how many significant digits of the mantissa the logarithm is good for.
+// False where x! is a finite double or undefined, and where x is so large
+// that not even one digit is good.
+bool large_factorial(double x, double *mantissa, long long *exponent, int *digits);
+
+// n! / (r! (n-r)!) and n! / (n-r)! for integers 0 <= r <= n
+EvalStatus combinations(double n, double r, double *result);
+EvalStatus permutations(double n, double r, double *result);
+
+#endif // CALC_SPECIAL_H
@@ -0,0 +1,487 @@
+#include "calc_stats.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const double QuantileSketch::RELATIVE_ERROR = 1.0 / (2 << SUB_BITS);
+
+namespace {
+
+// Blocks smaller than this are read by one thread
+const size_t MIN_THREAD_BLOCK = 4 << 20;
+const size_t STREAM_BLOCK = 1 << 20;
+
+uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Between numbers when every number counts
+struct SeparatorTable {
+    bool table[256];
+    SeparatorTable() {
+        memset(table, 0, sizeof(table));
+        const char separators[] = " \n,\t\r;\"";
+        for (const char *c = separators; *c; c++) table[(unsigned char)*c] = true;
+    }
+};
+const SeparatorTable SEPARATORS;
+
+bool is_separator(char c) {
+    return SEPARATORS.table[(unsigned char)c];
+}
+
+// Values on their way to ColumnStats, a block at a time
+class ValueBuffer {
+private:
+    ColumnStats &stats;
+    double values[ColumnStats::VALUE_BLOCK];
+    size_t count;
+
+public:
+    explicit ValueBuffer(ColumnStats &s) : stats(s), count(0) {}
+    ~ValueBuffer() { flush(); }
+
+    void add(double value) {
+        values[count++] = value;
+        if (count == ColumnStats::VALUE_BLOCK) flush();
+    }
+    void skip() { stats.skip(); }
+    void flush() {
+        if (count) stats.add(values, count);
+        count = 0;
+    }
+};
+
+// A number filling [p, end) exactly, with an optional sign
+bool parse_value(const char *p, const char *end, double *value) {
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    size_t n = parse_number(p, end - p, value);
+    if (n == 0 || p + n != end) return false;
+    if (negative) *value = -*value;
+    return true;
+}
+
+// Every number in [p, end), whatever separates them. A token is parsed
+// where it starts and is only scanned to its end when it isn't a number.
+void scan_numbers(const char *p, const char *end, ValueBuffer &values) {
+    while (p < end) {
+        if (is_separator(*p)) {
+            p++;
+            continue;
+        }
+        const char *start = p;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+') p++;
+        double value;
+        p += parse_number(p, end - p, &value);
+        if (p > start + (start[0] == '-' || start[0] == '+') && (p == end || is_separator(*p))) {
+            values.add(negative ? -value : value);
+            continue;
+        }
+        while (p < end && !is_separator(*p)) p++;
+        values.skip();
+    }
+}
+
+// Field `field` (from 1) of each line in [p, end); blank lines don't count
+void scan_field(const char *p, const char *end, size_t field, ValueBuffer &values) {
+    while (p < end) {
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!line_end) line_end = end;
+        if (line_end == p || (line_end - p == 1 && *p == '\r')) {
+            p = line_end + 1;
+            continue;
+        }
+        const char *f = p;
+        for (size_t i = 1; f && i < field; i++) {
+            f = static_cast<const char *>(memchr(f, ',', line_end - f));
+            if (f) f++;
+        }
+        if (f) {
+            const char *f_end = static_cast<const char *>(memchr(f, ',', line_end - f));
+            if (!f_end) f_end = line_end;
+            while (f < f_end && (*f == ' ' || *f == '\t' || *f == '"')) f++;
+            while (f_end > f && (f_end[-1] == ' ' || f_end[-1] == '\t' || f_end[-1] == '\r' || f_end[-1] == '"')) {
+                f_end--;
+            }
+            double value;
+            if (parse_value(f, f_end, &value)) {
+                values.add(value);
+            } else {
+                values.skip();
+            }
+        } else {
+            values.skip();
+        }
+        p = line_end + 1;
+    }
+}
+
+void scan(const char *text, size_t len, size_t field, ColumnStats &stats) {
+    ValueBuffer values(stats);
+    if (field == 0) {
+        scan_numbers(text, text + len, values);
+    } else {
+        scan_field(text, text + len, field, values);
+    }
+}
+
+} // namespace
+
+uint32_t QuantileSketch::key(double magnitude) {
+    return (uint32_t)(double_bits(magnitude) >> (52 - SUB_BITS));
+}
+
+double QuantileSketch::key_value(uint32_t key) {
+    double low = bits_double((uint64_t)key << (52 - SUB_BITS));
+    double high = bits_double((uint64_t)(key + 1) << (52 - SUB_BITS));
+    return std::isinf(high) ? low : low + (high - low) / 2;
+}
+
+void QuantileSketch::Store::add(uint32_t key, uint64_t count) {
+    size_t index = key - first_key; // Wraps below first_key
+    if (index < counts.size()) {
+        counts[index] += count;
+        total += count;
+        return;
+    }
+    if (counts.empty()) {
+        first_key = key;
+        counts.assign(1, 0);
+    } else if (key < first_key) {
+        counts.insert(counts.begin(), first_key - key, 0);
+        first_key = key;
+    } else if (key - first_key >= counts.size()) {
+        counts.resize(key - first_key + 1, 0);
+    }
+    counts[key - first_key] += count;
+    total += count;
+}
+
+void QuantileSketch::Store::merge(const Store &other) {
+    if (other.counts.empty()) return;
+    // Make room for both ends first, then add in place
+    add(other.first_key, 0);
+    add(other.first_key + (uint32_t)other.counts.size() - 1, 0);
+    uint64_t *dest = &counts[other.first_key - first_key];
+    for (size_t i = 0; i < other.counts.size(); i++) dest[i] += other.counts[i];
+    total += other.total;
+}
+
+void QuantileSketch::add(double value) {
+    if (value > 0) {
+        positive.add(key(value), 1);
+    } else if (value < 0) {
+        negative.add(key(-value), 1);
+    } else {
+        zeros++;
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+    positive.merge(other.positive);
+    negative.merge(other.negative);
+    zeros += other.zeros;
+}
+
+void QuantileSketch::clear() {
+    positive = Store();
+    negative = Store();
+    zeros = 0;
+}
+
+size_t QuantileSketch::memory() const {
+    return (positive.counts.capacity() + negative.counts.capacity()) * sizeof(uint64_t);
+}
+
+double QuantileSketch::quantile(double p) const {
+    uint64_t total = count();
+    if (total == 0) return std::numeric_limits<double>::quiet_NaN();
+    uint64_t rank = (uint64_t)ceil(p * (double)total);
+    if (rank == 0) rank = 1;
+    if (rank > total) rank = total;
+    // Most negative first
+    uint64_t seen = 0;
+    for (size_t i = negative.counts.size(); i-- > 0;) {
+        seen += negative.counts[i];
+        if (seen >= rank) return -key_value(negative.first_key + (uint32_t)i);
+    }
+    seen += zeros;
+    if (seen >= rank) return 0.0;
+    for (size_t i = 0; i < positive.counts.size(); i++) {
+        seen += positive.counts[i];
+        if (seen >= rank) return key_value(positive.first_key + (uint32_t)i);
+    }
+    return key_value(positive.first_key + (uint32_t)positive.counts.size() - 1);
+}
+
+void ColumnStats::clear() {
+    n = 0;
+    running_mean = 0;
+    m2 = 0;
+    sum = 0;
+    sum_error = 0;
+    smallest = std::numeric_limits<double>::infinity();
+    largest = -std::numeric_limits<double>::infinity();
+    skipped = 0;
+    sketch.clear();
+}
+
+// Folds in a summary of `count` values with that mean, sum of squared
+// differences from it and compensated sum
+void ColumnStats::combine(uint64_t count, double mean, double squares, double block_sum, double block_error) {
+    if (count == 0) return;
+    if (n == 0) {
+        running_mean = mean;
+        m2 = squares;
+    } else {
+        double total_n = (double)(n + count);
+        double delta = mean - running_mean;
+        running_mean += delta * ((double)count / total_n);
+        m2 += squares + delta * delta * ((double)n * (double)count / total_n);
+    }
+    n += count;
+    double t = sum + block_sum;
+    if (fabs(sum) >= fabs(block_sum)) {
+        sum_error += (sum - t) + block_sum;
+    } else {
+        sum_error += (block_sum - t) + sum;
+    }
+    sum = t;
+    sum_error += block_error;
+}
+
+void ColumnStats::add(const double *values, size_t count) {
+    double block_sum = 0, block_error = 0;
+    size_t finite = 0;
+    for (size_t i = 0; i < count; i++) {
+        double value = values[i];
+        if (!std::isfinite(value)) continue;
+        finite++;
+        double t = block_sum + value;
+        if (fabs(block_sum) >= fabs(value)) {
+            block_error += (block_sum - t) + value;
+        } else {
+            block_error += (value - t) + block_sum;
+        }
+        block_sum = t;
+        if (value < smallest) smallest = value;
+        if (value > largest) largest = value;
+        sketch.add(value);
+    }
+    skipped += count - finite;
+    if (finite == 0) return;
+    double mean = (block_sum + block_error) / (double)finite;
+    double squares = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!std::isfinite(values[i])) continue;
+        double d = values[i] - mean;
+        squares += d * d;
+    }
+    combine(finite, mean, squares, block_sum, block_error);
+}
+
+void ColumnStats::merge(const ColumnStats &other) {
+    skipped += other.skipped;
+    combine(other.n, other.running_mean, other.m2, other.sum, other.sum_error);
+    if (other.smallest < smallest) smallest = other.smallest;
+    if (other.largest > largest) largest = other.largest;
+    sketch.merge(other.sketch);
+}
+
+// From the compensated sum, which is closer than the running mean
+double ColumnStats::mean() const {
+    return n ? total() / (double)n : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ColumnStats::variance() const {
+    if (n == 0) return std::numeric_limits<double>::quiet_NaN();
+    return n > 1 ? m2 / (double)(n - 1) : 0.0;
+}
+
+double ColumnStats::population_variance() const {
+    return n ? m2 / (double)n : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ColumnStats::stddev() const {
+    return sqrt(variance());
+}
+
+double ColumnStats::min() const {
+    return n ? smallest : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ColumnStats::max() const {
+    return n ? largest : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ColumnStats::quantile(double p) const {
+    if (n == 0) return std::numeric_limits<double>::quiet_NaN();
+    if (p <= 0) return smallest;
+    if (p >= 1) return largest;
+    double value = sketch.quantile(p);
+    return value < smallest ? smallest : value > largest ? largest : value;
+}
+
+void summarize_text(const char *text, size_t len, const StatsOptions &options, ColumnStats *stats) {
+    size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    size_t parts = len / MIN_THREAD_BLOCK;
+    if (parts > threads) parts = threads;
+    if (parts <= 1) {
+        scan(text, len, options.field, *stats);
+        return;
+    }
+
+    // Split after a line break near each 1/parts of the text, so no number
+    // or line is cut; the first part is read on this thread
+    std::vector<size_t> starts(parts + 1, len);
+    starts[0] = 0;
+    for (size_t i = 1; i < parts; i++) {
+        size_t at = len / parts * i;
+        if (at < starts[i - 1]) at = starts[i - 1];
+        const char *newline = static_cast<const char *>(memchr(text + at, '\n', len - at));
+        starts[i] = newline ? (size_t)(newline - text) + 1 : len;
+    }
+    std::vector<ColumnStats> results(parts);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < parts; i++) {
+        workers.push_back(std::thread([&, i]() {
+            scan(text + starts[i], starts[i + 1] - starts[i], options.field, results[i]);
+        }));
+    }
+    scan(text, starts[1], options.field, results[0]);
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    for (size_t i = 0; i < parts; i++) stats->merge(results[i]);
+}
+
+bool summarize_stream(FILE *in, const StatsOptions &options, ColumnStats *stats) {
+    std::vector<char> block(STREAM_BLOCK);
+    size_t used = 0;
+    for (;;) {
+        if (used == block.size()) block.resize(block.size() * 2); // A line longer than a block
+        size_t n = fread(&block[used], 1, block.size() - used, in);
+        used += n;
+        if (n == 0) break;
+        // Whole lines (whole numbers, for field 0) now, the rest with the
+        // next block
+        size_t keep = 0;
+        while (keep < used && !(options.field ? block[used - keep - 1] == '\n' : is_separator(block[used - keep - 1]))) {
+            keep++;
+        }
+        if (keep == used) continue;
+        scan(&block[0], used - keep, options.field, *stats);
+        memmove(&block[0], &block[used - keep], keep);
+        used = keep;
+    }
+    if (used) scan(&block[0], used, options.field, *stats);
+    return !ferror(in);
+}
+
+bool summarize_file(const char *path, const StatsOptions &options, ColumnStats *stats, std::string *error) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        *error = std::string(path) + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        // Pipes and the like have nothing to map
+        FILE *f = fdopen(fd, "rb");
+        bool ok = f && summarize_stream(f, options, stats);
+        if (!ok) *error = std::string(path) + ": " + strerror(errno);
+        if (f) {
+            fclose(f);
+        } else {
+            close(fd);
+        }
+        return ok;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        *error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    summarize_text(static_cast<const char *>(map), size, options, stats);
+    munmap(map, size);
+    return true;
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        *error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = summarize_stream(f, options, stats);
+    if (!ok) *error = std::string(path) + ": read error";
+    fclose(f);
+    return ok;
+#endif
+}
+
+void summary_lines(const ColumnStats &stats, SummaryLine lines[SUMMARY_LINES]) {
+    static const struct {
+        const char *name;
+        double p;
+    } QUANTILES[] = {{"p1", 0.01}, {"p25", 0.25}, {"median", 0.5}, {"p75", 0.75}, {"p99", 0.99}};
+    size_t n = 0;
+    lines[n++] = SummaryLine{"sum", stats.total(), false};
+    lines[n++] = SummaryLine{"mean", stats.mean(), false};
+    lines[n++] = SummaryLine{"variance", stats.variance(), false};
+    lines[n++] = SummaryLine{"stddev", stats.stddev(), false};
+    lines[n++] = SummaryLine{"min", stats.min(), false};
+    for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); i++) {
+        lines[n++] = SummaryLine{QUANTILES[i].name, stats.quantile(QUANTILES[i].p), true};
+    }
+    lines[n++] = SummaryLine{"max", stats.max(), false};
+}
+
+int run_summary(const char *path, const StatsOptions &options, FILE *out) {
+    ColumnStats stats;
+    if (strcmp(path, "-") == 0) {
+        if (!summarize_stream(stdin, options, &stats)) {
+            fprintf(stderr, "stdin: read error\n");
+            return 1;
+        }
+    } else {
+        std::string error;
+        if (!summarize_file(path, options, &stats, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    char text[FORMAT_BUFFER_SIZE];
+    fprintf(out, "count     %llu\n", (unsigned long long)stats.count());
+    fprintf(out, "skipped   %llu\n", (unsigned long long)stats.skipped_count());
+    if (stats.count() == 0) return 0;
+    SummaryLine lines[SUMMARY_LINES];
+    summary_lines(stats, lines);
+    for (size_t i = 0; i < SUMMARY_LINES; i++) {
+        format_number(lines[i].value, text, FORMAT_BUFFER_SIZE - 1);
+        fprintf(out, "%-9s %s%s\n", lines[i].name, lines[i].approximate ? "~" : "", text);
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+#ifndef CALC_STATS_H
+#define CALC_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Statistics over a column of numbers, for calculator --summary and the
+// View → Statistics panel. One pass over the data keeps count, sum, mean,
+// variance, min, max and a quantile sketch; nothing is stored per value.
+//
+// The sum is Neumaier-compensated and the variance is taken about each
+// block's own mean, so 1e9+4, 1e9+7, 1e9+13, 1e9+16 give variance 30
+// exactly and sums that cancel lose nothing. Two summaries of parts of
+// the data merge (Chan et al.) into the summary of the whole, which is
+// how blocks are added and how files are read by several threads.
+
+// Quantiles within QuantileSketch::RELATIVE_ERROR of the true value, in
+// bounded memory. Values are counted in log-linear buckets, as
+// LatencyHistogram does, but taken straight from the bits of the double:
+// the exponent and the top SUB_BITS of the mantissa pick the bucket. Only
+// the buckets between the smallest and largest magnitude seen are kept,
+// at most 2 MB for each sign over the whole double range and a few KB
+// for ordinary data. Merging adds the counts, so the result does not
+// depend on how the data was split.
+class QuantileSketch {
+public:
+    static const int SUB_BITS = 7; // 128 buckets per power of two
+    static const double RELATIVE_ERROR;
+
+private:
+    // Counts by magnitude; bucket key first_key + i is at counts[i]
+    struct Store {
+        std::vector<uint64_t> counts;
+        uint32_t first_key;
+        uint64_t total;
+
+        Store() : first_key(0), total(0) {}
+        void add(uint32_t key, uint64_t count);
+        void merge(const Store &other);
+    };
+
+    Store positive;
+    Store negative; // By magnitude
+    uint64_t zeros;
+
+    static uint32_t key(double magnitude);
+    static double key_value(uint32_t key); // Middle of the bucket
+
+public:
+    QuantileSketch() : zeros(0) {}
+
+    // Finite values only
+    void add(double value);
+    void merge(const QuantileSketch &other);
+    void clear();
+
+    uint64_t count() const { return positive.total + negative.total + zeros; }
+    size_t memory() const;
+
+    // Value at or below which fraction p (0..1) of the values fall; NaN
+    // when empty
+    double quantile(double p) const;
+};
+
+class ColumnStats {
+public:
+    static const size_t VALUE_BLOCK = 256;
+
+private:
+    uint64_t n;
+    double running_mean;
+    double m2; // Sum of squared differences from the mean
+    double sum;
+    double sum_error; // Neumaier compensation
+    double smallest;
+    double largest;
+    uint64_t skipped;
+    QuantileSketch sketch;
+
+    void combine(uint64_t count, double mean, double squares, double block_sum, double block_error);
+
+public:
+    ColumnStats() { clear(); }
+
+    void clear();
+    void add(double value) { add(&value, 1); }
+    // A block of values at once: two passes over it, then merged in as a
+    // summary of its own. The scanners hand over VALUE_BLOCK at a time.
+    void add(const double *values, size_t count);
+    // Something in the input that is not a number
+    void skip() { skipped++; }
+    // Adds another summary's values, as if added here
+    void merge(const ColumnStats &other);
+
+    uint64_t count() const { return n; }
+    uint64_t skipped_count() const { return skipped; }
+    double total() const { return sum + sum_error; }
+    double mean() const;
+    // Sample variance (n - 1); 0 for a single value
+    double variance() const;
+    double population_variance() const;
+    double stddev() const;
+    double min() const;
+    double max() const;
+    // Exact at 0 and 1, otherwise from the sketch
+    double quantile(double p) const;
+    const QuantileSketch &quantiles() const { return sketch; }
+};
+
+// Where the values are. With field 0 every number in the text counts,
+// whatever separates them (spaces, commas, semicolons, newlines). With
+// field N only the Nth comma-separated field of each line does, as for
+// one column of a CSV file; surrounding spaces and quotes are allowed.
+// Anything else (headers, empty fields, words) is counted as skipped.
+struct StatsOptions {
+    size_t field;
+    size_t threads; // 0 for one per core
+};
+
+// Summarises a block of text in memory. Blocks of a few MB or more are
+// split at line breaks and read by several threads.
+void summarize_text(const char *text, size_t len, const StatsOptions &options, ColumnStats *stats);
+
+// Summarises a file through a memory map of it (read in blocks where
+// there is no mmap). False with a message in error if it can't be read.
+bool summarize_file(const char *path, const StatsOptions &options, ColumnStats *stats, std::string *error);
+
+// Summarises a stream block by block on one thread, for stdin
+bool summarize_stream(FILE *in, const StatsOptions &options, ColumnStats *stats);
+
+// One statistic as --summary prints it and the panel lists it
+struct SummaryLine {
+    const char *name;
+    double value;
+    bool approximate; // From the quantile sketch
+};
+const size_t SUMMARY_LINES = 11;
+
+// Sum, mean, spread, min, quantiles and max of stats, which must have at
+// least one value
+void summary_lines(const ColumnStats &stats, SummaryLine lines[SUMMARY_LINES]);
+
+// Headless --summary: summarises path ("-" for stdin) and prints one
+// "name value" line per statistic. Returns 0 on success, 1 with a message
+// on stderr.
+int run_summary(const char *path, const StatsOptions &options, FILE *out);
+
+#endif // CALC_STATS_H
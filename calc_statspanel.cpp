@@ -0,0 +1,195 @@
+#include "calc_statspanel.h"
+#include "calc_format.h"
+#include <cstring>
+
+namespace {
+
+const int DEFAULT_WIDTH = 300;
+const int MAX_FIELD = 999;
+
+} // namespace
+
+StatsPanel::StatsPanel(RecallFunc on_recall, gpointer data) :
+    recall(on_recall),
+    recall_data(data),
+    box(NULL),
+    field_spin(NULL),
+    open_button(NULL),
+    text_view(NULL),
+    list(NULL),
+    status(NULL),
+    line_count(0),
+    file_ok(false),
+    showing_file(false),
+    file_started(0) {}
+
+StatsPanel::~StatsPanel() {
+    if (reader.joinable()) reader.join();
+    g_idle_remove_by_data(this);
+}
+
+GtkWidget *StatsPanel::create() {
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_size_request(box, DEFAULT_WIDTH, -1);
+
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(row), gtk_label_new("CSV column"), FALSE, FALSE, 0);
+    field_spin = gtk_spin_button_new_with_range(0, MAX_FIELD, 1);
+    gtk_widget_set_tooltip_text(field_spin, "0 takes every number");
+    g_signal_connect(field_spin, "value-changed", G_CALLBACK(on_field_changed), this);
+    gtk_box_pack_start(GTK_BOX(row), field_spin, FALSE, FALSE, 0);
+    open_button = gtk_button_new_with_label("Open File…");
+    g_signal_connect(open_button, "clicked", G_CALLBACK(on_open_clicked), this);
+    gtk_box_pack_end(GTK_BOX(row), open_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), row, FALSE, FALSE, 0);
+
+    text_view = gtk_text_view_new();
+    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(text_view), GTK_WRAP_WORD_CHAR);
+    g_signal_connect(gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view)), "changed", G_CALLBACK(on_text_changed), this);
+    GtkWidget *text_scroller = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(text_scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(text_scroller), text_view);
+    gtk_box_pack_start(GTK_BOX(box), text_scroller, TRUE, TRUE, 0);
+
+    list = gtk_list_box_new();
+    gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(list), FALSE);
+    g_signal_connect(list, "row-activated", G_CALLBACK(on_row_activated), this);
+    gtk_style_context_add_class(gtk_widget_get_style_context(list), "history-list");
+    gtk_box_pack_start(GTK_BOX(box), list, FALSE, FALSE, 0);
+
+    status = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(status), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(status), PANGO_ELLIPSIZE_MIDDLE);
+    gtk_box_pack_start(GTK_BOX(box), status, FALSE, FALSE, 0);
+    return box;
+}
+
+StatsOptions StatsPanel::options() const {
+    StatsOptions result = {(size_t)gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(field_spin)), 0};
+    return result;
+}
+
+void StatsPanel::update() {
+    if (!text_view) return;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    GtkTextIter start, end;
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    gchar *text = gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
+    showing_file = false;
+    stats.clear();
+    summarize_text(text, strlen(text), options(), &stats);
+    g_free(text);
+    show(NULL);
+}
+
+// Lists the lines of `stats`, under a summary of where they came from
+void StatsPanel::show(const char *source) {
+    GList *children = gtk_container_get_children(GTK_CONTAINER(list));
+    for (GList *child = children; child; child = child->next) gtk_widget_destroy(GTK_WIDGET(child->data));
+    g_list_free(children);
+    line_count = stats.count() ? SUMMARY_LINES : 0;
+    if (line_count) summary_lines(stats, lines);
+    char value[FORMAT_BUFFER_SIZE + 1];
+    for (size_t i = 0; i < line_count; i++) {
+        GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+        GtkWidget *name = gtk_label_new(lines[i].name);
+        gtk_label_set_xalign(GTK_LABEL(name), 0.0);
+        value[0] = '~';
+        size_t n = format_number(lines[i].value, value + 1, FORMAT_BUFFER_SIZE - 1);
+        value[n + 1] = '\0';
+        GtkWidget *number = gtk_label_new(lines[i].approximate ? value : value + 1);
+        gtk_label_set_xalign(GTK_LABEL(number), 1.0);
+        gtk_label_set_selectable(GTK_LABEL(number), TRUE);
+        gtk_box_pack_start(GTK_BOX(row), name, FALSE, FALSE, 0);
+        gtk_box_pack_end(GTK_BOX(row), number, TRUE, TRUE, 0);
+        gtk_container_add(GTK_CONTAINER(list), row);
+    }
+    gtk_widget_show_all(list);
+
+    char summary[256];
+    unsigned long long count = stats.count(), skipped = stats.skipped_count();
+    if (source) {
+        g_snprintf(summary, sizeof(summary), "%s: %llu values, %llu skipped", source, count, skipped);
+    } else if (count || skipped) {
+        g_snprintf(summary, sizeof(summary), "%llu values, %llu skipped", count, skipped);
+    } else {
+        g_snprintf(summary, sizeof(summary), "Paste numbers or open a file");
+    }
+    gtk_label_set_text(GTK_LABEL(status), summary);
+}
+
+void StatsPanel::read_file() {
+    if (reader.joinable()) return;
+    gtk_widget_set_sensitive(open_button, FALSE);
+    gtk_widget_set_sensitive(field_spin, FALSE);
+    gchar *name = g_path_get_basename(file_name.c_str());
+    gchar *message = g_strdup_printf("Reading %s…", name);
+    gtk_label_set_text(GTK_LABEL(status), message);
+    g_free(message);
+    g_free(name);
+    file_stats.clear();
+    file_started = g_get_monotonic_time();
+    StatsOptions file_options = options();
+    reader = std::thread([this, file_options]() {
+        file_ok = summarize_file(file_name.c_str(), file_options, &file_stats, &file_error);
+        g_idle_add(on_file_read, this);
+    });
+}
+
+gboolean StatsPanel::on_file_read(gpointer data) {
+    StatsPanel *panel = static_cast<StatsPanel*>(data);
+    panel->reader.join();
+    gtk_widget_set_sensitive(panel->open_button, TRUE);
+    gtk_widget_set_sensitive(panel->field_spin, TRUE);
+    if (!panel->file_ok) {
+        panel->showing_file = false;
+        gtk_label_set_text(GTK_LABEL(panel->status), panel->file_error.c_str());
+        return G_SOURCE_REMOVE;
+    }
+    g_debug("summarised %s in %.1f ms", panel->file_name.c_str(),
+            (g_get_monotonic_time() - panel->file_started) / 1000.0);
+    panel->showing_file = true;
+    panel->stats = panel->file_stats;
+    gchar *name = g_path_get_basename(panel->file_name.c_str());
+    panel->show(name);
+    g_free(name);
+    return G_SOURCE_REMOVE;
+}
+
+void StatsPanel::on_text_changed(GtkTextBuffer *buffer, gpointer data) {
+    (void)buffer;  // Suppress unused parameter warning
+    static_cast<StatsPanel*>(data)->update();
+}
+
+void StatsPanel::on_field_changed(GtkSpinButton *spin, gpointer data) {
+    (void)spin;  // Suppress unused parameter warning
+    StatsPanel *panel = static_cast<StatsPanel*>(data);
+    if (panel->showing_file) {
+        panel->read_file();
+    } else {
+        panel->update();
+    }
+}
+
+void StatsPanel::on_open_clicked(GtkButton *button, gpointer data) {
+    (void)button;  // Suppress unused parameter warning
+    StatsPanel *panel = static_cast<StatsPanel*>(data);
+    GtkWidget *dialog = gtk_file_chooser_dialog_new("Open Numbers", GTK_WINDOW(gtk_widget_get_toplevel(panel->box)),
+                                                    GTK_FILE_CHOOSER_ACTION_OPEN, "_Cancel", GTK_RESPONSE_CANCEL,
+                                                    "_Open", GTK_RESPONSE_ACCEPT, NULL);
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        panel->file_name = path;
+        g_free(path);
+        panel->read_file();
+    }
+    gtk_widget_destroy(dialog);
+}
+
+void StatsPanel::on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data) {
+    (void)list_box;  // Suppress unused parameter warning
+    StatsPanel *panel = static_cast<StatsPanel*>(data);
+    int index = gtk_list_box_row_get_index(row);
+    if (index < 0 || (size_t)index >= panel->line_count) return;
+    panel->recall(panel->lines[index].value, panel->recall_data);
+}
@@ -0,0 +1,66 @@
+#ifndef CALC_STATSPANEL_H
+#define CALC_STATSPANEL_H
+
+#include <gtk/gtk.h>
+#include <string>
+#include <thread>
+#include "calc_stats.h"
+
+// View → Statistics: numbers pasted or typed into a text box, or a file
+// chosen with Open File…, summarised as ColumnStats. The text is
+// summarised again as it changes; a file is read on a thread of its own,
+// so a large one doesn't stop the window. Activating a line enters its
+// value as the current operand.
+class StatsPanel {
+public:
+    typedef void (*RecallFunc)(double value, gpointer data);
+
+private:
+    RecallFunc recall;
+    gpointer recall_data;
+
+    GtkWidget *box;
+    GtkWidget *field_spin;
+    GtkWidget *open_button;
+    GtkWidget *text_view;
+    GtkWidget *list;
+    GtkWidget *status;
+    ColumnStats stats;
+    SummaryLine lines[SUMMARY_LINES];
+    size_t line_count;
+
+    // File being read; the thread owns file_stats and file_error until it
+    // posts on_file_read
+    std::thread reader;
+    std::string file_name;
+    ColumnStats file_stats;
+    std::string file_error;
+    bool file_ok;
+    bool showing_file; // Else the text box
+    gint64 file_started;
+
+    StatsOptions options() const;
+    void read_file();
+    void show(const char *source);
+
+    static void on_text_changed(GtkTextBuffer *buffer, gpointer data);
+    static void on_field_changed(GtkSpinButton *spin, gpointer data);
+    static void on_open_clicked(GtkButton *button, gpointer data);
+    static gboolean on_file_read(gpointer data);
+    static void on_row_activated(GtkListBox *list_box, GtkListBoxRow *row, gpointer data);
+
+    StatsPanel(const StatsPanel &);
+    StatsPanel &operator=(const StatsPanel &);
+
+public:
+    StatsPanel(RecallFunc on_recall, gpointer data);
+    ~StatsPanel();
+
+    // Builds the widgets; the returned box is for the caller to pack
+    GtkWidget *create();
+
+    // Summarises the text box again
+    void update();
+};
+
+#endif // CALC_STATSPANEL_H
@@ -0,0 +1,70 @@
+#ifndef CALC_STRING_H
+#define CALC_STRING_H
+
+#include <cstddef>
+#include <cstring>
+
+// Fixed-capacity, NUL-terminated string stored inline. Used for display
+// text and number entry so keypresses never touch the heap. Appends that
+// do not fit are dropped and reported by returning false.
+template <size_t N>
+class FixedString {
+private:
+    char text[N];
+    size_t length;
+
+public:
+    FixedString() : length(0) { text[0] = '\0'; }
+
+    static size_t capacity() { return N - 1; }
+
+    const char *c_str() const { return text; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    char operator[](size_t index) const { return text[index]; }
+    char back() const { return length > 0 ? text[length - 1] : '\0'; }
+
+    bool operator==(const char *other) const { return strcmp(text, other) == 0; }
+    bool operator!=(const char *other) const { return strcmp(text, other) != 0; }
+
+    void clear() {
+        length = 0;
+        text[0] = '\0';
+    }
+
+    bool append(const char *data, size_t n) {
+        if (length + n > capacity()) return false;
+        memcpy(text + length, data, n);
+        length += n;
+        text[length] = '\0';
+        return true;
+    }
+
+    bool append(const char *data) { return append(data, strlen(data)); }
+    bool push_back(char c) { return append(&c, 1); }
+
+    bool assign(const char *data) {
+        clear();
+        return append(data);
+    }
+
+    void pop_back() {
+        if (length > 0) text[--length] = '\0';
+    }
+
+    bool insert_front(char c) {
+        if (length + 1 > capacity()) return false;
+        memmove(text + 1, text, length + 1);
+        text[0] = c;
+        length++;
+        return true;
+    }
+
+    void erase_front() {
+        if (length == 0) return;
+        memmove(text, text + 1, length);
+        length--;
+    }
+};
+
+#endif // CALC_STRING_H
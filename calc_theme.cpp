@@ -0,0 +1,84 @@
+#include "calc_theme.h"
+
+// Sizes and effects shared by every theme; the themes only add colours
+#define LAYOUT_CSS \
+    "button { font-weight: bold; border-radius: 8px; } " \
+    "button:hover { opacity: 0.8; } " \
+    "button:active { opacity: 0.6; } " \
+    "button.digit { font-size: 18px; } " \
+    "button.operator { font-size: 20px; } " \
+    "button.function { font-size: 14px; } " \
+    "button.utility, button.memory, button.clear { font-size: 16px; } " \
+    "button.equals { font-size: 22px; } " \
+    "label.history { font-size: 14px; padding-right: 5px; } " \
+    "label.preview { font-size: 16px; padding-right: 5px; } " \
+    "entry.display { font-size: 28px; font-weight: bold; padding: 5px; } " \
+    "label.latency { font-family: monospace; font-size: 11px; } " \
+    "label.progress { font-size: 12px; } "
+
+static const char LIGHT_CSS[] = LAYOUT_CSS
+    "label.history { color: #888888; } "
+    "label.preview { color: #606060; } "
+    "entry.display { background-color: #f0f0f0; border: 2px solid #ccc; } "
+    ".plot { background-color: #ffffff; color: #333333; } "
+    "button.digit { background-color: #2F4F4F; color: white; border: 1px solid #1C1C1C; } "
+    "button.operator { background-color: #FF8C00; color: white; border: 1px solid #FF6600; } "
+    "button.function { background-color: #6A0DAD; color: white; border: 1px solid #4B0082; } "
+    "button.utility, button.memory { background-color: #87CEEB; color: #000080; border: 1px solid #4682B4; } "
+    "button.clear { background-color: #FF4444; color: white; border: 1px solid #CC0000; } "
+    "button.equals { background-color: #32CD32; color: white; border: 1px solid #228B22; }";
+
+static const char DARK_CSS[] = LAYOUT_CSS
+    "label.history { color: #9a9a9a; } "
+    "label.preview { color: #b8b8b8; } "
+    "entry.display { background-color: #1e1e1e; color: #f0f0f0; border: 2px solid #3c3c3c; } "
+    ".plot { background-color: #1e1e1e; color: #d0d0d0; } "
+    "button.digit { background-color: #3a3a3a; color: #f0f0f0; border: 1px solid #262626; } "
+    "button.operator { background-color: #c96d00; color: white; border: 1px solid #a35800; } "
+    "button.function { background-color: #4b2a6e; color: #e8dcf5; border: 1px solid #33194f; } "
+    "button.utility, button.memory { background-color: #2c4a5c; color: #cfe8f7; border: 1px solid #1d3341; } "
+    "button.clear { background-color: #a83232; color: white; border: 1px solid #7d2121; } "
+    "button.equals { background-color: #2e8b2e; color: white; border: 1px solid #1f611f; }";
+
+static const char HIGH_CONTRAST_CSS[] = LAYOUT_CSS
+    "label.history { color: #ffffff; } "
+    "label.preview { color: #00ffff; } "
+    "entry.display { background-color: #000000; color: #ffff00; border: 3px solid #ffffff; } "
+    ".plot { background-color: #000000; color: #ffffff; } "
+    "button { border: 2px solid #ffffff; } "
+    "button.digit { background-color: #000000; color: #ffffff; } "
+    "button.operator { background-color: #000000; color: #ffff00; } "
+    "button.function { background-color: #000000; color: #00ffff; } "
+    "button.utility, button.memory { background-color: #000000; color: #00ff00; } "
+    "button.clear { background-color: #ffffff; color: #000000; } "
+    "button.equals { background-color: #ffff00; color: #000000; }";
+
+const char *theme_name(Theme theme) {
+    switch (theme) {
+    case THEME_LIGHT: return "Light";
+    case THEME_DARK: return "Dark";
+    case THEME_HIGH_CONTRAST: return "High Contrast";
+    default: return "";
+    }
+}
+
+const char *theme_css(Theme theme) {
+    switch (theme) {
+    case THEME_DARK: return DARK_CSS;
+    case THEME_HIGH_CONTRAST: return HIGH_CONTRAST_CSS;
+    default: return LIGHT_CSS;
+    }
+}
+
+const char *button_style_class(ButtonStyle style) {
+    switch (style) {
+    case STYLE_DIGIT: return "digit";
+    case STYLE_OPERATOR: return "operator";
+    case STYLE_FUNCTION: return "function";
+    case STYLE_UTILITY: return "utility";
+    case STYLE_MEMORY: return "memory";
+    case STYLE_CLEAR: return "clear";
+    case STYLE_EQUALS: return "equals";
+    }
+    return "";
+}
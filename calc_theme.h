@@ -0,0 +1,25 @@
+#ifndef CALC_THEME_H
+#define CALC_THEME_H
+
+#include "calc_commands.h"
+
+// Colour themes. Each is one complete stylesheet; the window loads it into
+// a single screen-wide CSS provider and widgets pick their look from style
+// classes, so switching theme is one reload rather than one per widget.
+enum Theme {
+    THEME_LIGHT,
+    THEME_DARK,
+    THEME_HIGH_CONTRAST,
+    THEME_COUNT
+};
+
+// Menu name of a theme ("Light", "Dark", "High Contrast")
+const char *theme_name(Theme theme);
+
+// Stylesheet for a theme
+const char *theme_css(Theme theme);
+
+// CSS class for a keypad button colour group ("digit", "operator", ...)
+const char *button_style_class(ButtonStyle style);
+
+#endif // CALC_THEME_H
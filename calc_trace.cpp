@@ -0,0 +1,86 @@
+#include "calc_trace.h"
+#include <cstring>
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+// Seconds since this process was exec'd: /proc/self/stat field 22 is the
+// start time in clock ticks after boot, compared against CLOCK_BOOTTIME
+static bool seconds_since_exec(double *seconds) {
+    FILE *stat = fopen("/proc/self/stat", "r");
+    if (!stat) return false;
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, stat);
+    fclose(stat);
+    buf[n] = '\0';
+
+    // The command name may contain spaces, so count fields after its ')'
+    const char *p = strrchr(buf, ')');
+    if (!p) return false;
+    unsigned long long start_ticks = 0;
+    int field = 2;
+    while (*p && field < 22) {
+        if (*p == ' ') field++;
+        p++;
+    }
+    if (field != 22 || sscanf(p, "%llu", &start_ticks) != 1) return false;
+
+    struct timespec now;
+    long ticks_per_second = sysconf(_SC_CLK_TCK);
+    if (ticks_per_second <= 0 || clock_gettime(CLOCK_BOOTTIME, &now) != 0) return false;
+    *seconds = now.tv_sec + now.tv_nsec * 1e-9 - (double)start_ticks / ticks_per_second;
+    return *seconds >= 0;
+}
+
+// Resident memory: /proc/self/statm field 2, in pages
+static bool resident_bytes(double *bytes) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm) return false;
+    unsigned long size = 0, resident = 0;
+    int fields = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+    long page = sysconf(_SC_PAGESIZE);
+    if (fields != 2 || page <= 0) return false;
+    *bytes = (double)resident * page;
+    return true;
+}
+#endif
+
+void StartupTrace::enable() {
+    Clock::time_point now = Clock::now();
+    enabled = true;
+    origin = now;
+#ifdef __linux__
+    double elapsed;
+    if (seconds_since_exec(&elapsed)) {
+        origin = now - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(elapsed));
+        have_process_start = true;
+    }
+#endif
+    mark("main");
+}
+
+void StartupTrace::mark(const char *phase) {
+    if (!enabled || mark_count == MAX_MARKS) return;
+    marks[mark_count].phase = phase;
+    marks[mark_count].time = Clock::now();
+    mark_count++;
+}
+
+void StartupTrace::print(FILE *out) const {
+    if (!enabled) return;
+    fprintf(out, "startup: %10.3f ms  %s\n", 0.0, have_process_start ? "process start" : "main (process start unknown)");
+    Clock::time_point previous = origin;
+    for (int i = 0; i < mark_count; i++) {
+        double at = std::chrono::duration<double, std::milli>(marks[i].time - origin).count();
+        double step = std::chrono::duration<double, std::milli>(marks[i].time - previous).count();
+        fprintf(out, "startup: %10.3f ms  %-24s (+%.3f ms)\n", at, marks[i].phase, step);
+        previous = marks[i].time;
+    }
+#ifdef __linux__
+    double resident;
+    if (resident_bytes(&resident)) fprintf(out, "startup: resident memory %.1f MB\n", resident / (1024 * 1024));
+#endif
+}
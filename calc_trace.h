@@ -0,0 +1,43 @@
+#ifndef CALC_TRACE_H
+#define CALC_TRACE_H
+
+#include <chrono>
+#include <cstdio>
+
+// Cold-start timeline for --startup-trace. Phases are marked as they
+// finish and printed as offsets from process start (read from /proc on
+// Linux, to the kernel's 10 ms tick) or from main() where that is not
+// available, followed by the resident memory on Linux. Marks are dropped
+// while disabled, so call sites stay unconditional.
+class StartupTrace {
+public:
+    static const int MAX_MARKS = 32;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Mark {
+        const char *phase;
+        Clock::time_point time;
+    };
+
+    bool enabled;
+    bool have_process_start;
+    Clock::time_point origin; // Process start, or main() if unknown
+    Mark marks[MAX_MARKS];
+    int mark_count;
+
+public:
+    StartupTrace() : enabled(false), have_process_start(false), mark_count(0) {}
+
+    // Start recording; called first thing in main()
+    void enable();
+    bool is_enabled() const { return enabled; }
+
+    // Record that a phase has just finished (phase must be a literal)
+    void mark(const char *phase);
+
+    void print(FILE *out) const;
+};
+
+#endif // CALC_TRACE_H
@@ -0,0 +1,165 @@
+#include "calc_trig.h"
+#include <cmath>
+
+namespace {
+
+const double ROUND_MAGIC = 6755399441055744.0; // 1.5 * 2^52
+const double SPLITTER = 134217729.0;            // 2^27 + 1
+const double TWO_50 = 1125899906842624.0;
+
+// One degree and one gradian in radians, as head and tail
+const double DEGREE = 0.017453292519943295;
+const double DEGREE_LO = 2.9486522708701687e-19;
+const double GRADIAN = 0.015707963267948967;
+const double GRADIAN_LO = -7.754553812077691e-19;
+
+// π/2 in pieces: two 33-bit heads whose products with a quadrant count
+// below 2^20 are exact, and the rest
+const double INV_PIO2 = 0.6366197723675814;
+const double PIO2_1 = 1.5707963267341256;
+const double PIO2_2 = 6.077100506303966e-11;
+const double PIO2_2T = 2.0222662487959506e-21;
+
+// fdlibm's minimax polynomials for sin and cos on [-π/4, π/4]
+const double S1 = -1.66666666666666324348e-01;
+const double S2 = 8.33333333332248946124e-03;
+const double S3 = -1.98412698298579493134e-04;
+const double S4 = 2.75573137070700676789e-06;
+const double S5 = -2.50507602534068634195e-08;
+const double S6 = 1.58969099521155010221e-10;
+const double C1 = 4.16666666666666019037e-02;
+const double C2 = -1.38888888888741095749e-03;
+const double C3 = 2.48015872894767294178e-05;
+const double C4 = -2.75573143513906633035e-07;
+const double C5 = 2.08757232129817482790e-09;
+const double C6 = -1.13596475577881948265e-11;
+
+// Nearest integer, for |x| < 2^51
+inline double round_int(double x) {
+    return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+// sin(t + tl) and cos(t + tl) for |t| <= π/4 and |tl| below an ulp of t
+inline double kernel_sin(double t, double tl) {
+    double z = t * t;
+    double w = z * z;
+    double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+    double v = z * t;
+    return t - ((z * (0.5 * tl - v * r) - tl) - v * S1);
+}
+
+inline double kernel_cos(double t, double tl) {
+    double z = t * t;
+    double w = z * z;
+    double r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+    double hz = 0.5 * z;
+    w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + (z * r - t * tl));
+}
+
+// Degrees and gradians split into 26-bit halves, so d·head is exact in
+// two_product without splitting the constant on every call
+const double DEGREE_HEAD = 0.01745329238474369;
+const double GRADIAN_HEAD = 0.01570796314626932;
+
+// x as t + tl radians with |t| <= π/4, in the given quadrant (0 to 3); d
+// is the remainder in x's own unit, NaN for radians. False for radians
+// past RADIAN_REDUCTION_LIMIT, which are left to libm.
+struct Reduced {
+    double t, tl;
+    double d;
+    int quadrant;
+};
+
+inline bool reduce(double x, AngleUnit unit, Reduced &out) {
+    double q;
+    if (unit == ANGLE_RADIANS) {
+        if (!(fabs(x) < RADIAN_REDUCTION_LIMIT)) return false;
+        q = round_int(x * INV_PIO2);
+        double r = x - q * PIO2_1; // Exact
+        double p = q * PIO2_2;     // Exact
+        double t = r - p;
+        double v = t - r;
+        double tl = ((r - (t - v)) - (p + v)) - q * PIO2_2T;
+        // The last piece can be larger than an ulp of t; fold it in
+        out.t = t + tl;
+        out.tl = tl - (out.t - t);
+        out.d = NAN;
+    } else {
+        bool degrees = unit == ANGLE_DEGREES;
+        double period = degrees ? 360.0 : 400.0;
+        double quarter = degrees ? 90.0 : 100.0;
+        // x - k·period and r - q·quarter are exact below 2^50; fmod is
+        // exact at any size, just slower
+        double r = fabs(x) < TWO_50 ? x - round_int(x * (degrees ? 1.0 / 360 : 1.0 / 400)) * period
+                                    : fmod(x, period);
+        q = round_int(r * (degrees ? 1.0 / 90 : 1.0 / 100));
+        double d = r - q * quarter;
+
+        // d × (π/180 or π/200) in double-double (Dekker, constant pre-split)
+        double head = degrees ? DEGREE_HEAD : GRADIAN_HEAD;
+        double scale = degrees ? DEGREE : GRADIAN;
+        double t = d * scale;
+        double cd = SPLITTER * d;
+        double dh = cd - (cd - d);
+        double dl = d - dh;
+        double tail = scale - head;
+        out.t = t;
+        out.tl = ((dh * head - t) + dh * tail + dl * head) + dl * tail +
+                 d * (degrees ? DEGREE_LO : GRADIAN_LO);
+        out.d = d;
+    }
+    out.quadrant = (int)q & 3;
+    return true;
+}
+
+// sin, cos, -sin and -cos of the reduced angle, so a quadrant indexes the
+// answer instead of branching on it. sin is exact at 30° (0° and 90° come
+// out exact anyway).
+inline void reduced_values(const Reduced &r, AngleUnit unit, double v[4]) {
+    double s = kernel_sin(r.t, r.tl);
+    double c = kernel_cos(r.t, r.tl);
+    if (unit == ANGLE_DEGREES && fabs(r.d) == 30.0) s = r.d > 0 ? 0.5 : -0.5;
+    // The + 0.0 turns a -0 from the quadrant sign into 0
+    v[0] = s + 0.0;
+    v[1] = c + 0.0;
+    v[2] = -s + 0.0;
+    v[3] = -c + 0.0;
+}
+
+} // namespace
+
+double sin_angle(double x, AngleUnit unit) {
+    Reduced r;
+    if (!reduce(x, unit, r)) return sin(x);
+    double v[4];
+    reduced_values(r, unit, v);
+    return v[r.quadrant];
+}
+
+double cos_angle(double x, AngleUnit unit) {
+    Reduced r;
+    if (!reduce(x, unit, r)) return cos(x);
+    double v[4];
+    reduced_values(r, unit, v);
+    return v[(r.quadrant + 1) & 3];
+}
+
+bool tan_angle(double x, AngleUnit unit, double *result) {
+    Reduced r;
+    if (!reduce(x, unit, r)) {
+        *result = tan(x);
+        return true;
+    }
+    double v[4];
+    reduced_values(r, unit, v);
+    double s = v[0], c = v[1];
+    // Halfway through a quadrant both round to the same double, so
+    // tan(45) is exactly 1
+    if (fabs(r.d) == (unit == ANGLE_DEGREES ? 45.0 : 50.0)) c = fabs(s);
+    double num = r.quadrant & 1 ? -c : s;
+    double den = r.quadrant & 1 ? s : c;
+    if (den == 0) return false;
+    *result = num / den + 0.0;
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef CALC_TRIG_H
+#define CALC_TRIG_H
+
+#include "calc_expr.h"
+
+// sin, cos and tan in double precision with the angle in degrees, radians
+// or gradians, for the expression VM and the keypad.
+//
+// Degrees and gradians are reduced in their own units: x - 360k (400k)
+// and the quadrant step are exact, so sin(180) is 0, cos(90) is 0,
+// tan(45) is 1, sin(30) is 0.5 and tan(90) is a pole at any size of
+// angle. Only the remainder, at most 45° (50 grad), is turned into
+// radians, in double-double, for a minimax polynomial on [-π/4, π/4].
+// Radians are reduced by π/2 carried to 119 bits, which is exact enough
+// below RADIAN_REDUCTION_LIMIT; larger radian arguments go to libm.
+// sin and cos are within an ulp of the true value, tan within two.
+
+const double RADIAN_REDUCTION_LIMIT = 1048576.0; // 2^20
+
+double sin_angle(double x, AngleUnit unit);
+double cos_angle(double x, AngleUnit unit);
+
+// False at a pole, where cos is exactly 0 (90° + 180°k, 100 grad + 200k)
+bool tan_angle(double x, AngleUnit unit, double *result);
+
+#endif // CALC_TRIG_H
@@ -0,0 +1,143 @@
+#include "calc_expr.h"
+#include "calc_registers.h"
+#include "calc_special.h"
+#include "calc_vecmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Column-at-a-time evaluation for table mode. The bytecode is the same one
+// Program::run() executes, but every stack slot holds VECTOR_BATCH values
+// and each opcode runs once over all of them, so dispatch costs nothing
+// per point and the math kernels see whole arrays.
+
+namespace {
+
+typedef EvalStatus (*ScalarBinary)(double, double, double *);
+
+// Factorial and the counting functions have no vector kernel
+void apply_scalar_unary(unsigned char op, double *a, size_t n, AngleUnit unit) {
+    for (size_t i = 0; i < n; i++) {
+        if (apply_unary(op, a[i], &a[i], unit) != EVAL_OK) a[i] = NAN;
+    }
+}
+
+void apply_scalar_binary(ScalarBinary f, double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (f(a[i], b[i], &a[i]) != EVAL_OK) a[i] = NAN;
+    }
+}
+
+} // namespace
+
+void Program::run_vector(const double *x, double *out, size_t n, const VecMath &math,
+                         std::vector<double> &stack) const {
+    if (stack.size() < max_depth * VECTOR_BATCH) stack.resize(max_depth * VECTOR_BATCH);
+    double *base = stack.data();
+    const double *k = constants.data();
+    const unsigned *s = symbols.data();
+    size_t top = 0; // Slots in use
+
+    for (size_t ip = 0; ip < code.size(); ip++) {
+        unsigned char op = code[ip];
+        if (op == OP_PUSH || op == OP_VARIABLE || op == OP_LOAD) {
+            double *slot = base + top * VECTOR_BATCH;
+            if (op == OP_PUSH) {
+                std::fill(slot, slot + n, *k++);
+            } else if (op == OP_LOAD) {
+                std::fill(slot, slot + n, registers->value(*s++)); // NaN if removed
+            } else {
+                memcpy(slot, x, n * sizeof(double));
+            }
+            top++;
+            continue;
+        }
+
+        double *b = NULL; // Right operand of a binary op, just popped
+        if (op == OP_ADD || op == OP_SUB || op == OP_MUL || op == OP_DIV || op == OP_POW ||
+            op == OP_NCR || op == OP_NPR) {
+            top--;
+            b = base + top * VECTOR_BATCH;
+        }
+        double *a = base + (top - 1) * VECTOR_BATCH;
+
+        switch (op) {
+            case OP_ADD:
+                for (size_t i = 0; i < n; i++) a[i] += b[i];
+                break;
+            case OP_SUB:
+                for (size_t i = 0; i < n; i++) a[i] -= b[i];
+                break;
+            case OP_MUL:
+                for (size_t i = 0; i < n; i++) a[i] *= b[i];
+                break;
+            case OP_DIV:
+                for (size_t i = 0; i < n; i++) a[i] = b[i] == 0 ? NAN : a[i] / b[i];
+                break;
+            case OP_POW: {
+                // x² is common and x*x is exactly what pow gives
+                bool square = true;
+                for (size_t i = 0; i < n; i++) square = square && b[i] == 2;
+                if (square) {
+                    for (size_t i = 0; i < n; i++) a[i] *= a[i];
+                    break;
+                }
+                // libm's pow(NaN, 0) is 1, but NaN here marks a failed point
+                for (size_t i = 0; i < n; i++) {
+                    if (a[i] != a[i]) b[i] = NAN;
+                }
+                math.pow(a, b, a, n);
+                for (size_t i = 0; i < n; i++) {
+                    if (b[i] != b[i]) a[i] = NAN;
+                }
+                break;
+            }
+            case OP_NCR:
+                apply_scalar_binary(combinations, a, b, n);
+                break;
+            case OP_NPR:
+                apply_scalar_binary(permutations, a, b, n);
+                break;
+            case OP_NEG:
+                for (size_t i = 0; i < n; i++) a[i] = -a[i];
+                break;
+            case OP_PERCENT:
+                for (size_t i = 0; i < n; i++) a[i] /= 100.0;
+                break;
+            case OP_SQUARE:
+                for (size_t i = 0; i < n; i++) a[i] *= a[i];
+                break;
+            case OP_SIN:
+            case OP_COS:
+            case OP_TAN:
+                // The kernels are in degrees; other units take the scalar path
+                if (angle_unit != ANGLE_DEGREES) {
+                    apply_scalar_unary(op, a, n, angle_unit);
+                } else if (op == OP_SIN) {
+                    math.sin_degrees(a, a, n);
+                } else if (op == OP_COS) {
+                    math.cos_degrees(a, a, n);
+                } else {
+                    math.tan_degrees(a, a, n);
+                }
+                break;
+            case OP_LOG:
+                math.log10(a, a, n);
+                break;
+            case OP_LN:
+                math.ln(a, a, n);
+                break;
+            case OP_SQRT:
+                math.sqrt(a, a, n);
+                break;
+            default:
+                apply_scalar_unary(op, a, n, angle_unit);
+                break;
+        }
+    }
+    if (top == 0) {
+        std::fill(out, out + n, 0.0);
+    } else {
+        memcpy(out, base, n * sizeof(double));
+    }
+}
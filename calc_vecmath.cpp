@@ -0,0 +1,190 @@
+#include "calc_vecmath.h"
+#include "calc_expr.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Constants shared by every kernel width (see calc_vecmath_impl.h)
+const double ROUND_MAGIC = 6755399441055744.0; // 1.5 * 2^52
+const double SPLITTER = 134217729.0;            // 2^27 + 1
+const double TWO_54 = 18014398509481984.0;
+const double TWO_50 = 1125899906842624.0;
+const double LOG_SPLIT = 1.40625; // Near √2, on a LOG_TABLE boundary
+const long long SIGN_BIT = 0x8000000000000000LL;
+const long long MANTISSA_BITS = 0x000fffffffffffffLL;
+const long long ONE_BITS = 0x3ff0000000000000LL;
+
+// ln 2 with a short head so n * LN2_HI is exact
+const double LN2_HI = 0.6931471803691238;
+const double LN2_LO = 1.9082149292705877e-10;
+const double INV_LN2 = 1.4426950408889634;
+const double INV_LN10 = 0.4342944819032518;
+
+// π/180 as head and tail
+const double DEGREE = 0.017453292519943295;
+const double DEGREE_LO = 2.9486522708701687e-19;
+
+// (-1)^i/(i+3): ln(1+r) past r - r²/2
+const double LOG1P_SERIES[11] = {
+    1.0 / 3, -1.0 / 4, 1.0 / 5, -1.0 / 6, 1.0 / 7, -1.0 / 8,
+    1.0 / 9, -1.0 / 10, 1.0 / 11, -1.0 / 12, 1.0 / 13
+};
+
+// For each 1/32 of the mantissa range, c near 1/m with 8 fractional bits
+// (1 for the intervals next to 1, so ln x near 0 keeps its precision) and
+// -ln c as head and tail. Entries 13 and up are for m halved below 1.
+struct LogEntry {
+    double c;
+    double minus_ln;
+    double minus_ln_lo;
+};
+
+const LogEntry LOG_TABLE[32] = {
+    {1.0, 0.0, 0.0},
+    {0.95703125, 0.04391923393483549, 1.762355270004629e-18},
+    {0.92578125, 0.07711730334443129, 2.5654358635266204e-18},
+    {0.90234375, 0.10275973395776894, -4.707630866560681e-18},
+    {0.875, 0.13353139262452263, -3.664457663660085e-18},
+    {0.8515625, 0.16068238169047347, -3.650183553047837e-18},
+    {0.83203125, 0.18388527877013736, 6.716094199344591e-18},
+    {0.80859375, 0.2124586512141934, -9.63115306272449e-18},
+    {0.7890625, 0.2369097470783577, 1.9682402978398164e-18},
+    {0.76953125, 0.26197371574157396, 3.769957084925505e-18},
+    {0.75390625, 0.2824872555746769, 1.3652325538490778e-17},
+    {0.734375, 0.3087354816496133, -1.6199186085148102e-17},
+    {0.71875, 0.33024168687057687, -1.0828321637483858e-17},
+    {1.40625, -0.3409265869705932, -1.7467136443544747e-17},
+    {1.375, -0.3184537311185346, -2.7114779367326236e-17},
+    {1.34765625, -0.2983669725517973, 1.1440869858035824e-18},
+    {1.3203125, -0.2778684510034563, 9.16018294909263e-19},
+    {1.29296875, -0.2569409308975004, -6.30788074376329e-18},
+    {1.265625, -0.2355660713127669, 2.3943371495187355e-18},
+    {1.2421875, -0.21687393830061436, -4.551026193234283e-18},
+    {1.21875, -0.19782574332991987, -1.2821194372980142e-17},
+    {1.1953125, -0.1784076574728183, 1.2432553788701131e-17},
+    {1.17578125, -0.16193282026931324, -9.773924675229098e-18},
+    {1.15234375, -0.14179791186025734, -1.3587228662372945e-17},
+    {1.1328125, -0.12470347850095724, 4.6522609636496624e-18},
+    {1.11328125, -0.10731173578908805, -4.480328406815626e-19},
+    {1.09375, -0.08961215868968714, 5.4268129336647135e-18},
+    {1.07421875, -0.07159365318700882, 3.804421579719008e-19},
+    {1.05859375, -0.056941376400138424, -4.849020418096643e-19},
+    {1.0390625, -0.0383188643021366, 2.357996157351286e-18},
+    {1.0234375, -0.02316705928153438, 1.1769544932063305e-18},
+    {1.0, 0.0, 0.0},
+};
+
+// 2/(2i+3): ln(1+f) = 2 atanh(s) past its first term
+const double LOG_SERIES[11] = {
+    2.0 / 3, 2.0 / 5, 2.0 / 7, 2.0 / 9, 2.0 / 11, 2.0 / 13,
+    2.0 / 15, 2.0 / 17, 2.0 / 19, 2.0 / 21, 2.0 / 23
+};
+
+// 1/(i+2)!
+const double EXP_SERIES[12] = {
+    1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+    1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800
+};
+
+// (-1)^(i+1)/(2i+3)! and (-1)^i/(2i+4)!, Taylor series on |t| <= π/4
+const double SIN_SERIES[8] = {
+    -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800,
+    1.0 / 6227020800, -1.0 / 1307674368000, 1.0 / 355687428096000
+};
+const double COS_SERIES[8] = {
+    1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800, 1.0 / 479001600,
+    -1.0 / 87178291200, 1.0 / 20922789888000, -1.0 / 6402373705728000
+};
+
+// The keypad's own path, one apply_unary() call per element
+void scalar_unary(unsigned char op, const double *x, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (apply_unary(op, x[i], &out[i]) != EVAL_OK) out[i] = NAN;
+    }
+}
+
+void scalar_sin(const double *x, double *out, size_t n) { scalar_unary(OP_SIN, x, out, n); }
+void scalar_cos(const double *x, double *out, size_t n) { scalar_unary(OP_COS, x, out, n); }
+void scalar_tan(const double *x, double *out, size_t n) { scalar_unary(OP_TAN, x, out, n); }
+void scalar_log10(const double *x, double *out, size_t n) { scalar_unary(OP_LOG, x, out, n); }
+void scalar_ln(const double *x, double *out, size_t n) { scalar_unary(OP_LN, x, out, n); }
+void scalar_sqrt(const double *x, double *out, size_t n) { scalar_unary(OP_SQRT, x, out, n); }
+
+void scalar_exp(const double *x, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = exp(x[i]);
+}
+
+void scalar_pow(const double *x, const double *y, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = pow(x[i], y[i]);
+}
+
+const VecMath SCALAR_KERNELS = {
+    "scalar", scalar_sin, scalar_cos, scalar_tan, scalar_log10, scalar_ln, scalar_exp, scalar_sqrt, scalar_pow
+};
+
+namespace vec128 {
+#define VEC_WIDTH 2
+#if defined(__x86_64__)
+#define VEC_NAME "sse2"
+#define VEC_SQRT(v) _mm_sqrt_pd(v)
+#else
+#define VEC_NAME "vec128"
+#endif
+#include "calc_vecmath_impl.h"
+#undef VEC_WIDTH
+#undef VEC_NAME
+#undef VEC_SQRT
+} // namespace vec128
+
+#ifdef CALC_VECMATH_AVX2
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+#define VEC_WIDTH 4
+#define VEC_NAME "avx2"
+#define VEC_SQRT(v) _mm256_sqrt_pd(v)
+#define VEC_FMA(a, b, c) _mm256_fmadd_pd(a, b, c)
+#include "calc_vecmath_impl.h"
+#undef VEC_WIDTH
+#undef VEC_NAME
+#undef VEC_SQRT
+#undef VEC_FMA
+} // namespace avx2
+#pragma GCC pop_options
+#endif
+
+} // namespace
+
+bool vecmath_has_avx2() {
+#ifdef CALC_VECMATH_AVX2
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+
+const VecMath &vecmath_scalar() {
+    return SCALAR_KERNELS;
+}
+
+const VecMath *vecmath_find(const char *name) {
+    if (strcmp(name, SCALAR_KERNELS.name) == 0) return &SCALAR_KERNELS;
+    if (strcmp(name, vec128::KERNELS.name) == 0) return &vec128::KERNELS;
+#ifdef CALC_VECMATH_AVX2
+    if (strcmp(name, avx2::KERNELS.name) == 0 && vecmath_has_avx2()) return &avx2::KERNELS;
+#endif
+    return NULL;
+}
+
+const VecMath &vecmath_best() {
+#ifdef CALC_VECMATH_AVX2
+    if (vecmath_has_avx2()) return avx2::KERNELS;
+#endif
+    return vec128::KERNELS;
+}
@@ -0,0 +1,53 @@
+#ifndef CALC_VECMATH_H
+#define CALC_VECMATH_H
+
+#include <cstddef>
+
+// The AVX2 kernels, here and in calc_matrix.cpp, need GCC's target pragma;
+// other compilers get SSE2 only
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define CALC_VECMATH_AVX2 1
+#endif
+
+// Elementwise math over arrays of doubles for table mode. Each kernel set
+// has the same entry points; vecmath_best() picks the widest one the CPU
+// supports at run time (AVX2 with FMA, then SSE2), and vecmath_scalar() is the
+// scalar loop over the keypad's own kernels (calc_trig.h), kept as the
+// reference.
+//
+// Angles are in degrees like the keypad. The SIMD kernels reduce them
+// exactly (x - 360k is exact in floating point), so sin(180) is 0 and
+// tan(90) is a pole. Results are within an ulp or two of the true value.
+// Wherever apply_unary() would report invalid input the result is NaN.
+
+// Points per Program::run_vector call
+const size_t VECTOR_BATCH = 256;
+
+typedef void (*VecUnary)(const double *x, double *out, size_t n);
+typedef void (*VecBinary)(const double *x, const double *y, double *out, size_t n);
+
+// out may alias an input
+struct VecMath {
+    const char *name;
+    VecUnary sin_degrees;
+    VecUnary cos_degrees;
+    VecUnary tan_degrees;
+    VecUnary log10;
+    VecUnary ln;
+    VecUnary exp;
+    VecUnary sqrt;
+    VecBinary pow;
+};
+
+const VecMath &vecmath_scalar();
+
+// The kernel set called name ("sse2", "avx2", "scalar"), or NULL if this
+// CPU or build does not have it
+const VecMath *vecmath_find(const char *name);
+
+const VecMath &vecmath_best();
+
+// True if this build has AVX2 kernels and the CPU runs AVX2 with FMA
+bool vecmath_has_avx2();
+
+#endif // CALC_VECMATH_H
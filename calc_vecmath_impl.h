@@ -0,0 +1,356 @@
+// Kernel bodies for calc_vecmath.cpp, which includes this file once per
+// vector width, each time inside its own namespace (and, for the wider
+// ones, inside a target pragma). No include guard on purpose.
+//
+// The includer defines:
+//   VEC_WIDTH     doubles per vector
+//   VEC_NAME      name reported in VecMath::name
+//   VEC_SQRT(v)   optional vector square root instruction
+//   VEC_FMA(a,b,c) optional fused multiply-add, used only where it gives
+//                 the same exact result as the plain arithmetic
+//
+// The code is written once with GCC vector types, so each width compiles
+// to its own instruction set. The widths run the same operations in the
+// same order, but where the compiler fuses a multiply-add (AVX2) the last
+// bit can differ; every set stays within the accuracy in calc_vecmath.h.
+
+typedef double vd __attribute__((vector_size(VEC_WIDTH * 8)));
+typedef decltype(vd() < vd()) vi;
+
+inline vd load(const double *p) {
+    vd v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(double *p, vd v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+inline vd splat(double a) {
+    return vd() + a;
+}
+
+inline bool any(vi mask) {
+    for (int i = 0; i < VEC_WIDTH; i++) {
+        if (mask[i]) return true;
+    }
+    return false;
+}
+
+// Nearest integer, for |x| < 2^51
+inline vd round_int(vd x) {
+    return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+// Small integers (|k| < 2^51) to double and back via the same constant
+inline vd to_double(vi k) {
+    return (vd)((vi)splat(ROUND_MAGIC) + k) - ROUND_MAGIC;
+}
+
+inline vi to_int(vd rounded) {
+    return (vi)(rounded + ROUND_MAGIC) - (vi)splat(ROUND_MAGIC);
+}
+
+inline vd vec_abs(vd x) {
+    return (vd)((vi)x & ~SIGN_BIT);
+}
+
+// Error-free transformations for the double-double steps
+inline void two_sum(vd a, vd b, vd &s, vd &e) {
+    s = a + b;
+    vd bb = s - a;
+    e = (a - (s - bb)) + (b - bb);
+}
+
+#ifdef VEC_FMA
+inline void two_product(vd a, vd b, vd &p, vd &e) {
+    p = a * b;
+    e = VEC_FMA(a, b, -p);
+}
+#else
+inline void two_product(vd a, vd b, vd &p, vd &e) {
+    p = a * b;
+    vd ca = a * SPLITTER;
+    vd ah = ca - (ca - a);
+    vd al = a - ah;
+    vd cb = b * SPLITTER;
+    vd bh = cb - (cb - b);
+    vd bl = b - bh;
+    e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+}
+#endif
+
+#ifdef VEC_SQRT
+inline vd vec_sqrt(vd x) {
+    return VEC_SQRT(x);
+}
+#else
+inline vd vec_sqrt(vd x) {
+    for (int i = 0; i < VEC_WIDTH; i++) x[i] = std::sqrt(x[i]);
+    return x;
+}
+#endif
+
+// x = 2^k m with m in [0.703125, 1.40625), for finite x > 0. index is the
+// top five mantissa bits, which pick the LOG_TABLE interval m lies in.
+// Sum of c[i] r^i for i < n, as even and odd halves in r² so the two
+// chains of multiply-adds overlap
+inline vd polynomial(const double *c, int n, vd r) {
+    vd r2 = r * r;
+    int last = n - 1;
+    vd even = splat(c[last & ~1]);
+    vd odd = splat(c[(last - 1) | 1]);
+    for (int i = (last & ~1) - 2; i >= 0; i -= 2) even = even * r2 + c[i];
+    for (int i = ((last - 1) | 1) - 2; i >= 1; i -= 2) odd = odd * r2 + c[i];
+    return even + r * odd;
+}
+
+inline vd split_exponent(vd x, vd &k, vi &index) {
+    // Subnormals: scale into the normal range first
+    vi tiny = x < DBL_MIN;
+    x = tiny ? x * TWO_54 : x;
+    vi bits = (vi)x;
+    vi e = ((bits >> 52) & 0x7ff) - 1023 - (tiny & 54);
+    vd m = (vd)((bits & MANTISSA_BITS) | ONE_BITS);
+    index = (bits >> 47) & 31;
+    vi high = m >= LOG_SPLIT;
+    k = to_double(e - high);
+    return high ? m * 0.5 : m;
+}
+
+// ln x for finite x > 0 to within an ulp: with f = m - 1 exact and
+// s = f/(2+f), ln m = f - f²/2 + s(f²/2 + R(s²)) where only the small
+// correction term carries rounding error
+inline vd ln_fast(vd x) {
+    vd k;
+    vi index;
+    vd f = split_exponent(x, k, index) - 1.0;
+    vd s = f / (2.0 + f);
+    vd z = s * s;
+    vd r = splat(LOG_SERIES[10]);
+    for (int i = 9; i >= 0; i--) r = r * z + LOG_SERIES[i];
+    r *= z;
+    vd hfsq = 0.5 * f * f;
+    return k * LN2_HI - ((hfsq - (s * (hfsq + r) + k * LN2_LO)) - f);
+}
+
+// ln x as hi + lo for finite x > 0, good to about 2^-70 relative. With
+// c from LOG_TABLE, m c = 1 + r with |r| < 1/32 held exactly in two
+// parts, and ln m = -ln c + ln(1 + r) needs only a short series.
+inline void ln_split(vd x, vd &hi, vd &lo) {
+    vd k;
+    vi index;
+    vd m = split_exponent(x, k, index);
+    vd c, lc, lc_lo;
+    for (int i = 0; i < VEC_WIDTH; i++) {
+        const LogEntry &entry = LOG_TABLE[index[i]];
+        c[i] = entry.c;
+        lc[i] = entry.minus_ln;
+        lc_lo[i] = entry.minus_ln_lo;
+    }
+
+    vd p, pe;
+    two_product(m, c, p, pe);
+    vd r, rl;
+    two_sum(p - 1.0, pe, r, rl);
+
+    // ln(1 + r) = r - r²/2 + r³ P(r)
+    vd q, qe;
+    two_product(r, r, q, qe);
+    vd series = polynomial(LOG1P_SERIES, 11, r);
+    vd s, se;
+    two_sum(r, -0.5 * q, s, se);
+    se += rl - (0.5 * qe + r * rl) + q * r * series;
+
+    vd u, ue;
+    two_sum(lc, s, u, ue);
+    ue += se + lc_lo;
+    vd t, te;
+    two_sum(k * LN2_HI, u, t, te);
+    te += ue + k * LN2_LO;
+    hi = t + te;
+    lo = te - (hi - t);
+}
+
+// e^(hi + lo), overflowing to Infinity and underflowing to 0
+inline vd exp_split(vd hi, vd lo) {
+    hi = hi > 1400.0 ? splat(1400.0) : hi;
+    hi = hi < -1400.0 ? splat(-1400.0) : hi;
+    vd n = round_int(hi * INV_LN2);
+    vd r, rl;
+    two_sum(hi - n * LN2_HI, -(n * LN2_LO), r, rl);
+    rl += lo;
+
+    // e^r - 1 for |r| <= 0.35
+    vd poly = polynomial(EXP_SERIES, 12, r);
+    vd em1 = r + r * r * poly;
+    vd y = 1.0 + (em1 + (rl + rl * em1));
+
+    // 2^n in two halves so subnormal results and n = 1024 both work
+    vi ni = to_int(n);
+    vi half = ni >> 1;
+    vd scale1 = (vd)((half + 1023) << 52);
+    vd scale2 = (vd)((ni - half + 1023) << 52);
+    return y * scale1 * scale2;
+}
+
+// sin and cos of x degrees, and the quadrant they were reduced by
+inline void sincos_degrees(vd x, vd &s, vd &c, vd &q) {
+    // x - 360k and r - 90q are exact for |x| < 2^50
+    vd k = round_int(x * (1.0 / 360));
+    vd r = x - k * 360.0;
+    q = round_int(r * (1.0 / 90));
+    vd d = r - q * 90.0;
+
+    vd t, tl;
+    two_product(d, splat(DEGREE), t, tl);
+    tl += d * DEGREE_LO;
+    vd w = t * t;
+
+    vd sp = splat(SIN_SERIES[7]);
+    for (int i = 6; i >= 0; i--) sp = sp * w + SIN_SERIES[i];
+    s = t + (tl + t * w * sp);
+
+    vd cp = splat(COS_SERIES[7]);
+    for (int i = 6; i >= 0; i--) cp = cp * w + COS_SERIES[i];
+    vd h = 0.5 * w;
+    vd hw = 1.0 - h;
+    c = hw + (((1.0 - hw) - h) + (w * w * cp - t * tl));
+
+    // At ±45° both round to the same double, so tan(45) is exactly 1
+    c = vec_abs(d) == 45.0 ? vec_abs(s) : c;
+}
+
+// Lanes too large for the exact reduction are brought into range first
+inline vd reduce_large(vd x) {
+    vi large = ~(vec_abs(x) < TWO_50);
+    if (any(large)) {
+        for (int i = 0; i < VEC_WIDTH; i++) {
+            if (large[i]) x[i] = std::fmod(x[i], 360.0);
+        }
+    }
+    return x;
+}
+
+inline vd sin_kernel(vd x) {
+    vd s, c, q;
+    sincos_degrees(reduce_large(x), s, c, q);
+    vi odd = (q == 1.0) | (q == -1.0);
+    vi negative = (q == 2.0) | (q == -2.0) | (q == -1.0);
+    vd v = odd ? c : s;
+    return (negative ? -v : v) + 0.0; // No -0 from the quadrant sign
+}
+
+inline vd cos_kernel(vd x) {
+    vd s, c, q;
+    sincos_degrees(reduce_large(x), s, c, q);
+    vi odd = (q == 1.0) | (q == -1.0);
+    vi negative = (q == 1.0) | (q == 2.0) | (q == -2.0);
+    vd v = odd ? s : c;
+    return (negative ? -v : v) + 0.0;
+}
+
+inline vd tan_kernel(vd x) {
+    vd s, c, q;
+    sincos_degrees(reduce_large(x), s, c, q);
+    vi odd = (q == 1.0) | (q == -1.0);
+    vd num = odd ? -c : s;
+    vd den = odd ? s : c;
+    return den == 0.0 ? splat(NAN) : num / den + 0.0;
+}
+
+inline vd ln_kernel(vd x) {
+    vd v = ln_fast(x);
+    v = x == INFINITY ? x : v;
+    return x > 0.0 ? v : splat(NAN);
+}
+
+inline vd log10_kernel(vd x) {
+    vd v = ln_fast(x) * INV_LN10;
+    v = x == INFINITY ? x : v;
+    return x > 0.0 ? v : splat(NAN);
+}
+
+inline vd exp_kernel(vd x) {
+    return exp_split(x, splat(0.0));
+}
+
+inline vd sqrt_kernel(vd x) {
+    return vec_sqrt(x);
+}
+
+// Full vectors, then the tail padded with zeros
+#define VEC_UNARY_ENTRY(entry, kernel)                                 \
+    void entry(const double *x, double *out, size_t n) {               \
+        size_t i = 0;                                                  \
+        for (; i + VEC_WIDTH <= n; i += VEC_WIDTH) {                   \
+            store(out + i, kernel(load(x + i)));                       \
+        }                                                              \
+        if (i < n) {                                                   \
+            double tail[VEC_WIDTH] = {0};                              \
+            memcpy(tail, x + i, (n - i) * sizeof(double));             \
+            store(tail, kernel(load(tail)));                           \
+            memcpy(out + i, tail, (n - i) * sizeof(double));           \
+        }                                                              \
+    }
+
+VEC_UNARY_ENTRY(sin_entry, sin_kernel)
+VEC_UNARY_ENTRY(cos_entry, cos_kernel)
+VEC_UNARY_ENTRY(tan_entry, tan_kernel)
+VEC_UNARY_ENTRY(log10_entry, log10_kernel)
+VEC_UNARY_ENTRY(ln_entry, ln_kernel)
+VEC_UNARY_ENTRY(exp_entry, exp_kernel)
+VEC_UNARY_ENTRY(sqrt_entry, sqrt_kernel)
+
+#undef VEC_UNARY_ENTRY
+
+// x^y as e^(y ln|x|) in double-double. Negative x takes the sign of an odd
+// integer y and is NaN otherwise; zeros, infinities, NaNs and huge y go to
+// libm one lane at a time.
+inline vd pow_kernel(vd x, vd y, vi &special) {
+    vd ax = vec_abs(x);
+    vd lh, ll;
+    ln_split(ax, lh, ll);
+    vd ph, pe;
+    two_product(y, lh, ph, pe);
+    vd v = exp_split(ph, pe + y * ll);
+
+    vi integer = round_int(y) == y;
+    vi odd = integer & (round_int(y * 0.5) != y * 0.5);
+    vi negative = x < 0.0;
+    v = (negative & odd) ? -v : v;
+    v = (negative & ~integer) ? splat(NAN) : v;
+    special = ~(ax > 0.0) | (ax == INFINITY) | ~(vec_abs(y) < TWO_50);
+    return v;
+}
+
+inline vd pow_lanes(vd x, vd y) {
+    vi special;
+    vd v = pow_kernel(x, y, special);
+    if (any(special)) {
+        for (int j = 0; j < VEC_WIDTH; j++) {
+            if (special[j]) v[j] = std::pow(x[j], y[j]);
+        }
+    }
+    return v;
+}
+
+void pow_entry(const double *x, const double *y, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+        store(out + i, pow_lanes(load(x + i), load(y + i)));
+    }
+    if (i < n) {
+        double xs[VEC_WIDTH] = {0};
+        double ys[VEC_WIDTH] = {0};
+        memcpy(xs, x + i, (n - i) * sizeof(double));
+        memcpy(ys, y + i, (n - i) * sizeof(double));
+        store(xs, pow_lanes(load(xs), load(ys)));
+        memcpy(out + i, xs, (n - i) * sizeof(double));
+    }
+}
+
+const VecMath KERNELS = {
+    VEC_NAME, sin_entry, cos_entry, tan_entry, log10_entry, ln_entry, exp_entry, sqrt_entry, pow_entry
+};
@@ -0,0 +1,93 @@
+#include "calc_worker.h"
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+EngineWorker::EngineWorker() :
+    engine(NULL),
+    command(CMD_NONE),
+    done(NULL),
+    done_data(NULL),
+    running(false),
+    stopping(false),
+    cancel_flag(false),
+    job_total(0),
+    cancel_total(0) {
+}
+
+EngineWorker::~EngineWorker() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+void EngineWorker::submit(CalcEngine &target, Command pressed, DoneFunc callback, void *data) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        engine = &target;
+        command = pressed;
+        done = callback;
+        done_data = data;
+        running = true;
+        cancel_flag = false;
+        job_total++;
+    }
+    if (!thread.joinable()) {
+        thread = std::thread(&EngineWorker::loop, this);
+    } else {
+        wake.notify_one();
+    }
+}
+
+void EngineWorker::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (running && !cancel_flag) {
+        cancel_flag = true;
+        cancel_total++;
+    }
+}
+
+void EngineWorker::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (running) finished.wait(guard);
+}
+
+bool EngineWorker::busy() {
+    std::lock_guard<std::mutex> guard(lock);
+    return running;
+}
+
+void EngineWorker::loop() {
+#ifdef __linux__
+    // Below the UI thread, so input still gets the CPU on a busy machine
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#endif
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        while (!stopping && (!running || !engine)) wake.wait(guard);
+        if (stopping) return;
+        CalcEngine *target = engine;
+        Command pressed = command;
+        DoneFunc callback = done;
+        void *data = done_data;
+        engine = NULL;
+        guard.unlock();
+        {
+            BigCancelScope scope(&cancel_flag);
+            target->press(pressed);
+        }
+        guard.lock();
+        running = false;
+        finished.notify_all();
+        // The callback may submit the next job
+        guard.unlock();
+        if (callback) callback(data);
+        guard.lock();
+    }
+}
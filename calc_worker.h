@@ -0,0 +1,61 @@
+#ifndef CALC_WORKER_H
+#define CALC_WORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "calc_engine.h"
+
+// Runs slow keypresses (CalcEngine::may_be_slow) on a background thread so
+// the window keeps taking input. submit() hands the engine over; the
+// caller must not touch it again until the job has finished, which it
+// learns from the done callback (called on the worker thread, so the GUI
+// posts it back to its main loop) or from wait().
+//
+// cancel() is cooperative: the job runs under a BigCancelScope, the bignum
+// loops poll its flag and the press ends in a "Cancelled" error within a
+// few milliseconds.
+//
+// One thread serves every job, so its per-thread constant caches (π, ln 2,
+// ln 10) carry over from one "=" to the next. It starts with the first job.
+class EngineWorker {
+public:
+    typedef void (*DoneFunc)(void *data);
+
+private:
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;     // A job was submitted, or stopping
+    std::condition_variable finished; // The running job finished
+    CalcEngine *engine;
+    Command command;
+    DoneFunc done;
+    void *done_data;
+    bool running; // Submitted and not finished
+    bool stopping;
+    std::atomic<bool> cancel_flag;
+    unsigned long job_total;
+    unsigned long cancel_total;
+
+    void loop();
+
+    EngineWorker(const EngineWorker &);
+    EngineWorker &operator=(const EngineWorker &);
+
+public:
+    EngineWorker();
+    ~EngineWorker(); // Cancels a running job and joins the thread
+
+    // Press `command` on `engine` in the background, then call done(data).
+    // Only one job at a time: call once the last one has finished.
+    void submit(CalcEngine &engine, Command command, DoneFunc done, void *data);
+    void cancel();
+    void wait(); // Until the job, if any, has finished
+    bool busy();
+
+    unsigned long jobs() const { return job_total; }
+    unsigned long cancelled() const { return cancel_total; }
+};
+
+#endif // CALC_WORKER_H
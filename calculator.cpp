@@ -1,38 +1,249 @@
 #include <gtk/gtk.h>
-#include <string>
-#include <cmath>
-#include <sstream>
-#include <iomanip>
-#include <iostream> // For debugging
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "calc_engine.h"
+#include "calc_format.h"
+#include "calc_keypad.h"
+#include "calc_theme.h"
+#include "calc_trace.h"
+#include "calc_batch.h"
+#include "calc_plotpanel.h"
+#include "calc_historypanel.h"
+#include "calc_statspanel.h"
+#include "calc_matrixpanel.h"
+#include "calc_calculus.h"
+#include "calc_calculuspanel.h"
+#include "calc_latency.h"
+#include "calc_session.h"
+#include "calc_server.h"
+#include "calc_worker.h"
+#include <vector>
+
+// View → Precision choices; 0 is standard double precision
+static const struct {
+    size_t digits;
+    const char *label;
+} PRECISION_CHOICES[] = {
+    {0, "Standard Precision"},
+    {50, "50 Digits"},
+    {100, "100 Digits"},
+    {1000, "1000 Digits"}
+};
+
+// View → angle units, in AngleUnit order
+static const char *const ANGLE_LABELS[] = {"Degrees", "Radians", "Gradians"};
+
+// Time the live preview may take out of a frame; the rest waits for the next
+static const double PREVIEW_BUDGET = 0.002;
+
+// Keyboard shortcuts, resolved straight to keypad commands
+static Command command_for_key(guint keyval) {
+    switch (keyval) {
+        case GDK_KEY_0: case GDK_KEY_KP_0: return CMD_DIGIT_0;
+        case GDK_KEY_1: case GDK_KEY_KP_1: return CMD_DIGIT_1;
+        case GDK_KEY_2: case GDK_KEY_KP_2: return CMD_DIGIT_2;
+        case GDK_KEY_3: case GDK_KEY_KP_3: return CMD_DIGIT_3;
+        case GDK_KEY_4: case GDK_KEY_KP_4: return CMD_DIGIT_4;
+        case GDK_KEY_5: case GDK_KEY_KP_5: return CMD_DIGIT_5;
+        case GDK_KEY_6: case GDK_KEY_KP_6: return CMD_DIGIT_6;
+        case GDK_KEY_7: case GDK_KEY_KP_7: return CMD_DIGIT_7;
+        case GDK_KEY_8: case GDK_KEY_KP_8: return CMD_DIGIT_8;
+        case GDK_KEY_9: case GDK_KEY_KP_9: return CMD_DIGIT_9;
+        case GDK_KEY_plus: case GDK_KEY_KP_Add: return CMD_ADD;
+        case GDK_KEY_minus: case GDK_KEY_KP_Subtract: return CMD_SUBTRACT;
+        case GDK_KEY_asterisk: case GDK_KEY_KP_Multiply: return CMD_MULTIPLY;
+        case GDK_KEY_slash: case GDK_KEY_KP_Divide: return CMD_DIVIDE;
+        case GDK_KEY_Return: case GDK_KEY_KP_Enter: case GDK_KEY_equal: return CMD_EQUALS;
+        case GDK_KEY_period: case GDK_KEY_KP_Decimal: return CMD_DECIMAL;
+        case GDK_KEY_BackSpace: return CMD_BACKSPACE;
+        case GDK_KEY_Escape: return CMD_ALL_CLEAR;
+        case GDK_KEY_Delete: return CMD_CLEAR_ENTRY;
+        case GDK_KEY_percent: return CMD_PERCENT;
+        case GDK_KEY_parenleft: return CMD_LPAREN;
+        case GDK_KEY_parenright: return CMD_RPAREN;
+        default: return CMD_NONE;
+    }
+}
+
+// Phase timestamps for --startup-trace
+static StartupTrace startup_trace;
+
+// Keypress latency; enabled by --stats, which prints it at exit, or by F12,
+// which shows it under the keypad
+static LatencyTracker latency;
+static bool print_latency_stats = false;
+
+// --button-keypad builds the keypad from one GtkButton per key, as before
+// the drawn keypad, to compare startup time, memory and repaints
+static bool button_keypad = false;
 
 class Calculator {
 private:
     GtkWidget *window;
     GtkWidget *display;
     GtkWidget *history_display; // New: for showing full expression/previous result
-    GtkWidget *grid;
+    GtkWidget *preview_display; // Value of the expression so far, under the display
+    GtkWidget *grid;    // GtkButton keypad, with --button-keypad
+    Keypad *keypad;     // Drawn keypad otherwise
+    GtkWidget *content_box; // Keypad column, then the plot panel beside it
+    
+    // View → Plot; built the first time it is opened
+    PlotPanel *plot;
+    GtkWidget *plot_box;
+    
+    // Every result goes to the log; it is opened at the first "=" or when
+    // View → History is, never at startup
+    HistoryLog history_log;
+    bool history_tried;
+    unsigned long history_recorded; // Engine calculation count last logged
+    unsigned long history_appends;
+    HistoryPanel *history;
+    GtkWidget *history_box;
+    
+    // View → Statistics; built the first time it is opened
+    StatsPanel *stats;
+    GtkWidget *stats_box;
+    
+    // View → Matrices; built the first time it is opened
+    MatrixPanel *matrices;
+    GtkWidget *matrix_box;
+    
+    // View → Calculus; built the first time it is opened. Its results are
+    // shown in the history line with what they cost, until the engine
+    // writes a new one over history_note_over.
+    CalculusPanel *calculus;
+    GtkWidget *calculus_box;
+    std::string history_note;
+    std::string history_note_over;
+    
+    // Memory slots and named values, loaded at startup and saved a couple
+    // of seconds after they change, and at exit
+    gchar *registers_path;
+    unsigned long registers_saved; // Register version last written
+    guint registers_save_timer;
+    unsigned long registers_saves;
+    GtkWidget *insert_menu; // Memory → Insert, rebuilt as the menu opens
+    
+    // Menu bar entries; their menus are filled in after the first frame
+    GtkWidget *file_item;
+    GtkWidget *view_item;
+    GtkWidget *memory_item;
+    GtkWidget *help_item;
+    
+    CalcEngine engine; // All calculator state and arithmetic
+    SessionRecorder recorder; // Every engine input, with --record
+    
+    // Slow precision-mode presses run on the worker, which owns the engine
+    // until the job is back. Keys typed meanwhile wait in pending_keys and
+    // the display keeps its text; AC (Escape) cancels. After 100 ms a
+    // spinner says so.
+    EngineWorker worker;
+    bool job_running;
+    Command job_command;
+    std::vector<Command> pending_keys;
+    GtkWidget *progress_box;
+    GtkWidget *progress_spinner;
+    guint progress_timer;
+    
+    // One stylesheet for the whole screen; themes reload it
+    GtkCssProvider *theme_provider;
+    Theme theme;
+    
+    // Input only marks the display dirty; a frame clock tick pushes the text
+    // to the widgets at most once per frame
+    bool display_dirty;
+    guint display_tick;
+    unsigned long display_requests;  // Keypresses that dirtied the display
+    unsigned long display_commits;   // Frames that pushed text to the widgets
+    unsigned long display_unchanged; // Widget updates skipped, text identical
+    unsigned long preview_deferred;  // Frames the preview ran out of time in
     
-    std::string current_input;
-    std::string stored_value;
-    std::string current_operation; // Renamed from 'operation'
-    std::string full_expression;   // New: to build the expression string
-    bool new_calculation;
-    bool operator_pressed; // New: flag to manage input after an operator
-    bool equals_pressed;   // New: flag to manage input after equals
-    double memory_value;   // New: for memory functions
+    // Latency overlay, hidden until F12
+    GtkWidget *latency_label;
+    guint latency_refresh;
+    gulong after_paint_handler;
+    
+    // Startup finishes once the first frame is drawn and deferred setup ran
+    gulong first_draw_handler;
+    bool first_frame_drawn;
+    bool deferred_setup_done;
     
 public:
-    Calculator() : 
-        current_input("0"), 
-        stored_value(""), 
-        current_operation(""), 
-        full_expression(""),
-        new_calculation(true),
-        operator_pressed(false),
-        equals_pressed(false),
-        memory_value(0.0) {}
+    Calculator() :
+        window(NULL),
+        display(NULL),
+        history_display(NULL),
+        preview_display(NULL),
+        grid(NULL),
+        keypad(NULL),
+        content_box(NULL),
+        plot(NULL),
+        plot_box(NULL),
+        history_tried(false),
+        history_recorded(0),
+        history_appends(0),
+        history(NULL),
+        history_box(NULL),
+        stats(NULL),
+        stats_box(NULL),
+        matrices(NULL),
+        matrix_box(NULL),
+        calculus(NULL),
+        calculus_box(NULL),
+        registers_path(NULL),
+        registers_saved(0),
+        registers_save_timer(0),
+        registers_saves(0),
+        insert_menu(NULL),
+        file_item(NULL),
+        view_item(NULL),
+        memory_item(NULL),
+        help_item(NULL),
+        job_running(false),
+        job_command(CMD_NONE),
+        progress_box(NULL),
+        progress_spinner(NULL),
+        progress_timer(0),
+        theme_provider(NULL),
+        theme(THEME_LIGHT),
+        display_dirty(false),
+        display_tick(0),
+        display_requests(0),
+        display_commits(0),
+        display_unchanged(0),
+        preview_deferred(0),
+        latency_label(NULL),
+        latency_refresh(0),
+        after_paint_handler(0),
+        first_draw_handler(0),
+        first_frame_drawn(false),
+        deferred_setup_done(false) {}
+    
+    ~Calculator() {
+        delete plot;
+        delete history;
+        delete stats;
+        delete matrices;
+        delete calculus;
+        delete keypad;
+        if (registers_save_timer) g_source_remove(registers_save_timer);
+        if (latency_refresh) g_source_remove(latency_refresh);
+        if (progress_timer) g_source_remove(progress_timer);
+        g_free(registers_path);
+    }
     
     void create_window() {
+        theme_provider = gtk_css_provider_new();
+        gtk_style_context_add_provider_for_screen(gdk_screen_get_default(),
+                                                  GTK_STYLE_PROVIDER(theme_provider),
+                                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+        set_theme(theme);
+        startup_trace.mark("stylesheet");
+        load_registers();
+        startup_trace.mark("registers");
+        
         window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
         gtk_window_set_title(GTK_WINDOW(window), "Scientific Calculator");
         gtk_window_set_default_size(GTK_WINDOW(window), 450, 600);
@@ -44,14 +255,6 @@ public:
         gtk_window_set_type_hint(GTK_WINDOW(window), GDK_WINDOW_TYPE_HINT_NORMAL);
         gtk_window_set_deletable(GTK_WINDOW(window), TRUE); // Enable close button
         
-        // Set window icon (optional - will use default if no icon found)
-        GError *error = NULL;
-        GdkPixbuf *icon = gdk_pixbuf_new_from_file("/usr/share/icons/hicolor/48x48/apps/accessories-calculator.png", &error);
-        if (icon) {
-            gtk_window_set_icon(GTK_WINDOW(window), icon);
-            g_object_unref(icon);
-        }
-        
         // Make window draggable by clicking anywhere in the title area
         // Note: gtk_window_set_has_resize_grip is deprecated in GTK3, resize grip is automatic
         
@@ -63,26 +266,23 @@ public:
         gtk_container_add(GTK_CONTAINER(window), vbox);
         gtk_container_set_border_width(GTK_CONTAINER(window), 10);
         
-        // Create menu bar
+        // Create menu bar (top-level entries only, menus come later)
         create_menu_bar(vbox);
         
+        // Keypad on the left; the plot panel, when open, to its right
+        content_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+        gtk_box_pack_start(GTK_BOX(vbox), content_box, TRUE, TRUE, 0);
+        GtkWidget *keypad_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+        gtk_box_pack_start(GTK_BOX(content_box), keypad_box, FALSE, FALSE, 0);
+        
         // Create history display (GtkLabel)
         history_display = gtk_label_new("");
         gtk_label_set_xalign(GTK_LABEL(history_display), 1.0); // Right align
         gtk_label_set_ellipsize(GTK_LABEL(history_display), PANGO_ELLIPSIZE_START); // Ellipsize long text
         gtk_widget_set_size_request(history_display, -1, 30);
         
-        GtkCssProvider *history_css_provider = gtk_css_provider_new();
-        const char *history_css_data = 
-            "label { "
-            "    font-size: 14px; "
-            "    color: #888888; " // Lighter color for history
-            "    padding-right: 5px; "
-            "}";
-        gtk_css_provider_load_from_data(history_css_provider, history_css_data, -1, NULL);
-        GtkStyleContext *history_context = gtk_widget_get_style_context(history_display);
-        gtk_style_context_add_provider(history_context, GTK_STYLE_PROVIDER(history_css_provider), GTK_STYLE_PROVIDER_PRIORITY_USER);
-        gtk_box_pack_start(GTK_BOX(vbox), history_display, FALSE, FALSE, 0);
+        gtk_style_context_add_class(gtk_widget_get_style_context(history_display), "history");
+        gtk_box_pack_start(GTK_BOX(keypad_box), history_display, FALSE, FALSE, 0);
 
         // Create main display (GtkEntry)
         display = gtk_entry_new();
@@ -91,46 +291,121 @@ public:
         gtk_editable_set_editable(GTK_EDITABLE(display), FALSE);
         gtk_widget_set_size_request(display, -1, 60); // Taller display
         
-        GtkCssProvider *display_css_provider = gtk_css_provider_new();
-        const char *display_css_data = 
-            "entry { "
-            "    font-size: 28px; " // Larger font
-            "    font-weight: bold; "
-            "    background-color: #f0f0f0; "
-            "    border: 2px solid #ccc; "
-            "    padding: 5px; "
-            "}";
-        gtk_css_provider_load_from_data(display_css_provider, display_css_data, -1, NULL);
-        GtkStyleContext *display_context = gtk_widget_get_style_context(display);
-        gtk_style_context_add_provider(display_context, GTK_STYLE_PROVIDER(display_css_provider), GTK_STYLE_PROVIDER_PRIORITY_USER);
-        
-        gtk_box_pack_start(GTK_BOX(vbox), display, FALSE, FALSE, 5); // Add some spacing below display
-        
-        // Create button grid
-        grid = gtk_grid_new();
-        gtk_grid_set_row_spacing(GTK_GRID(grid), 8); // Increased spacing
-        gtk_grid_set_column_spacing(GTK_GRID(grid), 8); // Increased spacing
-        gtk_box_pack_start(GTK_BOX(vbox), grid, TRUE, TRUE, 0);
-        
-        create_buttons();
+        gtk_style_context_add_class(gtk_widget_get_style_context(display), "display");
+        
+        gtk_box_pack_start(GTK_BOX(keypad_box), display, FALSE, FALSE, 5); // Add some spacing below display
+        
+        preview_display = gtk_label_new("");
+        gtk_label_set_xalign(GTK_LABEL(preview_display), 1.0);
+        gtk_style_context_add_class(gtk_widget_get_style_context(preview_display), "preview");
+        gtk_box_pack_start(GTK_BOX(keypad_box), preview_display, FALSE, FALSE, 0);
+        
+        progress_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+        progress_spinner = gtk_spinner_new();
+        gtk_box_pack_start(GTK_BOX(progress_box), progress_spinner, FALSE, FALSE, 0);
+        GtkWidget *progress_label = gtk_label_new("Computing… Esc cancels");
+        gtk_style_context_add_class(gtk_widget_get_style_context(progress_label), "progress");
+        gtk_box_pack_start(GTK_BOX(progress_box), progress_label, FALSE, FALSE, 0);
+        gtk_widget_set_halign(progress_box, GTK_ALIGN_END);
+        gtk_widget_show_all(progress_box);
+        gtk_widget_set_no_show_all(progress_box, TRUE);
+        gtk_widget_hide(progress_box);
+        gtk_box_pack_start(GTK_BOX(keypad_box), progress_box, FALSE, FALSE, 0);
+        startup_trace.mark("display");
+        
+        if (button_keypad) {
+            grid = gtk_grid_new();
+            gtk_grid_set_row_spacing(GTK_GRID(grid), 8); // Increased spacing
+            gtk_grid_set_column_spacing(GTK_GRID(grid), 8); // Increased spacing
+            gtk_box_pack_start(GTK_BOX(keypad_box), grid, TRUE, TRUE, 0);
+            create_buttons();
+        } else {
+            keypad = new Keypad(on_keypad_press, this);
+            gtk_box_pack_start(GTK_BOX(keypad_box), keypad->create(), TRUE, TRUE, 0);
+        }
+        startup_trace.mark("keypad");
+        
+        latency_label = gtk_label_new("");
+        gtk_label_set_xalign(GTK_LABEL(latency_label), 1.0);
+        gtk_style_context_add_class(gtk_widget_get_style_context(latency_label), "latency");
+        gtk_widget_set_no_show_all(latency_label, TRUE);
+        gtk_box_pack_start(GTK_BOX(keypad_box), latency_label, FALSE, FALSE, 0);
         
         // Add keyboard event handling
         g_signal_connect(window, "key-press-event", G_CALLBACK(on_key_press), this);
         gtk_widget_set_can_focus(window, TRUE);
         
+        if (startup_trace.is_enabled()) {
+            first_draw_handler = g_signal_connect_after(window, "draw", G_CALLBACK(on_first_draw), this);
+        }
+        
         gtk_widget_show_all(window);
         
         // Set minimum window size
         gtk_widget_set_size_request(window, 400, 500);
+        startup_trace.mark("window shown");
+        if (latency.is_enabled()) watch_frames();
+        
+        // Everything not needed for the first frame waits until the main
+        // loop is idle, which is after the window has been painted
+        g_idle_add(on_deferred_setup, this);
+    }
+    
+    static gboolean on_deferred_setup(gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->load_icon();
+        startup_trace.mark("icon");
+        calc->create_menus();
+        startup_trace.mark("menus");
+        calc->deferred_setup_done = true;
+        calc->finish_startup_trace();
+        return G_SOURCE_REMOVE;
+    }
+    
+    static gboolean on_first_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+        (void)cr;  // Suppress unused parameter warning
+        Calculator *calc = static_cast<Calculator*>(data);
+        startup_trace.mark("first frame");
+        g_signal_handler_disconnect(widget, calc->first_draw_handler);
+        calc->first_draw_handler = 0;
+        calc->first_frame_drawn = true;
+        calc->finish_startup_trace();
+        return FALSE;
+    }
+    
+    void finish_startup_trace() {
+        if (!startup_trace.is_enabled() || !first_frame_drawn || !deferred_setup_done) return;
+        startup_trace.print(stderr);
+    }
+    
+    // Set window icon (optional - will use default if no icon found)
+    void load_icon() {
+        GdkPixbuf *icon = gdk_pixbuf_new_from_file("/usr/share/icons/hicolor/48x48/apps/accessories-calculator.png", NULL);
+        if (icon) {
+            gtk_window_set_icon(GTK_WINDOW(window), icon);
+            g_object_unref(icon);
+        }
     }
     
     void create_menu_bar(GtkWidget *vbox) {
         GtkWidget *menubar = gtk_menu_bar_new();
         
+        file_item = gtk_menu_item_new_with_label("File");
+        view_item = gtk_menu_item_new_with_label("View");
+        memory_item = gtk_menu_item_new_with_label("Memory");
+        help_item = gtk_menu_item_new_with_label("Help");
+        
+        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), file_item);
+        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), view_item);
+        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), memory_item);
+        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), help_item);
+        
+        gtk_box_pack_start(GTK_BOX(vbox), menubar, FALSE, FALSE, 0);
+    }
+    
+    void create_menus() {
         // File menu
         GtkWidget *file_menu = gtk_menu_new();
-        GtkWidget *file_item = gtk_menu_item_new_with_label("File");
-        gtk_menu_item_set_submenu(GTK_MENU_ITEM(file_item), file_menu);
         
         GtkWidget *exit_item = gtk_menu_item_new_with_label("Exit");
         g_signal_connect(exit_item, "activate", G_CALLBACK(gtk_main_quit), NULL);
@@ -138,144 +413,151 @@ public:
         
         // View menu
         GtkWidget *view_menu = gtk_menu_new();
-        GtkWidget *view_item = gtk_menu_item_new_with_label("View");
-        gtk_menu_item_set_submenu(GTK_MENU_ITEM(view_item), view_menu);
         
         GtkWidget *always_on_top_item = gtk_check_menu_item_new_with_label("Always on Top");
         g_signal_connect(always_on_top_item, "toggled", G_CALLBACK(on_always_on_top_toggled), this);
         gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), always_on_top_item);
         
-        // Help menu
+        GtkWidget *plot_item = gtk_check_menu_item_new_with_label("Plot");
+        g_signal_connect(plot_item, "toggled", G_CALLBACK(on_plot_toggled), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), plot_item);
+        
+        GtkWidget *history_item = gtk_check_menu_item_new_with_label("History");
+        g_signal_connect(history_item, "toggled", G_CALLBACK(on_history_toggled), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), history_item);
+        
+        GtkWidget *stats_item = gtk_check_menu_item_new_with_label("Statistics");
+        g_signal_connect(stats_item, "toggled", G_CALLBACK(on_stats_toggled), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), stats_item);
+        
+        GtkWidget *matrix_item = gtk_check_menu_item_new_with_label("Matrices");
+        g_signal_connect(matrix_item, "toggled", G_CALLBACK(on_matrices_toggled), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), matrix_item);
+        
+        GtkWidget *calculus_item = gtk_check_menu_item_new_with_label("Calculus");
+        g_signal_connect(calculus_item, "toggled", G_CALLBACK(on_calculus_toggled), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), calculus_item);
+        
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), gtk_separator_menu_item_new());
+        GtkWidget *previous_theme_item = NULL;
+        for (int t = 0; t < THEME_COUNT; t++) {
+            GtkWidget *theme_item = gtk_radio_menu_item_new_with_label_from_widget(
+                previous_theme_item ? GTK_RADIO_MENU_ITEM(previous_theme_item) : NULL, theme_name(static_cast<Theme>(t)));
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(theme_item), t == theme);
+            g_object_set_data(G_OBJECT(theme_item), "theme", GINT_TO_POINTER(t));
+            g_signal_connect(theme_item, "toggled", G_CALLBACK(on_theme_toggled), this);
+            gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), theme_item);
+            previous_theme_item = theme_item;
+        }
+        
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), gtk_separator_menu_item_new());
+        GtkWidget *previous_precision_item = NULL;
+        for (size_t p = 0; p < sizeof(PRECISION_CHOICES) / sizeof(PRECISION_CHOICES[0]); p++) {
+            GtkWidget *precision_item = gtk_radio_menu_item_new_with_label_from_widget(
+                previous_precision_item ? GTK_RADIO_MENU_ITEM(previous_precision_item) : NULL, PRECISION_CHOICES[p].label);
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(precision_item),
+                                           PRECISION_CHOICES[p].digits == engine.precision_digits());
+            g_object_set_data(G_OBJECT(precision_item), "precision", GINT_TO_POINTER((int)p));
+            g_signal_connect(precision_item, "toggled", G_CALLBACK(on_precision_toggled), this);
+            gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), precision_item);
+            previous_precision_item = precision_item;
+        }
+
+        gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), gtk_separator_menu_item_new());
+        GtkWidget *previous_angle_item = NULL;
+        for (int unit = ANGLE_DEGREES; unit <= ANGLE_GRADIANS; unit++) {
+            GtkWidget *angle_item = gtk_radio_menu_item_new_with_label_from_widget(
+                previous_angle_item ? GTK_RADIO_MENU_ITEM(previous_angle_item) : NULL, ANGLE_LABELS[unit]);
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(angle_item), unit == engine.angle_unit());
+            g_object_set_data(G_OBJECT(angle_item), "angle", GINT_TO_POINTER(unit));
+            g_signal_connect(angle_item, "toggled", G_CALLBACK(on_angle_toggled), this);
+            gtk_menu_shell_append(GTK_MENU_SHELL(view_menu), angle_item);
+            previous_angle_item = angle_item;
+        }
+        
+        // Memory menu: the slot the M keys use, storing the display under a
+        // name, and inserting any stored value into the expression
+        GtkWidget *memory_menu = gtk_menu_new();
+        GtkWidget *previous_slot_item = NULL;
+        for (size_t slot = 0; slot < MEMORY_SLOTS; slot++) {
+            GtkWidget *slot_item = gtk_radio_menu_item_new_with_label_from_widget(
+                previous_slot_item ? GTK_RADIO_MENU_ITEM(previous_slot_item) : NULL,
+                engine.variables().name(engine.memory_symbol(slot)));
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(slot_item), slot == engine.memory_slot());
+            g_object_set_data(G_OBJECT(slot_item), "slot", GINT_TO_POINTER(slot));
+            g_signal_connect(slot_item, "toggled", G_CALLBACK(on_memory_slot_toggled), this);
+            gtk_menu_shell_append(GTK_MENU_SHELL(memory_menu), slot_item);
+            previous_slot_item = slot_item;
+        }
+        
+        gtk_menu_shell_append(GTK_MENU_SHELL(memory_menu), gtk_separator_menu_item_new());
+        
+        GtkWidget *store_item = gtk_menu_item_new_with_label("Store As…");
+        g_signal_connect(store_item, "activate", G_CALLBACK(on_store_as_clicked), this);
+        gtk_menu_shell_append(GTK_MENU_SHELL(memory_menu), store_item);
+        
+        GtkWidget *insert_item = gtk_menu_item_new_with_label("Insert");
+        insert_menu = gtk_menu_new();
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(insert_item), insert_menu);
+        gtk_menu_shell_append(GTK_MENU_SHELL(memory_menu), insert_item);
+        g_signal_connect(memory_item, "activate", G_CALLBACK(on_memory_menu_opened), this);
+        
+        // Help menu; the About dialog itself is only built when opened
         GtkWidget *help_menu = gtk_menu_new();
-        GtkWidget *help_item = gtk_menu_item_new_with_label("Help");
-        gtk_menu_item_set_submenu(GTK_MENU_ITEM(help_item), help_menu);
         
         GtkWidget *about_item = gtk_menu_item_new_with_label("About");
         g_signal_connect(about_item, "activate", G_CALLBACK(on_about_clicked), this);
         gtk_menu_shell_append(GTK_MENU_SHELL(help_menu), about_item);
         
-        // Add menus to menu bar
-        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), file_item);
-        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), view_item);
-        gtk_menu_shell_append(GTK_MENU_SHELL(menubar), help_item);
-        
-        gtk_box_pack_start(GTK_BOX(vbox), menubar, FALSE, FALSE, 0);
+        gtk_widget_show_all(file_menu);
+        gtk_widget_show_all(view_menu);
+        gtk_widget_show_all(memory_menu);
+        gtk_widget_show_all(help_menu);
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(file_item), file_menu);
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(view_item), view_menu);
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(memory_item), memory_menu);
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(help_item), help_menu);
     }
     
     void create_buttons() {
-        // Button layout (8 rows, 5 columns for scientific calculator)
-        const char* button_labels[8][5] = {
-            {"AC", "CE", "sin", "cos", "tan"},
-            {"log", "ln", "√", "x²", "xʸ"},
-            {"π", "e", "!", "%", "÷"},
-            {"7", "8", "9", "(", "×"},
-            {"4", "5", "6", ")", "-"},
-            {"1", "2", "3", "±", "+"},
-            {"0", "00", ".", "⌫", "="},
-            {"M+", "M-", "MR", "MC", ""}
-        };
-        
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 5; col++) {
-                if (strlen(button_labels[row][col]) == 0) continue;
+        for (int row = 0; row < KEYPAD_ROWS; row++) {
+            for (int col = 0; col < KEYPAD_COLUMNS; col++) {
+                Command command = KEYPAD_LAYOUT[row][col];
+                if (command == CMD_NONE) continue;
+                const CommandInfo &info = command_info(command);
                 
-                GtkWidget *button = gtk_button_new_with_label(button_labels[row][col]);
+                GtkWidget *button = gtk_button_new_with_label(info.label);
                 gtk_widget_set_size_request(button, 70, 60); // Standard size for all buttons
                 gtk_grid_attach(GTK_GRID(grid), button, col, row, 1, 1);
                 
-                style_button(button, button_labels[row][col]);
+                // The click handler reads the command back instead of the label
+                g_object_set_data(G_OBJECT(button), "command", GINT_TO_POINTER(command));
+                style_button(button, info.style);
                 g_signal_connect(button, "clicked", G_CALLBACK(on_button_clicked), this);
             }
         }
     }
     
-    void style_button(GtkWidget *button, const char *label) {
-        GtkCssProvider *css_provider = gtk_css_provider_new();
-        std::string css_data;
-        
-        // Improved color palette with better contrast
-        if (strcmp(label, "AC") == 0 || strcmp(label, "CE") == 0) {
-            // Clear buttons (bright red, white text)
-            css_data = "button { "
-                      "    font-size: 16px; "
-                      "    font-weight: bold; "
-                      "    background-color: #FF4444; " // Bright red
-                      "    color: white; "
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #CC0000; "
-                      "}";
-        } else if (strcmp(label, "sin") == 0 || strcmp(label, "cos") == 0 || strcmp(label, "tan") == 0 ||
-                   strcmp(label, "log") == 0 || strcmp(label, "ln") == 0 || strcmp(label, "√") == 0 ||
-                   strcmp(label, "x²") == 0 || strcmp(label, "xʸ") == 0 || strcmp(label, "π") == 0 ||
-                   strcmp(label, "e") == 0 || strcmp(label, "!") == 0 || strcmp(label, "(") == 0 ||
-                   strcmp(label, ")") == 0) {
-            // Scientific function buttons (purple, white text)
-            css_data = "button { "
-                      "    font-size: 14px; "
-                      "    font-weight: bold; "
-                      "    background-color: #6A0DAD; " // Purple
-                      "    color: white; "
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #4B0082; "
-                      "}";
-        } else if (strcmp(label, "±") == 0 || strcmp(label, "%") == 0 || strcmp(label, "⌫") == 0 ||
-                   strcmp(label, "M+") == 0 || strcmp(label, "M-") == 0 || 
-                   strcmp(label, "MR") == 0 || strcmp(label, "MC") == 0) {
-            // Utility buttons (light blue, dark text)
-            css_data = "button { "
-                      "    font-size: 16px; "
-                      "    font-weight: bold; "
-                      "    background-color: #87CEEB; " // Sky blue
-                      "    color: #000080; " // Dark blue text
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #4682B4; "
-                      "}";
-        } else if (strcmp(label, "÷") == 0 || strcmp(label, "×") == 0 || 
-                   strcmp(label, "-") == 0 || strcmp(label, "+") == 0) {
-            // Operation buttons (bright orange, white text)
-            css_data = "button { "
-                      "    font-size: 20px; "
-                      "    font-weight: bold; "
-                      "    background-color: #FF8C00; " // Dark orange
-                      "    color: white; "
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #FF6600; "
-                      "}";
-        } else if (strcmp(label, "=") == 0) {
-            // Equals button (green, white text)
-            css_data = "button { "
-                      "    font-size: 22px; "
-                      "    font-weight: bold; "
-                      "    background-color: #32CD32; " // Lime green
-                      "    color: white; "
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #228B22; "
-                      "}";
-        } else {
-            // Number and decimal buttons (dark blue, white text)
-            css_data = "button { "
-                      "    font-size: 18px; "
-                      "    font-weight: bold; "
-                      "    background-color: #2F4F4F; " // Dark slate gray
-                      "    color: white; "
-                      "    border-radius: 8px; "
-                      "    border: 1px solid #1C1C1C; "
-                      "}";
-        }
-        
-        // Add hover effects
-        css_data += "button:hover { opacity: 0.8; } ";
-        css_data += "button:active { opacity: 0.6; }";
-        
-        gtk_css_provider_load_from_data(css_provider, css_data.c_str(), -1, NULL);
-        GtkStyleContext *context = gtk_widget_get_style_context(button);
-        gtk_style_context_add_provider(context, GTK_STYLE_PROVIDER(css_provider), GTK_STYLE_PROVIDER_PRIORITY_USER);
+    void style_button(GtkWidget *button, ButtonStyle style) {
+        gtk_style_context_add_class(gtk_widget_get_style_context(button), button_style_class(style));
+    }
+    
+    // Swap the stylesheet; every widget restyles from its classes
+    void set_theme(Theme new_theme) {
+        theme = new_theme;
+        gtk_css_provider_load_from_data(theme_provider, theme_css(theme), -1, NULL);
     }
     
     static void on_button_clicked(GtkWidget *widget, gpointer data) {
+        if (latency.is_enabled()) latency.input(g_get_monotonic_time());
         Calculator *calc = static_cast<Calculator*>(data);
-        const char *label = gtk_button_get_label(GTK_BUTTON(widget));
-        calc->handle_button_click(label);
+        Command command = static_cast<Command>(GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "command")));
+        calc->handle_button_click(command);
+    }
+    
+    static void on_keypad_press(Command command, gpointer data) {
+        if (latency.is_enabled()) latency.input(g_get_monotonic_time());
+        static_cast<Calculator*>(data)->handle_button_click(command);
     }
     
     // Window close callback
@@ -292,34 +574,34 @@ public:
     static gboolean on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
         (void)widget;  // Suppress unused parameter warning
         Calculator *calc = static_cast<Calculator*>(data);
+        gint64 received = latency.is_enabled() ? g_get_monotonic_time() : 0;
         
-        // Handle keyboard shortcuts
-        switch (event->keyval) {
-            case GDK_KEY_0: case GDK_KEY_KP_0: calc->handle_button_click("0"); break;
-            case GDK_KEY_1: case GDK_KEY_KP_1: calc->handle_button_click("1"); break;
-            case GDK_KEY_2: case GDK_KEY_KP_2: calc->handle_button_click("2"); break;
-            case GDK_KEY_3: case GDK_KEY_KP_3: calc->handle_button_click("3"); break;
-            case GDK_KEY_4: case GDK_KEY_KP_4: calc->handle_button_click("4"); break;
-            case GDK_KEY_5: case GDK_KEY_KP_5: calc->handle_button_click("5"); break;
-            case GDK_KEY_6: case GDK_KEY_KP_6: calc->handle_button_click("6"); break;
-            case GDK_KEY_7: case GDK_KEY_KP_7: calc->handle_button_click("7"); break;
-            case GDK_KEY_8: case GDK_KEY_KP_8: calc->handle_button_click("8"); break;
-            case GDK_KEY_9: case GDK_KEY_KP_9: calc->handle_button_click("9"); break;
-            case GDK_KEY_plus: case GDK_KEY_KP_Add: calc->handle_button_click("+"); break;
-            case GDK_KEY_minus: case GDK_KEY_KP_Subtract: calc->handle_button_click("-"); break;
-            case GDK_KEY_asterisk: case GDK_KEY_KP_Multiply: calc->handle_button_click("×"); break;
-            case GDK_KEY_slash: case GDK_KEY_KP_Divide: calc->handle_button_click("÷"); break;
-            case GDK_KEY_Return: case GDK_KEY_KP_Enter: case GDK_KEY_equal: 
-                calc->handle_button_click("="); break;
-            case GDK_KEY_period: case GDK_KEY_KP_Decimal: calc->handle_button_click("."); break;
-            case GDK_KEY_BackSpace: calc->handle_button_click("⌫"); break;
-            case GDK_KEY_Escape: calc->handle_button_click("AC"); break;
-            case GDK_KEY_Delete: calc->handle_button_click("CE"); break;
-            case GDK_KEY_percent: calc->handle_button_click("%"); break;
-            case GDK_KEY_parenleft: calc->handle_button_click("("); break;
-            case GDK_KEY_parenright: calc->handle_button_click(")"); break;
+        if (event->keyval == GDK_KEY_F12) {
+            calc->toggle_latency_overlay();
+            return TRUE;
         }
-        calc->update_display();
+        
+        // Typing into an editable entry (the plot's y =) or text view (the
+        // statistics paste box, the matrix A and B editors) goes to that widget
+        GtkWidget *focus = gtk_window_get_focus(GTK_WINDOW(widget));
+        if (focus && ((GTK_IS_ENTRY(focus) && gtk_editable_get_editable(GTK_EDITABLE(focus))) ||
+                      (GTK_IS_TEXT_VIEW(focus) && gtk_text_view_get_editable(GTK_TEXT_VIEW(focus))))) {
+            return FALSE;
+        }
+
+        // A read-only text view (the matrix result) keeps its selection and
+        // copy keys; the rest fall through to the keypad shortcuts
+        if (focus && GTK_IS_TEXT_VIEW(focus) && gtk_window_propagate_key_event(GTK_WINDOW(widget), event)) return TRUE;
+        
+        // Arrow keys and Space move through and press the focused keypad key
+        if (calc->keypad && calc->keypad->key_press(event)) return TRUE;
+        
+        // Handle keyboard shortcuts; other keys (Tab, Shift+Tab) go on to
+        // GTK so focus can move onto and off the keypad
+        Command command = command_for_key(event->keyval);
+        if (command == CMD_NONE) return FALSE;
+        latency.input(received);
+        calc->handle_button_click(command);
         return TRUE;
     }
     
@@ -330,6 +612,289 @@ public:
         gtk_window_set_keep_above(GTK_WINDOW(calc->window), active);
     }
     
+    static void on_plot_toggled(GtkCheckMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!calc->plot) {
+            calc->plot = new PlotPanel();
+            calc->plot_box = calc->plot->create();
+            gtk_box_pack_start(GTK_BOX(calc->content_box), calc->plot_box, TRUE, TRUE, 0);
+        }
+        if (gtk_check_menu_item_get_active(item)) {
+            gtk_widget_show_all(calc->plot_box);
+        } else {
+            gtk_widget_hide(calc->plot_box);
+        }
+    }
+    
+    static void on_history_toggled(GtkCheckMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!calc->history) {
+            calc->open_history();
+            calc->history = new HistoryPanel(calc->history_log, on_history_recall, calc);
+            calc->history_box = calc->history->create();
+            gtk_box_pack_start(GTK_BOX(calc->content_box), calc->history_box, TRUE, TRUE, 0);
+        }
+        if (gtk_check_menu_item_get_active(item)) {
+            gtk_widget_show_all(calc->history_box);
+            calc->history->update();
+        } else {
+            gtk_widget_hide(calc->history_box);
+        }
+    }
+    
+    static void on_stats_toggled(GtkCheckMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!calc->stats) {
+            calc->stats = new StatsPanel(on_history_recall, calc);
+            calc->stats_box = calc->stats->create();
+            gtk_box_pack_start(GTK_BOX(calc->content_box), calc->stats_box, TRUE, TRUE, 0);
+            calc->stats->update();
+        }
+        if (gtk_check_menu_item_get_active(item)) {
+            gtk_widget_show_all(calc->stats_box);
+        } else {
+            gtk_widget_hide(calc->stats_box);
+        }
+    }
+    
+    static void on_matrices_toggled(GtkCheckMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!calc->matrices) {
+            calc->matrices = new MatrixPanel(on_history_recall, calc);
+            calc->matrix_box = calc->matrices->create();
+            gtk_box_pack_start(GTK_BOX(calc->content_box), calc->matrix_box, TRUE, TRUE, 0);
+        }
+        if (gtk_check_menu_item_get_active(item)) {
+            gtk_widget_show_all(calc->matrix_box);
+        } else {
+            gtk_widget_hide(calc->matrix_box);
+        }
+    }
+    
+    static void on_calculus_toggled(GtkCheckMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!calc->calculus) {
+            calc->calculus = new CalculusPanel(on_calculus_result, calc);
+            calc->calculus->set_angle_unit(calc->engine.angle_unit());
+            calc->calculus_box = calc->calculus->create();
+            gtk_box_pack_start(GTK_BOX(calc->content_box), calc->calculus_box, TRUE, TRUE, 0);
+        }
+        if (gtk_check_menu_item_get_active(item)) {
+            gtk_widget_show_all(calc->calculus_box);
+        } else {
+            gtk_widget_hide(calc->calculus_box);
+        }
+    }
+    
+    // Enters value like on_history_recall, logs "expression = value" and
+    // shows it in the history line with the cost
+    static void on_calculus_result(double value, const char *expression, const char *cost, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->take_engine();
+        calc->engine.recall(value);
+        calc->recorder.recall(value, calc->engine);
+        char number[FORMAT_BUFFER_SIZE];
+        format_number(value, number, DISPLAY_WIDTH, DISPLAY_DIGITS);
+        std::string line = std::string(expression) + " = " + number;
+        if (calc->open_history()) calc->append_history(line.c_str(), strlen(expression), value);
+        calc->history_note = line + "  ·  " + cost;
+        calc->history_note_over = calc->engine.history_text();
+        calc->update_display();
+    }
+    
+    // Also for View → Statistics and View → Matrices
+    static void on_history_recall(double value, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->take_engine();
+        calc->engine.recall(value);
+        calc->recorder.recall(value, calc->engine);
+        calc->update_display();
+    }
+    
+    // $XDG_DATA_HOME/scientific-calculator/history.log; reads only its
+    // last record
+    bool open_history() {
+        if (history_tried) return history_log.is_open();
+        history_tried = true;
+        gchar *dir = g_build_filename(g_get_user_data_dir(), "scientific-calculator", NULL);
+        gchar *path = g_build_filename(dir, "history.log", NULL);
+        if (g_mkdir_with_parents(dir, 0755) != 0 || !history_log.open(path)) {
+            g_warning("history is not kept: %s", history_log.is_open() ? path : history_log.error());
+        }
+        g_free(path);
+        g_free(dir);
+        return history_log.is_open();
+    }
+    
+    // Logs the result of an "=" that just produced one
+    void record_history() {
+        if (engine.calculation_count() == history_recorded) return;
+        history_recorded = engine.calculation_count();
+        if (!open_history()) return;
+        const char *line = engine.history_text();
+        const char *equals = strstr(line, " = ");
+        if (!equals) return;
+        append_history(line, equals - line, engine.value());
+    }
+    
+    // line is "expression = result", split at the " = "
+    void append_history(const char *line, size_t split, double value) {
+        if (history_log.append(line, split, value, (uint32_t)time(NULL))) {
+            history_appends++;
+        } else {
+            g_warning("%s", history_log.error());
+        }
+        if (history && gtk_widget_get_visible(history_box)) history->update();
+    }
+    
+    static void on_memory_slot_toggled(GtkCheckMenuItem *item, gpointer data) {
+        if (!gtk_check_menu_item_get_active(item)) return;
+        Calculator *calc = static_cast<Calculator*>(data);
+        size_t slot = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(item), "slot"));
+        calc->take_engine();
+        calc->engine.select_memory_slot(slot);
+        calc->recorder.select_memory_slot(slot, calc->engine);
+    }
+    
+    // Lists every defined register with its value
+    static void on_memory_menu_opened(GtkMenuItem *item, gpointer data) {
+        (void)item;  // Suppress unused parameter warning
+        Calculator *calc = static_cast<Calculator*>(data);
+        GList *old = gtk_container_get_children(GTK_CONTAINER(calc->insert_menu));
+        for (GList *l = old; l; l = l->next) gtk_widget_destroy(GTK_WIDGET(l->data));
+        g_list_free(old);
+        if (calc->job_running) { // The job may store to them; don't read them now
+            GtkWidget *busy_item = gtk_menu_item_new_with_label("Computing…");
+            gtk_widget_set_sensitive(busy_item, FALSE);
+            gtk_menu_shell_append(GTK_MENU_SHELL(calc->insert_menu), busy_item);
+            gtk_widget_show_all(calc->insert_menu);
+            return;
+        }
+        
+        const Registers &registers = calc->engine.variables();
+        char value[FORMAT_BUFFER_SIZE];
+        bool any = false;
+        for (SymbolId id = 0; id < registers.size(); id++) {
+            if (!registers.is_defined(id)) continue;
+            format_number(registers.value(id), value, DISPLAY_WIDTH, DISPLAY_DIGITS);
+            gchar *label = g_strdup_printf("%s = %s", registers.name(id), value);
+            GtkWidget *variable_item = gtk_menu_item_new_with_label(label);
+            g_free(label);
+            g_object_set_data(G_OBJECT(variable_item), "symbol", GUINT_TO_POINTER(id));
+            g_signal_connect(variable_item, "activate", G_CALLBACK(on_insert_variable), calc);
+            gtk_menu_shell_append(GTK_MENU_SHELL(calc->insert_menu), variable_item);
+            any = true;
+        }
+        if (!any) {
+            GtkWidget *empty_item = gtk_menu_item_new_with_label("Nothing stored");
+            gtk_widget_set_sensitive(empty_item, FALSE);
+            gtk_menu_shell_append(GTK_MENU_SHELL(calc->insert_menu), empty_item);
+        }
+        gtk_widget_show_all(calc->insert_menu);
+    }
+    
+    static void on_insert_variable(GtkMenuItem *item, gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        SymbolId id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(item), "symbol"));
+        calc->take_engine();
+        calc->engine.insert_variable(id);
+        calc->recorder.insert_variable(id, calc->engine);
+        calc->update_display();
+    }
+    
+    // Asks for a name until it is a valid one or the dialog is cancelled
+    static void on_store_as_clicked(GtkMenuItem *item, gpointer data) {
+        (void)item;  // Suppress unused parameter warning
+        Calculator *calc = static_cast<Calculator*>(data);
+        GtkWidget *dialog = gtk_dialog_new_with_buttons("Store As", GTK_WINDOW(calc->window), GTK_DIALOG_MODAL,
+                                                        "_Cancel", GTK_RESPONSE_CANCEL,
+                                                        "_Store", GTK_RESPONSE_OK, NULL);
+        gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+        GtkWidget *entry = gtk_entry_new();
+        gtk_entry_set_max_length(GTK_ENTRY(entry), MAX_NAME_LENGTH);
+        gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+        gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Name, such as rate or x1");
+        gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), entry);
+        gtk_widget_show_all(dialog);
+        
+        while (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+            const char *name = gtk_entry_get_text(GTK_ENTRY(entry));
+            calc->take_engine();
+            if (calc->engine.store_variable(name, strlen(name))) {
+                calc->recorder.store_variable(name, strlen(name), calc->engine);
+                calc->schedule_registers_save();
+                calc->update_display();
+                break;
+            }
+            gtk_widget_error_bell(entry);
+        }
+        gtk_widget_destroy(dialog);
+    }
+    
+    // $XDG_DATA_HOME/scientific-calculator/registers.bin
+    void load_registers() {
+        gchar *dir = g_build_filename(g_get_user_data_dir(), "scientific-calculator", NULL);
+        registers_path = g_build_filename(dir, "registers.bin", NULL);
+        g_free(dir);
+        engine.variables().load(registers_path);
+        registers_saved = engine.variables().version();
+    }
+    
+    // Saves are batched: one a couple of seconds after the first change
+    void schedule_registers_save() {
+        if (registers_save_timer || engine.variables().version() == registers_saved) return;
+        registers_save_timer = g_timeout_add_seconds(2, on_registers_save_timer, this);
+    }
+    
+    static gboolean on_registers_save_timer(gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->registers_save_timer = 0;
+        // The job owns the engine and may be storing ans; finish_job()
+        // schedules the save again once it is back
+        if (calc->job_running) return G_SOURCE_REMOVE;
+        calc->save_registers();
+        return G_SOURCE_REMOVE;
+    }
+    
+    void save_registers() {
+        if (engine.variables().version() == registers_saved) return;
+        registers_saved = engine.variables().version();
+        gchar *dir = g_path_get_dirname(registers_path);
+        if (g_mkdir_with_parents(dir, 0755) != 0 || !engine.variables().save(registers_path)) {
+            g_warning("could not save %s", registers_path);
+        } else {
+            registers_saves++;
+        }
+        g_free(dir);
+    }
+    
+    static void on_theme_toggled(GtkCheckMenuItem *item, gpointer data) {
+        if (!gtk_check_menu_item_get_active(item)) return; // The item being switched away from
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->set_theme(static_cast<Theme>(GPOINTER_TO_INT(g_object_get_data(G_OBJECT(item), "theme"))));
+    }
+    
+    static void on_precision_toggled(GtkCheckMenuItem *item, gpointer data) {
+        if (!gtk_check_menu_item_get_active(item)) return;
+        Calculator *calc = static_cast<Calculator*>(data);
+        int choice = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(item), "precision"));
+        calc->take_engine();
+        calc->engine.set_precision(PRECISION_CHOICES[choice].digits);
+        calc->recorder.set_precision(PRECISION_CHOICES[choice].digits, calc->engine);
+        calc->update_display();
+    }
+
+    static void on_angle_toggled(GtkCheckMenuItem *item, gpointer data) {
+        if (!gtk_check_menu_item_get_active(item)) return;
+        Calculator *calc = static_cast<Calculator*>(data);
+        AngleUnit unit = (AngleUnit)GPOINTER_TO_INT(g_object_get_data(G_OBJECT(item), "angle"));
+        calc->take_engine();
+        calc->engine.set_angle_unit(unit);
+        calc->recorder.set_angle_unit(unit, calc->engine);
+        if (calc->calculus) calc->calculus->set_angle_unit(unit);
+        calc->update_display();
+    }
+    
     static void on_about_clicked(GtkMenuItem *item, gpointer data) {
         (void)item;  // Suppress unused parameter warning
         Calculator *calc = static_cast<Calculator*>(data);
@@ -349,443 +914,500 @@ public:
         gtk_widget_destroy(dialog);
     }
     
-    void handle_button_click(const char *label) {
-        std::string btn = label;
-        
-        if (btn >= "0" && btn <= "9") {
-            handle_number(btn);
-        } else if (btn == "00") {
-            handle_number("00");
-        } else if (btn == ".") {
-            handle_decimal();
-        } else if (btn == "AC") { // All Clear
-            handle_all_clear();
-        } else if (btn == "CE") { // Clear Entry
-            handle_clear_entry();
-        } else if (btn == "±") {
-            handle_sign_change();
-        } else if (btn == "%") {
-            handle_percentage();
-        } else if (btn == "⌫") { // Backspace
-            handle_backspace();
-        } else if (btn == "+" || btn == "-" || btn == "×" || btn == "÷" || btn == "^") {
-            handle_operation(btn);
-        } else if (btn == "=") {
-            handle_equals();
-        } else if (btn == "M+") {
-            handle_memory_add();
-        } else if (btn == "M-") {
-            handle_memory_subtract();
-        } else if (btn == "MR") {
-            handle_memory_recall();
-        } else if (btn == "MC") {
-            handle_memory_clear();
-        } else if (btn == "sin") {
-            handle_scientific_function("sin");
-        } else if (btn == "cos") {
-            handle_scientific_function("cos");
-        } else if (btn == "tan") {
-            handle_scientific_function("tan");
-        } else if (btn == "log") {
-            handle_scientific_function("log");
-        } else if (btn == "ln") {
-            handle_scientific_function("ln");
-        } else if (btn == "√") {
-            handle_scientific_function("sqrt");
-        } else if (btn == "x²") {
-            handle_scientific_function("square");
-        } else if (btn == "xʸ") {
-            handle_operation("^");
-        } else if (btn == "π") {
-            handle_constant("pi");
-        } else if (btn == "e") {
-            handle_constant("e");
-        } else if (btn == "!") {
-            handle_scientific_function("factorial");
-        } else if (btn == "(") {
-            handle_parenthesis("(");
-        } else if (btn == ")") {
-            handle_parenthesis(")");
+    void handle_button_click(Command command) {
+        if (job_running) {
+            if (command == CMD_ALL_CLEAR) { // Stop it; keys typed after it still count
+                worker.cancel();
+                pending_keys.clear();
+            }
+            pending_keys.push_back(command);
+            return;
         }
-        
+        if (engine.may_be_slow(command)) {
+            start_job(command);
+            return;
+        }
+        engine.press(command);
+        pressed(command);
+    }
+    
+    // Everything after a press that reads the engine
+    void pressed(Command command) {
+        if (engine.refused()) gtk_widget_error_bell(window); // Full entry or expression
+        recorder.press(command, engine);
+        record_history();
+        schedule_registers_save();
         update_display();
     }
     
-    void handle_number(const std::string &num) {
-        if (new_calculation || operator_pressed || equals_pressed) {
-            if (num == "00") {
-                current_input = "0"; // Don't start with "00"
-            } else {
-                current_input = num;
-            }
-            if (equals_pressed) { // Clear full expression after equals
-                full_expression = "";
-            }
-            new_calculation = false;
-            operator_pressed = false;
-            equals_pressed = false;
-        } else {
-            if (current_input == "0" && num != "00") {
-                current_input = num; // Replace leading zero
-            } else if (current_input == "0" && num == "00") {
-                current_input = "0"; // Keep single zero
-            } else {
-                current_input += num;
-            }
+    void start_job(Command command) {
+        job_running = true;
+        job_command = command;
+        worker.submit(engine, command, on_job_done, this);
+        progress_timer = g_timeout_add(100, on_progress_timer, this);
+    }
+    
+    // On the worker thread: hand the engine back through the main loop
+    static void on_job_done(void *data) {
+        g_idle_add(on_job_finished, data);
+    }
+    
+    static gboolean on_job_finished(gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        // Already taken back if a menu action waited for it
+        if (calc->job_running && !calc->worker.busy()) calc->finish_job();
+        return G_SOURCE_REMOVE;
+    }
+    
+    static gboolean on_progress_timer(gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->progress_timer = 0;
+        gtk_widget_show(calc->progress_box);
+        gtk_spinner_start(GTK_SPINNER(calc->progress_spinner));
+        return G_SOURCE_REMOVE;
+    }
+    
+    // The engine is ours again: finish the press, then replay the keys
+    // that were typed while it ran (which may start another job)
+    void finish_job() {
+        job_running = false;
+        if (progress_timer) {
+            g_source_remove(progress_timer);
+            progress_timer = 0;
         }
-        // Update full_expression for immediate display
-        if (full_expression.empty() || (full_expression.back() >= '0' && full_expression.back() <= '9') || full_expression.back() == '.') {
-            if (full_expression == "0" && num != ".") { // Replace initial 0 if not adding decimal
-                full_expression = num;
-            } else {
-                full_expression += num;
-            }
-        } else {
-            full_expression += num;
+        gtk_spinner_stop(GTK_SPINNER(progress_spinner));
+        gtk_widget_hide(progress_box);
+        pressed(job_command); // Also reschedules a registers save skipped meanwhile
+        
+        std::vector<Command> keys;
+        keys.swap(pending_keys);
+        for (size_t i = 0; i < keys.size(); i++) handle_button_click(keys[i]);
+    }
+    
+    // For menu actions, which use the engine directly: cancel the running
+    // job, if any, and drop the keys waiting for it
+    void take_engine() {
+        if (!job_running) return;
+        pending_keys.clear();
+        worker.cancel();
+        worker.wait();
+        finish_job();
+    }
+    
+    // Schedule a display commit on the next frame; repeated calls before
+    // then (auto-repeat, fast typing) fold into that one commit
+    void update_display() {
+        display_requests++;
+        display_dirty = true;
+        if (display_tick == 0) {
+            display_tick = gtk_widget_add_tick_callback(window, on_display_tick, this, NULL);
         }
     }
     
-    void handle_decimal() {
-        if (new_calculation || operator_pressed || equals_pressed) {
-            current_input = "0.";
-            if (equals_pressed) {
-                full_expression = "";
-            }
-            new_calculation = false;
-            operator_pressed = false;
-            equals_pressed = false;
-        } else if (current_input.find('.') == std::string::npos) {
-            current_input += ".";
+    static gboolean on_display_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data) {
+        (void)widget;  // Suppress unused parameter warning
+        Calculator *calc = static_cast<Calculator*>(data);
+        calc->display_tick = 0;
+        calc->commit_display();
+        if (latency.is_enabled()) {
+            latency.committed(g_get_monotonic_time(), gdk_frame_clock_get_frame_counter(clock));
         }
+        return G_SOURCE_REMOVE;
+    }
+    
+    // Follow frames to paint and presentation; only connected while
+    // latency is tracked, so untracked frames cost nothing
+    void watch_frames() {
+        if (after_paint_handler) return;
+        GdkFrameClock *clock = gtk_widget_get_frame_clock(window);
+        if (!clock) return;
+        after_paint_handler = g_signal_connect(clock, "after-paint", G_CALLBACK(on_after_paint), this);
+    }
+    
+    static void on_after_paint(GdkFrameClock *clock, gpointer data) {
+        (void)data;    // Suppress unused parameter warning
+        latency.painted(g_get_monotonic_time(), gdk_frame_clock_get_frame_counter(clock));
         
-        if (full_expression.find('.') == std::string::npos || (full_expression.back() != '.' && (full_expression.back() < '0' || full_expression.back() > '9'))) {
-             if (full_expression.empty() || (full_expression.back() < '0' || full_expression.back() > '9')) {
-                full_expression += "0.";
-            } else {
-                full_expression += ".";
+        // Presentation times complete a frame or two after the paint; a
+        // frame gone from the clock's history counts as unknown
+        for (gint64 frame = latency.awaiting_presentation(); frame >= 0; frame = latency.awaiting_presentation()) {
+            GdkFrameTimings *timings = gdk_frame_clock_get_timings(clock, frame);
+            if (timings && !gdk_frame_timings_get_complete(timings)) {
+                gdk_frame_clock_request_phase(clock, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT);
+                break;
             }
+            latency.presented(frame, timings ? gdk_frame_timings_get_presentation_time(timings) : 0);
         }
     }
     
-    void handle_all_clear() { // Renamed from handle_clear
-        current_input = "0";
-        stored_value = "";
-        current_operation = "";
-        full_expression = "";
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
+    // F12: start tracking if --stats didn't, and show or hide the numbers
+    void toggle_latency_overlay() {
+        latency.enable();
+        watch_frames();
+        if (gtk_widget_get_visible(latency_label)) {
+            gtk_widget_hide(latency_label);
+            return;
+        }
+        refresh_latency_overlay();
+        gtk_widget_show(latency_label);
+        if (latency_refresh == 0) latency_refresh = g_timeout_add(250, on_latency_refresh, this);
     }
-
-    void handle_clear_entry() { // New: Clear current input only
-        current_input = "0";
-        // If an operation is pending, clear the last number from full_expression
-        if (!current_operation.empty() && !full_expression.empty()) {
-            size_t last_num_start = full_expression.find_last_not_of("+-×÷%±⌫.0123456789");
-            if (last_num_start != std::string::npos) {
-                full_expression.erase(last_num_start + 1);
-            } else {
-                full_expression = ""; // If only a number, clear it
-            }
-        } else {
-            full_expression = "";
+    
+    void refresh_latency_overlay() {
+        char text[128];
+        latency.summary(text, sizeof(text));
+        if (strcmp(gtk_label_get_text(GTK_LABEL(latency_label)), text) != 0) {
+            gtk_label_set_text(GTK_LABEL(latency_label), text);
         }
-        new_calculation = true; // Ready for new input
     }
-
-    void handle_backspace() { // New: Delete last character
-        if (current_input.length() > 1 && current_input != "Error") {
-            current_input.pop_back();
+    
+    static gboolean on_latency_refresh(gpointer data) {
+        Calculator *calc = static_cast<Calculator*>(data);
+        if (!gtk_widget_get_visible(calc->latency_label)) {
+            calc->latency_refresh = 0;
+            return G_SOURCE_REMOVE;
+        }
+        calc->refresh_latency_overlay();
+        return G_SOURCE_CONTINUE;
+    }
+    
+    // Push engine text to the widgets, leaving unchanged ones alone so they
+    // don't relayout and redraw
+    void commit_display() {
+        if (!display_dirty || job_running) return; // Committed when the job is back
+        display_dirty = false;
+        display_commits++;
+        
+        const char *text = engine.display_text();
+        if (strcmp(gtk_entry_get_text(GTK_ENTRY(display)), text) != 0) {
+            gtk_entry_set_text(GTK_ENTRY(display), text);
         } else {
-            current_input = "0";
+            display_unchanged++;
         }
-        if (full_expression.length() > 0) {
-            full_expression.pop_back();
+        
+        const char *history = engine.history_text();
+        if (!history_note.empty()) {
+            if (history_note_over == history) {
+                history = history_note.c_str();
+            } else {
+                history_note.clear();
+            }
         }
-        if (full_expression.empty()) {
-            full_expression = ""; // Ensure it's truly empty for history display
+        if (strcmp(gtk_label_get_text(GTK_LABEL(history_display)), history) != 0) {
+            gtk_label_set_text(GTK_LABEL(history_display), history);
+        } else {
+            display_unchanged++;
         }
-        new_calculation = false; // Allow continued input
+        commit_preview();
     }
     
-    void handle_sign_change() {
-        if (current_input != "0" && current_input != "Error") {
-            if (current_input[0] == '-') {
-                current_input = current_input.substr(1);
-            } else {
-                current_input = "-" + current_input;
-            }
-            // Update full_expression to reflect sign change
-            if (!full_expression.empty()) {
-                size_t last_num_start = full_expression.find_last_not_of("+-×÷%±⌫");
-                if (last_num_start == std::string::npos) last_num_start = 0; else last_num_start++;
-                
-                std::string last_num_str = full_expression.substr(last_num_start);
-                if (last_num_str[0] == '-') {
-                    full_expression.replace(last_num_start, last_num_str.length(), last_num_str.substr(1));
-                } else {
-                    full_expression.replace(last_num_start, last_num_str.length(), "-" + last_num_str);
-                }
+    // "= value" of the expression typed so far, when it says more than the
+    // display. Out of time this frame, the line is blanked rather than left
+    // stale, and the preview carries on from where it stopped next frame.
+    void commit_preview() {
+        double value = 0;
+        char text[FORMAT_BUFFER_SIZE + 8] = "";
+        PreviewStatus status = engine.preview(PREVIEW_BUDGET, &value);
+        if (status == PREVIEW_READY) {
+            char number[FORMAT_BUFFER_SIZE];
+            format_number(value, number, DISPLAY_WIDTH, DISPLAY_DIGITS);
+            if (strcmp(number, engine.display_text()) != 0) {
+                snprintf(text, sizeof(text), "%s %s", engine.precision_digits() ? "≈" : "=", number);
             }
+        } else if (status == PREVIEW_PENDING) {
+            preview_deferred++;
+            update_display();
+        }
+        if (strcmp(gtk_label_get_text(GTK_LABEL(preview_display)), text) != 0) {
+            gtk_label_set_text(GTK_LABEL(preview_display), text);
+        } else {
+            display_unchanged++;
         }
     }
     
-    void handle_percentage() {
-        if (current_input == "Error") return;
-        double value = std::stod(current_input);
-        value /= 100.0;
-        current_input = format_number(value);
-        // Update full_expression
-        if (!full_expression.empty()) {
-            size_t last_num_start = full_expression.find_last_not_of("+-×÷%±⌫");
-            if (last_num_start == std::string::npos) last_num_start = 0; else last_num_start++;
-            full_expression.replace(last_num_start, full_expression.length() - last_num_start, current_input);
-            full_expression += "%"; // Add percentage symbol to history
-        }
+    // Record every engine input from here on, for --replay
+    bool start_recording(const char *path) {
+        return recorder.open(path, engine);
     }
     
-    void handle_operation(const std::string &op) {
-        if (current_input == "Error") return;
-
-        if (!current_operation.empty() && !operator_pressed) {
-            // If there's a pending operation and a new number was entered, calculate first
-            handle_equals();
-            stored_value = current_input; // Result becomes the new stored value
-        } else if (equals_pressed) {
-            // If equals was just pressed, the result is already in current_input
-            stored_value = current_input;
-            full_expression = current_input; // Start new expression with the result
-        } else {
-            stored_value = current_input;
+    void run() {
+        gtk_main();
+        take_engine();
+        save_registers();
+        if (recorder.is_open()) {
+            unsigned long events = recorder.event_count();
+            if (!recorder.close(engine)) g_warning("could not write the recorded session");
+            g_debug("session: %lu events recorded", events);
         }
         
-        current_operation = op;
-        operator_pressed = true;
-        new_calculation = true; // Next number will clear current_input
-        equals_pressed = false;
+        // Shown with G_MESSAGES_DEBUG=all
+        g_debug("display updates: %lu requested, %lu committed, %lu coalesced, %lu widget updates unchanged, "
+                "%lu previews deferred",
+                display_requests, display_commits, display_requests - display_commits, display_unchanged,
+                preview_deferred);
+        if (plot) {
+            PlotSampleStats samples = plot->sample_stats();
+            g_debug("plot: %lu frames, %lu tiles drawn, %lu columns sampled, %lu reused, %lu points evaluated",
+                    plot->frames(), plot->rendered_tiles(), samples.misses, samples.hits, samples.evaluations);
+        }
+        if (history_tried) {
+            g_debug("history: %lu appended, %zu in the log, %lu searches, slowest %.2f ms",
+                    history_appends, history_log.count(), history ? history->searches() : 0UL,
+                    history ? history->slowest_search_ms() : 0.0);
+        }
+        if (keypad) {
+            g_debug("keypad: %lu draws, %lu keys painted, %.0f pixels", keypad->draws(), keypad->keys_painted(),
+                    keypad->pixels_painted());
+        }
+        g_debug("registers: %zu names, %lu saves", engine.variables().size(), registers_saves);
+        if (worker.jobs()) g_debug("background: %lu evaluations, %lu cancelled", worker.jobs(), worker.cancelled());
+        if (print_latency_stats) latency.print(stderr);
+    }
+};
 
-        // Append operation to full_expression, avoid double operators
-        if (!full_expression.empty() && (full_expression.back() == '+' || full_expression.back() == '-' ||
-                                         full_expression.find("×") == full_expression.length() - 1 || 
-                                         full_expression.find("÷") == full_expression.length() - 1)) {
-            // Remove the last operator and add the new one
-            if (full_expression.find("×") == full_expression.length() - 1 || 
-                full_expression.find("÷") == full_expression.length() - 1) {
-                full_expression.pop_back(); // Remove the Unicode operator
-            } else {
-                full_expression.back() = op[0]; // Replace ASCII operator
-            }
-            full_expression += op;
+// Number argument of a command-line option
+static bool parse_option_value(const char *option, const char *text, double *value) {
+    char *end;
+    *value = strtod(text, &end);
+    if (end == text || *end != '\0') {
+        fprintf(stderr, "%s needs a number, not \"%s\"\n", option, text);
+        return false;
+    }
+    return true;
+}
+
+// calculator --table EXPR [--from A] --to B [--step S] [--binary] [--output FILE]
+//            --table EXPR --column FILE|- [--binary] [--output FILE]
+static int table_main(int argc, char *argv[]) {
+    TableOptions options = {argv[2], 0.0, 0.0, 1.0, NULL, false};
+    const char *column = NULL;
+    const char *output = NULL;
+    bool have_to = false;
+    for (int arg = 3; arg < argc; arg++) {
+        const char *option = argv[arg];
+        bool has_value = arg + 1 < argc;
+        if (strcmp(option, "--binary") == 0) {
+            options.binary = true;
+        } else if (has_value && strcmp(option, "--from") == 0) {
+            if (!parse_option_value(option, argv[++arg], &options.from)) return 1;
+        } else if (has_value && strcmp(option, "--to") == 0) {
+            if (!parse_option_value(option, argv[++arg], &options.to)) return 1;
+            have_to = true;
+        } else if (has_value && strcmp(option, "--step") == 0) {
+            if (!parse_option_value(option, argv[++arg], &options.step)) return 1;
+        } else if (has_value && strcmp(option, "--column") == 0) {
+            column = argv[++arg];
+        } else if (has_value && strcmp(option, "--output") == 0) {
+            output = argv[++arg];
         } else {
-            full_expression += op;
+            fprintf(stderr, "Unknown table option %s\n", option);
+            return 1;
         }
     }
-    
-    void handle_equals() {
-        if (current_operation.empty() || stored_value.empty() || current_input == "Error") {
-            return;
+    if (!column && !have_to) {
+        fprintf(stderr, "--table needs --to or --column\n");
+        return 1;
+    }
+
+    if (column) {
+        options.column = strcmp(column, "-") == 0 ? stdin : fopen(column, "rb");
+        if (!options.column) {
+            perror(column);
+            return 1;
         }
-        
-        double val1 = std::stod(stored_value);
-        double val2 = std::stod(current_input);
-        double result = 0;
-        
-        if (current_operation == "+") {
-            result = val1 + val2;
-        } else if (current_operation == "-") {
-            result = val1 - val2;
-        } else if (current_operation == "×") {
-            result = val1 * val2;
-        } else if (current_operation == "÷") {
-            if (val2 != 0) {
-                result = val1 / val2;
-            } else {
-                current_input = "Error";
-                full_expression = "Error: Division by zero";
-                current_operation = "";
-                stored_value = "";
-                new_calculation = true;
-                operator_pressed = false;
-                equals_pressed = true; // Set equals_pressed to true for error state
-                return;
-            }
-        } else if (current_operation == "^") {
-            result = pow(val1, val2);
+    }
+    FILE *out = stdout;
+    if (output) {
+        out = fopen(output, "wb");
+        if (!out) {
+            perror(output);
+            if (options.column && options.column != stdin) fclose(options.column);
+            return 1;
         }
-        
-        current_input = format_number(result);
-        full_expression += " = " + current_input; // Complete the expression
-        current_operation = "";
-        stored_value = "";
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = true; // Indicate that equals was pressed
     }
+    int status = run_table(options, out);
+    if (options.column && options.column != stdin) fclose(options.column);
+    if (out != stdout && fclose(out) != 0) status = 1;
+    return status;
+}
 
-    // New: Scientific function handlers
-    void handle_scientific_function(const std::string &func) {
-        if (current_input == "Error") return;
-        
-        double value = std::stod(current_input);
-        double result = 0;
-        
-        if (func == "sin") {
-            result = sin(value * M_PI / 180.0); // Convert to radians
-            full_expression = "sin(" + current_input + ")";
-        } else if (func == "cos") {
-            result = cos(value * M_PI / 180.0);
-            full_expression = "cos(" + current_input + ")";
-        } else if (func == "tan") {
-            result = tan(value * M_PI / 180.0);
-            full_expression = "tan(" + current_input + ")";
-        } else if (func == "log") {
-            if (value > 0) {
-                result = log10(value);
-                full_expression = "log(" + current_input + ")";
-            } else {
-                current_input = "Error";
-                full_expression = "Error: Invalid input for log";
-                return;
-            }
-        } else if (func == "ln") {
-            if (value > 0) {
-                result = log(value);
-                full_expression = "ln(" + current_input + ")";
-            } else {
-                current_input = "Error";
-                full_expression = "Error: Invalid input for ln";
-                return;
-            }
-        } else if (func == "sqrt") {
-            if (value >= 0) {
-                result = sqrt(value);
-                full_expression = "√(" + current_input + ")";
-            } else {
-                current_input = "Error";
-                full_expression = "Error: Invalid input for √";
-                return;
-            }
-        } else if (func == "square") {
-            result = value * value;
-            full_expression = "(" + current_input + ")²";
-        } else if (func == "factorial") {
-            if (value >= 0 && value == floor(value) && value <= 20) { // Limit to avoid overflow
-                result = 1;
-                for (int i = 1; i <= (int)value; i++) {
-                    result *= i;
-                }
-                full_expression = current_input + "!";
-            } else {
-                current_input = "Error";
-                full_expression = "Error: Invalid input for factorial";
-                return;
-            }
+// calculator --summary FILE|- [--field N] [--threads N]
+static int summary_main(int argc, char *argv[]) {
+    StatsOptions options = {0, 0};
+    for (int arg = 3; arg < argc; arg++) {
+        if (arg + 1 < argc && strcmp(argv[arg], "--field") == 0) {
+            options.field = strtoul(argv[++arg], NULL, 10);
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+            options.threads = strtoul(argv[++arg], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown summary option %s\n", argv[arg]);
+            return 1;
         }
-        
-        current_input = format_number(result);
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
     }
-    
-    void handle_constant(const std::string &constant) {
-        if (constant == "pi") {
-            current_input = format_number(M_PI);
-            full_expression = "π";
-        } else if (constant == "e") {
-            current_input = format_number(M_E);
-            full_expression = "e";
+    return run_summary(argv[2], options, stdout);
+}
+
+// calculator --matrix OP A [B]
+static int matrix_main(int argc, char *argv[]) {
+    if (argc > 5) {
+        fprintf(stderr, "Unknown matrix option %s\n", argv[5]);
+        return 1;
+    }
+    return run_matrix(argv[2], argv[3], argc > 4 ? argv[4] : NULL, stdout);
+}
+
+// calculator --calculus roots|integrate EXPR A B [--threads N] [--radians|--gradians]
+//            --calculus derivative EXPR X [--radians|--gradians]
+static int calculus_main(int argc, char *argv[]) {
+    CalculusCommand command = {argv[2], argv[3], 0, 0, ANGLE_DEGREES, {0, 0}};
+    bool derivative = strcmp(command.op, "derivative") == 0;
+    int arg = 5;
+    char *end;
+    command.a = strtod(argv[4], &end);
+    bool ok = *end == '\0';
+    if (!derivative) {
+        ok = ok && argc > 5;
+        if (ok) command.b = strtod(argv[5], &end);
+        ok = ok && *end == '\0';
+        arg = 6;
+    }
+    if (!ok) {
+        fprintf(stderr, "--calculus %s needs %s\n", command.op, derivative ? "a point" : "an interval A B");
+        return 1;
+    }
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--radians") == 0) {
+            command.unit = ANGLE_RADIANS;
+        } else if (strcmp(argv[arg], "--gradians") == 0) {
+            command.unit = ANGLE_GRADIANS;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+            command.options.threads = strtoul(argv[++arg], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown calculus option %s\n", argv[arg]);
+            return 1;
         }
-        
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
     }
-    
-    void handle_parenthesis(const std::string &paren) {
-        // Simple parenthesis handling for display
-        if (paren == "(") {
-            if (new_calculation || operator_pressed || equals_pressed) {
-                full_expression = "(";
-                current_input = "0";
-            } else {
-                full_expression += "(";
-            }
-        } else if (paren == ")") {
-            full_expression += ")";
+    return run_calculus(command, stdout);
+}
+
+// calculator --replay FILE... [--repeat N] [--no-verify]
+static int replay_main(int argc, char *argv[]) {
+    unsigned long repeat = 1;
+    bool verify = true;
+    int files = 0;
+    for (int arg = 2; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--no-verify") == 0) {
+            verify = false;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--repeat") == 0) {
+            repeat = strtoul(argv[++arg], NULL, 10);
+            if (repeat == 0) repeat = 1;
+        } else {
+            argv[2 + files++] = argv[arg];
         }
-        
-        new_calculation = false;
-        operator_pressed = false;
-        equals_pressed = false;
     }
+    int status = 0;
+    for (int i = 0; i < files; i++) {
+        if (replay_session(argv[2 + i], repeat, verify, stdout) != 0) status = 1;
+    }
+    return status;
+}
 
-    // New: Memory functions
-    void handle_memory_add() {
-        if (current_input == "Error") return;
-        memory_value += std::stod(current_input);
-        full_expression = "M+ " + current_input;
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
+int main(int argc, char *argv[]) {
+    // Headless table mode: an expression in x over a range or a column
+    if (argc > 2 && strcmp(argv[1], "--table") == 0) {
+        return table_main(argc, argv);
     }
 
-    void handle_memory_subtract() {
-        if (current_input == "Error") return;
-        memory_value -= std::stod(current_input);
-        full_expression = "M- " + current_input;
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
+    // Headless statistics over a column of numbers
+    if (argc > 2 && strcmp(argv[1], "--summary") == 0) {
+        return summary_main(argc, argv);
     }
 
-    void handle_memory_recall() {
-        current_input = format_number(memory_value);
-        full_expression = "MR";
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
+    // Headless roots, integrals and derivatives of an expression in x
+    if (argc > 4 && strcmp(argv[1], "--calculus") == 0) {
+        return calculus_main(argc, argv);
     }
 
-    void handle_memory_clear() {
-        memory_value = 0.0;
-        full_expression = "MC";
-        new_calculation = true;
-        operator_pressed = false;
-        equals_pressed = false;
+    // Headless matrix arithmetic on files of rows
+    if (argc > 3 && strcmp(argv[1], "--matrix") == 0) {
+        return matrix_main(argc, argv);
+    }
+
+    // Headless batch mode: calculator --batch [--digits N] [FILE], no
+    // display required
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        FILE *in = stdin;
+        size_t digits = 0;
+        int arg = 2;
+        if (argc > arg + 1 && strcmp(argv[arg], "--digits") == 0) {
+            digits = strtoul(argv[arg + 1], NULL, 10);
+            if (digits == 0 || digits > MAX_PRECISION_DIGITS) {
+                fprintf(stderr, "--digits must be between 1 and %zu\n", MAX_PRECISION_DIGITS);
+                return 1;
+            }
+            arg += 2;
+        }
+        if (argc > arg && strcmp(argv[arg], "-") != 0) {
+            in = fopen(argv[arg], "rb");
+            if (!in) {
+                perror(argv[arg]);
+                return 1;
+            }
+        }
+        int status = run_batch(in, stdout, digits);
+        if (in != stdin) fclose(in);
+        return status;
     }
     
-    std::string format_number(double num) {
-        std::ostringstream oss;
-        oss << std::fixed << std::setprecision(10) << num;
-        std::string result = oss.str();
-        
-        // Remove trailing zeros
-        result.erase(result.find_last_not_of('0') + 1, std::string::npos);
-        // Remove trailing decimal point if it's the last character
-        if (result.back() == '.') {
-            result.pop_back();
+    // Headless replay of recorded sessions
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        return replay_main(argc, argv);
+    }
+    
+    // Evaluation service: calculator --serve PATH [--threads N] [--window],
+    // headless unless --window also opens the calculator
+    const char *serve_path = NULL;
+    size_t serve_threads = 0;
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        serve_path = argv[2];
+        bool window = false;
+        for (int arg = 3; arg < argc; arg++) {
+            if (strcmp(argv[arg], "--window") == 0) {
+                window = true;
+            } else if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+                serve_threads = strtoul(argv[++arg], NULL, 10);
+            }
         }
-        
-        return result;
+        if (!window) return run_server(serve_path, serve_threads);
     }
     
-    void update_display() {
-        gtk_entry_set_text(GTK_ENTRY(display), current_input.c_str());
-        gtk_label_set_text(GTK_LABEL(history_display), full_expression.c_str());
+    // Record the session for --replay: calculator --record FILE
+    const char *record_path = NULL;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) record_path = argv[i + 1];
     }
     
-    void run() {
-        gtk_main();
+    // Cold-start timeline on stderr: calculator --startup-trace
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--startup-trace") == 0) startup_trace.enable();
+        if (strcmp(argv[i], "--button-keypad") == 0) button_keypad = true;
+        // Keypress latency percentiles on stderr at exit: calculator --stats
+        if (strcmp(argv[i], "--stats") == 0) {
+            latency.enable();
+            print_latency_stats = true;
+        }
     }
-};
-
-int main(int argc, char *argv[]) {
+    
     gtk_init(&argc, &argv);
+    startup_trace.mark("gtk_init");
     
     Calculator calc;
     calc.create_window();
+    if (record_path && !calc.start_recording(record_path)) return 1;
+    EvalServer server;
+    if (serve_path && !server.start(serve_path, serve_threads)) return 1;
     calc.run();
+    server.stop();
     
     return 0;
 }